@@ -1,9 +1,16 @@
 #ifndef FORGED_STL_INTERNAL_ALLOC_H_
 #define FORGED_STL_INTERNAL_ALLOC_H_
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <new>
+#include <type_traits>
+#include <utility>
 
 #define __THROW_BAD_ALLOC std::cerr << "out of memroy" << std::endl; exit(1)
 
@@ -85,78 +92,244 @@ void* __malloc_alloc_template<inst>::oom_realloc(void* p, size_t n) {
 
 typedef __malloc_alloc_template<0> malloc_alloc;
 
-template <bool threads, int inst>
+// Size classes served by __default_alloc_template. Requests up to LinearMax
+// bytes are rounded to a multiple of Align; above that, up to MaxBytes, every
+// doubling of the size is split into Steps geometrically spaced classes
+// (LinearMax = 128, Steps = 4: 160, 192, 224, 256, 320, ...). Anything larger
+// goes straight to malloc_alloc. Align is also the alignment of every block
+// handed out, so 16 or 64 can be used for SIMD payloads.
+inline constexpr size_t __pool_log2(size_t n) {
+    return n <= 1 ? 0 : 1 + __pool_log2(n / 2);
+}
+
+template <size_t Align = 8, size_t LinearMax = 128, size_t MaxBytes = LinearMax,
+          size_t Steps = 4>
+struct __pool_size_classes {
+    static_assert(Align >= sizeof(void*) && (Align & (Align - 1)) == 0,
+                  "Align must be a power of two that can hold a pointer");
+    static_assert(LinearMax % Align == 0 && LinearMax % Steps == 0 &&
+                  (LinearMax / Steps) % Align == 0,
+                  "LinearMax must split into Steps Align-multiples");
+    static_assert(MaxBytes % LinearMax == 0 &&
+                  ((MaxBytes / LinearMax) & (MaxBytes / LinearMax - 1)) == 0,
+                  "MaxBytes must be LinearMax times a power of two");
+
+    enum { align = Align };
+    enum { max_bytes = MaxBytes };
+    enum { count = LinearMax / Align + Steps * __pool_log2(MaxBytes / LinearMax) };
+
+    static size_t index(size_t bytes) {
+        if (bytes <= LinearMax) {
+            return bytes == 0 ? 0 : (bytes + Align - 1) / Align - 1;
+        }
+        size_t group = 0;
+        size_t base = LinearMax;
+        while (bytes > 2 * base) {
+            base *= 2;
+            ++group;
+        }
+        const size_t step = base / Steps;
+        return LinearMax / Align + group * Steps + (bytes - base + step - 1) / step - 1;
+    }
+
+    static size_t size(size_t index) {
+        if (index < LinearMax / Align) {
+            return (index + 1) * Align;
+        }
+        const size_t j = index - LinearMax / Align;
+        const size_t base = LinearMax << (j / Steps);
+        return base + (j % Steps + 1) * (base / Steps);
+    }
+};
+
+// threads == false: one global pool, no synchronization.
+// threads == true: every thread owns a private set of free lists that is
+// refilled from (and drained back into) the shared pool in batches, so the
+// common allocate/deallocate path never takes the lock.
+template <bool threads, int inst, typename SizeClasses = __pool_size_classes<> >
 class __default_alloc_template {
 public:
     static void* allocate(size_t n);
     static void deallocate(void* p, size_t n);
     static void* reallocate(void* p, size_t old_sz, size_t new_sz);
 
+    // Returns every chunk whose objects are all free back to the system and
+    // reports the number of bytes released. Objects parked in the caches of
+    // other threads (threads == true) keep their chunk alive.
+    static size_t trim();
+
+    static size_t heap_bytes();
+    static size_t bytes_in_use();
+    static size_t free_list_depth(size_t bytes);
+
 private:
-    enum { __ALIGN = 8 };
-    enum { __MAX_BYTES = 128 };
-    enum { __NFREELISTS = __MAX_BYTES / __ALIGN };
+    enum { __ALIGN = SizeClasses::align };
+    enum { __MAX_BYTES = SizeClasses::max_bytes };
+    enum { __NFREELISTS = SizeClasses::count };
+    enum { __BATCH_OBJS = 20 };   // objects moved per refill/drain
+    enum { __CACHE_LIMIT = 64 };  // per-thread list depth that triggers a drain
 
     union obj {
         union obj* free_list_link;
         char client_data[1];
     };
 
+    // header placed in front of every block obtained from malloc; the
+    // usable bytes start at the first __ALIGN boundary after it
+    struct __chunk {
+        __chunk* next;
+        size_t size;
+    };
+    enum { __CHUNK_HEADER = sizeof(__chunk) + __ALIGN - 1 };
+
+    // per-thread free lists, only used when threads == true
+    struct __thread_cache {
+        obj* free_list[__NFREELISTS];
+        size_t depth[__NFREELISTS];
+
+        __thread_cache() {
+            for (int i = 0; i < __NFREELISTS; ++i) {
+                free_list[i] = nullptr;
+                depth[i] = 0;
+            }
+        }
+        ~__thread_cache() { // give everything back when the thread exits
+            for (int i = 0; i < __NFREELISTS; ++i) {
+                release_to_central(i, free_list[i]);
+            }
+            cache_released() = true;
+        }
+    };
+
+    class __lock {
+    public:
+        __lock() {
+            if (threads) {
+                central_mutex.lock();
+            }
+        }
+        ~__lock() {
+            if (threads) {
+                central_mutex.unlock();
+            }
+        }
+    };
+
     static char* start_free;
     static char* end_free;
     static size_t heap_size;
+    static __chunk* chunk_list;
 
     static obj* volatile free_list[__NFREELISTS];
+    static std::mutex central_mutex;
 
     static size_t ROUND_UP(size_t bytes) {
         return (bytes + __ALIGN - 1) & ~(__ALIGN - 1);
     }
     static size_t FREELIST_INDEX(size_t bytes) {
-        return (bytes + __ALIGN - 1) / __ALIGN - 1;
+        return SizeClasses::index(bytes);
+    }
+    static size_t CLASS_SIZE(size_t index) {
+        return SizeClasses::size(index);
+    }
+
+    static __thread_cache& thread_cache() {
+        static thread_local __thread_cache cache;
+        return cache;
+    }
+    // Set once the thread's cache is destroyed; thread_local objects built
+    // before it outlive it, and their blocks go straight to the shared
+    // pool. A bool needs no destructor, so it is still there to be read.
+    static bool& cache_released() {
+        static thread_local bool released = false;
+        return released;
     }
 
     static void* refill(size_t size);
+    static void* refill_thread_cache(size_t size);
+    static void release_to_central(size_t index, obj* first);
+    static void flush_thread_cache();
     static char* chunk_alloc(size_t size, int& nobjs);
+    static size_t free_bytes();
 };
 
-template <bool threads, int inst>
-char* __default_alloc_template<threads, inst>::start_free = 0;
-template <bool threads, int inst>
-char* __default_alloc_template<threads, inst>::end_free = 0;
-template <bool threads, int inst>
-size_t __default_alloc_template<threads, inst>::heap_size = 0;
-template <bool threads, int inst>
-typename __default_alloc_template<threads, inst>::obj*
-volatile __default_alloc_template<threads, inst>::free_list[__NFREELISTS] =
-{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-template <bool threads, int inst>
-void* __default_alloc_template<threads, inst>::allocate(size_t size) {
+template <bool threads, int inst, typename SizeClasses>
+char* __default_alloc_template<threads, inst, SizeClasses>::start_free = 0;
+template <bool threads, int inst, typename SizeClasses>
+char* __default_alloc_template<threads, inst, SizeClasses>::end_free = 0;
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::heap_size = 0;
+template <bool threads, int inst, typename SizeClasses>
+typename __default_alloc_template<threads, inst, SizeClasses>::__chunk*
+__default_alloc_template<threads, inst, SizeClasses>::chunk_list = 0;
+template <bool threads, int inst, typename SizeClasses>
+typename __default_alloc_template<threads, inst, SizeClasses>::obj*
+volatile __default_alloc_template<threads, inst, SizeClasses>::free_list[__NFREELISTS] = { 0 };
+template <bool threads, int inst, typename SizeClasses>
+std::mutex __default_alloc_template<threads, inst, SizeClasses>::central_mutex;
+
+template <bool threads, int inst, typename SizeClasses>
+void* __default_alloc_template<threads, inst, SizeClasses>::allocate(size_t size) {
     if (size > (size_t)__MAX_BYTES) {
         return malloc_alloc::allocate(size);
     }
 
+    if (threads && !cache_released()) {
+        __thread_cache& cache = thread_cache();
+        const size_t index = FREELIST_INDEX(size);
+        obj* result = cache.free_list[index];
+        if (result == nullptr) {
+            return refill_thread_cache(CLASS_SIZE(index));
+        }
+        cache.free_list[index] = result->free_list_link;
+        --cache.depth[index];
+        return (void*)result;
+    }
+
+    __lock guard;
     obj* volatile * my_free_list;
     obj* result;
 
     my_free_list = free_list + FREELIST_INDEX(size);
     result = *my_free_list;
     if (result == nullptr) {
-        void* r = refill(ROUND_UP(size));
+        void* r = refill(CLASS_SIZE(FREELIST_INDEX(size)));
         return r;
     }
     *my_free_list = result->free_list_link;
     return (void*)result;
 }
 
-template <bool threads, int inst>
-void __default_alloc_template<threads, inst>::deallocate(void* p, size_t size) {
+template <bool threads, int inst, typename SizeClasses>
+void __default_alloc_template<threads, inst, SizeClasses>::deallocate(void* p, size_t size) {
     if (size > (size_t)__MAX_BYTES) {
         malloc_alloc::deallocate(p, size);
         return;
     }
 
     obj* q = (obj*)p;
+    if (threads && !cache_released()) {
+        __thread_cache& cache = thread_cache();
+        const size_t index = FREELIST_INDEX(size);
+        q->free_list_link = cache.free_list[index];
+        cache.free_list[index] = q;
+        if (++cache.depth[index] > __CACHE_LIMIT) {
+            // hand the oldest part of the list back so that a thread which
+            // only frees cannot hoard the pool
+            const size_t keep = __CACHE_LIMIT - __BATCH_OBJS;
+            obj* last = q;
+            for (size_t i = 1; i < keep; ++i) {
+                last = last->free_list_link;
+            }
+            obj* surplus = last->free_list_link;
+            last->free_list_link = nullptr;
+            release_to_central(index, surplus);
+            cache.depth[index] = keep;
+        }
+        return;
+    }
+
+    __lock guard;
     obj* volatile * my_free_list;
 
     my_free_list = free_list + FREELIST_INDEX(size);
@@ -164,13 +337,14 @@ void __default_alloc_template<threads, inst>::deallocate(void* p, size_t size) {
     *my_free_list = q;
 }
 
-template <bool threads, int inst>
-void* __default_alloc_template<threads, inst>::reallocate(void* p, size_t old_sz, size_t new_sz) {
+template <bool threads, int inst, typename SizeClasses>
+void* __default_alloc_template<threads, inst, SizeClasses>::reallocate(void* p, size_t old_sz, size_t new_sz) {
     if (old_sz > (size_t)__MAX_BYTES && new_sz > (size_t)__MAX_BYTES) {
         return malloc_alloc::reallocate(p, old_sz, new_sz);
     }
 
-    if (ROUND_UP(old_sz) == ROUND_UP(new_sz)) {
+    if (old_sz <= (size_t)__MAX_BYTES && new_sz <= (size_t)__MAX_BYTES &&
+        FREELIST_INDEX(old_sz) == FREELIST_INDEX(new_sz)) {
         return p;
     }
 
@@ -181,8 +355,8 @@ void* __default_alloc_template<threads, inst>::reallocate(void* p, size_t old_sz
     return result;
 }
 
-template <bool threads, int inst>
-void* __default_alloc_template<threads, inst>::refill(size_t size) {
+template <bool threads, int inst, typename SizeClasses>
+void* __default_alloc_template<threads, inst, SizeClasses>::refill(size_t size) {
     int nobjs = 20;
     char* chunk = chunk_alloc(size, nobjs);
     if (nobjs == 1) {
@@ -220,8 +394,61 @@ void* __default_alloc_template<threads, inst>::refill(size_t size) {
     return result;
 }
 
-template <bool threads, int inst>
-char* __default_alloc_template<threads, inst>::chunk_alloc(size_t size, int& nobjs) {
+template <bool threads, int inst, typename SizeClasses>
+void* __default_alloc_template<threads, inst, SizeClasses>::refill_thread_cache(size_t size) {
+    const size_t index = FREELIST_INDEX(size);
+    obj* result;
+    int nobjs = __BATCH_OBJS;
+    {
+        __lock guard;
+        obj* volatile * my_free_list = free_list + index;
+        result = *my_free_list;
+        if (result != nullptr) { // take a batch of already carved objects
+            obj* last = result;
+            for (nobjs = 1; nobjs < __BATCH_OBJS; ++nobjs) {
+                if (last->free_list_link == nullptr) {
+                    break;
+                }
+                last = last->free_list_link;
+            }
+            *my_free_list = last->free_list_link;
+            last->free_list_link = nullptr;
+        } else {
+            char* chunk = chunk_alloc(size, nobjs);
+            result = (obj*)chunk;
+            obj* current_obj = result;
+            for (int i = 1; i < nobjs; ++i) {
+                obj* next_obj = (obj*)((char*)current_obj + size);
+                current_obj->free_list_link = next_obj;
+                current_obj = next_obj;
+            }
+            current_obj->free_list_link = nullptr;
+        }
+    }
+
+    __thread_cache& cache = thread_cache();
+    cache.free_list[index] = result->free_list_link;
+    cache.depth[index] = nobjs - 1;
+    return result;
+}
+
+template <bool threads, int inst, typename SizeClasses>
+void __default_alloc_template<threads, inst, SizeClasses>::release_to_central(size_t index, obj* first) {
+    if (first == nullptr) {
+        return;
+    }
+    obj* last = first;
+    while (last->free_list_link != nullptr) {
+        last = last->free_list_link;
+    }
+    __lock guard;
+    obj* volatile * my_free_list = free_list + index;
+    last->free_list_link = *my_free_list;
+    *my_free_list = first;
+}
+
+template <bool threads, int inst, typename SizeClasses>
+char* __default_alloc_template<threads, inst, SizeClasses>::chunk_alloc(size_t size, int& nobjs) {
     char* result;
     size_t total_bytes = size * nobjs;
     size_t bytes_left = end_free - start_free;
@@ -236,37 +463,323 @@ char* __default_alloc_template<threads, inst>::chunk_alloc(size_t size, int& nob
         start_free += nobjs * size;
         return result;
     } else {
-        // deal with the memory left
-        if (bytes_left > 0) {
-            obj* volatile * my_free_list = free_list + FREELIST_INDEX(bytes_left);
+        // deal with the memory left, possibly spread over several classes
+        while (bytes_left >= __ALIGN) {
+            size_t index = FREELIST_INDEX(bytes_left);
+            if (CLASS_SIZE(index) > bytes_left) {
+                --index;
+            }
+            obj* volatile * my_free_list = free_list + index;
             ((obj*)start_free)->free_list_link = *my_free_list;
             *my_free_list = (obj*)start_free;
+            start_free += CLASS_SIZE(index);
+            bytes_left -= CLASS_SIZE(index);
         }
 
         size_t bytes_to_get = 2 * total_bytes + ROUND_UP(heap_size >> 4);
-        start_free = (char*)malloc(bytes_to_get);
-        if (start_free == nullptr) {
+        __chunk* chunk = (__chunk*)malloc(__CHUNK_HEADER + bytes_to_get);
+        if (chunk == nullptr) {
             obj* volatile * my_free_list, *p;
-            for (size_t i = size; i <= __MAX_BYTES; i += __ALIGN) {
-                my_free_list = free_list + FREELIST_INDEX(i);
+            for (size_t i = FREELIST_INDEX(size); i < __NFREELISTS; ++i) {
+                my_free_list = free_list + i;
                 p = *my_free_list;
                 if (p != nullptr) {
                     *my_free_list = p->free_list_link;
                     start_free = (char*)p;
-                    end_free = start_free + i;
+                    end_free = start_free + CLASS_SIZE(i);
                     return chunk_alloc(size, nobjs);
                 }
             }
             end_free = 0;
-            start_free = (char*)malloc_alloc::allocate(bytes_to_get);
+            chunk = (__chunk*)malloc_alloc::allocate(__CHUNK_HEADER + bytes_to_get);
         }
+        chunk->size = bytes_to_get;
+        chunk->next = chunk_list;
+        chunk_list = chunk;
+        start_free = (char*)(((size_t)(chunk + 1) + __ALIGN - 1) & ~(size_t)(__ALIGN - 1));
         heap_size += bytes_to_get;
         end_free = start_free + bytes_to_get;
         return chunk_alloc(size, nobjs);
     }
 }
 
+template <bool threads, int inst, typename SizeClasses>
+void __default_alloc_template<threads, inst, SizeClasses>::flush_thread_cache() {
+    if (threads && !cache_released()) {
+        __thread_cache& cache = thread_cache();
+        for (int i = 0; i < __NFREELISTS; ++i) {
+            release_to_central(i, cache.free_list[i]);
+            cache.free_list[i] = nullptr;
+            cache.depth[i] = 0;
+        }
+    }
+}
+
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::free_bytes() {
+    size_t result = end_free - start_free;
+    for (int i = 0; i < __NFREELISTS; ++i) {
+        for (obj* p = free_list[i]; p != nullptr; p = p->free_list_link) {
+            result += CLASS_SIZE(i);
+        }
+    }
+    return result;
+}
+
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::heap_bytes() {
+    __lock guard;
+    return heap_size;
+}
+
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::bytes_in_use() {
+    __lock guard;
+    return heap_size - free_bytes();
+}
+
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::free_list_depth(size_t bytes) {
+    if (bytes == 0 || bytes > (size_t)__MAX_BYTES) {
+        return 0;
+    }
+    __lock guard;
+    size_t n = 0;
+    for (obj* p = free_list[FREELIST_INDEX(bytes)]; p != nullptr; p = p->free_list_link) {
+        ++n;
+    }
+    return n;
+}
+
+template <bool threads, int inst, typename SizeClasses>
+size_t __default_alloc_template<threads, inst, SizeClasses>::trim() {
+    flush_thread_cache();
+
+    __lock guard;
+    size_t nchunks = 0;
+    for (__chunk* c = chunk_list; c != nullptr; c = c->next) {
+        ++nchunks;
+    }
+    if (nchunks == 0) {
+        return 0;
+    }
+
+    // sort the chunks by address so every free object can find its owner
+    __chunk** chunks = (__chunk**)malloc(nchunks * sizeof(__chunk*));
+    size_t* unused = (size_t*)malloc(nchunks * sizeof(size_t));
+    if (chunks == nullptr || unused == nullptr) {
+        free(chunks);
+        free(unused);
+        return 0;
+    }
+    size_t k = 0;
+    for (__chunk* c = chunk_list; c != nullptr; c = c->next) {
+        chunks[k++] = c;
+    }
+    std::sort(chunks, chunks + nchunks, std::less<__chunk*>());
+    memset(unused, 0, nchunks * sizeof(size_t));
+
+    struct owner_of {
+        __chunk** first;
+        __chunk** last;
+        size_t operator()(const void* p) const {
+            size_t lo = 0;
+            size_t hi = last - first;
+            while (hi - lo > 1) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (std::less<const void*>()(p, first[mid])) {
+                    hi = mid;
+                } else {
+                    lo = mid;
+                }
+            }
+            return lo;
+        }
+    } owner = { chunks, chunks + nchunks };
+
+    if (start_free != end_free) {
+        unused[owner(start_free)] += end_free - start_free;
+    }
+    for (int i = 0; i < __NFREELISTS; ++i) {
+        for (obj* p = free_list[i]; p != nullptr; p = p->free_list_link) {
+            unused[owner(p)] += CLASS_SIZE(i);
+        }
+    }
+
+    // from here on unused[k] != 0 means chunk k goes back to the system
+    bool any = false;
+    for (k = 0; k < nchunks; ++k) {
+        unused[k] = unused[k] == chunks[k]->size;
+        any = any || unused[k] != 0;
+    }
+    size_t released = 0;
+    if (any) {
+        for (int i = 0; i < __NFREELISTS; ++i) {
+            obj* kept = nullptr;
+            obj* p = free_list[i];
+            while (p != nullptr) {
+                obj* next = p->free_list_link;
+                if (unused[owner(p)] == 0) {
+                    p->free_list_link = kept;
+                    kept = p;
+                }
+                p = next;
+            }
+            free_list[i] = kept;
+        }
+        if (start_free != end_free && unused[owner(start_free)] != 0) {
+            start_free = end_free = 0;
+        }
+        __chunk** link = &chunk_list;
+        while (*link != nullptr) {
+            __chunk* c = *link;
+            if (unused[owner(c)] != 0) {
+                *link = c->next;
+                heap_size -= c->size;
+                released += c->size;
+                free(c);
+            } else {
+                link = &c->next;
+            }
+        }
+    }
+    free(chunks);
+    free(unused);
+    return released;
+}
+
 typedef __default_alloc_template<false, 0> alloc;
+typedef __default_alloc_template<true, 0> threaded_alloc;
+
+// Monotonic (bump pointer) arena. allocate carves from the current block,
+// deallocate does nothing and release() hands every block back at once, so
+// a container that lives for one request pays almost nothing to allocate
+// and to tear down. With threads == true each thread bumps and releases its
+// own arena; with threads == false there is one arena and no locking.
+// Containers using the arena must be destroyed or abandoned before release().
+template <bool threads, int inst>
+class __arena_alloc_template {
+public:
+    static void* allocate(size_t n);
+    static void deallocate(void*, size_t) { }
+    static void* reallocate(void* p, size_t old_sz, size_t new_sz);
+
+    static void release();
+    static size_t bytes_allocated();
+    static size_t heap_bytes();
+
+private:
+    enum { __ALIGN = 16 };
+    enum { __BLOCK_SIZE = 64 * 1024 };
+
+    struct __block {
+        __block* next;
+        size_t size;
+    };
+    enum { __BLOCK_HEADER = (sizeof(__block) + __ALIGN - 1) & ~(__ALIGN - 1) };
+
+    struct __arena {
+        __block* blocks;
+        char* cur;
+        char* end;
+        size_t allocated;
+        size_t heap;
+
+        __arena() : blocks(nullptr), cur(nullptr), end(nullptr), allocated(0), heap(0) { }
+        ~__arena() {
+            clear();
+        }
+        void clear() {
+            while (blocks != nullptr) {
+                __block* next = blocks->next;
+                malloc_alloc::deallocate(blocks, __BLOCK_HEADER + blocks->size);
+                blocks = next;
+            }
+            cur = end = nullptr;
+            allocated = heap = 0;
+        }
+    };
+
+    static size_t ROUND_UP(size_t bytes) {
+        return (bytes + __ALIGN - 1) & ~(size_t)(__ALIGN - 1);
+    }
+
+    static __arena& arena() {
+        if (threads) {
+            static thread_local __arena a;
+            return a;
+        } else {
+            static __arena a;
+            return a;
+        }
+    }
+
+    static char* new_block(__arena& a, size_t size);
+};
+
+template <bool threads, int inst>
+char* __arena_alloc_template<threads, inst>::new_block(__arena& a, size_t size) {
+    __block* b = (__block*)malloc_alloc::allocate(__BLOCK_HEADER + size);
+    b->size = size;
+    b->next = a.blocks;
+    a.blocks = b;
+    a.heap += size;
+    return (char*)b + __BLOCK_HEADER;
+}
+
+template <bool threads, int inst>
+void* __arena_alloc_template<threads, inst>::allocate(size_t n) {
+    __arena& a = arena();
+    n = ROUND_UP(n == 0 ? 1 : n);
+    a.allocated += n;
+    if (size_t(a.end - a.cur) >= n) {
+        char* result = a.cur;
+        a.cur += n;
+        return result;
+    }
+    if (n > __BLOCK_SIZE / 4) { // big requests get a block of their own
+        return new_block(a, n);
+    }
+    char* result = new_block(a, __BLOCK_SIZE);
+    a.cur = result + n;
+    a.end = result + __BLOCK_SIZE;
+    return result;
+}
+
+template <bool threads, int inst>
+void* __arena_alloc_template<threads, inst>::reallocate(void* p, size_t old_sz, size_t new_sz) {
+    __arena& a = arena();
+    char* q = (char*)p;
+    // the most recent allocation can grow or shrink in place
+    if (q + ROUND_UP(old_sz) == a.cur && q + ROUND_UP(new_sz) <= a.end) {
+        a.cur = q + ROUND_UP(new_sz);
+        a.allocated = a.allocated - ROUND_UP(old_sz) + ROUND_UP(new_sz);
+        return p;
+    }
+    if (new_sz <= old_sz) {
+        return p;
+    }
+    void* result = allocate(new_sz);
+    memcpy(result, p, old_sz);
+    return result;
+}
+
+template <bool threads, int inst>
+void __arena_alloc_template<threads, inst>::release() {
+    arena().clear();
+}
+
+template <bool threads, int inst>
+size_t __arena_alloc_template<threads, inst>::bytes_allocated() {
+    return arena().allocated;
+}
+
+template <bool threads, int inst>
+size_t __arena_alloc_template<threads, inst>::heap_bytes() {
+    return arena().heap;
+}
+
+typedef __arena_alloc_template<false, 0> arena_alloc;
 
 template <typename T, typename Alloc>
 class simple_alloc {
@@ -285,6 +798,105 @@ public:
     static void deallocate(T* p) {
         Alloc::deallocate(p, sizeof(T));
     }
+
+    // Instance forms, used by the containers so that stateful allocators
+    // work too. The static allocators above are simply called through the
+    // object.
+    static T* allocate(Alloc& a, size_t n) {
+        return n == 0 ? 0 : (T*)a.allocate(n * sizeof(T));
+    }
+    static T* allocate(Alloc& a) {
+        return (T*)a.allocate(sizeof(T));
+    }
+    static void deallocate(Alloc& a, T* p, size_t n) {
+        if (n != 0) {
+            a.deallocate(p, n * sizeof(T));
+        }
+    }
+    static void deallocate(Alloc& a, T* p) {
+        a.deallocate(p, sizeof(T));
+    }
+    // Only for allocators with a reallocate member (see
+    // __alloc_has_reallocate) and for T that may be moved by memcpy.
+    static T* reallocate(Alloc& a, T* p, size_t old_n, size_t new_n) {
+        return (T*)a.reallocate(p, old_n * sizeof(T), new_n * sizeof(T));
+    }
+};
+
+// Propagation rules for an allocator instance owned by a container.
+// Copy construction always copies the source's allocator; specialize this
+// for allocators that want a different contract. When swap does not
+// propagate, swapping containers with unequal allocators is undefined.
+template <typename Alloc>
+struct __alloc_traits {
+    enum { propagate_on_copy_assignment = false };
+    enum { propagate_on_move_assignment = true };
+    enum { propagate_on_swap = true };
+};
+
+// Empty allocators are interchangeable; stateful ones must provide ==.
+template <typename Alloc>
+inline bool __alloc_equal(const Alloc&, const Alloc&, std::true_type) {
+    return true;
+}
+
+template <typename Alloc>
+inline bool __alloc_equal(const Alloc& x, const Alloc& y, std::false_type) {
+    return x == y;
+}
+
+template <typename Alloc>
+inline bool __alloc_equal(const Alloc& x, const Alloc& y) {
+    return __alloc_equal(x, y, std::is_empty<Alloc>());
+}
+
+// Whether Alloc has reallocate(void*, size_t, size_t). Containers holding
+// trivially relocatable data grow through it, which lets malloc_alloc
+// extend large buffers in place.
+template <typename Alloc>
+class __alloc_has_reallocate {
+    template <typename A>
+    static char test(decltype(std::declval<A&>().reallocate(
+        (void*)0, size_t(0), size_t(0)))*);
+    template <typename A>
+    static long test(...);
+
+public:
+    enum { value = sizeof(test<Alloc>(0)) == sizeof(char) };
+};
+
+// Base class holding a container's allocator. Empty allocators (alloc,
+// malloc_alloc, ...) are stored through the empty base optimization and
+// add nothing to the size of the container.
+template <typename Alloc, bool = std::is_empty<Alloc>::value>
+class __alloc_holder : private Alloc {
+public:
+    __alloc_holder() { }
+    explicit __alloc_holder(const Alloc& a) : Alloc(a) { }
+
+    Alloc& get_alloc() {
+        return *this;
+    }
+    const Alloc& get_alloc() const {
+        return *this;
+    }
+};
+
+template <typename Alloc>
+class __alloc_holder<Alloc, false> {
+public:
+    __alloc_holder() : instance() { }
+    explicit __alloc_holder(const Alloc& a) : instance(a) { }
+
+    Alloc& get_alloc() {
+        return instance;
+    }
+    const Alloc& get_alloc() const {
+        return instance;
+    }
+
+private:
+    Alloc instance;
 };
 
 template <typename Alloc>
@@ -306,7 +918,7 @@ public:
         char* real_p = (char*)p - extra;
         assert(*(size_t*)real_p == old_sz);
         char* result = (char*)
-            Alloc::deallocate(real_p, old_sz + extra, new_sz + extra);
+            Alloc::reallocate(real_p, old_sz + extra, new_sz + extra);
         *(size_t*)result = new_sz;
         return result + extra;
     }
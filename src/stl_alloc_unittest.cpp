@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
 
 #include "stl_alloc.h"
+#include "stl_vector.h"
 
 namespace forgedstl {
 
@@ -32,7 +35,14 @@ protected:
 
 using ::testing::Types;
 
-typedef Types<__default_alloc_template<false, 0>, __malloc_alloc_template<0>> Implementations;
+typedef __pool_size_classes<16, 128, 1024, 4> geometric_classes;
+typedef __pool_size_classes<64, 256, 256> wide_classes;
+
+typedef Types<__default_alloc_template<false, 0>, __default_alloc_template<true, 0>,
+              __default_alloc_template<false, 0, geometric_classes>,
+              __default_alloc_template<true, 0, wide_classes>,
+              __malloc_alloc_template<0>, __arena_alloc_template<false, 0>,
+              __arena_alloc_template<true, 0>> Implementations;
 
 TYPED_TEST_CASE(AllocTest, Implementations);
 
@@ -53,4 +63,220 @@ TYPED_TEST(AllocTest, Reallocate) {
     }
 }
 
+TEST(PoolSizeClassesTest, Layout) {
+    typedef __pool_size_classes<> linear;
+    EXPECT_EQ(16, linear::count);
+    EXPECT_EQ(0, linear::index(1));
+    EXPECT_EQ(0, linear::index(8));
+    EXPECT_EQ(1, linear::index(9));
+    EXPECT_EQ(15, linear::index(128));
+    for (size_t i = 0; i < linear::count; ++i) {
+        EXPECT_EQ((i + 1) * 8, linear::size(i));
+    }
+
+    EXPECT_EQ(8 + 4 * 3, geometric_classes::count);
+    EXPECT_EQ(7, geometric_classes::index(128));
+    EXPECT_EQ(8, geometric_classes::index(129));
+    EXPECT_EQ(160, geometric_classes::size(8));
+    EXPECT_EQ(256, geometric_classes::size(11));
+    EXPECT_EQ(320, geometric_classes::size(12));
+    EXPECT_EQ(1024, geometric_classes::size(geometric_classes::count - 1));
+    for (size_t n = 1; n <= 1024; ++n) {
+        size_t i = geometric_classes::index(n);
+        ASSERT_GE(geometric_classes::size(i), n);
+        if (i > 0) {
+            ASSERT_LT(geometric_classes::size(i - 1), n);
+        }
+        ASSERT_EQ(0, geometric_classes::size(i) % 16);
+    }
+}
+
+TEST(PoolSizeClassesTest, Alignment) {
+    typedef __default_alloc_template<false, 2, wide_classes> Alloc;
+    std::vector<void*> blocks;
+    for (size_t n = 1; n <= 256; ++n) {
+        void* p = Alloc::allocate(n);
+        EXPECT_EQ(0, (size_t)p % 64);
+        blocks.push_back(p);
+    }
+    for (size_t n = 1; n <= 256; ++n) {
+        Alloc::deallocate(blocks[n - 1], n);
+    }
+}
+
+TEST(ThreadedAllocTest, ConcurrentAllocateDeallocate) {
+    typedef __default_alloc_template<true, 0> Alloc;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 8; ++t) {
+        workers.push_back(std::thread([t]() {
+            std::vector<char*> blocks;
+            for (int round = 0; round < 200; ++round) {
+                for (size_t n = 1; n <= 128; n += 7) {
+                    char* p = (char*)Alloc::allocate(n);
+                    memset(p, t, n);
+                    blocks.push_back(p);
+                }
+                for (size_t i = 0, n = 1; n <= 128; n += 7, ++i) {
+                    char* p = blocks[blocks.size() - 19 + i];
+                    for (size_t j = 0; j < n; ++j) {
+                        EXPECT_EQ(char(t), p[j]);
+                    }
+                }
+                for (size_t n = 128 - 127 % 7; ; n -= 7) {
+                    Alloc::deallocate(blocks.back(), n);
+                    blocks.pop_back();
+                    if (n == 1) {
+                        break;
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+TEST(ThreadedAllocTest, CrossThreadDeallocate) {
+    typedef __default_alloc_template<true, 0> Alloc;
+    std::vector<void*> blocks;
+    std::thread producer([&blocks]() {
+        for (int i = 0; i < 1000; ++i) {
+            blocks.push_back(Alloc::allocate(32));
+        }
+    });
+    producer.join();
+
+    std::thread consumer([&blocks]() {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            Alloc::deallocate(blocks[i], 32);
+        }
+    });
+    consumer.join();
+}
+
+TEST(ThreadedAllocTest, ThreadLocalOutlivesCache) {
+    // the vector is built before the thread's cache and so destroyed after
+    // it; its block has to go back to the shared pool all the same
+    typedef __default_alloc_template<true, 7> Alloc;
+    const size_t in_use = Alloc::bytes_in_use();
+    for (int round = 0; round < 3; ++round) {
+        std::thread worker([]() {
+            thread_local vector<int, Alloc> v;
+            v.push_back(1);
+        });
+        worker.join();
+        EXPECT_EQ(in_use, Alloc::bytes_in_use());
+    }
+}
+
+template <typename Alloc>
+class TrimTest : public ::testing::Test { };
+
+typedef Types<__default_alloc_template<false, 1>, __default_alloc_template<true, 1>> PoolImplementations;
+
+TYPED_TEST_CASE(TrimTest, PoolImplementations);
+
+TYPED_TEST(TrimTest, ReleaseFullyFreeChunks) {
+    typedef TypeParam Alloc;
+    std::vector<void*> blocks;
+    for (int i = 0; i < 10000; ++i) {
+        blocks.push_back(Alloc::allocate(64));
+    }
+    size_t heap = Alloc::heap_bytes();
+    EXPECT_GE(heap, 10000 * 64);
+    EXPECT_GE(Alloc::bytes_in_use(), 10000 * 64);
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        Alloc::deallocate(blocks[i], 64);
+    }
+    blocks.clear();
+    EXPECT_EQ(heap, Alloc::trim());
+    EXPECT_EQ(0, Alloc::heap_bytes());
+    EXPECT_EQ(0, Alloc::bytes_in_use());
+    EXPECT_EQ(0, Alloc::free_list_depth(64));
+
+    void* p = Alloc::allocate(64);
+    memset(p, 1, 64);
+    Alloc::deallocate(p, 64);
+}
+
+TYPED_TEST(TrimTest, KeepChunksInUse) {
+    typedef TypeParam Alloc;
+    std::vector<char*> blocks;
+    for (int i = 0; i < 10000; ++i) {
+        char* p = (char*)Alloc::allocate(24);
+        memset(p, i & 0x7f, 24);
+        blocks.push_back(p);
+    }
+    char* survivor = blocks[5000];
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (blocks[i] != survivor) {
+            Alloc::deallocate(blocks[i], 24);
+        }
+    }
+    size_t heap = Alloc::heap_bytes();
+    size_t released = Alloc::trim();
+    EXPECT_GT(released, 0);
+    EXPECT_LT(released, heap);
+    EXPECT_EQ(heap - released, Alloc::heap_bytes());
+    EXPECT_GE(Alloc::bytes_in_use(), 24);
+    for (int i = 0; i < 24; ++i) {
+        EXPECT_EQ(5000 & 0x7f, survivor[i]);
+    }
+
+    Alloc::deallocate(survivor, 24);
+    Alloc::trim();
+    EXPECT_EQ(0, Alloc::heap_bytes());
+}
+
+TEST(ArenaAllocTest, BumpAndRelease) {
+    typedef __arena_alloc_template<false, 1> Alloc;
+    EXPECT_EQ(0, Alloc::heap_bytes());
+
+    char* p1 = (char*)Alloc::allocate(10);
+    char* p2 = (char*)Alloc::allocate(20);
+    EXPECT_EQ(p1 + 16, p2);
+    EXPECT_EQ(0, (size_t)p1 % 16);
+    Alloc::deallocate(p1, 10);
+    EXPECT_EQ(16 + 32, Alloc::bytes_allocated());
+
+    // the newest block grows in place
+    char* p3 = (char*)Alloc::reallocate(p2, 20, 100);
+    EXPECT_EQ(p2, p3);
+    char* p4 = (char*)Alloc::allocate(8);
+    EXPECT_EQ(p3 + 112, p4);
+
+    void* big = Alloc::allocate(1 << 20);
+    memset(big, 0, 1 << 20);
+    char* p5 = (char*)Alloc::allocate(8);
+    EXPECT_EQ(p4 + 16, p5);
+    EXPECT_GE(Alloc::heap_bytes(), (1 << 20) + 16 + 112 + 16 + 16);
+
+    Alloc::release();
+    EXPECT_EQ(0, Alloc::heap_bytes());
+    EXPECT_EQ(0, Alloc::bytes_allocated());
+}
+
+TEST(ArenaAllocTest, PerThreadArenas) {
+    typedef __arena_alloc_template<true, 1> Alloc;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.push_back(std::thread([]() {
+            for (int request = 0; request < 10; ++request) {
+                for (int i = 0; i < 10000; ++i) {
+                    int* p = (int*)Alloc::allocate(sizeof(int));
+                    *p = i;
+                }
+                EXPECT_EQ(10000 * 16, Alloc::bytes_allocated());
+                Alloc::release();
+                EXPECT_EQ(0, Alloc::heap_bytes());
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
 } // namespace forgedstl
\ No newline at end of file
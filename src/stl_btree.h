@@ -0,0 +1,1298 @@
+#ifndef FORGED_STL_INTERNAL_BTREE_H_
+#define FORGED_STL_INTERNAL_BTREE_H_
+
+#include <cstring>
+#include <type_traits>
+
+#include "stl_alloc.h"
+#include "stl_construct.h"
+#include "stl_iterator.h"
+#include "stl_node_handle.h"
+#include "stl_pair.h"
+#include "type_traits.h"
+
+namespace forgedstl {
+
+// Nodes are sized to about four cache lines, minus their header, and hold
+// no fewer than three values however large a value is.
+const size_t __btree_node_bytes = 256;
+
+template <typename Value>
+struct __btree_node {
+    enum {
+        fit = (__btree_node_bytes - 16) / sizeof(Value),
+        max_values = fit < 3 ? 3 : fit
+    };
+
+    __btree_node* parent;
+    unsigned short position;  // index among the parent's children
+    unsigned short count;     // values in use
+    bool leaf;
+    alignas(Value) unsigned char storage[max_values * sizeof(Value)];
+
+    Value* value(int i) {
+        return reinterpret_cast<Value*>(storage) + i;
+    }
+    const Value* value(int i) const {
+        return reinterpret_cast<const Value*>(storage) + i;
+    }
+    // Only for internal nodes.
+    __btree_node* child(int i) const;
+    void set_child(int i, __btree_node* x);
+};
+
+// An internal node has one more child than it has values; child i holds
+// the values that sort before value i.
+template <typename Value>
+struct __btree_internal_node : public __btree_node<Value> {
+    __btree_node<Value>* children[__btree_node<Value>::max_values + 1];
+};
+
+template <typename Value>
+inline __btree_node<Value>* __btree_node<Value>::child(int i) const {
+    return static_cast<const __btree_internal_node<Value>*>(this)->children[i];
+}
+
+template <typename Value>
+inline void __btree_node<Value>::set_child(int i, __btree_node* x) {
+    static_cast<__btree_internal_node<Value>*>(this)->children[i] = x;
+    x->parent = this;
+    x->position = (unsigned short)i;
+}
+
+// A value that extract took out of a btree. The values of a btree share
+// their nodes, so a node handle carries the value alone.
+template <typename Value>
+struct __btree_extracted {
+    Value val;
+};
+
+template <typename Value>
+inline Value& __node_value(__btree_extracted<Value>* p) {
+    return p->val;
+}
+
+// An iterator is a node and a slot in it. end() is one past the last slot
+// of the rightmost leaf, or a null node in an empty tree.
+template <typename Value, typename Ref, typename Ptr>
+struct __btree_iterator {
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef ptrdiff_t difference_type;
+    typedef __btree_iterator<Value, Value&, Value*> iterator;
+    typedef __btree_iterator<Value, const Value&, const Value*> const_iterator;
+    typedef __btree_iterator<Value, Ref, Ptr> self;
+    typedef __btree_node<Value>* node_ptr;
+
+    node_ptr node;
+    int position;
+
+    __btree_iterator() : node(nullptr), position(0) { }
+    __btree_iterator(node_ptr x, int i) : node(x), position(i) { }
+    __btree_iterator(const iterator& it)
+        : node(it.node), position(it.position) { }
+
+    reference operator*() const {
+        return *node->value(position);
+    }
+    pointer operator->() const {
+        return &(operator*());
+    }
+
+    self& operator++() {
+        increment();
+        return *this;
+    }
+    self operator++(int) {
+        self tmp = *this;
+        increment();
+        return tmp;
+    }
+
+    self& operator--() {
+        decrement();
+        return *this;
+    }
+    self operator--(int) {
+        self tmp = *this;
+        decrement();
+        return tmp;
+    }
+
+    bool operator==(const const_iterator& x) const {
+        return node == x.node && position == x.position;
+    }
+    bool operator!=(const const_iterator& x) const {
+        return !(*this == x);
+    }
+
+    void increment() {
+        if (!node->leaf) {
+            node = node->child(position + 1);
+            while (!node->leaf) {
+                node = node->child(0);
+            }
+            position = 0;
+            return;
+        }
+        if (++position < node->count) {
+            return;
+        }
+        // climb to the first ancestor with a value to the right; past the
+        // last value the iterator stays at the end of its leaf
+        node_ptr x = node;
+        int i = position;
+        while (i == x->count && x->parent != nullptr) {
+            i = x->position;
+            x = x->parent;
+        }
+        if (i < x->count) {
+            node = x;
+            position = i;
+        }
+    }
+
+    void decrement() {
+        if (!node->leaf) {
+            node = node->child(position);
+            while (!node->leaf) {
+                node = node->child(node->count);
+            }
+            position = node->count - 1;
+            return;
+        }
+        if (position > 0) {
+            --position;
+            return;
+        }
+        while (node->position == 0) {
+            node = node->parent;
+        }
+        position = node->position - 1;
+        node = node->parent;
+    }
+};
+
+template <typename Value, typename Ref, typename Ptr>
+inline bidirectional_iterator_tag
+iterator_category(const __btree_iterator<Value, Ref, Ptr>&) {
+    return bidirectional_iterator_tag();
+}
+
+template <typename Value, typename Ref, typename Ptr>
+inline ptrdiff_t* distance_type(const __btree_iterator<Value, Ref, Ptr>&) {
+    return (ptrdiff_t*)0;
+}
+
+template <typename Value, typename Ref, typename Ptr>
+inline Value* value_type(const __btree_iterator<Value, Ref, Ptr>&) {
+    return (Value*)0;
+}
+
+// An ordered container with the interface of rb_tree, keeping many values
+// per node in sorted arrays, so that a search walks a few wide nodes
+// instead of one pointer per comparison and a scan reads values in
+// memory order. Each value costs its own size plus a share of the node
+// headers, where an rb_tree node adds three pointers and a color.
+//
+// Values move between slots as nodes fill, split and merge, so inserting
+// or erasing invalidates every iterator into the tree, and a node handle
+// carries a value rather than a node. Values are moved with memmove when
+// they are trivially relocatable, and otherwise by move construction; a
+// move that throws leaves the tree in an unspecified state.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare,
+          typename Alloc = alloc>
+class btree : protected __alloc_holder<Alloc> {
+protected:
+    typedef __alloc_holder<Alloc> base;
+    typedef __btree_node<Value> node;
+    typedef __btree_internal_node<Value> internal_node;
+    typedef node* node_ptr;
+    typedef simple_alloc<node, Alloc> leaf_allocator;
+    typedef simple_alloc<internal_node, Alloc> internal_allocator;
+    typedef __btree_extracted<Value> extracted_node;
+    typedef simple_alloc<extracted_node, Alloc> extracted_allocator;
+
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef Alloc allocator_type;
+
+    typedef __btree_iterator<value_type, reference, pointer> iterator;
+    typedef __btree_iterator<value_type, const_reference, const_pointer>
+        const_iterator;
+    typedef reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef reverse_iterator<iterator> reverse_iterator;
+    typedef __node_handle<extracted_node, Value, Alloc> node_type;
+
+    enum {
+        max_values = node::max_values,
+        min_values = max_values / 2
+    };
+
+    btree(const Compare& comp = Compare(),
+          const allocator_type& a = allocator_type()) : base(a),
+        root(nullptr), leftmost(nullptr), rightmost(nullptr), node_count(0),
+        key_compare(comp) { }
+    btree(const btree<Key, Value, KeyOfValue, Compare, Alloc>& x)
+        : base(x.get_alloc()), root(nullptr), leftmost(nullptr),
+          rightmost(nullptr), node_count(0), key_compare(x.key_compare) {
+        if (x.root != nullptr) {
+            root = __copy(x.root, nullptr, 0);
+            node_count = x.node_count;
+            update_ends();
+        }
+    }
+    btree(btree<Key, Value, KeyOfValue, Compare, Alloc>&& x)
+        noexcept(std::is_nothrow_copy_constructible<Compare>::value)
+        : base(x.get_alloc()), root(nullptr), leftmost(nullptr),
+          rightmost(nullptr), node_count(0), key_compare(x.key_compare) {
+        __take_nodes(x);
+    }
+    ~btree() {
+        clear();
+    }
+
+    btree<Key, Value, KeyOfValue, Compare, Alloc>&
+    operator=(const btree<Key, Value, KeyOfValue, Compare, Alloc>& x);
+    btree<Key, Value, KeyOfValue, Compare, Alloc>&
+    operator=(btree<Key, Value, KeyOfValue, Compare, Alloc>&& x)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment &&
+                 std::is_nothrow_copy_assignable<Compare>::value) {
+        if (this != &x) {
+            clear();
+            __move_assign(x, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
+
+    Compare key_comp() const {
+        return key_compare;
+    }
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+    iterator begin() {
+        return iterator(leftmost, 0);
+    }
+    const_iterator begin() const {
+        return const_iterator(leftmost, 0);
+    }
+    iterator end() {
+        return iterator(rightmost, rightmost == nullptr ? 0 : rightmost->count);
+    }
+    const_iterator end() const {
+        return const_iterator(rightmost,
+                              rightmost == nullptr ? 0 : rightmost->count);
+    }
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    bool empty() const {
+        return node_count == 0;
+    }
+    size_type size() const {
+        return node_count;
+    }
+    size_type max_size() const {
+        return size_type(-1);
+    }
+
+    void swap(btree<Key, Value, KeyOfValue, Compare, Alloc>& t) {
+        std::swap(root, t.root);
+        std::swap(leftmost, t.leftmost);
+        std::swap(rightmost, t.rightmost);
+        std::swap(node_count, t.node_count);
+        std::swap(key_compare, t.key_compare);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), t.get_alloc());
+        }
+    }
+
+    pair<iterator, bool> insert_unique(const value_type& x) {
+        return __insert_unique(x);
+    }
+    pair<iterator, bool> insert_unique(value_type&& x) {
+        return __insert_unique(std::move(x));
+    }
+    iterator insert_equal(const value_type& x) {
+        return __insert_equal(x);
+    }
+    iterator insert_equal(value_type&& x) {
+        return __insert_equal(std::move(x));
+    }
+
+    // A hint only helps at end(), where sorted input is appended to the
+    // rightmost leaf without a search.
+    iterator insert_unique(iterator position, const value_type& x) {
+        return __insert_unique(position, x);
+    }
+    iterator insert_unique(iterator position, value_type&& x) {
+        return __insert_unique(position, std::move(x));
+    }
+    iterator insert_equal(iterator position, const value_type& x) {
+        return __insert_equal(position, x);
+    }
+    iterator insert_equal(iterator position, value_type&& x) {
+        return __insert_equal(position, std::move(x));
+    }
+
+    // The value is built aside and moved into its slot.
+    template <typename... Args>
+    pair<iterator, bool> emplace_unique(Args&&... args) {
+        return __insert_unique(value_type(std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    iterator emplace_equal(Args&&... args) {
+        return __insert_equal(value_type(std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    iterator emplace_hint_unique(iterator position, Args&&... args) {
+        return __insert_unique(position,
+                               value_type(std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    iterator emplace_hint_equal(iterator position, Args&&... args) {
+        return __insert_equal(position,
+                              value_type(std::forward<Args>(args)...));
+    }
+
+    template <typename InputIterator>
+    void insert_unique(InputIterator first, InputIterator last);
+    template <typename InputIterator>
+    void insert_equal(InputIterator first, InputIterator last);
+    // Sorted input goes onto the rightmost leaf without a search anyway.
+    template <typename InputIterator>
+    void insert_unique_sorted(InputIterator first, InputIterator last) {
+        insert_unique(first, last);
+    }
+    template <typename InputIterator>
+    void insert_equal_sorted(InputIterator first, InputIterator last) {
+        insert_equal(first, last);
+    }
+
+    void erase(iterator position) {
+        __erase(position.node, position.position);
+    }
+    size_type erase(const key_type& x);
+    void erase(iterator first, iterator last);
+
+    // extract moves the value out into a node of its own, and the
+    // node_type inserts move it back in. A node_type insert_unique that
+    // finds the key already present leaves the value in nh.
+    node_type extract(iterator position);
+    node_type extract(const key_type& x);
+    pair<iterator, bool> insert_unique(node_type&& nh);
+    iterator insert_equal(node_type&& nh);
+    // Moves the values of t into this tree; merge_unique leaves behind
+    // those whose keys are already here.
+    void merge_unique(btree<Key, Value, KeyOfValue, Compare, Alloc>& t);
+    void merge_equal(btree<Key, Value, KeyOfValue, Compare, Alloc>& t);
+
+    void clear() {
+        if (root != nullptr) {
+            __destroy(root);
+            root = nullptr;
+            leftmost = nullptr;
+            rightmost = nullptr;
+            node_count = 0;
+        }
+    }
+
+    iterator find(const key_type& x);
+    const_iterator find(const key_type& x) const;
+    size_type count(const key_type& x) const;
+    iterator lower_bound(const key_type& x);
+    const_iterator lower_bound(const key_type& x) const;
+    iterator upper_bound(const key_type& x);
+    const_iterator upper_bound(const key_type& x) const;
+    pair<iterator, iterator> equal_range(const key_type& x);
+    pair<const_iterator, const_iterator> equal_range(const key_type& x) const;
+
+    bool __btree_verify() const;
+
+protected:
+    node_ptr root;
+    node_ptr leftmost;
+    node_ptr rightmost;
+    size_type node_count;
+    Compare key_compare;
+
+    static const key_type& key(const node* x, int i) {
+        return KeyOfValue()(*x->value(i));
+    }
+
+    node_ptr new_node(bool leaf) {
+        node_ptr x;
+        if (leaf) {
+            x = leaf_allocator::allocate(this->get_alloc());
+        } else {
+            internal_node* y = internal_allocator::allocate(this->get_alloc());
+            for (int i = 0; i <= max_values; ++i) {
+                y->children[i] = nullptr;
+            }
+            x = y;
+        }
+        x->parent = nullptr;
+        x->position = 0;
+        x->count = 0;
+        x->leaf = leaf;
+        return x;
+    }
+
+    void delete_node(node_ptr x) {
+        if (x->leaf) {
+            leaf_allocator::deallocate(this->get_alloc(), x);
+        } else {
+            internal_allocator::deallocate(this->get_alloc(),
+                                           static_cast<internal_node*>(x));
+        }
+    }
+
+private:
+    enum {
+        trivially_relocatable = std::is_same<
+            typename __relocate_traits<Value>::is_trivially_relocatable,
+            __true_type>::value
+    };
+
+    // Arithmetic keys under the standard orders are found by counting the
+    // smaller values of a node in one pass without early exit, which the
+    // compiler can vectorize; other keys are found by binary search.
+    enum {
+        linear_search = std::is_arithmetic<Key>::value &&
+            (std::is_same<Compare, std::less<Key> >::value ||
+             std::is_same<Compare, std::greater<Key> >::value)
+    };
+
+    int lower_index(const node* x, const key_type& k) const {
+        return lower_index(x, k, typename __bool_type<linear_search>::type());
+    }
+    int upper_index(const node* x, const key_type& k) const {
+        return upper_index(x, k, typename __bool_type<linear_search>::type());
+    }
+    int lower_index(const node* x, const key_type& k, __true_type) const {
+        int i = 0;
+        for (int j = 0; j < x->count; ++j) {
+            i += key_compare(key(x, j), k);
+        }
+        return i;
+    }
+    int upper_index(const node* x, const key_type& k, __true_type) const {
+        int i = 0;
+        for (int j = 0; j < x->count; ++j) {
+            i += !key_compare(k, key(x, j));
+        }
+        return i;
+    }
+    int lower_index(const node* x, const key_type& k, __false_type) const {
+        int first = 0;
+        int len = x->count;
+        while (len > 0) {
+            const int half = len / 2;
+            if (key_compare(key(x, first + half), k)) {
+                first += half + 1;
+                len -= half + 1;
+            } else {
+                len = half;
+            }
+        }
+        return first;
+    }
+    int upper_index(const node* x, const key_type& k, __false_type) const {
+        int first = 0;
+        int len = x->count;
+        while (len > 0) {
+            const int half = len / 2;
+            if (key_compare(k, key(x, first + half))) {
+                len = half;
+            } else {
+                first += half + 1;
+                len -= half + 1;
+            }
+        }
+        return first;
+    }
+
+    // Moves n values from src to dst, which may overlap, leaving src raw.
+    static void relocate(Value* dst, Value* src, int n) {
+        relocate(dst, src, n, typename __bool_type<trivially_relocatable>::type());
+    }
+    static void relocate(Value* dst, Value* src, int n, __true_type) {
+        if (n > 0) {
+            memmove((void*)dst, (const void*)src, n * sizeof(Value));
+        }
+    }
+    static void relocate(Value* dst, Value* src, int n, __false_type) {
+        if (dst < src) {
+            for (int i = 0; i < n; ++i) {
+                forgedstl::construct(dst + i, std::move(src[i]));
+                forgedstl::destroy(src + i);
+            }
+        } else {
+            for (int i = n; i-- > 0; ) {
+                forgedstl::construct(dst + i, std::move(src[i]));
+                forgedstl::destroy(src + i);
+            }
+        }
+    }
+
+    template <typename Arg>
+    pair<iterator, bool> __insert_unique(Arg&& v);
+    template <typename Arg>
+    iterator __insert_equal(Arg&& v);
+    template <typename Arg>
+    iterator __insert_unique(iterator position, Arg&& v);
+    template <typename Arg>
+    iterator __insert_equal(iterator position, Arg&& v);
+
+    template <typename Arg>
+    iterator __insert(node_ptr x, int i, Arg&& v);
+    void __split(node_ptr& x, int& i);
+    void __erase(node_ptr x, int i);
+    void __rebalance(node_ptr x);
+    void __merge(node_ptr left, int i);
+    void __shift_left(node_ptr x);
+    void __shift_right(node_ptr x);
+    node_ptr __copy(const node* x, node_ptr parent, int position);
+    void __destroy(node_ptr x);
+    bool __verify(const node* x, int depth, int& leaf_depth,
+                  size_type& values) const;
+
+    node_ptr root_leaf() {
+        if (root == nullptr) {
+            root = new_node(true);
+            leftmost = root;
+            rightmost = root;
+        }
+        return root;
+    }
+    void update_ends() {
+        leftmost = root;
+        rightmost = root;
+        if (root != nullptr) {
+            while (!leftmost->leaf) {
+                leftmost = leftmost->child(0);
+            }
+            while (!rightmost->leaf) {
+                rightmost = rightmost->child(rightmost->count);
+            }
+        }
+    }
+
+    // Moves all of x's nodes into this tree, which must be empty.
+    void __take_nodes(btree<Key, Value, KeyOfValue, Compare, Alloc>& x) {
+        root = x.root;
+        leftmost = x.leftmost;
+        rightmost = x.rightmost;
+        node_count = x.node_count;
+        x.root = nullptr;
+        x.leftmost = nullptr;
+        x.rightmost = nullptr;
+        x.node_count = 0;
+    }
+    void __move_assign(btree<Key, Value, KeyOfValue, Compare, Alloc>& x,
+                       __true_type) {
+        this->get_alloc() = x.get_alloc();
+        key_compare = x.key_compare;
+        __take_nodes(x);
+    }
+    void __move_assign(btree<Key, Value, KeyOfValue, Compare, Alloc>& x,
+                       __false_type) {
+        if (__alloc_equal(this->get_alloc(), x.get_alloc())) {
+            __move_assign(x, __true_type());
+        } else {
+            // x's nodes cannot change hands, only their values can
+            key_compare = x.key_compare;
+            for (iterator it = x.begin(); it != x.end(); ++it) {
+                __insert_equal(end(), std::move(*it));
+            }
+            x.clear();
+        }
+    }
+};
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+inline bool operator==(const btree<Key, Value, KeyOfValue, Compare, Alloc>& x,
+                       const btree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+    return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+inline bool operator<(const btree<Key, Value, KeyOfValue, Compare, Alloc>& x,
+    const btree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+    return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+inline void swap(btree<Key, Value, KeyOfValue, Compare, Alloc>& x,
+                 btree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+    x.swap(y);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+btree<Key, Value, KeyOfValue, Compare, Alloc>&
+btree<Key, Value, KeyOfValue, Compare, Alloc>::
+operator=(const btree<Key, Value, KeyOfValue, Compare, Alloc>& x) {
+    if (this != &x) {
+        clear();
+        if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+            this->get_alloc() = x.get_alloc();
+        }
+        key_compare = x.key_compare;
+        if (x.root != nullptr) {
+            root = __copy(x.root, nullptr, 0);
+            node_count = x.node_count;
+            update_ends();
+        }
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Arg>
+pair<typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator, bool>
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_unique(Arg&& v) {
+    const key_type& k = KeyOfValue()(v);
+    node_ptr x = root_leaf();
+    for (;;) {
+        const int i = lower_index(x, k);
+        if (i < x->count && !key_compare(k, key(x, i))) {
+            return pair<iterator, bool>(iterator(x, i), false);
+        }
+        if (x->leaf) {
+            return pair<iterator, bool>(__insert(x, i, std::forward<Arg>(v)),
+                                        true);
+        }
+        x = x->child(i);
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Arg>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_equal(Arg&& v) {
+    const key_type& k = KeyOfValue()(v);
+    node_ptr x = root_leaf();
+    for (;;) {
+        const int i = upper_index(x, k);
+        if (x->leaf) {
+            return __insert(x, i, std::forward<Arg>(v));
+        }
+        x = x->child(i);
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Arg>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_unique(iterator position, Arg&& v) {
+    if (position == end() && node_count != 0 &&
+        key_compare(key(rightmost, rightmost->count - 1), KeyOfValue()(v))) {
+        return __insert(rightmost, rightmost->count, std::forward<Arg>(v));
+    }
+    return __insert_unique(std::forward<Arg>(v)).first;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Arg>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert_equal(iterator position, Arg&& v) {
+    if (position == end() && node_count != 0 &&
+        !key_compare(KeyOfValue()(v), key(rightmost, rightmost->count - 1))) {
+        return __insert(rightmost, rightmost->count, std::forward<Arg>(v));
+    }
+    return __insert_equal(std::forward<Arg>(v));
+}
+
+// Puts v at slot i of leaf x, splitting the full nodes on the way up.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Arg>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__insert(node_ptr x, int i, Arg&& v) {
+    if (x->count == max_values) {
+        __split(x, i);
+    }
+    relocate(x->value(i + 1), x->value(i), x->count - i);
+    try {
+        forgedstl::construct(x->value(i), std::forward<Arg>(v));
+    } catch (...) {
+        relocate(x->value(i), x->value(i + 1), x->count - i);
+        if (node_count == 0) {
+            delete_node(root);
+            root = nullptr;
+            leftmost = nullptr;
+            rightmost = nullptr;
+        }
+        throw;
+    }
+    ++x->count;
+    ++node_count;
+    return iterator(x, i);
+}
+
+// Splits the full node x around its middle value, which moves up into the
+// parent, and leaves (x, i) naming the same gap in whichever half holds it
+// now. A gap at the very end keeps the left half full, so that ascending
+// input packs its leaves.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__split(node_ptr& x, int& i) {
+    node_ptr sibling = new_node(x->leaf);
+    node_ptr parent = x->parent;
+    try {
+        if (parent == nullptr) {
+            parent = new_node(false);
+            parent->set_child(0, x);
+            root = parent;
+        } else if (parent->count == max_values) {
+            int j = x->position;
+            __split(parent, j);
+            parent = x->parent;
+        }
+    } catch (...) {
+        delete_node(sibling);
+        throw;
+    }
+
+    const int mid = i == max_values ? max_values - 1 : max_values / 2;
+    const int moved = max_values - mid - 1;
+    relocate(sibling->value(0), x->value(mid + 1), moved);
+    if (!x->leaf) {
+        for (int j = 0; j <= moved; ++j) {
+            sibling->set_child(j, x->child(mid + 1 + j));
+        }
+    }
+    sibling->count = (unsigned short)moved;
+    x->count = (unsigned short)mid;
+
+    const int at = x->position;
+    relocate(parent->value(at + 1), parent->value(at), parent->count - at);
+    relocate(parent->value(at), x->value(mid), 1);
+    for (int j = parent->count; j > at; --j) {
+        parent->set_child(j + 1, parent->child(j));
+    }
+    parent->set_child(at + 1, sibling);
+    ++parent->count;
+
+    if (i > mid) {
+        x = sibling;
+        i -= mid + 1;
+    }
+    update_ends();
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename InputIterator>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(InputIterator first, InputIterator last) {
+    for (; first != last; ++first) {
+        __insert_unique(end(), *first);
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename InputIterator>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(InputIterator first, InputIterator last) {
+    for (; first != last; ++first) {
+        __insert_equal(end(), *first);
+    }
+}
+
+// Erasing from an internal node takes the predecessor up from its leaf,
+// so that values only ever leave leaves.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__erase(node_ptr x, int i) {
+    forgedstl::destroy(x->value(i));
+    if (x->leaf) {
+        relocate(x->value(i), x->value(i + 1), x->count - i - 1);
+    } else {
+        node_ptr y = x->child(i);
+        while (!y->leaf) {
+            y = y->child(y->count);
+        }
+        relocate(x->value(i), y->value(y->count - 1), 1);
+        x = y;
+    }
+    --x->count;
+    --node_count;
+    __rebalance(x);
+}
+
+// Refills x after an erase left it less than half full, by merging it
+// with a sibling when the two fit in one node and by taking values from
+// the fuller sibling otherwise. A merge takes a value from the parent,
+// which may need refilling in turn.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__rebalance(node_ptr x) {
+    bool merged = false;
+    while (x != root && x->count < min_values) {
+        node_ptr parent = x->parent;
+        const int at = x->position;
+        node_ptr left = at > 0 ? parent->child(at - 1) : nullptr;
+        node_ptr right = at < parent->count ? parent->child(at + 1) : nullptr;
+        if (left != nullptr && left->count + x->count < max_values) {
+            __merge(left, at - 1);
+        } else if (right != nullptr && x->count + right->count < max_values) {
+            __merge(x, at);
+        } else {
+            if (left != nullptr) {
+                __shift_right(x);
+            } else {
+                __shift_left(x);
+            }
+            break;
+        }
+        merged = true;
+        x = parent;
+    }
+    if (root->count == 0) {
+        node_ptr old = root;
+        if (root->leaf) {
+            root = nullptr;
+        } else {
+            root = root->child(0);
+            root->parent = nullptr;
+            root->position = 0;
+        }
+        delete_node(old);
+        merged = true;
+    }
+    if (merged) {
+        update_ends();
+    }
+}
+
+// Moves the separator i of left's parent and all of the right sibling into
+// left, and frees the sibling.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__merge(node_ptr left, int i) {
+    node_ptr parent = left->parent;
+    node_ptr right = parent->child(i + 1);
+    relocate(left->value(left->count), parent->value(i), 1);
+    relocate(left->value(left->count + 1), right->value(0), right->count);
+    if (!left->leaf) {
+        for (int j = 0; j <= right->count; ++j) {
+            left->set_child(left->count + 1 + j, right->child(j));
+        }
+    }
+    left->count += right->count + 1;
+
+    relocate(parent->value(i), parent->value(i + 1), parent->count - i - 1);
+    for (int j = i + 1; j < parent->count; ++j) {
+        parent->set_child(j, parent->child(j + 1));
+    }
+    --parent->count;
+    delete_node(right);
+}
+
+// Evens out x and its left sibling by rotating values right through their
+// separator.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__shift_right(node_ptr x) {
+    node_ptr parent = x->parent;
+    const int s = x->position - 1;
+    node_ptr left = parent->child(s);
+    const int n = (left->count - x->count + 1) / 2;
+
+    relocate(x->value(n), x->value(0), x->count);
+    if (!x->leaf) {
+        for (int j = x->count; j >= 0; --j) {
+            x->set_child(j + n, x->child(j));
+        }
+    }
+    relocate(x->value(n - 1), parent->value(s), 1);
+    relocate(x->value(0), left->value(left->count - n + 1), n - 1);
+    relocate(parent->value(s), left->value(left->count - n), 1);
+    if (!x->leaf) {
+        for (int j = 0; j < n; ++j) {
+            x->set_child(j, left->child(left->count - n + 1 + j));
+        }
+    }
+    left->count -= n;
+    x->count += n;
+}
+
+// Evens out x and its right sibling by rotating values left through their
+// separator.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__shift_left(node_ptr x) {
+    node_ptr parent = x->parent;
+    const int s = x->position;
+    node_ptr right = parent->child(s + 1);
+    const int n = (right->count - x->count + 1) / 2;
+
+    relocate(x->value(x->count), parent->value(s), 1);
+    relocate(x->value(x->count + 1), right->value(0), n - 1);
+    relocate(parent->value(s), right->value(n - 1), 1);
+    if (!x->leaf) {
+        for (int j = 0; j < n; ++j) {
+            x->set_child(x->count + 1 + j, right->child(j));
+        }
+    }
+    relocate(right->value(0), right->value(n), right->count - n);
+    if (!right->leaf) {
+        for (int j = 0; j <= right->count - n; ++j) {
+            right->set_child(j, right->child(j + n));
+        }
+    }
+    right->count -= n;
+    x->count += n;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
+btree<Key, Value, KeyOfValue, Compare, Alloc>::erase(const key_type& x) {
+    pair<iterator, iterator> p = equal_range(x);
+    size_type n = 0;
+    distance(p.first, p.second, n);
+    erase(p.first, p.second);
+    return n;
+}
+
+// Every erase may move the values after it, so the end of the range is
+// kept as a count rather than an iterator, and the next value is found
+// again after each erase: in place when the erase stayed within one leaf,
+// and otherwise by its key and its rank among the values with that key.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator first, iterator last) {
+    if (first == begin() && last == end()) {
+        clear();
+        return;
+    }
+    size_type n = 0;
+    distance(first, last, n);
+    for (; n > 0; --n) {
+        node_ptr x = first.node;
+        const int i = first.position;
+        if (n == 1) {
+            __erase(x, i);
+            break;
+        }
+        if (x->leaf && (x == root || x->count > min_values)) {
+            iterator next = first;
+            if (i == x->count - 1) {
+                ++next;
+            }
+            __erase(x, i);
+            first = next;
+            continue;
+        }
+        iterator next = first;
+        ++next;
+        const key_type k = KeyOfValue()(*next);
+        size_type rank = 0;
+        for (iterator it = next; it != begin(); ) {
+            --it;
+            if (it == first) {
+                continue;
+            }
+            if (key_compare(KeyOfValue()(*it), k)) {
+                break;
+            }
+            ++rank;
+        }
+        __erase(x, i);
+        first = lower_bound(k);
+        forgedstl::advance(first, rank);
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::node_type
+btree<Key, Value, KeyOfValue, Compare, Alloc>::extract(iterator position) {
+    extracted_node* p = extracted_allocator::allocate(this->get_alloc());
+    try {
+        forgedstl::construct(&p->val, std::move(*position));
+    } catch (...) {
+        extracted_allocator::deallocate(this->get_alloc(), p);
+        throw;
+    }
+    erase(position);
+    return node_type(p, this->get_alloc());
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::node_type
+btree<Key, Value, KeyOfValue, Compare, Alloc>::extract(const key_type& x) {
+    iterator position = find(x);
+    return position == end() ? node_type() : extract(position);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+pair<typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator, bool>
+btree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(node_type&& nh) {
+    if (nh.empty()) {
+        return pair<iterator, bool>(end(), false);
+    }
+    pair<iterator, bool> result = __insert_unique(std::move(nh.value()));
+    if (result.second) {
+        nh = node_type();
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(node_type&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    iterator result = __insert_equal(std::move(nh.value()));
+    nh = node_type();
+    return result;
+}
+
+// The values left behind are gathered into a new tree for t, since
+// erasing from t while walking it would move the values not yet seen.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::merge_unique(
+    btree<Key, Value, KeyOfValue, Compare, Alloc>& t) {
+    if (&t == this) {
+        return;
+    }
+    btree<Key, Value, KeyOfValue, Compare, Alloc> kept(t.key_compare,
+                                                       t.get_alloc());
+    for (iterator it = t.begin(); it != t.end(); ++it) {
+        if (!__insert_unique(std::move(*it)).second) {
+            kept.__insert_equal(kept.end(), std::move(*it));
+        }
+    }
+    t.clear();
+    t.__take_nodes(kept);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::merge_equal(
+    btree<Key, Value, KeyOfValue, Compare, Alloc>& t) {
+    if (&t == this) {
+        return;
+    }
+    for (iterator it = t.begin(); it != t.end(); ++it) {
+        __insert_equal(std::move(*it));
+    }
+    t.clear();
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) {
+    iterator j = lower_bound(k);
+    return (j == end() || key_compare(k, KeyOfValue()(*j))) ? end() : j;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) const {
+    const_iterator j = lower_bound(k);
+    return (j == end() || key_compare(k, KeyOfValue()(*j))) ? end() : j;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
+btree<Key, Value, KeyOfValue, Compare, Alloc>::count(const key_type& k) const {
+    pair<const_iterator, const_iterator> p = equal_range(k);
+    size_type n = 0;
+    distance(p.first, p.second, n);
+    return n;
+}
+
+// The last node on the search path with a value not less than k holds the
+// answer; below it every value is less.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k) {
+    iterator result = end();
+    for (node_ptr x = root; x != nullptr; ) {
+        const int i = lower_index(x, k);
+        if (i < x->count) {
+            result = iterator(x, i);
+        }
+        x = x->leaf ? nullptr : x->child(i);
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k) const {
+    const_iterator result = end();
+    for (node_ptr x = root; x != nullptr; ) {
+        const int i = lower_index(x, k);
+        if (i < x->count) {
+            result = const_iterator(x, i);
+        }
+        x = x->leaf ? nullptr : x->child(i);
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k) {
+    iterator result = end();
+    for (node_ptr x = root; x != nullptr; ) {
+        const int i = upper_index(x, k);
+        if (i < x->count) {
+            result = iterator(x, i);
+        }
+        x = x->leaf ? nullptr : x->child(i);
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
+btree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k) const {
+    const_iterator result = end();
+    for (node_ptr x = root; x != nullptr; ) {
+        const int i = upper_index(x, k);
+        if (i < x->count) {
+            result = const_iterator(x, i);
+        }
+        x = x->leaf ? nullptr : x->child(i);
+    }
+    return result;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+inline pair<typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator,
+            typename btree<Key, Value, KeyOfValue, Compare, Alloc>::iterator>
+btree<Key, Value, KeyOfValue, Compare, Alloc>::equal_range(const key_type& k) {
+    return pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+inline pair<typename btree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator,
+            typename btree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator>
+btree<Key, Value, KeyOfValue, Compare, Alloc>::equal_range(const key_type& k) const {
+    return pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
+}
+
+// Copies the subtree x under parent. A copy that throws frees what it has
+// built; the children not yet copied are still null.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+typename btree<Key, Value, KeyOfValue, Compare, Alloc>::node_ptr
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__copy(const node* x, node_ptr parent, int position) {
+    node_ptr top = new_node(x->leaf);
+    top->parent = parent;
+    top->position = (unsigned short)position;
+    try {
+        for (int i = 0; i < x->count; ++i) {
+            if (!x->leaf) {
+                static_cast<internal_node*>(top)->children[i] =
+                    __copy(x->child(i), top, i);
+            }
+            forgedstl::construct(top->value(i), *x->value(i));
+            ++top->count;
+        }
+        if (!x->leaf) {
+            static_cast<internal_node*>(top)->children[x->count] =
+                __copy(x->child(x->count), top, x->count);
+        }
+    } catch (...) {
+        __destroy(top);
+        throw;
+    }
+    return top;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+void btree<Key, Value, KeyOfValue, Compare, Alloc>::__destroy(node_ptr x) {
+    if (!x->leaf) {
+        for (int i = 0; i <= x->count; ++i) {
+            if (x->child(i) != nullptr) {
+                __destroy(x->child(i));
+            }
+        }
+    }
+    forgedstl::destroy(x->value(0), x->value(x->count));
+    delete_node(x);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+bool
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__verify(const node* x, int depth, int& leaf_depth, size_type& values) const {
+    if (x->count > max_values || (x != root && x->count == 0)) {
+        return false;
+    }
+    for (int i = 1; i < x->count; ++i) {
+        if (key_compare(key(x, i), key(x, i - 1))) {
+            return false;
+        }
+    }
+    values += x->count;
+    if (x->leaf) {
+        if (leaf_depth < 0) {
+            leaf_depth = depth;
+        }
+        return leaf_depth == depth;
+    }
+    for (int i = 0; i <= x->count; ++i) {
+        const node* y = x->child(i);
+        if (y == nullptr || y->parent != x || y->position != i) {
+            return false;
+        }
+        // the child lies between the separators around it
+        if (i > 0 && key_compare(key(y, 0), key(x, i - 1))) {
+            return false;
+        }
+        if (i < x->count && key_compare(key(x, i), key(y, y->count - 1))) {
+            return false;
+        }
+        if (!__verify(y, depth + 1, leaf_depth, values)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+bool
+btree<Key, Value, KeyOfValue, Compare, Alloc>::__btree_verify() const {
+    if (root == nullptr) {
+        return node_count == 0 && leftmost == nullptr && rightmost == nullptr;
+    }
+    if (root->parent != nullptr || root->count == 0) {
+        return false;
+    }
+    int leaf_depth = -1;
+    size_type values = 0;
+    if (!__verify(root, 0, leaf_depth, values) || values != node_count) {
+        return false;
+    }
+
+    const node* x = root;
+    while (!x->leaf) {
+        x = x->child(0);
+    }
+    if (leftmost != x) {
+        return false;
+    }
+    x = root;
+    while (!x->leaf) {
+        x = x->child(x->count);
+    }
+    return rightmost == x;
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_BTREE_H_
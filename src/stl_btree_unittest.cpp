@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include "stl_btree.h"
+#include "stl_function.h"
+#include "stl_map.h"
+#include "stl_multimap.h"
+#include "stl_multiset.h"
+#include "stl_set.h"
+#include "stl_tree.h"
+#include "test_alloc.h"
+
+namespace forgedstl {
+
+typedef btree<int, int, identity<int>, std::less<int> > int_btree;
+
+static unsigned next_random(unsigned& x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+TEST(BTreeTest, Basic) {
+    int_btree t;
+    EXPECT_TRUE(t.empty());
+    EXPECT_TRUE(t.begin() == t.end());
+    EXPECT_TRUE(t.find(1) == t.end());
+    EXPECT_TRUE(t.__btree_verify());
+
+    unsigned x = 2463534242u;
+    std::set<int> expected;
+    for (int i = 0; i < 20000; ++i) {
+        const int v = int(next_random(x) % 50000);
+        EXPECT_EQ(expected.insert(v).second, t.insert_unique(v).second);
+    }
+    ASSERT_EQ(expected.size(), t.size());
+    ASSERT_TRUE(t.__btree_verify());
+
+    std::set<int>::const_iterator e = expected.begin();
+    for (int_btree::const_iterator it = t.begin(); it != t.end(); ++it, ++e) {
+        ASSERT_EQ(*e, *it);
+    }
+    int_btree::reverse_iterator rit = t.rbegin();
+    for (std::set<int>::const_reverse_iterator re = expected.rbegin();
+         re != expected.rend(); ++re, ++rit) {
+        ASSERT_EQ(*re, *rit);
+    }
+    EXPECT_TRUE(rit.base() == t.begin());
+
+    for (int k = -1; k <= 50001; ++k) {
+        const bool present = expected.count(k) != 0;
+        ASSERT_EQ(present, t.find(k) != t.end());
+        ASSERT_EQ(present ? 1u : 0u, t.count(k));
+        std::set<int>::const_iterator lb = expected.lower_bound(k);
+        int_btree::iterator tlb = t.lower_bound(k);
+        ASSERT_EQ(lb == expected.end(), tlb == t.end());
+        if (lb != expected.end()) {
+            ASSERT_EQ(*lb, *tlb);
+        }
+        std::set<int>::const_iterator ub = expected.upper_bound(k);
+        int_btree::iterator tub = t.upper_bound(k);
+        ASSERT_EQ(ub == expected.end(), tub == t.end());
+        if (ub != expected.end()) {
+            ASSERT_EQ(*ub, *tub);
+        }
+    }
+
+    // ascending input goes straight onto the rightmost leaf, which splits
+    // with its left half full
+    int_btree sorted;
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(i, *sorted.insert_unique(sorted.end(), i));
+    }
+    EXPECT_EQ(10000, sorted.size());
+    EXPECT_TRUE(sorted.__btree_verify());
+    EXPECT_EQ(9999, *sorted.rbegin());
+    EXPECT_EQ(5000, *sorted.insert_unique(sorted.end(), 5000));
+    EXPECT_EQ(10000, sorted.size());
+
+    btree<int, int, identity<int>, std::greater<int> > descending;
+    for (int i = 0; i < 1000; ++i) {
+        descending.insert_equal(i % 100);
+    }
+    EXPECT_EQ(99, *descending.begin());
+    EXPECT_EQ(10, descending.count(42));
+    EXPECT_EQ(10, descending.erase(42));
+    EXPECT_TRUE(descending.__btree_verify());
+}
+
+// Random inserts and erases of every kind against std::multiset, with
+// int values, which are memmoved and searched linearly, and with strings,
+// which are moved one by one and searched by bisection in small nodes.
+template <typename Tree, typename MakeValue>
+void check_against_multiset(MakeValue make) {
+    typedef typename Tree::value_type value_type;
+    Tree t;
+    std::multiset<value_type> expected;
+    unsigned x = 88172645u;
+    for (int round = 0; round < 20000; ++round) {
+        const unsigned r = next_random(x);
+        const value_type v = make(r / 8 % 2000);
+        switch (r % 8) {
+        case 0: case 1: case 2:
+            t.insert_equal(v);
+            expected.insert(v);
+            break;
+        case 3: {
+            const bool fresh = expected.count(v) == 0;
+            ASSERT_EQ(fresh, t.insert_unique(v).second);
+            if (fresh) {
+                expected.insert(v);
+            }
+            break;
+        }
+        case 4:
+            ASSERT_EQ(expected.erase(v), t.erase(v));
+            break;
+        case 5:
+            if (t.find(v) != t.end()) {
+                t.erase(t.find(v));
+                expected.erase(expected.find(v));
+            }
+            break;
+        case 6: {
+            // a range of up to 40 values from v
+            typename Tree::iterator first = t.lower_bound(v);
+            typename Tree::iterator last = first;
+            typename std::multiset<value_type>::iterator efirst =
+                expected.lower_bound(v);
+            typename std::multiset<value_type>::iterator elast = efirst;
+            for (unsigned n = r / 16384 % 40; n > 0 && last != t.end(); --n) {
+                ++last;
+                ++elast;
+            }
+            t.erase(first, last);
+            expected.erase(efirst, elast);
+            break;
+        }
+        default:
+            ASSERT_EQ(expected.count(v), t.count(v));
+            break;
+        }
+        if (round % 500 == 0) {
+            ASSERT_TRUE(t.__btree_verify());
+            ASSERT_EQ(expected.size(), t.size());
+            ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                                   t.begin()));
+        }
+    }
+    ASSERT_TRUE(t.__btree_verify());
+    ASSERT_EQ(expected.size(), t.size());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), t.begin()));
+
+    while (!t.empty()) {
+        t.erase(t.begin());
+        expected.erase(expected.begin());
+        if (t.size() % 97 == 0) {
+            ASSERT_TRUE(t.__btree_verify());
+        }
+    }
+    EXPECT_TRUE(t.__btree_verify());
+    EXPECT_TRUE(t.begin() == t.end());
+}
+
+static int make_int(unsigned k) {
+    return int(k);
+}
+
+static std::string make_string(unsigned k) {
+    std::string s = std::to_string(k);
+    return std::string(6 - s.size(), '0') + s;
+}
+
+TEST(BTreeTest, InsertAndErase) {
+    check_against_multiset<int_btree>(make_int);
+    check_against_multiset<btree<std::string, std::string,
+                                 identity<std::string>,
+                                 std::less<std::string> > >(make_string);
+
+    int_btree t;
+    for (int i = 0; i < 5000; ++i) {
+        t.insert_equal(i / 3);
+    }
+    // the whole tree, then ranges crossing leaves and internal nodes
+    int_btree u(t);
+    u.erase(u.begin(), u.end());
+    EXPECT_TRUE(u.empty());
+    EXPECT_TRUE(u.__btree_verify());
+    t.erase(t.lower_bound(100), t.upper_bound(1400));
+    EXPECT_EQ(5000 - 1301 * 3, t.size());
+    EXPECT_TRUE(t.__btree_verify());
+    EXPECT_EQ(99, *--t.lower_bound(1401));
+    EXPECT_EQ(0, t.count(700));
+}
+
+TEST(BTreeTest, CopyMoveAndSwap) {
+    typedef btree<int, int, identity<int>, std::less<int>,
+                  stateful_alloc> Tree;
+    EXPECT_TRUE(std::is_nothrow_move_constructible<Tree>::value);
+
+    test_pool p1, p2;
+    {
+        const std::less<int> less;
+        Tree t1(less, stateful_alloc(&p1));
+        for (int i = 0; i < 3000; ++i) {
+            t1.insert_unique(i * 7 % 3000);
+        }
+        // nodes hold about 60 ints each, where an rb_tree spends a node
+        // of 40 bytes on every one
+        EXPECT_LT(p1.bytes_in_use, 3000 * 40 / 4);
+
+        Tree t2(t1);
+        EXPECT_TRUE(t1 == t2);
+        EXPECT_TRUE(t2.__btree_verify());
+        t2.erase(0);
+        EXPECT_TRUE(t1 < t2);
+
+        Tree t3(std::move(t2));
+        EXPECT_TRUE(t2.empty());
+        EXPECT_TRUE(t2.begin() == t2.end());
+        EXPECT_EQ(2999, t3.size());
+        t2.insert_unique(5);
+        EXPECT_TRUE(t2.__btree_verify());
+
+        Tree t4(less, stateful_alloc(&p2));
+        t4 = t3;
+        EXPECT_EQ(2999, t4.size());
+        EXPECT_TRUE(t4.__btree_verify());
+        // the pools differ, so the values move across
+        t4 = std::move(t1);
+        EXPECT_TRUE(t1.empty());
+        EXPECT_EQ(3000, t4.size());
+        EXPECT_TRUE(t4.__btree_verify());
+
+        t4.swap(t2);
+        EXPECT_EQ(1, t4.size());
+        EXPECT_EQ(3000, t2.size());
+        EXPECT_TRUE(t2.__btree_verify());
+        t2.clear();
+        EXPECT_TRUE(t2.__btree_verify());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+TEST(BTreeTest, ExtractAndMerge) {
+    typedef btree<int, int, identity<int>, std::less<int>,
+                  stateful_alloc> Tree;
+    test_pool p1;
+    {
+        const std::less<int> less;
+        Tree t1(less, stateful_alloc(&p1));
+        Tree t2(less, stateful_alloc(&p1));
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        for (int i = 50; i < 150; ++i) {
+            t2.insert_unique(i);
+        }
+
+        Tree::node_type nh = t1.extract(10);
+        ASSERT_FALSE(nh.empty());
+        EXPECT_EQ(10, nh.value());
+        EXPECT_EQ(99, t1.size());
+        EXPECT_TRUE(t1.__btree_verify());
+        EXPECT_TRUE(t1.extract(10).empty());
+
+        nh.value() = 200;
+        EXPECT_TRUE(t2.insert_unique(std::move(nh)).second);
+        EXPECT_TRUE(nh.empty());
+        nh = t2.extract(t2.find(60));
+        EXPECT_FALSE(t1.insert_unique(std::move(nh)).second);
+        EXPECT_FALSE(nh.empty());
+        t1.insert_equal(std::move(nh));
+        EXPECT_EQ(2, t1.count(60));
+        EXPECT_TRUE(t1.__btree_verify());
+
+        // t2 adds 100 to 149 and 200; 50 to 99 are in both
+        t1.merge_unique(t2);
+        EXPECT_EQ(151, t1.size());
+        EXPECT_EQ(49, t2.size());
+        EXPECT_EQ(50, *t2.begin());
+        EXPECT_TRUE(t1.__btree_verify());
+        EXPECT_TRUE(t2.__btree_verify());
+        t1.merge_equal(t2);
+        EXPECT_TRUE(t2.empty());
+        EXPECT_EQ(200, t1.size());
+        EXPECT_EQ(2, t1.count(99));
+        EXPECT_TRUE(t1.__btree_verify());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+}
+
+TEST(BTreeTest, Adapters) {
+    map<int, std::string, std::less<int>, alloc, btree> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[i] = std::to_string(i);
+    }
+    EXPECT_EQ(1000, m.size());
+    EXPECT_EQ("500", m[500]);
+    EXPECT_EQ(1, m.erase(500));
+    EXPECT_TRUE(m.find(500) == m.end());
+    EXPECT_FALSE(m.insert(pair<const int, std::string>(1, "x")).second);
+    map<int, std::string, std::less<int>, alloc, btree> m2(m);
+    EXPECT_TRUE(m == m2);
+
+    multimap<int, std::string, std::less<int>, alloc, btree> mm;
+    mm.insert(m.extract(1));
+    mm.insert(m.extract(m.begin()));
+    mm.insert(pair<const int, std::string>(1, "one"));
+    EXPECT_EQ(3, mm.size());
+    EXPECT_EQ(2, mm.count(1));
+    EXPECT_EQ(997, m.size());
+
+    set<int, std::less<int>, alloc, btree> s1, s2;
+    for (int i = 0; i < 100; ++i) {
+        s1.insert(i * 2);
+        s2.insert(i * 3);
+    }
+    s1.merge(s2);
+    EXPECT_EQ(166, s1.size());
+    EXPECT_EQ(34, s2.size());
+    s2.erase(s2.begin(), s2.end());
+    EXPECT_TRUE(s2.empty());
+
+    multiset<int, std::less<int>, alloc, btree> ms;
+    ms.insert(s1.extract(s1.begin()));
+    ms.insert(0);
+    ms.insert(s1.begin(), s1.end());
+    EXPECT_EQ(2, ms.count(0));
+    EXPECT_EQ(167, ms.size());
+    multiset<int, std::less<int>, alloc, btree> sorted(sorted_equal,
+                                                       ms.begin(), ms.end());
+    EXPECT_TRUE(std::equal(ms.begin(), ms.end(), sorted.begin()));
+}
+
+// Lookups and a full scan of one million ints, and the memory each tree
+// holds. Run with --gtest_also_run_disabled_tests.
+TEST(BTreeTest, DISABLED_Benchmark) {
+    typedef rb_tree<int, int, identity<int>, std::less<int>,
+                    stateful_alloc> rb_int_tree;
+    typedef btree<int, int, identity<int>, std::less<int>,
+                  stateful_alloc> b_int_tree;
+    const int n = 1 << 20;
+    const std::less<int> less;
+    test_pool rb_pool, b_pool;
+    rb_int_tree rb(less, stateful_alloc(&rb_pool));
+    b_int_tree b(less, stateful_alloc(&b_pool));
+    unsigned x = 2463534242u;
+    for (int i = 0; i < n; ++i) {
+        const int v = int(next_random(x));
+        rb.insert_unique(v);
+        b.insert_unique(v);
+    }
+
+    double seconds[2][2];
+    long long sink = 0;
+    for (int which = 0; which < 2; ++which) {
+        unsigned y = 88172645u;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+            const int k = int(next_random(y));
+            sink += which == 0 ? rb.count(k) : b.count(k);
+        }
+        seconds[which][0] = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        if (which == 0) {
+            for (rb_int_tree::const_iterator it = rb.begin(); it != rb.end();
+                 ++it) {
+                sink += *it;
+            }
+        } else {
+            for (b_int_tree::const_iterator it = b.begin(); it != b.end();
+                 ++it) {
+                sink += *it;
+            }
+        }
+        seconds[which][1] = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    std::cout << "rb_tree: " << n / seconds[0][0] / 1e6 << " M lookups/s, "
+              << rb.size() / seconds[0][1] / 1e6 << " M scanned/s, "
+              << double(rb_pool.bytes_in_use) / rb.size() << " bytes/value\n"
+              << "btree:   " << n / seconds[1][0] / 1e6 << " M lookups/s, "
+              << b.size() / seconds[1][1] / 1e6 << " M scanned/s, "
+              << double(b_pool.bytes_in_use) / b.size() << " bytes/value"
+              << " (" << sink % 2 << ")" << std::endl;
+}
+
+} // namespace forgedstl
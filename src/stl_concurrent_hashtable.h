@@ -0,0 +1,278 @@
+#ifndef FORGED_STL_INTERNAL_CONCURRENT_HASHTABLE_H_
+#define FORGED_STL_INTERNAL_CONCURRENT_HASHTABLE_H_
+
+#include <mutex>
+#include <shared_mutex>
+
+#include "stl_alloc.h"
+#include "stl_construct.h"
+#include "stl_hashtable.h"
+
+namespace forgedstl {
+
+// A hashtable that many threads may use at once. The elements are spread
+// over a power-of-two number of segments, each an ordinary hashtable
+// behind its own reader-writer lock, so lookups share a segment with each
+// other and writes only exclude the threads that hit the same segment.
+// Every segment grows on its own, under its own lock, while the others
+// stay in use; set_incremental_rehash bounds how long one growth step
+// holds that lock.
+//
+// No reference to an element ever escapes a lock: there are no iterators,
+// and visit and cvisit run a function on the element in place, where the
+// caller copies out what it needs. An erased node can therefore be freed
+// at once, with no deferred reclamation.
+//
+// The default allocator is threaded_alloc; an allocator without locking
+// of its own is not safe to share between segments.
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey,
+          typename Alloc = threaded_alloc>
+class concurrent_hashtable : protected __alloc_holder<Alloc> {
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef HashFunc hasher;
+    typedef EqualKey key_equal;
+
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+    typedef Alloc     allocator_type;
+
+    // n is a hint for the total number of buckets; concurrency, rounded up
+    // to a power of two, is the number of segments.
+    concurrent_hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
+                         const allocator_type& a = allocator_type(),
+                         size_type concurrency = 64)
+        : base(a), hash(hf), seg_bits(0) {
+        while ((size_type(1) << seg_bits) < concurrency) {
+            ++seg_bits;
+        }
+        initialize_segments(n, hf, eql, ExtractKey());
+    }
+    concurrent_hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
+                         const ExtractKey& ext,
+                         const allocator_type& a = allocator_type(),
+                         size_type concurrency = 64)
+        : base(a), hash(hf), seg_bits(0) {
+        while ((size_type(1) << seg_bits) < concurrency) {
+            ++seg_bits;
+        }
+        initialize_segments(n, hf, eql, ext);
+    }
+
+    concurrent_hashtable(const concurrent_hashtable&) = delete;
+    concurrent_hashtable& operator=(const concurrent_hashtable&) = delete;
+
+    ~concurrent_hashtable() {
+        for (size_type i = 0; i < segment_count(); ++i) {
+            forgedstl::destroy(&segs[i]);
+        }
+        segment_allocator::deallocate(this->get_alloc(), segs,
+                                      segment_count());
+    }
+
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+    hasher hash_funct() const {
+        return hash;
+    }
+
+    size_type segment_count() const {
+        return size_type(1) << seg_bits;
+    }
+
+    // The sum over the segments, each read at a slightly different time.
+    size_type size() const {
+        size_type n = 0;
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::shared_lock<std::shared_mutex> guard(segs[i].lock);
+            n += segs[i].table.size();
+        }
+        return n;
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool insert_unique(const value_type& obj) {
+        return insert_unique_hashed(obj, hash(get_key(obj)));
+    }
+    bool insert_unique(value_type&& obj) {
+        return insert_unique_hashed(std::move(obj), hash(get_key(obj)));
+    }
+    void insert_equal(const value_type& obj) {
+        insert_equal_hashed(obj, hash(get_key(obj)));
+    }
+    void insert_equal(value_type&& obj) {
+        insert_equal_hashed(std::move(obj), hash(get_key(obj)));
+    }
+    // The value is built before any lock is taken.
+    template <typename... Args>
+    bool emplace_unique(Args&&... args) {
+        return insert_unique(value_type(std::forward<Args>(args)...));
+    }
+    template <typename... Args>
+    void emplace_equal(Args&&... args) {
+        insert_equal(value_type(std::forward<Args>(args)...));
+    }
+
+    bool contains(const key_type& key) const {
+        return count(key) != 0;
+    }
+    size_type count(const key_type& key) const {
+        const size_t h = hash(key);
+        const segment& seg = segment_of(h);
+        std::shared_lock<std::shared_mutex> guard(seg.lock);
+        return seg.table.count(key, h);
+    }
+
+    // Calls fn on the first element with key, if there is one, while
+    // holding its segment's lock: exclusively in visit, so that fn may
+    // change the non-key part of the element, and shared in cvisit. fn
+    // must not call back into this table.
+    template <typename Function>
+    bool visit(const key_type& key, Function fn) {
+        const size_t h = hash(key);
+        segment& seg = segment_of(h);
+        std::unique_lock<std::shared_mutex> guard(seg.lock);
+        if (node* n = seg.table.find_node(key, h)) {
+            fn(n->val);
+            return true;
+        }
+        return false;
+    }
+    template <typename Function>
+    bool cvisit(const key_type& key, Function fn) const {
+        const size_t h = hash(key);
+        const segment& seg = segment_of(h);
+        std::shared_lock<std::shared_mutex> guard(seg.lock);
+        if (const node* n = seg.table.find_node(key, h)) {
+            fn(static_cast<const value_type&>(n->val));
+            return true;
+        }
+        return false;
+    }
+    // Calls fn on every element, one segment at a time under its shared
+    // lock. Elements inserted or erased meanwhile may or may not be seen.
+    template <typename Function>
+    void for_each(Function fn) const {
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::shared_lock<std::shared_mutex> guard(segs[i].lock);
+            for (const_table_iterator it = segs[i].table.begin();
+                 it != segs[i].table.end(); ++it) {
+                fn(*it);
+            }
+        }
+    }
+
+    size_type erase(const key_type& key) {
+        const size_t h = hash(key);
+        segment& seg = segment_of(h);
+        std::unique_lock<std::shared_mutex> guard(seg.lock);
+        return seg.table.erase(key, h);
+    }
+    void clear() {
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::unique_lock<std::shared_mutex> guard(segs[i].lock);
+            segs[i].table.clear();
+        }
+    }
+
+    // These apply to every segment, each under its own lock; n counts
+    // elements across the whole table.
+    void reserve(size_type n) {
+        const size_type per_segment = n / segment_count() + 1;
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::unique_lock<std::shared_mutex> guard(segs[i].lock);
+            segs[i].table.reserve(per_segment);
+        }
+    }
+    void max_load_factor(float z) {
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::unique_lock<std::shared_mutex> guard(segs[i].lock);
+            segs[i].table.max_load_factor(z);
+        }
+    }
+    void set_incremental_rehash(size_type n) {
+        for (size_type i = 0; i < segment_count(); ++i) {
+            std::unique_lock<std::shared_mutex> guard(segs[i].lock);
+            segs[i].table.set_incremental_rehash(n);
+        }
+    }
+
+private:
+    typedef __alloc_holder<Alloc> base;
+    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+        table_type;
+    typedef typename table_type::node node;
+    typedef typename table_type::const_iterator const_table_iterator;
+
+    struct segment {
+        mutable std::shared_mutex lock;
+        table_type table;
+        // keeps the lock of the next segment off this one's cache lines
+        char pad[64];
+
+        segment(size_type n, const HashFunc& hf, const EqualKey& eql,
+                const ExtractKey& ext, const allocator_type& a)
+            : table(n, hf, eql, ext, a) { }
+    };
+    typedef simple_alloc<segment, Alloc> segment_allocator;
+
+    hasher hash;
+    ExtractKey get_key;
+    int seg_bits;
+    segment* segs;
+
+    void initialize_segments(size_type n, const HashFunc& hf,
+                             const EqualKey& eql, const ExtractKey& ext) {
+        get_key = ext;
+        const size_type count = segment_count();
+        segs = segment_allocator::allocate(this->get_alloc(), count);
+        size_type i = 0;
+        try {
+            for (; i < count; ++i) {
+                forgedstl::construct(&segs[i], n / count, hf, eql, ext,
+                                     this->get_alloc());
+            }
+        } catch (...) {
+            while (i > 0) {
+                forgedstl::destroy(&segs[--i]);
+            }
+            segment_allocator::deallocate(this->get_alloc(), segs, count);
+            throw;
+        }
+    }
+
+    // The top bits of a Fibonacci product, which the segment's own bucket
+    // policy, working from the low end of h, does not depend on.
+    segment& segment_of(size_t h) const {
+        if (seg_bits == 0) {
+            return segs[0];
+        }
+        return segs[((unsigned long long)h * 0x9E3779B97F4A7C15ull) >>
+                    (64 - seg_bits)];
+    }
+
+    template <typename Arg>
+    bool insert_unique_hashed(Arg&& obj, size_t h) {
+        segment& seg = segment_of(h);
+        std::unique_lock<std::shared_mutex> guard(seg.lock);
+        seg.table.resize(seg.table.size() + 1);
+        return seg.table.__insert_unique_noresize(std::forward<Arg>(obj),
+                                                  h).second;
+    }
+    template <typename Arg>
+    void insert_equal_hashed(Arg&& obj, size_t h) {
+        segment& seg = segment_of(h);
+        std::unique_lock<std::shared_mutex> guard(seg.lock);
+        seg.table.resize(seg.table.size() + 1);
+        seg.table.__insert_equal_noresize(std::forward<Arg>(obj), h);
+    }
+};
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_CONCURRENT_HASHTABLE_H_
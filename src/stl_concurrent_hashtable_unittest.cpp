@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stl_concurrent_hashtable.h"
+#include "stl_function.h"
+#include "stl_hash_fun.h"
+#include "stl_hashtable.h"
+
+namespace forgedstl {
+
+typedef pair<const int, int> int_pair;
+typedef concurrent_hashtable<int_pair, int, hash<int>, select1st<int_pair>,
+                             equal_to<int> > int_map;
+
+TEST(ConcurrentHashTableTest, Basic) {
+    int_map m(100, hash<int>(), equal_to<int>(), threaded_alloc(), 5);
+    EXPECT_EQ(8, m.segment_count());
+    EXPECT_TRUE(m.empty());
+
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(m.insert_unique(int_pair(i, i * 2)));
+    }
+    EXPECT_FALSE(m.insert_unique(int_pair(7, 0)));
+    EXPECT_FALSE(m.emplace_unique(8, 0));
+    m.emplace_equal(9, -9);
+    EXPECT_EQ(1001, m.size());
+    EXPECT_EQ(2, m.count(9));
+
+    int seen = 0;
+    EXPECT_TRUE(m.cvisit(500, [&seen](const int_pair& p) { seen = p.second; }));
+    EXPECT_EQ(1000, seen);
+    EXPECT_FALSE(m.cvisit(1000, [](const int_pair&) { }));
+    EXPECT_TRUE(m.contains(999));
+
+    EXPECT_TRUE(m.visit(500, [](int_pair& p) { p.second = -1; }));
+    EXPECT_TRUE(m.cvisit(500, [&seen](const int_pair& p) { seen = p.second; }));
+    EXPECT_EQ(-1, seen);
+    EXPECT_FALSE(m.visit(2000, [](int_pair&) { }));
+
+    long long sum = 0;
+    m.for_each([&sum](const int_pair& p) { sum += p.first; });
+    EXPECT_EQ(999 * 1000 / 2 + 9, sum);
+
+    EXPECT_EQ(2, m.erase(9));
+    EXPECT_EQ(0, m.erase(9));
+    EXPECT_EQ(999, m.size());
+    m.clear();
+    EXPECT_TRUE(m.empty());
+
+    concurrent_hashtable<std::string, std::string, hash<std::string>,
+                         identity<std::string>, equal_to<std::string> >
+        names(10, hash<std::string>(), equal_to<std::string>());
+    EXPECT_EQ(64, names.segment_count());
+    std::string s(50, 'x');
+    EXPECT_TRUE(names.insert_unique(std::move(s)));
+    EXPECT_TRUE(names.contains(std::string(50, 'x')));
+}
+
+TEST(ConcurrentHashTableTest, Threads) {
+    int_map m(0, hash<int>(), equal_to<int>());
+    m.set_incremental_rehash(8);
+    const int threads = 8;
+    const int per_thread = 20000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&m, t]() {
+            const int base = t * per_thread;
+            for (int i = 0; i < per_thread; ++i) {
+                m.insert_unique(int_pair(base + i, t));
+                // other threads' keys are being inserted meanwhile
+                m.count((base + i * 7) % (threads * per_thread));
+            }
+            for (int i = 0; i < per_thread; i += 2) {
+                m.erase(base + i);
+            }
+            for (int i = 1; i < per_thread; i += 2) {
+                m.visit(base + i, [](int_pair& p) { ++p.second; });
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    EXPECT_EQ(threads * per_thread / 2, m.size());
+    for (int k = 0; k < threads * per_thread; ++k) {
+        int value = -1;
+        ASSERT_EQ(k % 2 == 1,
+                  m.cvisit(k, [&value](const int_pair& p) { value = p.second; }));
+        if (k % 2 == 1) {
+            EXPECT_EQ(k / per_thread + 1, value);
+        }
+    }
+}
+
+// Read-mostly throughput against one hashtable behind one mutex. Run with
+// --gtest_also_run_disabled_tests.
+TEST(ConcurrentHashTableTest, DISABLED_Throughput) {
+    typedef hashtable<int_pair, int, hash<int>, select1st<int_pair>,
+                      equal_to<int>, threaded_alloc> locked_map;
+    const int keys = 1 << 20;
+    const int ops = 1 << 21;
+    const unsigned max_threads =
+        std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        int_map cm(keys, hash<int>(), equal_to<int>());
+        locked_map lm(keys, hash<int>(), equal_to<int>());
+        std::mutex lm_lock;
+        for (int i = 0; i < keys; ++i) {
+            cm.insert_unique(int_pair(i, i));
+            lm.insert_unique(int_pair(i, i));
+        }
+
+        double seconds[2];
+        for (int which = 0; which < 2; ++which) {
+            std::atomic<long long> found(0);
+            std::vector<std::thread> workers;
+            const std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.push_back(std::thread([&, t]() {
+                    unsigned x = 2463534242u + t;
+                    long long local = 0;
+                    for (int i = 0; i < ops / int(threads); ++i) {
+                        x ^= x << 13;
+                        x ^= x >> 17;
+                        x ^= x << 5;
+                        const int key = int(x % (2 * keys));
+                        const bool write = x % 10 == 0;  // 10% updates
+                        if (which == 0) {
+                            if (write) {
+                                cm.insert_unique(int_pair(key, key));
+                            } else {
+                                local += cm.count(key);
+                            }
+                        } else {
+                            std::lock_guard<std::mutex> guard(lm_lock);
+                            if (write) {
+                                lm.insert_unique(int_pair(key, key));
+                            } else {
+                                local += lm.count(key);
+                            }
+                        }
+                    }
+                    found += local;
+                }));
+            }
+            for (size_t i = 0; i < workers.size(); ++i) {
+                workers[i].join();
+            }
+            seconds[which] = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << threads << " threads: concurrent "
+                  << ops / seconds[0] / 1e6 << " Mops/s, global mutex "
+                  << ops / seconds[1] / 1e6 << " Mops/s" << std::endl;
+    }
+}
+
+} // namespace forgedstl
@@ -2,15 +2,16 @@
 #define FORGED_STL_INTERNAL_CONSTRUCT_H_
 
 #include <new>
+#include <utility>
 
 #include "type_traits.h"
 #include "stl_iterator.h"
 
 namespace forgedstl {
 
-template <typename T1, typename T2>
-inline void construct(T1* p, const T2& value) {
-    new (p) T1(value);
+template <typename T1, typename... Args>
+inline void construct(T1* p, Args&&... args) {
+    new (p) T1(std::forward<Args>(args)...);
 }
 
 template <typename T>
@@ -24,7 +25,7 @@ inline void __destroy_aux(ForwardIterator first, ForwardIterator last, __true_ty
 template <typename ForwardIterator>
 inline void __destroy_aux(ForwardIterator first, ForwardIterator last, __false_type) {
     for (; first < last; ++first) {
-        destroy(&*first);
+        forgedstl::destroy(&*first);
     }
 }
 
@@ -2,6 +2,7 @@
 #define FORGED_STL_INTERNAL_DEQUE_H_
 
 #include <algorithm>
+#include <cstring>
 
 #include "stl_alloc.h"
 #include "stl_construct.h"
@@ -149,7 +150,7 @@ inline ptrdiff_t* distance_type(const __deque_iterator<T, Ref, Ptr, BufSize>&) {
 }
 
 template <typename T, typename Alloc = alloc, size_t BufSize = 0>
-class deque {
+class deque : protected __alloc_holder<Alloc> {
 public:
     typedef T value_type;
     typedef value_type* pointer;
@@ -158,6 +159,7 @@ public:
     typedef const value_type& const_reference;
     typedef size_t size_type;
     typedef ptrdiff_t difference_type;
+    typedef Alloc allocator_type;
 
     typedef __deque_iterator<T, T&, T*, BufSize> iterator;
     typedef __deque_iterator<T, const T&, const T*, BufSize> const_iterator;
@@ -209,89 +211,146 @@ public:
         return start == finish;
     }
 
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+
     deque() : start(), finish(), map(nullptr), map_size(0) {
         create_map_and_nodes(0);
     }
-    deque(const deque& x) : start(), finish(),
+    explicit deque(const allocator_type& a) : base(a), start(), finish(),
+        map(nullptr), map_size(0) {
+        create_map_and_nodes(0);
+    }
+    deque(const deque& x) : base(x.get_alloc()), start(), finish(),
         map(nullptr), map_size(0) {
         create_map_and_nodes(x.size());
         try {
-            uninitialized_copy(x.begin(), x.end(), start);
+            forgedstl::uninitialized_copy(x.begin(), x.end(), start);
         } catch (...) {
             destroy_map_and_nodes();
             throw;
         }
     }
-    deque(size_type n, const value_type& value) : start(), finish(),
+    // x is left with a fresh empty map, so unlike the other containers
+    // this move allocates and may throw.
+    deque(deque&& x) : base(x.get_alloc()), start(), finish(),
         map(nullptr), map_size(0) {
+        create_map_and_nodes(0);
+        swap_storage(x);
+    }
+    deque(size_type n, const value_type& value,
+          const allocator_type& a = allocator_type()) : base(a),
+        start(), finish(), map(nullptr), map_size(0) {
         fill_initialize(n, value);
     }
-    deque(int n, const value_type& value) : start(), finish(),
-        map(nullptr), map_size(0) {
+    deque(int n, const value_type& value,
+          const allocator_type& a = allocator_type()) : base(a),
+        start(), finish(), map(nullptr), map_size(0) {
         fill_initialize(n, value);
     }
-    deque(long n, const value_type& value) : start(), finish(),
-        map(nullptr), map_size(0) {
+    deque(long n, const value_type& value,
+          const allocator_type& a = allocator_type()) : base(a),
+        start(), finish(), map(nullptr), map_size(0) {
         fill_initialize(n, value);
     }
-    explicit deque(size_type n) : start(), finish(), map(nullptr),
-        map_size(0) {
+    explicit deque(size_type n, const allocator_type& a = allocator_type())
+        : base(a), start(), finish(), map(nullptr), map_size(0) {
         fill_initialize(n, value_type());
     }
     template <typename InputIterator>
-    deque(InputIterator first, InputIterator last) : start(), finish(),
-        map(nullptr), map_size(0) {
+    deque(InputIterator first, InputIterator last,
+          const allocator_type& a = allocator_type()) : base(a),
+        start(), finish(), map(nullptr), map_size(0) {
         range_initialize(first, last, iterator_category(first));
 
     }
     ~deque() {
-        destroy(start, finish);
+        forgedstl::destroy(start, finish);
         destroy_map_and_nodes();
     }
 
     deque& operator=(const deque& x) {
-        const size_type len = size();
         if (&x != this) {
+            if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+                if (!__alloc_equal(this->get_alloc(), x.get_alloc())) {
+                    // buffers and map belong to the allocator being replaced
+                    clear();
+                    destroy_map_and_nodes();
+                    this->get_alloc() = x.get_alloc();
+                    create_map_and_nodes(0);
+                } else {
+                    this->get_alloc() = x.get_alloc();
+                }
+            }
+            const size_type len = size();
             if (len > x.size()) {
                 erase(std::copy(x.begin(), x.end(), start), finish);
             } else {
                 const_iterator mid = x.begin() + difference_type(len);
                 std::copy(x.begin(), mid, start);
-                insert(finish, mid, x.end());
+                for (; mid != x.end(); ++mid) {
+                    push_back(*mid);
+                }
             }
         }
         return *this;
     }
+    deque& operator=(deque&& x)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment) {
+        if (&x != this) {
+            clear();
+            move_assign(x, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
 
     void swap(deque& x) {
-        std::swap(start, x.start);
-        std::swap(finish, x.finish);
-        std::swap(map, x.map);
-        std::swap(map_size, x.map_size);
+        swap_storage(x);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), x.get_alloc());
+        }
     }
 
     void push_back(const value_type& t) {
+        emplace_back(t);
+    }
+    void push_back(value_type&& t) {
+        emplace_back(std::move(t));
+    }
+
+    void push_front(const value_type& t) {
+        emplace_front(t);
+    }
+    void push_front(value_type&& t) {
+        emplace_front(std::move(t));
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
         if (finish.cur != finish.last - 1) {
-            construct(finish.cur, t);
+            forgedstl::construct(finish.cur, std::forward<Args>(args)...);
             ++finish.cur;
         } else {
-            push_back_aux(t);
+            push_back_aux(std::forward<Args>(args)...);
         }
     }
 
-    void push_front(const value_type& t) {
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
         if (start.cur != start.first) {
-            construct(start.cur - 1, t);
+            forgedstl::construct(start.cur - 1, std::forward<Args>(args)...);
             --start.cur;
         } else {
-            push_front_aux(t);
+            push_front_aux(std::forward<Args>(args)...);
         }
     }
 
     void pop_back() {
         if (finish.cur != finish.first) {
             --finish.cur;
-            destroy(finish.cur);
+            forgedstl::destroy(finish.cur);
         } else {
             pop_back_aux();
         }
@@ -299,7 +358,7 @@ public:
 
     void pop_front() {
         if (start.cur != start.last - 1) {
-            destroy(start.cur);
+            forgedstl::destroy(start.cur);
             ++start.cur;
         } else {
             pop_front_aux();
@@ -307,16 +366,24 @@ public:
     }
 
     iterator insert(iterator position, const value_type& x) {
+        return emplace(position, x);
+    }
+    iterator insert(iterator position, value_type&& x) {
+        return emplace(position, std::move(x));
+    }
+
+    template <typename... Args>
+    iterator emplace(iterator position, Args&&... args) {
         if (position.cur == start.cur) {
-            push_front(x);
+            emplace_front(std::forward<Args>(args)...);
             return start;
         } else if (position.cur == finish.cur) {
-            push_back(x);
+            emplace_back(std::forward<Args>(args)...);
             iterator tmp = finish;
             --tmp;
             return tmp;
         } else {
-            return insert_aux(position, x);
+            return insert_aux(position, std::forward<Args>(args)...);
         }
     }
 
@@ -373,6 +440,7 @@ public:
     }
 
 protected:
+    typedef __alloc_holder<Alloc> base;
     typedef pointer* map_pointer;
     typedef simple_alloc<value_type, Alloc> data_allocator;
     typedef simple_alloc<pointer, Alloc> map_allocator;
@@ -392,6 +460,52 @@ protected:
 
     void create_map_and_nodes(size_type num_elements);
     void destroy_map_and_nodes();
+
+    // Returns a map of new_map_size entries holding the current nodes from
+    // new_offset on; the old map is released. Node pointers can always be
+    // moved bytewise, so the allocator's reallocate is used when present.
+    map_pointer grow_map(size_type new_map_size, size_type new_offset,
+                         __true_type) {
+        const size_type old_offset = start.node - map;
+        const size_type num_nodes = finish.node - start.node + 1;
+        map_pointer new_map = map_allocator::reallocate(
+            this->get_alloc(), map, map_size, new_map_size);
+        memmove(new_map + new_offset, new_map + old_offset,
+                num_nodes * sizeof(pointer));
+        return new_map;
+    }
+    map_pointer grow_map(size_type new_map_size, size_type new_offset,
+                         __false_type) {
+        map_pointer new_map =
+            map_allocator::allocate(this->get_alloc(), new_map_size);
+        std::copy(start.node, finish.node + 1, new_map + new_offset);
+        map_allocator::deallocate(this->get_alloc(), map, map_size);
+        return new_map;
+    }
+
+    void swap_storage(deque& x) {
+        std::swap(start, x.start);
+        std::swap(finish, x.finish);
+        std::swap(map, x.map);
+        std::swap(map_size, x.map_size);
+    }
+    // Both move_assign overloads expect this deque to be empty. x takes
+    // our empty map in exchange, together with the allocator it came from.
+    void move_assign(deque& x, __true_type) {
+        swap_storage(x);
+        std::swap(this->get_alloc(), x.get_alloc());
+    }
+    void move_assign(deque& x, __false_type) {
+        if (__alloc_equal(this->get_alloc(), x.get_alloc())) {
+            swap_storage(x);
+        } else {
+            // x's buffers cannot change hands, only their elements can
+            for (iterator it = x.begin(); it != x.end(); ++it) {
+                emplace_back(std::move(*it));
+            }
+            x.clear();
+        }
+    }
     void fill_initialize(size_type n, const value_type& value);
 
     template <typename InputIterator>
@@ -401,12 +515,15 @@ protected:
     void range_initialize(ForwardIterator first, ForwardIterator last,
                           forward_iterator_tag);
 
-    void push_back_aux(const value_type& t);
-    void push_front_aux(const value_type& t);
+    template <typename... Args>
+    void push_back_aux(Args&&... args);
+    template <typename... Args>
+    void push_front_aux(Args&&... args);
     void pop_back_aux();
     void pop_front_aux();
 
-    iterator insert_aux(iterator pos, const value_type& x);
+    template <typename... Args>
+    iterator insert_aux(iterator pos, Args&&... args);
     void insert_aux(iterator pos, size_type n, const value_type& x);
 
     void reserve_map_at_back(size_type nodes_to_add = 1) {
@@ -445,10 +562,10 @@ protected:
     void reallocate_map(size_type nodes_to_add, bool add_at_front);
 
     pointer allocate_node() {
-        return data_allocator::allocate(buffer_size());
+        return data_allocator::allocate(this->get_alloc(), buffer_size());
     }
     void deallocate_node(pointer n) {
-        data_allocator::deallocate(n, buffer_size());
+        data_allocator::deallocate(this->get_alloc(), n, buffer_size());
     }
 };
 
@@ -457,11 +574,11 @@ void deque<T, Alloc, BufSize>::insert(iterator pos, size_type n,
                                       const value_type& x) {
     if (pos.cur == start.cur) {
         iterator new_start = reserve_elements_at_front(n);
-        uninitialized_fill(new_start, start, x);
+        forgedstl::uninitialized_fill(new_start, start, x);
         start = new_start;
     } else if (pos.cur == finish.cur) {
         iterator new_finish = reserve_elements_at_back(n);
-        uninitialized_fill(finish, new_finish, x);
+        forgedstl::uninitialized_fill(finish, new_finish, x);
         finish = new_finish;
     } else {
         insert_aux(pos, n, x);
@@ -482,17 +599,17 @@ deque<T, Alloc, BufSize>::erase(iterator first, iterator last) {
         if ((size_type)elems_before < (size() - n) / 2) {
             std::copy_backward(start, first, last);
             iterator new_start = start + n;
-            destroy(start, new_start);
+            forgedstl::destroy(start, new_start);
             for (map_pointer cur = start.node; cur < new_start.node; ++cur) {
-                data_allocator::deallocate(*cur, buffer_size());
+                deallocate_node(*cur);
             }
             start = new_start;
         } else {
             std::copy(last, finish, first);
             iterator new_finish = finish - n;
-            destroy(new_finish, finish);
+            forgedstl::destroy(new_finish, finish);
             for (map_pointer cur = new_finish.node + 1; cur <= finish.node; ++cur) {
-                data_allocator::deallocate(*cur, buffer_size());
+                deallocate_node(*cur);
             }
             finish = new_finish;
         }
@@ -503,16 +620,16 @@ deque<T, Alloc, BufSize>::erase(iterator first, iterator last) {
 template <typename T, typename Alloc, size_t BufSize>
 void deque<T, Alloc, BufSize>::clear() {
     for (map_pointer node = start.node + 1; node < finish.node; ++node) {
-        destroy(*node, *node + buffer_size());
-        data_allocator::deallocate(*node, buffer_size());
+        forgedstl::destroy(*node, *node + buffer_size());
+        deallocate_node(*node);
     }
 
     if (start.node != finish.node) {
-        destroy(start.cur, start.last);
-        destroy(finish.first, finish.cur);
-        data_allocator::deallocate(finish.first, buffer_size());
+        forgedstl::destroy(start.cur, start.last);
+        forgedstl::destroy(finish.first, finish.cur);
+        deallocate_node(finish.first);
     } else {
-        destroy(start.cur, finish.cur);
+        forgedstl::destroy(start.cur, finish.cur);
     }
 
     finish = start;
@@ -523,7 +640,7 @@ void deque<T, Alloc, BufSize>::create_map_and_nodes(size_type num_elements) {
     size_type num_nodes = num_elements / buffer_size() + 1;
 
     map_size = std::max(initial_map_size(), num_nodes + 2);
-    map = map_allocator::allocate(map_size);
+    map = map_allocator::allocate(this->get_alloc(), map_size);
 
     map_pointer nstart = map + (map_size - num_nodes) / 2;
     map_pointer nfinish = nstart + num_nodes - 1;
@@ -537,7 +654,7 @@ void deque<T, Alloc, BufSize>::create_map_and_nodes(size_type num_elements) {
         for (map_pointer n = nstart; n < cur; ++n) {
             deallocate_node(*n);
         }
-        map_allocator::deallocate(map, map_size);
+        map_allocator::deallocate(this->get_alloc(), map, map_size);
         throw;
     }
 
@@ -552,7 +669,7 @@ void deque<T, Alloc, BufSize>::destroy_map_and_nodes() {
     for (map_pointer cur = start.node; cur <= finish.node; ++cur) {
         deallocate_node(*cur);
     }
-    map_allocator::deallocate(map, map_size);
+    map_allocator::deallocate(this->get_alloc(), map, map_size);
 }
 
 template <typename T, typename Alloc, size_t BufSize>
@@ -561,12 +678,12 @@ void deque<T, Alloc, BufSize>::fill_initialize(size_type n, const value_type& va
     map_pointer cur;
     try {
         for (cur = start.node; cur < finish.node; ++cur) {
-            uninitialized_fill(*cur, *cur + buffer_size(), value);
+            forgedstl::uninitialized_fill(*cur, *cur + buffer_size(), value);
         }
-        uninitialized_fill(finish.first, finish.cur, value);
+        forgedstl::uninitialized_fill(finish.first, finish.cur, value);
     } catch (...) {
         for (map_pointer n = start.node; n < cur; ++n) {
-            destroy(*n, *n + buffer_size());
+            forgedstl::destroy(*n, *n + buffer_size());
         }
         destroy_map_and_nodes();
         throw;
@@ -593,24 +710,26 @@ void deque<T, Alloc, BufSize>::range_initialize(ForwardIterator first,
     distance(first, last, n);
     create_map_and_nodes(n);
     try {
-        uninitialized_copy(first, last, start);
+        forgedstl::uninitialized_copy(first, last, start);
     } catch (...) {
         destroy_map_and_nodes();
         throw;
     }
 }
 
+// Only the map may move while a buffer is added, never the elements, so
+// args referring into the deque stay valid.
 template <typename T, typename Alloc, size_t BufSize>
-void deque<T, Alloc, BufSize>::push_back_aux(const value_type& t) {
+template <typename... Args>
+void deque<T, Alloc, BufSize>::push_back_aux(Args&&... args) {
     assert(finish.cur == finish.last - 1);
 
-    value_type t_copy = t;
     reserve_map_at_back();
     *(finish.node + 1) = allocate_node();
     try {
-        construct(finish.cur, t_copy);
+        forgedstl::construct(finish.cur, std::forward<Args>(args)...);
         finish.set_node(finish.node + 1);
-        finish.cur = finish.last;
+        finish.cur = finish.first;
     } catch (...) {
         deallocate_node(*(finish.node + 1));
         throw;
@@ -618,22 +737,21 @@ void deque<T, Alloc, BufSize>::push_back_aux(const value_type& t) {
 }
 
 template <typename T, typename Alloc, size_t BufSize>
-void deque<T, Alloc, BufSize>::push_front_aux(const value_type& t) {
+template <typename... Args>
+void deque<T, Alloc, BufSize>::push_front_aux(Args&&... args) {
     assert(start.cur == start.first);
 
-    value_type t_copy = t;
     reserve_map_at_front();
     *(start.node - 1) = allocate_node();
     try {
-        start.set_node(start.node - 1);
-        start.cur = start.last - 1;
-        construct(start.cur, t_copy);
+        forgedstl::construct(*(start.node - 1) + (buffer_size() - 1),
+                             std::forward<Args>(args)...);
     } catch (...) {
-        start.set_node(start.node + 1);
-        start.cur = start.first;
         deallocate_node(*(start.node - 1));
         throw;
     }
+    start.set_node(start.node - 1);
+    start.cur = start.last - 1;
 }
 
 template <typename T, typename Alloc, size_t BufSize>
@@ -642,25 +760,26 @@ void deque<T, Alloc, BufSize>::pop_back_aux() {
     deallocate_node(finish.first);
     finish.set_node(finish.node - 1);
     finish.cur = finish.last - 1;
-    destroy(finish.cur);
+    forgedstl::destroy(finish.cur);
 }
 
 template <typename T, typename Alloc, size_t BufSize>
 void deque<T, Alloc, BufSize>::pop_front_aux() {
     assert(start.cur == start.last - 1);
-    destroy(start.cur);
+    forgedstl::destroy(start.cur);
     deallocate_node(start.first);
     start.set_node(start.node + 1);
     start.cur = start.first;
 }
 
 template <typename T, typename Alloc, size_t BufSize>
+template <typename... Args>
 typename deque<T, Alloc, BufSize>::iterator
-deque<T, Alloc, BufSize>::insert_aux(iterator pos, const value_type& x) {
+deque<T, Alloc, BufSize>::insert_aux(iterator pos, Args&&... args) {
     difference_type index = pos - start;
-    value_type x_copy = x;
+    value_type x_copy(std::forward<Args>(args)...);
     if ((size_type)index < size() / 2) {
-        push_front(front());
+        push_front(std::move(front()));
         iterator front1 = start;
         ++front1;
         iterator front2 = front1;
@@ -668,17 +787,17 @@ deque<T, Alloc, BufSize>::insert_aux(iterator pos, const value_type& x) {
         pos = start + index;
         iterator pos1 = pos;
         ++pos1;
-        std::copy(front2, pos1, front1);
+        std::move(front2, pos1, front1);
     } else {
-        push_back(back());
+        push_back(std::move(back()));
         iterator back1 = finish;
         --back1;
         iterator back2 = back1;
         --back2;
         pos = start + index;
-        std::copy_backward(pos, back2, back1);
+        std::move_backward(pos, back2, back1);
     }
-    *pos = x_copy;
+    *pos = std::move(x_copy);
     return pos;
 }
 
@@ -695,7 +814,7 @@ void deque<T, Alloc, BufSize>::insert_aux(iterator pos, size_type n,
         try {
             if (elems_before >= difference_type(n)) {
                 iterator start_n = start + difference_type(n);
-                uninitialized_copy(start, start_n, new_start);
+                forgedstl::uninitialized_copy(start, start_n, new_start);
                 start = new_start;
                 std::copy(start_n, pos, old_start);
                 std::fill(pos - difference_type(n), pos, x_copy);
@@ -716,7 +835,7 @@ void deque<T, Alloc, BufSize>::insert_aux(iterator pos, size_type n,
         try {
             if (elems_after > difference_type(n)) {
                 iterator finish_n = finish - difference_type(n);
-                uninitialized_copy(finish_n, finish, finish);
+                forgedstl::uninitialized_copy(finish_n, finish, finish);
                 finish = new_finish;
                 std::copy_backward(pos, finish_n, old_finish);
                 std::fill(pos, pos + difference_type(n), x_copy);
@@ -798,15 +917,14 @@ void deque<T, Alloc, BufSize>::reallocate_map(size_type nodes_to_add,
         }
     } else {
         size_type new_map_size = map_size + std::max(map_size, nodes_to_add) + 2;
-
-        map_pointer new_map = map_allocator::allocate(new_map_size);
-        new_nstart = new_map + (new_map_size - new_num_nodes) / 2
+        size_type new_offset = (new_map_size - new_num_nodes) / 2
             + (add_at_front ? nodes_to_add : 0);
-        std::copy(start.node, finish.node + 1, new_nstart);
-        map_allocator::deallocate(map, map_size);
 
-        map = new_map;
+        map = grow_map(new_map_size, new_offset,
+                       typename __bool_type<
+                           __alloc_has_reallocate<Alloc>::value>::type());
         map_size = new_map_size;
+        new_nstart = map + new_offset;
     }
 
     start.set_node(new_nstart);
@@ -815,4 +933,12 @@ void deque<T, Alloc, BufSize>::reallocate_map(size_type nodes_to_add,
 
 } // namespace forgedstl
 
+// The deque's iterators point into its map and buffers, never into the
+// deque itself, so it may be relocated bytewise like vector.
+template <typename T, typename Alloc, size_t BufSize>
+struct __relocate_traits<forgedstl::deque<T, Alloc, BufSize> > {
+    typedef typename __bool_type<std::is_empty<Alloc>::value>::type
+        is_trivially_relocatable;
+};
+
 #endif // FORGED_STL_INTERNAL_DEQUE_H_
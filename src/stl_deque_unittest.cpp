@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
+#include <memory>
+#include <string>
 
 #include "stl_deque.h"
+#include "test_alloc.h"
 
 namespace forgedstl {
 
@@ -201,4 +204,88 @@ TEST(DequeTest, EraseAndResize) {
     ASSERT_TRUE(id.empty());
 }
 
+TEST(DequeTest, StatefulAlloc) {
+    test_pool p1, p2;
+    {
+        deque<int, stateful_alloc> d1((stateful_alloc(&p1)));
+        for (int i = 0; i < 1000; ++i) {
+            d1.push_back(i);
+            d1.push_front(-i);
+        }
+        EXPECT_LT(0, p1.bytes_in_use);
+        EXPECT_EQ(0, p2.bytes_in_use);
+
+        deque<int, stateful_alloc> d2(d1);
+        EXPECT_EQ(&p1, d2.get_allocator().resource());
+
+        deque<int, stateful_alloc> d3(10, 7, stateful_alloc(&p2));
+        d3 = d1;
+        EXPECT_EQ(&p2, d3.get_allocator().resource());
+        EXPECT_TRUE(d1 == d3);
+
+        d2.swap(d3);
+        EXPECT_EQ(&p2, d2.get_allocator().resource());
+        EXPECT_EQ(&p1, d3.get_allocator().resource());
+
+        deque<int, stateful_alloc> d4(50, stateful_alloc(&p2));
+        EXPECT_EQ(50, d4.size());
+        EXPECT_EQ(0, d4[49]);
+        EXPECT_EQ(&p2, d4.get_allocator().resource());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+TEST(DequeTest, MoveAndEmplace) {
+    deque<std::unique_ptr<int> > pd;
+    for (int i = 0; i < 200; ++i) {
+        pd.emplace_back(new int(i));
+        pd.push_front(std::unique_ptr<int>(new int(-i - 1)));
+    }
+    ASSERT_EQ(400, pd.size());
+    for (int i = 0; i < 400; ++i) {
+        EXPECT_EQ(i - 200, *pd[i]);
+    }
+
+    pd.emplace(pd.begin() + 10, new int(1000));
+    pd.insert(pd.end() - 10, std::unique_ptr<int>(new int(2000)));
+    ASSERT_EQ(402, pd.size());
+    EXPECT_EQ(1000, *pd[10]);
+    EXPECT_EQ(-190, *pd[11]);
+    EXPECT_EQ(2000, *pd[391]);
+    EXPECT_EQ(190, *pd[392]);
+
+    deque<std::string> sd;
+    std::string s(100, 'x');
+    sd.push_front(std::move(s));
+    EXPECT_TRUE(s.empty());
+    sd.emplace_front(2, 'y');
+    EXPECT_EQ("yy", sd.front());
+    EXPECT_EQ(100, sd.back().size());
+}
+
+TEST(DequeTest, MoveConstructAndAssign) {
+    EXPECT_TRUE(std::is_nothrow_move_assignable<deque<int> >::value);
+
+    deque<int> d1;
+    for (int i = 0; i < 1000; ++i) {
+        d1.push_back(i);
+    }
+    const int* first = &d1.front();
+    deque<int> d2(std::move(d1));
+    EXPECT_TRUE(d1.empty());
+    ASSERT_EQ(1000, d2.size());
+    EXPECT_EQ(first, &d2.front());
+    d1.push_front(1);
+    EXPECT_EQ(1, d1.size());
+
+    deque<int> d3(3, 1);
+    d3 = std::move(d2);
+    EXPECT_TRUE(d2.empty());
+    EXPECT_EQ(first, &d3.front());
+    EXPECT_EQ(999, d3.back());
+    d2.push_back(1);
+    EXPECT_EQ(1, d2.size());
+}
+
 } // namespace forgedstl
\ No newline at end of file
@@ -0,0 +1,749 @@
+#ifndef FORGED_STL_INTERNAL_FLAT_HASHTABLE_H_
+#define FORGED_STL_INTERNAL_FLAT_HASHTABLE_H_
+
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "stl_alloc.h"
+#include "stl_construct.h"
+#include "stl_iterator.h"
+#include "stl_pair.h"
+
+namespace forgedstl {
+
+// Control bytes of flat_hashtable, one per slot. A full slot holds the low
+// 7 bits of its hash (0..127); empty and deleted slots have the sign bit
+// set, so full slots are told apart from the rest by one mask.
+enum {
+    __flat_empty = -128,
+    __flat_deleted = -2
+};
+
+// Sixteen control bytes looked at together. Each match returns a mask
+// with bit i set when byte i qualifies.
+struct __flat_group {
+    enum { width = 16 };
+
+#if defined(__SSE2__)
+    __m128i ctrl;
+
+    explicit __flat_group(const signed char* p)
+        : ctrl(_mm_loadu_si128((const __m128i*)p)) { }
+
+    unsigned match(signed char h2) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+    }
+    unsigned match_empty_or_deleted() const {
+        return _mm_movemask_epi8(ctrl);
+    }
+#else
+    const signed char* ctrl;
+
+    explicit __flat_group(const signed char* p) : ctrl(p) { }
+
+    unsigned match(signed char h2) const {
+        unsigned mask = 0;
+        for (int i = 0; i < width; ++i) {
+            mask |= unsigned(ctrl[i] == h2) << i;
+        }
+        return mask;
+    }
+    unsigned match_empty_or_deleted() const {
+        unsigned mask = 0;
+        for (int i = 0; i < width; ++i) {
+            mask |= unsigned(ctrl[i] < 0) << i;
+        }
+        return mask;
+    }
+#endif
+
+    unsigned match_empty() const {
+        return match(__flat_empty);
+    }
+};
+
+inline int __flat_lowest_bit(unsigned mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int n = 0;
+    for (; (mask & 1) == 0; mask >>= 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Tables without storage point their control bytes here, so a lookup in
+// them needs no special case: it sees one empty group and stops.
+inline signed char* __flat_empty_group() {
+    alignas(16) static signed char group[__flat_group::width] = {
+        -128, -128, -128, -128, -128, -128, -128, -128,
+        -128, -128, -128, -128, -128, -128, -128, -128
+    };
+    return group;
+}
+
+// hash<int> and friends return the key itself; spread it over all bits so
+// that runs of keys neither share a group nor a 7-bit tag.
+inline size_t __flat_mix(size_t h) {
+    const unsigned long long m = (unsigned long long)h * 0x9E3779B97F4A7C15ull;
+    return size_t(m ^ (m >> 32));
+}
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+class flat_hashtable;
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+struct __flat_hashtable_iterator;
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+struct __flat_hashtable_const_iterator;
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc>
+struct __flat_hashtable_iterator {
+    typedef flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+        hashtable;
+    typedef __flat_hashtable_iterator<Value, Key, HashFunc,
+        ExtractKey, EqualKey, Alloc>
+        iterator;
+
+    typedef forward_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef ptrdiff_t difference_type;
+    typedef size_t size_type;
+    typedef Value& reference;
+    typedef Value* pointer;
+
+    size_type pos;
+    hashtable* ht;
+
+    __flat_hashtable_iterator(size_type n, hashtable* tab)
+        : pos(n), ht(tab) { }
+    __flat_hashtable_iterator() { }
+    reference operator*() const {
+        return ht->slots[pos];
+    }
+    pointer operator->() const {
+        return &(operator*());
+    }
+
+    iterator& operator++() {
+        pos = ht->next_full(pos + 1);
+        return *this;
+    }
+    iterator operator++(int) {
+        iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    bool operator==(const iterator& it) const { return pos == it.pos; }
+    bool operator!=(const iterator& it) const { return pos != it.pos; }
+};
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc>
+struct __flat_hashtable_const_iterator {
+    typedef flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+        hashtable;
+    typedef __flat_hashtable_iterator<Value, Key, HashFunc,
+        ExtractKey, EqualKey, Alloc>
+        iterator;
+    typedef __flat_hashtable_const_iterator<Value, Key, HashFunc,
+        ExtractKey, EqualKey, Alloc>
+        const_iterator;
+
+    typedef forward_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef ptrdiff_t difference_type;
+    typedef size_t size_type;
+    typedef const Value& reference;
+    typedef const Value* pointer;
+
+    size_type pos;
+    const hashtable* ht;
+
+    __flat_hashtable_const_iterator(size_type n, const hashtable* tab)
+        : pos(n), ht(tab) { }
+    __flat_hashtable_const_iterator() { }
+    __flat_hashtable_const_iterator(const iterator& it)
+        : pos(it.pos), ht(it.ht) { }
+    reference operator*() const {
+        return ht->slots[pos];
+    }
+    pointer operator->() const {
+        return &(operator*());
+    }
+
+    const_iterator& operator++() {
+        pos = ht->next_full(pos + 1);
+        return *this;
+    }
+    const_iterator operator++(int) {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    bool operator==(const const_iterator& it) const { return pos == it.pos; }
+    bool operator!=(const const_iterator& it) const { return pos != it.pos; }
+};
+
+// Open addressing over the same policies as hashtable. Values are stored
+// inline in one array of slots, next to an array of control bytes that is
+// searched 16 slots at a time, so a hit usually costs one control line and
+// one slot instead of a bucket and a chain of nodes. Groups are probed in
+// triangular order and the table doubles once 7/8 of its slots are used.
+//
+// Keys are unique. Inserting may move every value, so it invalidates all
+// iterators and references; erasing invalidates only the erased element.
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc>
+class flat_hashtable : protected __alloc_holder<Alloc> {
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef HashFunc hasher;
+    typedef EqualKey key_equal;
+
+    typedef size_t            size_type;
+    typedef ptrdiff_t         difference_type;
+    typedef value_type*       pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type&       reference;
+    typedef const value_type& const_reference;
+    typedef Alloc             allocator_type;
+
+    typedef __flat_hashtable_iterator<Value, Key, HashFunc, ExtractKey,
+        EqualKey, Alloc> iterator;
+    typedef __flat_hashtable_const_iterator<Value, Key, HashFunc, ExtractKey,
+        EqualKey, Alloc> const_iterator;
+
+    friend struct
+        __flat_hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>;
+    friend struct
+        __flat_hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>;
+
+    flat_hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
+                   const ExtractKey& ext,
+                   const allocator_type& a = allocator_type())
+        : base(a), hash(hf), equals(eql), get_key(ext) {
+        reset();
+        resize(n);
+    }
+    flat_hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
+                   const allocator_type& a = allocator_type())
+        : base(a), hash(hf), equals(eql), get_key(ExtractKey()) {
+        reset();
+        resize(n);
+    }
+    flat_hashtable(const flat_hashtable& ht)
+        : base(ht.get_alloc()), hash(ht.hash), equals(ht.equals),
+          get_key(ht.get_key) {
+        reset();
+        copy_from(ht);
+    }
+    flat_hashtable(flat_hashtable&& ht)
+        noexcept(std::is_nothrow_copy_constructible<HashFunc>::value &&
+                 std::is_nothrow_copy_constructible<EqualKey>::value &&
+                 std::is_nothrow_copy_constructible<ExtractKey>::value)
+        : base(ht.get_alloc()), hash(ht.hash), equals(ht.equals),
+          get_key(ht.get_key) {
+        take_slots(ht);
+    }
+
+    flat_hashtable& operator=(const flat_hashtable& ht) {
+        if (&ht != this) {
+            clear();
+            hash = ht.hash;
+            equals = ht.equals;
+            get_key = ht.get_key;
+            if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+                deallocate_slots();
+                reset();
+                this->get_alloc() = ht.get_alloc();
+            }
+            copy_from(ht);
+        }
+        return *this;
+    }
+
+    flat_hashtable& operator=(flat_hashtable&& ht)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment &&
+                 std::is_nothrow_copy_assignable<HashFunc>::value &&
+                 std::is_nothrow_copy_assignable<EqualKey>::value &&
+                 std::is_nothrow_copy_assignable<ExtractKey>::value) {
+        if (&ht != this) {
+            clear();
+            hash = ht.hash;
+            equals = ht.equals;
+            get_key = ht.get_key;
+            move_assign(ht, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
+
+    ~flat_hashtable() {
+        clear();
+        deallocate_slots();
+    }
+
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+
+    hasher hash_funct() const {
+        return hash;
+    }
+    key_equal key_eq() const {
+        return equals;
+    }
+
+    size_type size() const {
+        return num_elements;
+    }
+    size_type max_size() const {
+        return size_type(-1) / sizeof(Value);
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void swap(flat_hashtable& ht) {
+        std::swap(hash, ht.hash);
+        std::swap(equals, ht.equals);
+        std::swap(get_key, ht.get_key);
+        std::swap(ctrl, ht.ctrl);
+        std::swap(slots, ht.slots);
+        std::swap(num_slots, ht.num_slots);
+        std::swap(group_mask, ht.group_mask);
+        std::swap(num_elements, ht.num_elements);
+        std::swap(growth_left, ht.growth_left);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), ht.get_alloc());
+        }
+    }
+
+    iterator begin() {
+        return iterator(next_full(0), this);
+    }
+    iterator end() {
+        return iterator(num_slots, this);
+    }
+    const_iterator begin() const {
+        return const_iterator(next_full(0), this);
+    }
+    const_iterator end() const {
+        return const_iterator(num_slots, this);
+    }
+
+    // Slots, not chains: every bucket holds at most one value.
+    size_type bucket_count() const {
+        return num_slots;
+    }
+
+    pair<iterator, bool> insert_unique(const value_type& obj) {
+        return __insert_unique(obj);
+    }
+    pair<iterator, bool> insert_unique(value_type&& obj) {
+        return __insert_unique(std::move(obj));
+    }
+
+    // The value is built before the key is known, so a duplicate costs
+    // one construction that is thrown away.
+    template <typename... Args>
+    pair<iterator, bool> emplace_unique(Args&&... args) {
+        value_type tmp(std::forward<Args>(args)...);
+        return __insert_unique(std::move(tmp));
+    }
+
+    template <class InputIterator>
+    void insert_unique(InputIterator f, InputIterator l) {
+        insert_unique(f, l, iterator_category(f));
+    }
+
+    template <class InputIterator>
+    void insert_unique(InputIterator f, InputIterator l,
+                       input_iterator_tag) {
+        for (; f != l; ++f) {
+            insert_unique(*f);
+        }
+    }
+
+    template <class ForwardIterator>
+    void insert_unique(ForwardIterator f, ForwardIterator l,
+                       forward_iterator_tag) {
+        size_type n = 0;
+        distance(f, l, n);
+        resize(num_elements + n);
+        for (; n > 0; --n, ++f) {
+            insert_unique(*f);
+        }
+    }
+
+    reference find_or_insert(const value_type& obj) {
+        return *insert_unique(obj).first;
+    }
+
+    iterator find(const key_type& key) {
+        return iterator(find_pos(key, hash_of(key)), this);
+    }
+    const_iterator find(const key_type& key) const {
+        return const_iterator(find_pos(key, hash_of(key)), this);
+    }
+    size_type count(const key_type& key) const {
+        return find_pos(key, hash_of(key)) != num_slots ? 1 : 0;
+    }
+
+    size_type erase(const key_type& key) {
+        const size_type pos = find_pos(key, hash_of(key));
+        if (pos == num_slots) {
+            return 0;
+        }
+        erase_slot(pos);
+        return 1;
+    }
+    void erase(const iterator& it) {
+        erase_slot(it.pos);
+    }
+    void erase(const const_iterator& it) {
+        erase_slot(it.pos);
+    }
+    void erase(iterator first, iterator last) {
+        for (; first != last; ++first) {
+            erase_slot(first.pos);
+        }
+    }
+    void erase(const_iterator first, const_iterator last) {
+        for (; first != last; ++first) {
+            erase_slot(first.pos);
+        }
+    }
+
+    // Makes room for num_elements_hint values without further growth.
+    void resize(size_type num_elements_hint) {
+        if (num_elements_hint > max_load(num_slots)) {
+            size_type n = __flat_group::width;
+            while (max_load(n) < num_elements_hint) {
+                n *= 2;
+            }
+            rehash_slots(n);
+        }
+    }
+    void clear();
+
+private:
+    typedef __alloc_holder<Alloc> base;
+    typedef simple_alloc<signed char, Alloc> ctrl_allocator;
+    typedef simple_alloc<value_type, Alloc> slot_allocator;
+
+    hasher hash;
+    key_equal equals;
+    ExtractKey get_key;
+
+    signed char* ctrl;  // num_slots bytes, or __flat_empty_group()
+    value_type* slots;
+    size_type num_slots;
+    size_type group_mask;  // number of groups - 1
+    size_type num_elements;
+    size_type growth_left;  // empty slots that may still be filled
+
+    static size_type max_load(size_type n) {
+        return n - n / 8;
+    }
+    static signed char h2(size_t h) {
+        return (signed char)(h & 0x7F);
+    }
+
+    size_t hash_of(const key_type& key) const {
+        return __flat_mix(hash(key));
+    }
+
+    size_type next_full(size_type pos) const {
+        while (pos < num_slots && ctrl[pos] < 0) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    size_type find_pos(const key_type& key, size_t h) const;
+    static size_type find_first_non_full(const signed char* c,
+                                         size_type mask, size_t h);
+
+    template <typename Arg>
+    pair<iterator, bool> __insert_unique(Arg&& obj);
+
+    void erase_slot(size_type pos) {
+        forgedstl::destroy(slots + pos);
+        --num_elements;
+        // Searches walk past a group only when it has no empty slot. If
+        // this group still has one, no search depends on this slot being
+        // taken and it can become empty again.
+        const size_type first = pos & ~size_type(__flat_group::width - 1);
+        if (__flat_group(ctrl + first).match_empty() != 0) {
+            ctrl[pos] = __flat_empty;
+            ++growth_left;
+        } else {
+            ctrl[pos] = __flat_deleted;
+        }
+    }
+
+    void reset() {
+        ctrl = __flat_empty_group();
+        slots = nullptr;
+        num_slots = 0;
+        group_mask = 0;
+        num_elements = 0;
+        growth_left = 0;
+    }
+    void deallocate_slots() {
+        if (num_slots != 0) {
+            ctrl_allocator::deallocate(this->get_alloc(), ctrl, num_slots);
+            slot_allocator::deallocate(this->get_alloc(), slots, num_slots);
+        }
+    }
+    // Gives this table n fresh empty slots; the old ones are not released.
+    void allocate_slots(size_type n) {
+        signed char* c = ctrl_allocator::allocate(this->get_alloc(), n);
+        try {
+            slots = slot_allocator::allocate(this->get_alloc(), n);
+        } catch (...) {
+            ctrl_allocator::deallocate(this->get_alloc(), c, n);
+            throw;
+        }
+        memset(c, __flat_empty, n);
+        ctrl = c;
+        num_slots = n;
+        group_mask = n / __flat_group::width - 1;
+        num_elements = 0;
+        growth_left = max_load(n);
+    }
+    void take_slots(flat_hashtable& ht) {
+        ctrl = ht.ctrl;
+        slots = ht.slots;
+        num_slots = ht.num_slots;
+        group_mask = ht.group_mask;
+        num_elements = ht.num_elements;
+        growth_left = ht.growth_left;
+        ht.reset();
+    }
+
+    void rehash_slots(size_type n);
+
+    // Both move_assign overloads expect this table to be empty.
+    void move_assign(flat_hashtable& ht, __true_type) {
+        deallocate_slots();
+        this->get_alloc() = ht.get_alloc();
+        take_slots(ht);
+    }
+    void move_assign(flat_hashtable& ht, __false_type) {
+        if (__alloc_equal(this->get_alloc(), ht.get_alloc())) {
+            move_assign(ht, __true_type());
+        } else {
+            // ht's slots cannot change hands, only their values can
+            resize(ht.size());
+            for (iterator it = ht.begin(); it != ht.end(); ++it) {
+                insert_unique(std::move(*it));
+            }
+            ht.clear();
+        }
+    }
+
+    void copy_from(const flat_hashtable& ht);
+};
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+bool operator==(const flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht1,
+                const flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht2) {
+    typedef typename flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey,
+        Alloc>::const_iterator const_iterator;
+    if (ht1.size() != ht2.size()) {
+        return false;
+    }
+    ExtractKey get_key;
+    for (const_iterator it = ht1.begin(); it != ht1.end(); ++it) {
+        const_iterator other = ht2.find(get_key(*it));
+        if (other == ht2.end() || !(*other == *it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+inline void swap(flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht1,
+                 flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht2) {
+    ht1.swap(ht2);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+typename flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::size_type
+flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::find_pos(
+    const key_type& key, size_t h) const {
+    const signed char tag = h2(h);
+    size_type group = (h >> 7) & group_mask;
+    // at least one slot is always empty, so the walk ends
+    for (size_type step = 1; ; ++step) {
+        const size_type first = group * __flat_group::width;
+        const __flat_group g(ctrl + first);
+        for (unsigned m = g.match(tag); m != 0; m &= m - 1) {
+            const size_type pos = first + __flat_lowest_bit(m);
+            if (equals(get_key(slots[pos]), key)) {
+                return pos;
+            }
+        }
+        if (g.match_empty() != 0) {
+            return num_slots;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+typename flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::size_type
+flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::find_first_non_full(
+    const signed char* c, size_type mask, size_t h) {
+    size_type group = (h >> 7) & mask;
+    for (size_type step = 1; ; ++step) {
+        const size_type first = group * __flat_group::width;
+        const unsigned m = __flat_group(c + first).match_empty_or_deleted();
+        if (m != 0) {
+            return first + __flat_lowest_bit(m);
+        }
+        group = (group + step) & mask;
+    }
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+template <typename Arg>
+pair<typename flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::iterator, bool>
+flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::__insert_unique(Arg&& obj) {
+    const size_t h = hash_of(get_key(obj));
+    size_type pos = find_pos(get_key(obj), h);
+    if (pos != num_slots) {
+        return pair<iterator, bool>(iterator(pos, this), false);
+    }
+    // obj is not in this table, so growing cannot move it
+    if (growth_left == 0) {
+        // Deleted slots also use up growth_left. While they are at least
+        // half of it, rehashing at the same size gets it back.
+        rehash_slots(num_elements < max_load(num_slots) / 2 ?
+                     num_slots : std::max(2 * num_slots,
+                                          size_type(__flat_group::width)));
+    }
+    pos = find_first_non_full(ctrl, group_mask, h);
+    forgedstl::construct(slots + pos, std::forward<Arg>(obj));
+    if (ctrl[pos] == __flat_empty) {
+        --growth_left;
+    }
+    ctrl[pos] = h2(h);
+    ++num_elements;
+    return pair<iterator, bool>(iterator(pos, this), true);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+void flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::rehash_slots(size_type n) {
+    signed char* const old_ctrl = ctrl;
+    value_type* const old_slots = slots;
+    const size_type old_n = num_slots;
+    const size_type elements = num_elements;
+    const size_type growth = growth_left;
+    allocate_slots(n);
+    try {
+        for (size_type i = 0; i < old_n; ++i) {
+            if (old_ctrl[i] >= 0) {
+                const size_t h = hash_of(get_key(old_slots[i]));
+                const size_type pos = find_first_non_full(ctrl, group_mask, h);
+                forgedstl::construct(slots + pos,
+                                     std::move_if_noexcept(old_slots[i]));
+                ctrl[pos] = h2(h);
+                --growth_left;
+                ++num_elements;
+            }
+        }
+    } catch (...) {
+        clear();
+        deallocate_slots();
+        ctrl = old_ctrl;
+        slots = old_slots;
+        num_slots = old_n;
+        group_mask = old_n != 0 ? old_n / __flat_group::width - 1 : 0;
+        num_elements = elements;
+        growth_left = growth;
+        throw;
+    }
+    for (size_type i = 0; i < old_n; ++i) {
+        if (old_ctrl[i] >= 0) {
+            forgedstl::destroy(old_slots + i);
+        }
+    }
+    if (old_n != 0) {
+        ctrl_allocator::deallocate(this->get_alloc(), old_ctrl, old_n);
+        slot_allocator::deallocate(this->get_alloc(), old_slots, old_n);
+    }
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+void flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::clear() {
+    for (size_type i = 0; i < num_slots; ++i) {
+        if (ctrl[i] >= 0) {
+            forgedstl::destroy(slots + i);
+        }
+    }
+    if (num_slots != 0) {
+        memset(ctrl, __flat_empty, num_slots);
+    }
+    num_elements = 0;
+    growth_left = max_load(num_slots);
+}
+
+// Copies slot for slot, so nothing is hashed again.
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey,
+          typename EqualKey, typename Alloc>
+void flat_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::copy_from(
+    const flat_hashtable& ht) {
+    if (num_slots != ht.num_slots) {
+        deallocate_slots();
+        reset();
+        if (ht.num_slots != 0) {
+            allocate_slots(ht.num_slots);
+        }
+    }
+    size_type i = 0;
+    try {
+        for (; i < ht.num_slots; ++i) {
+            if (ht.ctrl[i] >= 0) {
+                forgedstl::construct(slots + i, ht.slots[i]);
+            }
+        }
+    } catch (...) {
+        while (i-- > 0) {
+            if (ht.ctrl[i] >= 0) {
+                forgedstl::destroy(slots + i);
+            }
+        }
+        throw;
+    }
+    if (num_slots != 0) {
+        memcpy(ctrl, ht.ctrl, num_slots);
+    }
+    num_elements = ht.num_elements;
+    growth_left = ht.growth_left;
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_FLAT_HASHTABLE_H_
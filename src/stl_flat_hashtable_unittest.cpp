@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "stl_flat_hashtable.h"
+#include "stl_function.h"
+#include "stl_hash_fun.h"
+#include "test_alloc.h"
+
+namespace forgedstl {
+
+typedef flat_hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+    flat_int_table;
+
+TEST(FlatHashTableTest, Basic) {
+    flat_int_table iht(50, hash<int>(), equal_to<int>());
+    ASSERT_TRUE(iht.empty());
+    ASSERT_EQ(0, iht.size());
+    ASSERT_EQ(64, iht.bucket_count());
+
+    int a[] = { 59, 63, 108, 2, 53, 55 };
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_TRUE(iht.insert_unique(a[i]).second);
+    }
+    EXPECT_FALSE(iht.insert_unique(53).second);
+    ASSERT_EQ(6, iht.size());
+    for (int i = 0; i < 6; ++i) {
+        ASSERT_TRUE(iht.find(a[i]) != iht.end());
+        EXPECT_EQ(a[i], *iht.find(a[i]));
+    }
+    EXPECT_TRUE(iht.find(54) == iht.end());
+    EXPECT_EQ(0, iht.count(54));
+
+    int sum = 0;
+    int n = 0;
+    for (flat_int_table::iterator it = iht.begin(); it != iht.end(); ++it) {
+        sum += *it;
+        ++n;
+    }
+    EXPECT_EQ(6, n);
+    EXPECT_EQ(59 + 63 + 108 + 2 + 53 + 55, sum);
+
+    for (int i = 0; i < 1000; ++i) {
+        iht.insert_unique(i);
+    }
+    ASSERT_EQ(1000, iht.size());
+    EXPECT_EQ(2048, iht.bucket_count());
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(1, iht.count(i));
+    }
+
+    const flat_int_table& ciht = iht;
+    EXPECT_EQ(108, *ciht.find(108));
+}
+
+TEST(FlatHashTableTest, Erase) {
+    flat_int_table iht(0, hash<int>(), equal_to<int>());
+    EXPECT_EQ(0, iht.bucket_count());
+    EXPECT_TRUE(iht.find(1) == iht.end());
+    EXPECT_EQ(0, iht.erase(1));
+
+    for (int i = 0; i < 100; ++i) {
+        iht.insert_unique(i);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        EXPECT_EQ(1, iht.erase(i));
+    }
+    EXPECT_EQ(0, iht.erase(0));
+    ASSERT_EQ(50, iht.size());
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(i % 2, iht.count(i));
+    }
+
+    iht.erase(iht.find(1));
+    EXPECT_EQ(49, iht.size());
+    iht.erase(iht.begin(), iht.end());
+    EXPECT_TRUE(iht.empty());
+    EXPECT_TRUE(iht.begin() == iht.end());
+
+    // erased slots are reused or rehashed away instead of growing the table
+    const size_t buckets = iht.bucket_count();
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 50; ++i) {
+            iht.insert_unique(round * 50 + i);
+        }
+        for (int i = 0; i < 50; ++i) {
+            iht.erase(round * 50 + i);
+        }
+    }
+    EXPECT_TRUE(iht.empty());
+    EXPECT_EQ(buckets, iht.bucket_count());
+
+    iht.insert_unique(7);
+    iht.clear();
+    EXPECT_TRUE(iht.empty());
+    EXPECT_EQ(buckets, iht.bucket_count());
+}
+
+TEST(FlatHashTableTest, CopyAndCompare) {
+    flat_int_table t1(10, hash<int>(), equal_to<int>());
+    for (int i = 0; i < 100; ++i) {
+        t1.insert_unique(i * 7);
+    }
+    flat_int_table t2(t1);
+    EXPECT_TRUE(t1 == t2);
+    t2.erase(14);
+    EXPECT_FALSE(t1 == t2);
+    t2.insert_unique(14);
+    EXPECT_TRUE(t1 == t2);
+
+    flat_int_table t3(0, hash<int>(), equal_to<int>());
+    t3.insert_unique(-1);
+    t3 = t1;
+    EXPECT_TRUE(t1 == t3);
+    EXPECT_EQ(0, t3.count(-1));
+
+    t3.swap(t2);
+    EXPECT_TRUE(t1 == t2);
+
+    int a[] = { 1, 2, 3, 2, 1 };
+    flat_int_table t4(0, hash<int>(), equal_to<int>());
+    t4.insert_unique(a, a + 5);
+    EXPECT_EQ(3, t4.size());
+}
+
+TEST(FlatHashTableTest, MoveAndEmplace) {
+    typedef pair<const int, std::string> value;
+    typedef flat_hashtable<value, int, hash<int>, select1st<value>,
+                           equal_to<int> > Table;
+    Table ht(0, hash<int>(), equal_to<int>());
+
+    std::string s(100, 'x');
+    EXPECT_TRUE(ht.insert_unique(value(1, std::move(s))).second);
+    EXPECT_TRUE(s.empty());
+    EXPECT_TRUE(ht.emplace_unique(2, "two").second);
+    EXPECT_FALSE(ht.emplace_unique(2, "deux").second);
+    EXPECT_EQ("two", ht.find(2)->second);
+    for (int i = 3; i < 200; ++i) {
+        ht.emplace_unique(i, std::to_string(i));
+    }
+    EXPECT_EQ(199, ht.size());
+    EXPECT_EQ(100, ht.find(1)->second.size());
+    EXPECT_EQ("150", ht.find(150)->second);
+    ht.find_or_insert(value(150, "x")).second += "!";
+    EXPECT_EQ("150!", ht.find(150)->second);
+
+    Table ht2(std::move(ht));
+    EXPECT_TRUE(ht.empty());
+    EXPECT_TRUE(ht.find(2) == ht.end());
+    EXPECT_EQ(199, ht2.size());
+    ht.emplace_unique(5, "five");
+    EXPECT_EQ(1, ht.size());
+
+    ht = std::move(ht2);
+    EXPECT_TRUE(ht2.empty());
+    EXPECT_EQ(199, ht.size());
+    EXPECT_EQ("two", ht.find(2)->second);
+}
+
+TEST(FlatHashTableTest, StatefulAlloc) {
+    typedef flat_hashtable<int, int, hash<int>, identity<int>, equal_to<int>,
+                           stateful_alloc> Table;
+    test_pool p1, p2;
+    {
+        Table t1(50, hash<int>(), equal_to<int>(), stateful_alloc(&p1));
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        EXPECT_LT(0, p1.bytes_in_use);
+        EXPECT_EQ(0, p2.bytes_in_use);
+
+        Table t2(t1);
+        EXPECT_EQ(&p1, t2.get_allocator().resource());
+
+        Table t3(50, hash<int>(), equal_to<int>(), stateful_alloc(&p2));
+        t3 = t1;
+        EXPECT_EQ(&p2, t3.get_allocator().resource());
+        EXPECT_EQ(100, t3.size());
+
+        Table t4(0, hash<int>(), equal_to<int>(), stateful_alloc(&p2));
+        t4 = std::move(t2);
+        EXPECT_EQ(100, t4.size());
+        EXPECT_TRUE(t1 == t4);
+
+        t3.swap(t4);
+        EXPECT_EQ(100, t3.size());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+} // namespace forgedstl
@@ -0,0 +1,442 @@
+#ifndef FORGED_STL_INTERNAL_FROZEN_HASHTABLE_H_
+#define FORGED_STL_INTERNAL_FROZEN_HASHTABLE_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define __FORGED_STL_HAS_MMAP 1
+#endif
+
+#include "stl_alloc.h"
+#include "stl_hash_fun.h"
+#include "stl_vector.h"
+
+namespace forgedstl {
+
+// The file image of a frozen_hashtable, all offsets from its first byte:
+// this header, the seed of every bucket, then the values in slot order.
+struct __frozen_header {
+    char magic[8];
+    unsigned byte_order;    // 0x01020304 as written by the saving machine
+    unsigned hash_bits;     // 8 * sizeof(size_t) of the saving machine
+    unsigned long long value_size;
+    unsigned long long count;
+    unsigned long long buckets;
+    unsigned long long seeds_offset;
+    unsigned long long values_offset;
+    unsigned long long image_size;
+};
+
+static const char __frozen_magic[8] = { 'F', 'S', 'T', 'L', 'M', 'P', 'H', '1' };
+
+// An immutable table of unique keys laid out by a minimal perfect hash,
+// built from any range of values, such as a populated hashtable:
+//
+//     frozen.build(ht.begin(), ht.end());
+//     frozen.save("table.img");
+//     ...
+//     other.load("table.img");  // mmap; nothing is parsed or copied
+//
+// Each key's hash code picks one of about size() / 4 buckets, and the
+// bucket's seed turns the hash code into the key's slot in an array of
+// exactly size() values. A lookup is one hash, one seed read and one
+// value compared. There are no pointers in the image, so it works at any
+// address and pages are faulted in as lookups reach them.
+//
+// Value must be trivially copyable, and HashFunc must give the same codes
+// in every process that opens the file; load refuses an image written by
+// a machine with another byte order or size_t. Seeds take 32 bits, which
+// caps a table at 2^31 values.
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+class frozen_hashtable : protected __alloc_holder<Alloc> {
+    static_assert(std::is_trivially_copyable<Value>::value,
+                  "frozen_hashtable stores its values as raw bytes");
+    static_assert(alignof(Value) <= alignof(unsigned long long),
+                  "frozen_hashtable images are 8-byte aligned");
+
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef HashFunc hasher;
+    typedef EqualKey key_equal;
+
+    typedef size_t            size_type;
+    typedef ptrdiff_t         difference_type;
+    typedef const value_type* const_iterator;
+    typedef const value_type& const_reference;
+    typedef Alloc             allocator_type;
+
+    explicit frozen_hashtable(const HashFunc& hf = HashFunc(),
+                              const EqualKey& eql = EqualKey(),
+                              const ExtractKey& ext = ExtractKey(),
+                              const allocator_type& a = allocator_type())
+        : base(a), hash(hf), equals(eql), get_key(ext), owned(a),
+          image(nullptr), mapped_size(0) { }
+
+    frozen_hashtable(const frozen_hashtable&) = delete;
+    frozen_hashtable& operator=(const frozen_hashtable&) = delete;
+
+    ~frozen_hashtable() {
+        clear();
+    }
+
+    size_type size() const {
+        return image == nullptr ? 0 : size_type(header()->count);
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    size_type bucket_count() const {
+        return image == nullptr ? 0 : size_type(header()->buckets);
+    }
+
+    const_iterator begin() const {
+        return values();
+    }
+    const_iterator end() const {
+        return values() + size();
+    }
+
+    const_iterator find(const key_type& key) const {
+        if (size() == 0) {
+            return end();
+        }
+        const size_t h = hash(key);
+        const value_type* v = values() + slot_of(h);
+        return equals(get_key(*v), key) ? v : end();
+    }
+    size_type count(const key_type& key) const {
+        return find(key) == end() ? 0 : 1;
+    }
+
+    // Replaces the contents with the values in [first, last); of values
+    // with equal keys only the first is kept. Returns false, leaving the
+    // table empty, if two different keys have the same hash code, since
+    // no seed can then tell them apart.
+    template <typename ForwardIterator>
+    bool build(ForwardIterator first, ForwardIterator last);
+
+    // Writes the image to path, which load can open later.
+    bool save(const char* path) const;
+    // Replaces the contents with the image at path, mapped read-only
+    // where the system supports it and read into memory otherwise.
+    // Returns false, leaving the table empty, for a missing file or an
+    // image this build cannot use.
+    bool load(const char* path);
+
+    void clear() {
+#ifdef __FORGED_STL_HAS_MMAP
+        if (mapped_size != 0) {
+            munmap(const_cast<char*>(image), mapped_size);
+        }
+#endif
+        owned.clear();
+        owned.shrink_to_fit();
+        image = nullptr;
+        mapped_size = 0;
+    }
+
+private:
+    typedef __alloc_holder<Alloc> base;
+    typedef unsigned long long word;
+
+    enum { bucket_load = 4 };
+    // A seed with this bit set holds the slot of a one-key bucket itself.
+    static const unsigned direct_slot = 0x80000000u;
+
+    hasher hash;
+    key_equal equals;
+    ExtractKey get_key;
+
+    vector<word, Alloc> owned;  // the image when it was built or read
+    const char* image;
+    size_t mapped_size;         // of the image when it is mapped
+
+    const __frozen_header* header() const {
+        return reinterpret_cast<const __frozen_header*>(image);
+    }
+    const unsigned* seeds() const {
+        return reinterpret_cast<const unsigned*>(image +
+                                                 header()->seeds_offset);
+    }
+    const value_type* values() const {
+        return image == nullptr ? nullptr :
+            reinterpret_cast<const value_type*>(image +
+                                                header()->values_offset);
+    }
+
+    // h scaled into [0, n) by the high half of a 128-bit product.
+    static size_type reduce(unsigned long long h, size_type n) {
+        unsigned long long lo = h, hi = n;
+        __stl_hash_mum(lo, hi);
+        return size_type(hi);
+    }
+    static size_type bucket_of(size_t h, size_type buckets) {
+        return reduce(__stl_hash_mix64(h), buckets);
+    }
+    static size_type seeded_slot(size_t h, unsigned seed, size_type n) {
+        return reduce(__stl_hash_mix64(
+            h + (seed + 1) * 0x9E3779B97F4A7C15ull), n);
+    }
+    size_type slot_of(size_t h) const {
+        const __frozen_header* hd = header();
+        const unsigned seed = seeds()[bucket_of(h, size_type(hd->buckets))];
+        return seed & direct_slot ? size_type(seed & ~direct_slot) :
+            seeded_slot(h, seed, size_type(hd->count));
+    }
+
+    static bool valid_image(const char* p, size_t size);
+};
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+template <typename ForwardIterator>
+bool frozen_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::build(
+    ForwardIterator first, ForwardIterator last) {
+    clear();
+
+    // the input, grouped by bucket
+    vector<value_type, Alloc> input(this->get_alloc());
+    vector<size_t, Alloc> codes(this->get_alloc());
+    for (; first != last; ++first) {
+        input.push_back(*first);
+        codes.push_back(hash(get_key(input.back())));
+    }
+    const size_type buckets = input.size() / bucket_load + 1;
+    vector<size_type, Alloc> start(buckets + 1, 0, this->get_alloc());
+    for (size_type i = 0; i < input.size(); ++i) {
+        ++start[bucket_of(codes[i], buckets) + 1];
+    }
+    for (size_type b = 0; b < buckets; ++b) {
+        start[b + 1] += start[b];
+    }
+    vector<size_type, Alloc> order(input.size(), 0, this->get_alloc());
+    vector<size_type, Alloc> fill(start.begin(), start.end() - 1,
+                                  this->get_alloc());
+    for (size_type i = 0; i < input.size(); ++i) {
+        order[fill[bucket_of(codes[i], buckets)]++] = i;
+    }
+
+    // drop repeated keys; a shared hash code between others is fatal
+    vector<size_type, Alloc> len(buckets, 0, this->get_alloc());
+    size_type n = 0;
+    for (size_type b = 0; b < buckets; ++b) {
+        size_type* keys = order.begin() + start[b];
+        size_type k = 0;
+        for (size_type i = 0; i < start[b + 1] - start[b]; ++i) {
+            bool repeated = false;
+            for (size_type j = 0; j < k && !repeated; ++j) {
+                if (codes[keys[j]] == codes[keys[i]]) {
+                    if (!equals(get_key(input[keys[j]]),
+                                get_key(input[keys[i]]))) {
+                        return false;
+                    }
+                    repeated = true;
+                }
+            }
+            if (!repeated) {
+                keys[k++] = keys[i];
+            }
+        }
+        len[b] = k;
+        n += k;
+    }
+    if (n >= direct_slot) {
+        return false;
+    }
+
+    // Largest buckets first, while most slots are free: try seeds until
+    // every key of the bucket lands on its own free slot. The one-key
+    // buckets at the end just take the free slots that are left.
+    vector<size_type, Alloc> by_size(buckets, 0, this->get_alloc());
+    for (size_type b = 0; b < buckets; ++b) {
+        by_size[b] = b;
+    }
+    std::sort(by_size.begin(), by_size.end(),
+              [&len](size_type x, size_type y) { return len[x] > len[y]; });
+    vector<unsigned, Alloc> seed(buckets, 0u, this->get_alloc());
+    vector<char, Alloc> taken(n, 0, this->get_alloc());
+    vector<size_type, Alloc> slot(input.size(), 0, this->get_alloc());
+    size_type free_slot = 0;
+    for (size_type i = 0; i < buckets && len[by_size[i]] != 0; ++i) {
+        const size_type b = by_size[i];
+        const size_type* keys = order.begin() + start[b];
+        if (len[b] == 1) {
+            while (taken[free_slot]) {
+                ++free_slot;
+            }
+            taken[free_slot] = 1;
+            slot[keys[0]] = free_slot;
+            seed[b] = direct_slot | unsigned(free_slot);
+            continue;
+        }
+        for (unsigned s = 0; ; ++s) {
+            if (s == direct_slot) {
+                clear();
+                return false;
+            }
+            size_type k = 0;
+            for (; k < len[b]; ++k) {
+                const size_type at = seeded_slot(codes[keys[k]], s, n);
+                if (taken[at]) {
+                    break;
+                }
+                taken[at] = 1;
+                slot[keys[k]] = at;
+            }
+            if (k == len[b]) {
+                seed[b] = s;
+                break;
+            }
+            while (k > 0) {
+                taken[slot[keys[--k]]] = 0;
+            }
+        }
+    }
+
+    // the image
+    __frozen_header hd;
+    std::memcpy(hd.magic, __frozen_magic, sizeof(hd.magic));
+    hd.byte_order = 0x01020304u;
+    hd.hash_bits = unsigned(8 * sizeof(size_t));
+    hd.value_size = sizeof(value_type);
+    hd.count = n;
+    hd.buckets = buckets;
+    hd.seeds_offset = sizeof(__frozen_header);
+    hd.values_offset = (hd.seeds_offset + buckets * sizeof(unsigned) +
+                        sizeof(word) - 1) / sizeof(word) * sizeof(word);
+    hd.image_size = hd.values_offset + n * sizeof(value_type);
+    owned.insert(owned.end(),
+                 size_type((hd.image_size + sizeof(word) - 1) / sizeof(word)),
+                 word(0));
+    char* p = reinterpret_cast<char*>(owned.begin());
+    std::memcpy(p, &hd, sizeof(hd));
+    std::memcpy(p + hd.seeds_offset, seed.begin(),
+                buckets * sizeof(unsigned));
+    for (size_type b = 0; b < buckets; ++b) {
+        for (size_type k = 0; k < len[b]; ++k) {
+            const size_type i = order[start[b] + k];
+            std::memcpy(p + hd.values_offset + slot[i] * sizeof(value_type),
+                        &input[i], sizeof(value_type));
+        }
+    }
+    image = p;
+    return true;
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+bool frozen_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::save(
+    const char* path) const {
+    __frozen_header empty_image;
+    const char* p = image;
+    if (p == nullptr) {
+        // an empty table still saves a valid image
+        std::memset(&empty_image, 0, sizeof(empty_image));
+        std::memcpy(empty_image.magic, __frozen_magic, sizeof(__frozen_magic));
+        empty_image.byte_order = 0x01020304u;
+        empty_image.hash_bits = unsigned(8 * sizeof(size_t));
+        empty_image.value_size = sizeof(value_type);
+        empty_image.seeds_offset = sizeof(__frozen_header);
+        empty_image.values_offset = sizeof(__frozen_header);
+        empty_image.image_size = sizeof(__frozen_header);
+        p = reinterpret_cast<const char*>(&empty_image);
+    }
+    const size_t size =
+        size_t(reinterpret_cast<const __frozen_header*>(p)->image_size);
+    std::FILE* f = std::fopen(path, "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    const bool written = std::fwrite(p, 1, size, f) == size;
+    return std::fclose(f) == 0 && written;
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+bool frozen_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::load(
+    const char* path) {
+    clear();
+#ifdef __FORGED_STL_HAS_MMAP
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);  // the mapping stays valid
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    if (!valid_image(static_cast<const char*>(p), size_t(st.st_size))) {
+        munmap(p, size_t(st.st_size));
+        return false;
+    }
+    image = static_cast<const char*>(p);
+    mapped_size = size_t(st.st_size);
+    if (size() == 0) {
+        clear();  // nothing worth keeping mapped
+    }
+    return true;
+#else
+    std::FILE* f = std::fopen(path, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    long size = -1;
+    if (std::fseek(f, 0, SEEK_END) == 0) {
+        size = std::ftell(f);
+    }
+    bool read = size > 0 && std::fseek(f, 0, SEEK_SET) == 0;
+    if (read) {
+        owned.insert(owned.end(),
+                     (size_t(size) + sizeof(word) - 1) / sizeof(word),
+                     word(0));
+        read = std::fread(owned.begin(), 1, size_t(size), f) == size_t(size);
+    }
+    std::fclose(f);
+    const char* p = reinterpret_cast<const char*>(owned.begin());
+    if (!read || !valid_image(p, size_t(size))) {
+        clear();
+        return false;
+    }
+    image = p;
+    if (this->size() == 0) {
+        clear();
+    }
+    return true;
+#endif
+}
+
+// Only the header is checked; the seeds and values are trusted as saved.
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+bool frozen_hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::valid_image(
+    const char* p, size_t size) {
+    if (size < sizeof(__frozen_header)) {
+        return false;
+    }
+    const __frozen_header* hd = reinterpret_cast<const __frozen_header*>(p);
+    return std::memcmp(hd->magic, __frozen_magic, sizeof(hd->magic)) == 0 &&
+           hd->byte_order == 0x01020304u &&
+           hd->hash_bits == 8 * sizeof(size_t) &&
+           hd->value_size == sizeof(value_type) &&
+           hd->image_size <= size &&
+           hd->values_offset % sizeof(word) == 0 &&
+           hd->seeds_offset + hd->buckets * sizeof(unsigned) <=
+               hd->values_offset &&
+           hd->values_offset + hd->count * sizeof(value_type) <=
+               hd->image_size &&
+           (hd->count == 0 || hd->buckets != 0);
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_FROZEN_HASHTABLE_H_
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+
+#include "stl_frozen_hashtable.h"
+#include "stl_function.h"
+#include "stl_hash_fun.h"
+#include "stl_hashtable.h"
+
+namespace forgedstl {
+
+struct int_entry {
+    int key;
+    int value;
+};
+
+struct entry_key {
+    const int& operator()(const int_entry& e) const {
+        return e.key;
+    }
+};
+
+typedef frozen_hashtable<int_entry, int, hash<int>, entry_key,
+                         equal_to<int> > frozen_int_map;
+
+// a hash with a single code, which no seed can split
+struct constant_hash {
+    size_t operator()(int) const {
+        return 7;
+    }
+};
+
+static std::string temp_path(const char* name) {
+    return std::string(::testing::TempDir()) + name;
+}
+
+TEST(FrozenHashTableTest, Build) {
+    frozen_int_map m;
+    EXPECT_TRUE(m.empty());
+    EXPECT_TRUE(m.find(1) == m.end());
+    const int_entry* none = nullptr;
+    EXPECT_TRUE(m.build(none, none));
+    EXPECT_EQ(0, m.size());
+
+    hashtable<int_entry, int, hash<int>, entry_key, equal_to<int> >
+        source(100, hash<int>(), equal_to<int>());
+    for (int i = 0; i < 5000; ++i) {
+        int_entry e = { i * 3, -i };
+        source.insert_unique(e);
+    }
+    EXPECT_TRUE(m.build(source.begin(), source.end()));
+    EXPECT_EQ(5000, m.size());
+    EXPECT_EQ(5000 / 4 + 1, m.bucket_count());
+    for (int i = 0; i < 5000; ++i) {
+        frozen_int_map::const_iterator it = m.find(i * 3);
+        ASSERT_TRUE(it != m.end());
+        EXPECT_EQ(i * 3, it->key);
+        EXPECT_EQ(-i, it->value);
+        EXPECT_EQ(0, m.count(i * 3 + 1));
+    }
+    long long sum = 0;
+    for (frozen_int_map::const_iterator it = m.begin(); it != m.end(); ++it) {
+        sum += it->key;
+    }
+    EXPECT_EQ(3LL * 4999 * 5000 / 2, sum);
+
+    // the first of the values with one key is kept
+    int_entry repeated[] = { { 1, 10 }, { 2, 20 }, { 1, 11 }, { 3, 30 } };
+    EXPECT_TRUE(m.build(repeated, repeated + 4));
+    EXPECT_EQ(3, m.size());
+    EXPECT_EQ(10, m.find(1)->value);
+
+    frozen_hashtable<int_entry, int, constant_hash, entry_key,
+                     equal_to<int> > colliding;
+    EXPECT_FALSE(colliding.build(repeated, repeated + 4));
+    EXPECT_TRUE(colliding.empty());
+    EXPECT_TRUE(colliding.build(repeated, repeated + 1));
+    EXPECT_EQ(1, colliding.count(1));
+}
+
+TEST(FrozenHashTableTest, SaveAndLoad) {
+    const std::string path = temp_path("frozen_hashtable_unittest.img");
+    frozen_int_map m;
+    int_entry entries[1000];
+    for (int i = 0; i < 1000; ++i) {
+        entries[i].key = i * i;
+        entries[i].value = i;
+    }
+    ASSERT_TRUE(m.build(entries, entries + 1000));
+    ASSERT_TRUE(m.save(path.c_str()));
+
+    frozen_int_map loaded;
+    ASSERT_TRUE(loaded.load(path.c_str()));
+    EXPECT_EQ(1000, loaded.size());
+    EXPECT_EQ(m.bucket_count(), loaded.bucket_count());
+    for (int i = 0; i < 1000; ++i) {
+        frozen_int_map::const_iterator it = loaded.find(i * i);
+        ASSERT_TRUE(it != loaded.end());
+        EXPECT_EQ(i, it->value);
+    }
+    EXPECT_EQ(0, loaded.count(2));
+
+    m.clear();
+    ASSERT_TRUE(m.save(path.c_str()));
+    EXPECT_TRUE(loaded.load(path.c_str()));
+    EXPECT_TRUE(loaded.empty());
+
+    // an image of another value type, a bad file and a missing one
+    frozen_hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+        other;
+    EXPECT_FALSE(other.load(path.c_str()));
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    std::fputs("not an image", f);
+    std::fclose(f);
+    EXPECT_FALSE(loaded.load(path.c_str()));
+    EXPECT_TRUE(loaded.empty());
+    std::remove(path.c_str());
+    EXPECT_FALSE(loaded.load(path.c_str()));
+}
+
+} // namespace forgedstl
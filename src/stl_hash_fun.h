@@ -1,16 +1,123 @@
 #ifndef FORGED_STL_INTERNAL_HASH_FUN_H_
 #define FORGED_STL_INTERNAL_HASH_FUN_H_
 
+#include <cstddef>
+#include <cstring>
+#include <string>
+
 namespace forgedstl {
 template <typename Key>
 struct hash { };
 
-inline size_t __stl_hash_string(const char* s) {
-    unsigned long h = 0;
-    for (; *s; ++s) {
-        h = 5 * h + *s;
+// Replaces a and b with the low and high halves of their 128-bit product.
+inline void __stl_hash_mum(unsigned long long& a, unsigned long long& b) {
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 r = (unsigned __int128)a * b;
+    a = (unsigned long long)r;
+    b = (unsigned long long)(r >> 64);
+#else
+    const unsigned long long ha = a >> 32, la = (unsigned)a;
+    const unsigned long long hb = b >> 32, lb = (unsigned)b;
+    const unsigned long long hh = ha * hb, hl = ha * lb;
+    const unsigned long long lh = la * hb, ll = la * lb;
+    const unsigned long long t = ll + (hl << 32);
+    const unsigned long long lo = t + (lh << 32);
+    a = lo;
+    b = hh + (hl >> 32) + (lh >> 32) + (t < ll) + (lo < t);
+#endif
+}
+
+// The two halves of a * b xor-ed together: one multiply that spreads
+// every input bit across the whole result.
+inline unsigned long long __stl_hash_fold(unsigned long long a,
+                                          unsigned long long b) {
+    __stl_hash_mum(a, b);
+    return a ^ b;
+}
+
+static const unsigned long long __stl_hash_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+// Scrambles an integer so that keys differing only in their high bits or
+// by a power-of-two stride still land in different buckets. Two rounds,
+// since one leaves the low bits weak when only high input bits change.
+inline size_t __stl_hash_mix64(unsigned long long x) {
+    unsigned long long a = x ^ __stl_hash_secret[0];
+    unsigned long long b = __stl_hash_secret[1];
+    __stl_hash_mum(a, b);
+    return size_t(__stl_hash_fold(a ^ __stl_hash_secret[0],
+                                  b ^ __stl_hash_secret[1]));
+}
+
+inline unsigned long long __stl_hash_read8(const unsigned char* p) {
+    unsigned long long v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+inline unsigned long long __stl_hash_read4(const unsigned char* p) {
+    unsigned v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+// Hashes n bytes eight at a time in the manner of wyhash: long keys run
+// three independent lanes of 16 bytes, and keys of 16 bytes or fewer are
+// read with at most four overlapping loads and no loop. The result
+// depends on the byte order of the machine.
+inline size_t __stl_hash_bytes(const void* key, size_t n, size_t seed = 0) {
+    const unsigned long long* const s = __stl_hash_secret;
+    const unsigned char* p = static_cast<const unsigned char*>(key);
+    unsigned long long h = __stl_hash_fold(seed ^ s[0], s[1]);
+    unsigned long long a, b;
+    if (n <= 16) {
+        if (n >= 4) {
+            const size_t mid = (n >> 3) << 2;
+            a = (__stl_hash_read4(p) << 32) | __stl_hash_read4(p + mid);
+            b = (__stl_hash_read4(p + n - 4) << 32) |
+                __stl_hash_read4(p + n - 4 - mid);
+        } else if (n > 0) {
+            a = ((unsigned long long)p[0] << 16) |
+                ((unsigned long long)p[n >> 1] << 8) | p[n - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = n;
+        if (i > 48) {
+            unsigned long long h1 = h, h2 = h;
+            do {
+                h = __stl_hash_fold(__stl_hash_read8(p) ^ s[1],
+                                    __stl_hash_read8(p + 8) ^ h);
+                h1 = __stl_hash_fold(__stl_hash_read8(p + 16) ^ s[2],
+                                     __stl_hash_read8(p + 24) ^ h1);
+                h2 = __stl_hash_fold(__stl_hash_read8(p + 32) ^ s[3],
+                                     __stl_hash_read8(p + 40) ^ h2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            h ^= h1 ^ h2;
+        }
+        for (; i > 16; i -= 16, p += 16) {
+            h = __stl_hash_fold(__stl_hash_read8(p) ^ s[1],
+                                __stl_hash_read8(p + 8) ^ h);
+        }
+        a = __stl_hash_read8(p + i - 16);
+        b = __stl_hash_read8(p + i - 8);
     }
-    return size_t(h);
+    a ^= s[1];
+    b ^= h;
+    __stl_hash_mum(a, b);
+    return size_t(__stl_hash_fold(a ^ s[0] ^ n, b ^ s[1]));
+}
+
+inline size_t __stl_hash_string(const char* s, size_t n) {
+    return __stl_hash_bytes(s, n);
+}
+inline size_t __stl_hash_string(const char* s) {
+    return __stl_hash_bytes(s, std::strlen(s));
 }
 
 template <> struct hash<char*> {
@@ -67,15 +174,67 @@ template <> struct hash<unsigned int> {
     }
 };
 
+// Keys of 32 bits or fewer hash to themselves, which the bucket policies
+// of hashtable already spread well. Wider keys are mixed, or their high
+// bits would be lost to a 32-bit size_t and to the bucket modulo.
 template <> struct hash<long> {
     size_t operator()(long x) const {
-        return x;
+        return __stl_hash_mix64((unsigned long long)x);
     }
 };
 
 template <> struct hash<unsigned long> {
     size_t operator()(unsigned long x) const {
-        return x;
+        return __stl_hash_mix64(x);
+    }
+};
+
+template <> struct hash<long long> {
+    size_t operator()(long long x) const {
+        return __stl_hash_mix64((unsigned long long)x);
+    }
+};
+
+template <> struct hash<unsigned long long> {
+    size_t operator()(unsigned long long x) const {
+        return __stl_hash_mix64(x);
+    }
+};
+
+// Pointers are aligned, so their low bits are nearly always zero.
+template <typename T> struct hash<T*> {
+    size_t operator()(T* p) const {
+        return __stl_hash_mix64((unsigned long long)(size_t)p);
+    }
+};
+
+// 0.0 and -0.0 compare equal and so must hash alike; NaNs never compare
+// equal and may hash anyhow.
+template <> struct hash<float> {
+    size_t operator()(float x) const {
+        if (x == 0.0f) {
+            return 0;
+        }
+        unsigned bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return __stl_hash_mix64(bits);
+    }
+};
+
+template <> struct hash<double> {
+    size_t operator()(double x) const {
+        if (x == 0.0) {
+            return 0;
+        }
+        unsigned long long bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return __stl_hash_mix64(bits);
+    }
+};
+
+template <> struct hash<std::string> {
+    size_t operator()(const std::string& s) const {
+        return __stl_hash_string(s.data(), s.size());
     }
 };
 
@@ -0,0 +1,242 @@
+#ifndef FORGED_STL_INTERNAL_HASH_MULTIMAP_H_
+#define FORGED_STL_INTERNAL_HASH_MULTIMAP_H_
+
+#include "stl_function.h"
+#include "stl_hash_fun.h"
+#include "stl_hashtable.h"
+#include "stl_pair.h"
+
+namespace forgedstl {
+
+template <typename Key, typename T, typename HashFcn = hash<Key>,
+          typename EqualKey = equal_to<Key>, typename Alloc = alloc>
+class hash_multimap;
+
+template <typename Key, typename T, typename HashFcn, typename EqualKey,
+          typename Alloc>
+inline bool operator==(const hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& x,
+                       const hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& y);
+
+template <typename Key, typename T, typename HashFcn, typename EqualKey,
+          typename Alloc>
+class hash_multimap {
+private:
+    typedef hashtable<pair<const Key, T>, Key, HashFcn,
+                      select1st<pair<const Key, T> >, EqualKey, Alloc> ht;
+
+public:
+    typedef typename ht::key_type key_type;
+    typedef T data_type;
+    typedef T mapped_type;
+    typedef typename ht::value_type value_type;
+    typedef typename ht::hasher hasher;
+    typedef typename ht::key_equal key_equal;
+    typedef typename ht::allocator_type allocator_type;
+
+    typedef typename ht::size_type size_type;
+    typedef typename ht::difference_type difference_type;
+    typedef typename ht::pointer pointer;
+    typedef typename ht::const_pointer const_pointer;
+    typedef typename ht::reference reference;
+    typedef typename ht::const_reference const_reference;
+
+    typedef typename ht::iterator iterator;
+    typedef typename ht::const_iterator const_iterator;
+    typedef typename ht::node_type node_type;
+
+    hash_multimap() : rep(100, hasher(), key_equal()) { }
+    explicit hash_multimap(size_type n) : rep(n, hasher(), key_equal()) { }
+    hash_multimap(size_type n, const hasher& hf) : rep(n, hf, key_equal()) { }
+    hash_multimap(size_type n, const hasher& hf, const key_equal& eql,
+                  const allocator_type& a = allocator_type())
+        : rep(n, hf, eql, a) { }
+
+    template <typename InputIterator>
+    hash_multimap(InputIterator f, InputIterator l)
+        : rep(100, hasher(), key_equal()) {
+        rep.insert_equal(f, l);
+    }
+    template <typename InputIterator>
+    hash_multimap(InputIterator f, InputIterator l, size_type n)
+        : rep(n, hasher(), key_equal()) {
+        rep.insert_equal(f, l);
+    }
+    template <typename InputIterator>
+    hash_multimap(InputIterator f, InputIterator l, size_type n,
+                  const hasher& hf, const key_equal& eql)
+        : rep(n, hf, eql) {
+        rep.insert_equal(f, l);
+    }
+
+    allocator_type get_allocator() const {
+        return rep.get_allocator();
+    }
+    hasher hash_funct() const {
+        return rep.hash_funct();
+    }
+    key_equal key_eq() const {
+        return rep.key_eq();
+    }
+
+    size_type size() const {
+        return rep.size();
+    }
+    size_type max_size() const {
+        return rep.max_size();
+    }
+    bool empty() const {
+        return rep.empty();
+    }
+    void swap(hash_multimap& hs) {
+        rep.swap(hs.rep);
+    }
+
+    iterator begin() {
+        return rep.begin();
+    }
+    iterator end() {
+        return rep.end();
+    }
+    const_iterator begin() const {
+        return rep.begin();
+    }
+    const_iterator end() const {
+        return rep.end();
+    }
+
+    iterator insert(const value_type& obj) {
+        return rep.insert_equal(obj);
+    }
+    iterator insert(value_type&& obj) {
+        return rep.insert_equal(std::move(obj));
+    }
+    template <typename InputIterator>
+    void insert(InputIterator f, InputIterator l) {
+        rep.insert_equal(f, l);
+    }
+    iterator insert_noresize(const value_type& obj) {
+        return rep.insert_equal_noresize(obj);
+    }
+    template <typename... Args>
+    iterator emplace(Args&&... args) {
+        return rep.emplace_equal(std::forward<Args>(args)...);
+    }
+
+    iterator find(const key_type& key) {
+        return rep.find(key);
+    }
+    const_iterator find(const key_type& key) const {
+        return rep.find(key);
+    }
+    size_type count(const key_type& key) const {
+        return rep.count(key);
+    }
+    pair<iterator, iterator> equal_range(const key_type& key) {
+        return rep.equal_range(key);
+    }
+    pair<const_iterator, const_iterator>
+    equal_range(const key_type& key) const {
+        return rep.equal_range(key);
+    }
+
+    // The batch calls overlap the cache misses of many lookups; see
+    // hashtable::find_batch.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator f, ForwardIterator l,
+                              OutputIterator result) {
+        return rep.find_batch(f, l, result);
+    }
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator f, ForwardIterator l,
+                              OutputIterator result) const {
+        return rep.find_batch(f, l, result);
+    }
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator count_batch(ForwardIterator f, ForwardIterator l,
+                               OutputIterator result) const {
+        return rep.count_batch(f, l, result);
+    }
+    template <typename ForwardIterator>
+    void insert_batch(ForwardIterator f, ForwardIterator l) {
+        rep.insert_equal_batch(f, l);
+    }
+
+    size_type erase(const key_type& key) {
+        return rep.erase(key);
+    }
+    void erase(iterator it) {
+        rep.erase(it);
+    }
+    void erase(iterator f, iterator l) {
+        rep.erase(f, l);
+    }
+    // extract and insert move an element between hash_maps and
+    // hash_multimaps of the same types without allocating; see
+    // hashtable::extract.
+    node_type extract(const_iterator it) {
+        return rep.extract(it);
+    }
+    node_type extract(const key_type& key) {
+        return rep.extract(key);
+    }
+    iterator insert(node_type&& nh) {
+        return rep.insert_equal(std::move(nh));
+    }
+    void merge(hash_multimap& hs) {
+        rep.merge_equal(hs.rep);
+    }
+    void clear() {
+        rep.clear();
+    }
+
+    void resize(size_type hint) {
+        rep.resize(hint);
+    }
+    void reserve(size_type n) {
+        rep.reserve(n);
+    }
+    void rehash(size_type n) {
+        rep.rehash(n);
+    }
+    float load_factor() const {
+        return rep.load_factor();
+    }
+    float max_load_factor() const {
+        return rep.max_load_factor();
+    }
+    void max_load_factor(float z) {
+        rep.max_load_factor(z);
+    }
+    size_type bucket_count() const {
+        return rep.bucket_count();
+    }
+    size_type max_bucket_count() const {
+        return rep.max_buckets_count();
+    }
+    size_type elems_in_bucket(size_type n) const {
+        return rep.elems_in_buckets(n);
+    }
+
+    friend bool operator== <> (const hash_multimap&, const hash_multimap&);
+
+private:
+    ht rep;
+};
+
+template <typename Key, typename T, typename HashFcn, typename EqualKey,
+          typename Alloc>
+inline bool operator==(const hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& x,
+                       const hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& y) {
+    return x.rep == y.rep;
+}
+
+template <typename Key, typename T, typename HashFcn, typename EqualKey,
+          typename Alloc>
+inline void swap(hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& x,
+                 hash_multimap<Key, T, HashFcn, EqualKey, Alloc>& y) {
+    x.swap(y);
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_HASH_MULTIMAP_H_
@@ -2,44 +2,216 @@
 #define FORGED_STL_INTERNAL_HASHTABLE_H_
 
 #include <algorithm>
+#include <cmath>
 
 #include "stl_alloc.h"
 #include "stl_construct.h"
+#include "stl_node_handle.h"
 #include "stl_pair.h"
 #include "stl_vector.h"
 
 namespace forgedstl {
 
-template <typename Value>
-struct __hashtable_node {
+static const unsigned long long __stl_prime_list[] = {
+    53,         97,           193,         389,       769,
+  1543,       3079,         6151,        12289,     24593,
+  49157,      98317,        196613,      393241,    786433,
+  1572869,    3145739,      6291469,     12582917,  25165843,
+  50331653,   100663319,    201326611,   402653189, 805306457,
+  1610612741, 3221225473ul, 4294967291ul,
+  6442450967ull,          12884901893ull,         25769803799ull,
+  51539607599ull,         103079215111ull,        206158430209ull,
+  412316860441ull,        824633720837ull,        1649267441681ull,
+  3298534883417ull,       6597069766657ull,       13194139533349ull,
+  26388279066671ull,      52776558133303ull,      105553116266509ull,
+  211106232533047ull,     422212465066001ull,     844424930132057ull,
+  1688849860263953ull,    3377699720527897ull,    6755399441055827ull,
+  13510798882111519ull,   27021597764223071ull,   54043195528445957ull,
+  108086391056891941ull,  216172782113783843ull,  432345564227567621ull,
+  864691128455135281ull,  1729382256910270481ull, 3458764513820540933ull,
+  6917529027641081903ull, 18446744073709551557ull
+};
+// The primes after 4294967291 only fit a 64-bit size_t.
+static const int __stl_num_primes = sizeof(size_t) > 4 ? 60 : 28;
+
+inline unsigned long long __stl_next_prime(unsigned long long n) {
+    const unsigned long long * first = __stl_prime_list;
+    const unsigned long long * last = __stl_prime_list + __stl_num_primes;
+    const unsigned long long * pos = std::lower_bound(first, last, n);
+    return pos == last ? *(last - 1) : *pos;
+}
+
+// Bucket-index policies for hashtable, picked by its BucketPolicy
+// parameter. A policy built from a bucket count hint settles on the actual
+// count, bucket_count(), and maps hash values into [0, bucket_count()).
+
+// Prime bucket counts from __stl_prime_list. Every prime gets its own
+// case with a constant divisor, which the compiler turns into a multiply
+// and a shift instead of a 64-bit divide. The result is still hash % n, so
+// tables keep their layout and weak hash functions still spread well.
+struct __prime_buckets {
+    explicit __prime_buckets(size_t n = 0)
+        : index(std::lower_bound(__stl_prime_list,
+                                 __stl_prime_list + __stl_num_primes - 1,
+                                 (unsigned long long)n) - __stl_prime_list) { }
+
+    size_t bucket_count() const {
+        return size_t(__stl_prime_list[index]);
+    }
+    size_t bucket(size_t h) const {
+        switch (index) {
+        case 0: return h % 53ull;
+        case 1: return h % 97ull;
+        case 2: return h % 193ull;
+        case 3: return h % 389ull;
+        case 4: return h % 769ull;
+        case 5: return h % 1543ull;
+        case 6: return h % 3079ull;
+        case 7: return h % 6151ull;
+        case 8: return h % 12289ull;
+        case 9: return h % 24593ull;
+        case 10: return h % 49157ull;
+        case 11: return h % 98317ull;
+        case 12: return h % 196613ull;
+        case 13: return h % 393241ull;
+        case 14: return h % 786433ull;
+        case 15: return h % 1572869ull;
+        case 16: return h % 3145739ull;
+        case 17: return h % 6291469ull;
+        case 18: return h % 12582917ull;
+        case 19: return h % 25165843ull;
+        case 20: return h % 50331653ull;
+        case 21: return h % 100663319ull;
+        case 22: return h % 201326611ull;
+        case 23: return h % 402653189ull;
+        case 24: return h % 805306457ull;
+        case 25: return h % 1610612741ull;
+        case 26: return h % 3221225473ull;
+        case 27: return h % 4294967291ull;
+        // tables past four billion buckets can afford a plain divide
+        default: return h % size_t(__stl_prime_list[index]);
+        }
+    }
+    static size_t max_bucket_count() {
+        return size_t(__stl_prime_list[__stl_num_primes - 1]);
+    }
+
+    int index;
+};
+
+// Power-of-two bucket counts. The hash is multiplied by 2^64 / phi and the
+// top bits of the product select the bucket (Fibonacci hashing), which
+// mixes identity hashes such as hash<int> well enough for this to replace
+// the modulo with one multiply and one shift.
+struct __power2_buckets {
+    enum { min_bits = 3 };
+    enum { max_bits = sizeof(size_t) * 8 - 1 };
+
+    explicit __power2_buckets(size_t n = 0) : bits(min_bits) {
+        while (bits < max_bits && (size_t(1) << bits) < n) {
+            ++bits;
+        }
+    }
+
+    size_t bucket_count() const {
+        return size_t(1) << bits;
+    }
+    size_t bucket(size_t h) const {
+        return size_t(((unsigned long long)h * 0x9E3779B97F4A7C15ull) >>
+                      (64 - bits));
+    }
+    static size_t max_bucket_count() {
+        return size_t(1) << max_bits;
+    }
+
+    int bits;
+};
+
+// Nodes of a hashtable built with CacheHash keep the full hash code of
+// their key, so growing and iterating never call the hash function again
+// and most mismatches in a chain are rejected without calling EqualKey.
+// Without it the base is empty and costs nothing.
+template <bool CacheHash>
+struct __hashtable_hash_code {
+    bool hash_code_differs(size_t) const {
+        return false;
+    }
+    void set_hash_code(size_t) { }
+    void copy_hash_code(const __hashtable_hash_code&) { }
+};
+
+template <>
+struct __hashtable_hash_code<true> {
+    size_t hash_code;
+
+    bool hash_code_differs(size_t h) const {
+        return hash_code != h;
+    }
+    void set_hash_code(size_t h) {
+        hash_code = h;
+    }
+    void copy_hash_code(const __hashtable_hash_code& x) {
+        hash_code = x.hash_code;
+    }
+};
+
+template <typename Value, bool CacheHash = false>
+struct __hashtable_node : __hashtable_hash_code<CacheHash> {
     __hashtable_node* next;
     Value val;
 };
 
+template <typename Value, bool CacheHash>
+inline Value& __node_value(__hashtable_node<Value, CacheHash>* p) {
+    return p->val;
+}
+
+// A hint to start loading the cache line at p; it never faults.
+inline void __stl_prefetch(const void* p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
 template <typename Value, typename Key, typename HashFunc,
-          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc,
+          typename BucketPolicy = __prime_buckets,
+          bool CacheHash = false>
 class hashtable;
 
 template <typename Value, typename Key, typename HashFunc,
-          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+          typename ExtractKey, typename EqualKey, typename Alloc,
+          typename BucketPolicy, bool CacheHash>
+bool operator==(const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht1,
+                const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht2);
+
+template <typename Value, typename Key, typename HashFunc,
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc,
+          typename BucketPolicy = __prime_buckets,
+          bool CacheHash = false>
 struct __hashtable_iterator;
 
 template <typename Value, typename Key, typename HashFunc,
-          typename ExtractKey, typename EqualKey, typename Alloc = alloc>
+          typename ExtractKey, typename EqualKey, typename Alloc = alloc,
+          typename BucketPolicy = __prime_buckets,
+          bool CacheHash = false>
 struct __hashtable_const_iterator;
 
 template <typename Value, typename Key, typename HashFunc,
-          typename ExtractKey, typename EqualKey, typename Alloc>
+          typename ExtractKey, typename EqualKey, typename Alloc,
+          typename BucketPolicy, bool CacheHash>
 struct __hashtable_iterator {
-    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         hashtable;
     typedef __hashtable_iterator<Value, Key, HashFunc,
-        ExtractKey, EqualKey, Alloc>
+        ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         iterator;
     typedef __hashtable_const_iterator<Value, Key, HashFunc,
-        ExtractKey, EqualKey, Alloc>
+        ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         const_iterator;
-    typedef __hashtable_node<Value> node;
+    typedef __hashtable_node<Value, CacheHash> node;
 
     typedef forward_iterator_tag iterator_category;
     typedef Value value_type;
@@ -50,8 +222,10 @@ struct __hashtable_iterator {
 
     node* cur;
     hashtable* ht;
+    size_type bucket;  // of cur, so that ++ never needs to hash
 
-    __hashtable_iterator(node* n, hashtable* tab) : cur(n), ht(tab) { }
+    __hashtable_iterator(node* n, hashtable* tab, size_type b = 0)
+        : cur(n), ht(tab), bucket(b) { }
     __hashtable_iterator() { }
     reference operator*() const {
         return cur->val;
@@ -67,17 +241,18 @@ struct __hashtable_iterator {
 };
 
 template <typename Value, typename Key, typename HashFunc,
-          typename ExtractKey, typename EqualKey, typename Alloc>
+          typename ExtractKey, typename EqualKey, typename Alloc,
+          typename BucketPolicy, bool CacheHash>
 struct __hashtable_const_iterator {
-    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         hashtable;
     typedef __hashtable_iterator<Value, Key, HashFunc,
-        ExtractKey, EqualKey, Alloc>
+        ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         iterator;
     typedef __hashtable_const_iterator<Value, Key, HashFunc,
-        ExtractKey, EqualKey, Alloc>
+        ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         const_iterator;
-    typedef __hashtable_node<Value> node;
+    typedef __hashtable_node<Value, CacheHash> node;
 
     typedef forward_iterator_tag iterator_category;
     typedef Value value_type;
@@ -88,12 +263,13 @@ struct __hashtable_const_iterator {
 
     node* cur;
     hashtable* ht;
+    size_type bucket;
 
-    __hashtable_const_iterator(node* n, hashtable* tab)
-        : cur(n), ht(tab) { }
+    __hashtable_const_iterator(node* n, hashtable* tab, size_type b = 0)
+        : cur(n), ht(tab), bucket(b) { }
     __hashtable_const_iterator() { }
     __hashtable_const_iterator(const iterator& it)
-        : cur(it.cur), ht(it.ht) { }
+        : cur(it.cur), ht(it.ht), bucket(it.bucket) { }
     reference operator*() const {
         return cur->val;
     }
@@ -107,26 +283,10 @@ struct __hashtable_const_iterator {
     bool operator!=(const const_iterator& it) const { return cur != it.cur; }
 };
 
-static const int __stl_num_primes = 28;
-static const unsigned long long __stl_prime_list[__stl_num_primes] = {
-    53,         97,           193,         389,       769,
-  1543,       3079,         6151,        12289,     24593,
-  49157,      98317,        196613,      393241,    786433,
-  1572869,    3145739,      6291469,     12582917,  25165843,
-  50331653,   100663319,    201326611,   402653189, 805306457,
-  1610612741, 3221225473ul, 4294967291ul
-};
-
-inline unsigned long long __stl_next_prime(unsigned long long n) {
-    const unsigned long long * first = __stl_prime_list;
-    const unsigned long long * last = __stl_prime_list + __stl_num_primes;
-    const unsigned long long * pos = std::lower_bound(first, last, n);
-    return pos == last ? *(last - 1) : *pos;
-}
-
 template <typename Value, typename Key, typename HashFunc,
-    typename ExtractKey, typename EqualKey, typename Alloc>
-class hashtable {
+    typename ExtractKey, typename EqualKey, typename Alloc,
+    typename BucketPolicy, bool CacheHash>
+class hashtable : protected __alloc_holder<Alloc> {
 public:
     typedef Key key_type;
     typedef Value value_type;
@@ -139,30 +299,57 @@ public:
     typedef const value_type* const_pointer;
     typedef value_type&       reference;
     typedef const value_type& const_reference;
+    typedef Alloc             allocator_type;
 
-    typedef __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+    typedef __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
         iterator;
     typedef __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey,
-        Alloc> const_iterator;
+        Alloc, BucketPolicy, CacheHash> const_iterator;
+    typedef __node_handle<__hashtable_node<Value, CacheHash>, Value, Alloc>
+        node_type;
 
     friend struct
-        __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>;
+        __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>;
     friend struct
-        __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>;
+        __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>;
 
     hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
-              const ExtractKey& ext)
-        : hash(hf), equals(eql), get_key(ext), num_elements(0) {
+              const ExtractKey& ext,
+              const allocator_type& a = allocator_type())
+        : base(a), hash(hf), equals(eql), get_key(ext), buckets(a),
+          num_elements(0), max_load(1.0f), old_buckets(a), rehash_pos(0),
+          rehash_batch(0) {
         initialize_buckets(n);
     }
-    hashtable(size_type n, const HashFunc& hf, const EqualKey& eql)
-        : hash(hf), equals(eql), get_key(ExtractKey()), num_elements(0) {
+    hashtable(size_type n, const HashFunc& hf, const EqualKey& eql,
+              const allocator_type& a = allocator_type())
+        : base(a), hash(hf), equals(eql), get_key(ExtractKey()), buckets(a),
+          num_elements(0), max_load(1.0f), old_buckets(a), rehash_pos(0),
+          rehash_batch(0) {
         initialize_buckets(n);
     }
     hashtable(const hashtable& ht)
-        : hash(ht.hash), equals(ht.equals), get_key(ht.get_key()), num_elements(0) {
+        : base(ht.get_alloc()), hash(ht.hash), equals(ht.equals),
+          get_key(ht.get_key), buckets(ht.get_alloc()), num_elements(0),
+          max_load(ht.max_load), old_buckets(ht.get_alloc()), rehash_pos(0),
+          rehash_batch(ht.rehash_batch) {
         copy_from(ht);
     }
+    // The moved-from table keeps no buckets at all; lookups check for an
+    // empty table before hashing and inserts grow it again.
+    hashtable(hashtable&& ht)
+        noexcept(std::is_nothrow_copy_constructible<HashFunc>::value &&
+                 std::is_nothrow_copy_constructible<EqualKey>::value &&
+                 std::is_nothrow_copy_constructible<ExtractKey>::value)
+        : base(ht.get_alloc()), hash(ht.hash), equals(ht.equals),
+          get_key(ht.get_key), buckets(std::move(ht.buckets)),
+          bucket_policy(ht.bucket_policy), num_elements(ht.num_elements),
+          max_load(ht.max_load), old_buckets(std::move(ht.old_buckets)),
+          old_policy(ht.old_policy),
+          rehash_pos(ht.rehash_pos), rehash_batch(ht.rehash_batch) {
+        ht.num_elements = 0;
+        ht.rehash_pos = 0;
+    }
 
     hashtable& operator=(const hashtable& ht) {
         if (&ht != this) {
@@ -170,14 +357,45 @@ public:
             hash = ht.hash;
             equals = ht.equals;
             get_key = ht.get_key;
+            max_load = ht.max_load;
+            rehash_batch = ht.rehash_batch;
+            if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+                // every node is gone; the bucket vector follows its own rules
+                this->get_alloc() = ht.get_alloc();
+                buckets = vector<node*, Alloc>(ht.get_alloc());
+                old_buckets = vector<node*, Alloc>(ht.get_alloc());
+            }
             copy_from(ht);
         }
+        return *this;
+    }
+
+    hashtable& operator=(hashtable&& ht)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment &&
+                 std::is_nothrow_copy_assignable<HashFunc>::value &&
+                 std::is_nothrow_copy_assignable<EqualKey>::value &&
+                 std::is_nothrow_copy_assignable<ExtractKey>::value) {
+        if (&ht != this) {
+            clear();
+            hash = ht.hash;
+            equals = ht.equals;
+            get_key = ht.get_key;
+            max_load = ht.max_load;
+            rehash_batch = ht.rehash_batch;
+            move_assign(ht, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
     }
 
     ~hashtable() {
         clear();
     }
 
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+
     hasher hash_funct() const {
         return hash;
     }
@@ -200,27 +418,30 @@ public:
         std::swap(equals, ht.equals);
         std::swap(get_key, ht.get_key);
         buckets.swap(ht.buckets);
+        std::swap(bucket_policy, ht.bucket_policy);
         std::swap(num_elements, ht.num_elements);
+        std::swap(max_load, ht.max_load);
+        old_buckets.swap(ht.old_buckets);
+        std::swap(old_policy, ht.old_policy);
+        std::swap(rehash_pos, ht.rehash_pos);
+        std::swap(rehash_batch, ht.rehash_batch);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), ht.get_alloc());
+        }
     }
 
     iterator begin() {
-        for (size_type n = 0; n < buckets.size(); ++n) {
-            if (buckets[n] != nullptr) {
-                return iterator(buckets[n], this);
-            }
-        }
-        return end();
+        size_type bucket = 0;
+        node* first = first_node_from(bucket);
+        return iterator(first, this, bucket);
     }
     iterator end() {
         return iterator(nullptr, this);
     }
     const_iterator begin() const {
-        for (size_type n = 0; n < buckets.size(); ++n) {
-            if (buckets[n] != nullptr) {
-                return const_iterator(buckets[n], this);
-            }
-        }
-        return end();
+        size_type bucket = 0;
+        node* first = first_node_from(bucket);
+        return const_iterator(first, this, bucket);
     }
     const_iterator end() const {
         return const_iterator(0, this);
@@ -230,7 +451,7 @@ public:
         return buckets.size();
     }
     size_type max_buckets_count() const {
-        return __stl_prime_list[__stl_num_primes - 1];
+        return BucketPolicy::max_bucket_count();
     }
     size_type elems_in_buckets(size_type bucket) const {
         size_type result = 0;
@@ -244,14 +465,39 @@ public:
         resize(num_elements + 1);
         return insert_unique_noresize(obj);
     }
+    pair<iterator, bool> insert_unique(value_type&& obj) {
+        resize(num_elements + 1);
+        return insert_unique_noresize(std::move(obj));
+    }
 
     iterator insert_equal(const value_type& obj) {
         resize(num_elements + 1);
         return insert_equal_noresize(obj);
     }
+    iterator insert_equal(value_type&& obj) {
+        resize(num_elements + 1);
+        return insert_equal_noresize(std::move(obj));
+    }
 
-    pair<iterator, bool> insert_unique_noresize(const value_type& obj);
-    iterator insert_equal_noresize(const value_type& obj);
+    pair<iterator, bool> insert_unique_noresize(const value_type& obj) {
+        return __insert_unique_noresize(obj);
+    }
+    pair<iterator, bool> insert_unique_noresize(value_type&& obj) {
+        return __insert_unique_noresize(std::move(obj));
+    }
+    iterator insert_equal_noresize(const value_type& obj) {
+        return __insert_equal_noresize(obj);
+    }
+    iterator insert_equal_noresize(value_type&& obj) {
+        return __insert_equal_noresize(std::move(obj));
+    }
+
+    // The node is built before the key is known, so a duplicate costs
+    // one construction that is thrown away.
+    template <typename... Args>
+    pair<iterator, bool> emplace_unique(Args&&... args);
+    template <typename... Args>
+    iterator emplace_equal(Args&&... args);
 
     template <class InputIterator>
     void insert_unique(InputIterator f, InputIterator l)
@@ -309,27 +555,121 @@ public:
     reference find_or_insert(const value_type& obj);
 
     iterator find(const key_type& key) {
-        size_type n = bkt_num_key(key);
+        if (num_elements == 0) {
+            return end();
+        }
+        const size_t h = hash(key);
+        size_type bucket;
         node* first;
-        for (first = buckets[n]; 
-             first != nullptr && !equals(get_key(first->val), key);
+        for (first = *chain_of(h, bucket);
+             first != nullptr && !key_matches(first, h, key);
              first = first->next) { }
-        return iterator(first, this);
+        return iterator(first, this, bucket);
     }
 
     const_iterator find(const key_type& key) const {
-        size_type n = bkt_num_key(key);
+        if (num_elements == 0) {
+            return end();
+        }
+        const size_t h = hash(key);
+        size_type bucket;
         node* first;
-        for (first = buckets[n];
-             first != nullptr && !equals(get_key(first->val), key);
+        for (first = *chain_of(h, bucket);
+             first != nullptr && !key_matches(first, h, key);
              first = first->next) {
         }
-        return const_iterator(first, this);
+        return const_iterator(first, this, bucket);
+    }
+
+    size_type count(const key_type& key) const {
+        return num_elements == 0 ? 0 : count(key, hash(key));
     }
 
     pair<iterator, iterator> equal_range(const key_type& key);
     pair<const_iterator, const_iterator> equal_range(const key_type& key) const;
 
+    // The batch operations take many independent keys at once. They work
+    // through them batch_size at a time: hash every key, prefetch its
+    // bucket, prefetch the first node of each chain, and only then walk
+    // the chains, so the cache misses of a batch overlap instead of
+    // following one another. find_batch writes one iterator per key to
+    // result and count_batch one count; both return the end of the output.
+    enum { batch_size = 16 };
+
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last,
+                              OutputIterator result) {
+        ForwardIterator keys[batch_size];
+        size_type bucket[batch_size];
+        node* found[batch_size];
+        while (first != last) {
+            const int n = probe_batch(first, last, keys, bucket, found);
+            for (int i = 0; i < n; ++i) {
+                *result++ = iterator(found[i], this, bucket[i]);
+            }
+        }
+        return result;
+    }
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last,
+                              OutputIterator result) const {
+        ForwardIterator keys[batch_size];
+        size_type bucket[batch_size];
+        node* found[batch_size];
+        while (first != last) {
+            const int n = probe_batch(first, last, keys, bucket, found);
+            for (int i = 0; i < n; ++i) {
+                *result++ = const_iterator(found[i], this, bucket[i]);
+            }
+        }
+        return result;
+    }
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator count_batch(ForwardIterator first, ForwardIterator last,
+                               OutputIterator result) const {
+        ForwardIterator keys[batch_size];
+        size_type bucket[batch_size];
+        node* found[batch_size];
+        while (first != last) {
+            const int n = probe_batch(first, last, keys, bucket, found);
+            for (int i = 0; i < n; ++i) {
+                // equal keys are linked next to each other
+                size_type count = 0;
+                for (const node* cur = found[i]; cur != nullptr &&
+                     equals(get_key(cur->val), *keys[i]); cur = cur->next) {
+                    ++count;
+                }
+                *result++ = count;
+            }
+        }
+        return result;
+    }
+
+    // Inserts the values in [first, last) as insert_unique and
+    // insert_equal do, growing the table once per batch.
+    template <class ForwardIterator>
+    void insert_unique_batch(ForwardIterator first, ForwardIterator last) {
+        ForwardIterator vals[batch_size];
+        size_t h[batch_size];
+        while (first != last) {
+            const int n = prepare_insert_batch(first, last, vals, h);
+            for (int i = 0; i < n; ++i) {
+                __insert_unique_noresize(*vals[i], h[i]);
+            }
+        }
+    }
+    template <class ForwardIterator>
+    void insert_equal_batch(ForwardIterator first, ForwardIterator last) {
+        ForwardIterator vals[batch_size];
+        size_t h[batch_size];
+        while (first != last) {
+            const int n = prepare_insert_batch(first, last, vals, h);
+            for (int i = 0; i < n; ++i) {
+                __insert_equal_noresize(*vals[i], h[i]);
+            }
+        }
+    }
+
     size_type erase(const key_type& key);
     void erase(const iterator& it);
     void erase(iterator first, iterator last);
@@ -337,13 +677,76 @@ public:
     void erase(const const_iterator& it);
     void erase(const_iterator first, const_iterator last);
 
+    // extract unlinks a node without freeing it, and the node_type
+    // inserts link one in without allocating. A node_type insert_unique
+    // that finds the key already present leaves the node in nh.
+    node_type extract(const const_iterator& it) {
+        return node_type(unlink(it.cur, it.bucket), this->get_alloc());
+    }
+    node_type extract(const key_type& key) {
+        return extract(const_iterator(find(key)));
+    }
+    pair<iterator, bool> insert_unique(node_type&& nh);
+    iterator insert_equal(node_type&& nh);
+    // Moves the nodes of ht into this table; merge_unique leaves behind
+    // those whose keys are already here. Between tables with unequal
+    // allocators the values are moved instead of the nodes.
+    void merge_unique(hashtable& ht) {
+        merge(ht, true);
+    }
+    void merge_equal(hashtable& ht) {
+        merge(ht, false);
+    }
+
+    // resize and reserve make room for n elements under the current
+    // max_load_factor(), growing the table if it has too few buckets.
     void resize(size_type num_elements_hint);
+    void reserve(size_type n) {
+        resize(n);
+    }
+    // Rebuilds the table with at least n buckets and at least enough for
+    // size() elements. Unlike resize, this may also shrink it.
+    void rehash(size_type n);
     void clear();
 
+    float load_factor() const {
+        return buckets.empty() ? 0.0f : float(num_elements) / buckets.size();
+    }
+    float max_load_factor() const {
+        return max_load;
+    }
+    // The average chain length the table grows to stay under; 1 by default.
+    // Lowering it grows the table at once if it is already over. A factor
+    // that is not positive, NaN, or too small for the elements to fit in
+    // max_bucket_count() buckets is ignored.
+    void max_load_factor(float z) {
+        if (!(z > 0.0f) || double(num_elements) / z >
+                               double(BucketPolicy::max_bucket_count())) {
+            return;
+        }
+        max_load = z;
+        resize(num_elements);
+    }
+
+    // With n != 0, growing the table no longer moves every node in one
+    // call. The new bucket array is filled n old buckets at a time, by
+    // each later insert and erase of a key, and lookups meanwhile search
+    // whichever array holds the key. Those erases may then move nodes and
+    // invalidate iterators. n == 0, the default, rehashes at once.
+    void set_incremental_rehash(size_type n) {
+        rehash_batch = n;
+    }
+    bool rehashing() const {
+        return !old_buckets.empty();
+    }
+
     friend bool operator== <> (const hashtable&, const hashtable&);
+    template <typename, typename, typename, typename, typename, typename>
+    friend class concurrent_hashtable;
 
 private:
-    typedef __hashtable_node<Value> node;
+    typedef __alloc_holder<Alloc> base;
+    typedef __hashtable_node<Value, CacheHash> node;
     typedef simple_alloc<node, Alloc> node_allocator;
 
     hasher hash;
@@ -351,287 +754,597 @@ private:
     ExtractKey get_key;
 
     vector<node*, Alloc> buckets;
+    BucketPolicy bucket_policy;  // matches buckets.size()
     size_t num_elements;
+    float max_load;
 
-    size_type next_size(size_type n) const {
-        return __stl_next_prime(n);
-    }
+    // The array being drained while rehashing() and empty otherwise. The
+    // buckets before rehash_pos are already moved. Any other old bucket
+    // that is not empty holds every node that maps to it, so each key
+    // lives in exactly one chain (see chain_of).
+    vector<node*, Alloc> old_buckets;
+    BucketPolicy old_policy;
+    size_type rehash_pos;
+    size_type rehash_batch;
 
     void initialize_buckets(size_type n) {
-        const size_type n_buckets = next_size(n);
+        bucket_policy = BucketPolicy(n);
+        const size_type n_buckets = bucket_policy.bucket_count();
         buckets.reserve(n_buckets);
         buckets.insert(buckets.end(), n_buckets, (node*)nullptr);
         num_elements = 0;
     }
 
-    size_type bkt_num_key(const key_type& key) const {
-        return bkt_num_key(key, buckets.size());
-    
+    // The hash code of the key in n, which a CacheHash node already holds.
+    size_t node_hash(const node* n) const {
+        return node_hash(n, typename __bool_type<CacheHash>::type());
     }
-    size_type bkt_num(const value_type& obj) const {
-        return bkt_num_key(get_key(obj));
+    size_t node_hash(const node* n, __true_type) const {
+        return n->hash_code;
     }
-    size_type bkt_num_key(const key_type& key, size_t n) const {
-        return hash(key) % n;
+    size_t node_hash(const node* n, __false_type) const {
+        return hash(get_key(n->val));
     }
-    size_type bkt_num(const value_type& obj, size_t n) const {
-        return bkt_num_key(get_key(obj), n);
+    bool key_matches(const node* n, size_t h, const key_type& key) const {
+        return !n->hash_code_differs(h) && equals(get_key(n->val), key);
     }
 
-    node* new_node(const value_type& obj) {
-        node* n = node_allocator::allocate();
+    // Iterators number the chains of both arrays as one sequence: the new
+    // buckets first, then old bucket i as buckets.size() + i.
+    size_type bucket_end() const {
+        return buckets.size() + old_buckets.size();
+    }
+    node*& bucket_ref(size_type bucket) {
+        return bucket < buckets.size() ? buckets[bucket] :
+            old_buckets[bucket - buckets.size()];
+    }
+
+    // The chain that holds, or is to hold, the nodes with hash code h, and
+    // its number in bucket.
+    node** chain_of(size_t h, size_type& bucket) {
+        if (rehashing()) {
+            const size_type old = old_policy.bucket(h);
+            if (old_buckets[old] != nullptr) {
+                bucket = buckets.size() + old;
+                return &old_buckets[old];
+            }
+        }
+        bucket = bucket_policy.bucket(h);
+        return &buckets[bucket];
+    }
+    node* const* chain_of(size_t h, size_type& bucket) const {
+        return const_cast<hashtable*>(this)->chain_of(h, bucket);
+    }
+
+    // The first node in chain bucket or a later one; bucket is moved to
+    // the chain found, or to bucket_end().
+    node* first_node_from(size_type& bucket) const {
+        for (; bucket < buckets.size(); ++bucket) {
+            if (buckets[bucket] != nullptr) {
+                return buckets[bucket];
+            }
+        }
+        // the old buckets before rehash_pos are known to be empty
+        bucket = std::max(bucket, buckets.size() + rehash_pos);
+        for (; bucket < bucket_end(); ++bucket) {
+            if (old_buckets[bucket - buckets.size()] != nullptr) {
+                return old_buckets[bucket - buckets.size()];
+            }
+        }
+        return nullptr;
+    }
+
+    // Lookups by a key whose hash code h the caller already has.
+    node* find_node(const key_type& key, size_t h) const {
+        if (num_elements == 0) {
+            return nullptr;
+        }
+        size_type bucket;
+        node* first = *chain_of(h, bucket);
+        for (; first != nullptr && !key_matches(first, h, key);
+             first = first->next) { }
+        return first;
+    }
+    size_type count(const key_type& key, size_t h) const {
+        size_type result = 0;
+        for (const node* cur = find_node(key, h);
+             cur != nullptr && key_matches(cur, h, key); cur = cur->next) {
+            ++result;
+        }
+        return result;
+    }
+    size_type erase(const key_type& key, size_t h);
+
+    // The bucket count that holds n elements under max_load.
+    // A tiny factor can ask for more buckets than size_type holds, so the
+    // count is clamped before it is converted.
+    size_type buckets_for(size_type n) const {
+        const double b = std::ceil(double(n) / max_load);
+        return b < double(BucketPolicy::max_bucket_count()) ?
+            size_type(b) : BucketPolicy::max_bucket_count();
+    }
+    void rehash_some(size_type n);
+    void rebuild(const BucketPolicy& policy);
+
+    void prefetch_buckets(const size_t* h, int n) const {
+        for (int i = 0; i < n; ++i) {
+            __stl_prefetch(&buckets[bucket_policy.bucket(h[i])]);
+            if (rehashing()) {
+                __stl_prefetch(&old_buckets[old_policy.bucket(h[i])]);
+            }
+        }
+    }
+
+    // Takes up to batch_size keys from first and leaves in found the node
+    // holding each, or nullptr, and in bucket the chain it is in.
+    template <class ForwardIterator>
+    int probe_batch(ForwardIterator& first, ForwardIterator last,
+                    ForwardIterator* keys, size_type* bucket,
+                    node** found) const {
+        size_t h[batch_size];
+        int n = 0;
+        for (; n < batch_size && first != last; ++n, ++first) {
+            keys[n] = first;
+            h[n] = hash(*first);
+        }
+        if (num_elements == 0) { // every key misses, as end() does
+            std::fill(found, found + n, (node*)nullptr);
+            std::fill(bucket, bucket + n, size_type(0));
+            return n;
+        }
+        prefetch_buckets(h, n);
+        for (int i = 0; i < n; ++i) {
+            found[i] = *chain_of(h[i], bucket[i]);
+            if (found[i] != nullptr) {
+                __stl_prefetch(found[i]);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            node* cur = found[i];
+            for (; cur != nullptr && !key_matches(cur, h[i], *keys[i]);
+                 cur = cur->next) { }
+            found[i] = cur;
+        }
+        return n;
+    }
+
+    // Takes up to batch_size values from first, hashes them and makes
+    // room for them, then prefetches the chains they go into.
+    template <class ForwardIterator>
+    int prepare_insert_batch(ForwardIterator& first, ForwardIterator last,
+                             ForwardIterator* vals, size_t* h) {
+        int n = 0;
+        for (; n < batch_size && first != last; ++n, ++first) {
+            vals[n] = first;
+            h[n] = hash(get_key(*first));
+        }
+        resize(num_elements + n);
+        prefetch_buckets(h, n);
+        for (int i = 0; i < n; ++i) {
+            size_type bucket;
+            if (node* head = *chain_of(h[i], bucket)) {
+                __stl_prefetch(head);
+            }
+        }
+        return n;
+    }
+
+    template <typename Arg>
+    pair<iterator, bool> __insert_unique_noresize(Arg&& obj) {
+        const size_t h = hash(get_key(obj));
+        return __insert_unique_noresize(std::forward<Arg>(obj), h);
+    }
+    template <typename Arg>
+    iterator __insert_equal_noresize(Arg&& obj) {
+        const size_t h = hash(get_key(obj));
+        return __insert_equal_noresize(std::forward<Arg>(obj), h);
+    }
+    // h is the hash code of obj's key.
+    template <typename Arg>
+    pair<iterator, bool> __insert_unique_noresize(Arg&& obj, size_t h);
+    template <typename Arg>
+    iterator __insert_equal_noresize(Arg&& obj, size_t h);
+    void __link_equal(node* tmp, size_t h, node** chain);
+
+    template <typename... Args>
+    node* new_node(Args&&... args) {
+        node* n = node_allocator::allocate(this->get_alloc());
         n->next = nullptr;
         try {
-            construct(&n->val, obj);
+            forgedstl::construct(&n->val, std::forward<Args>(args)...);
             return n;
         } catch (...) {
-            node_allocator::deallocate(n);
+            node_allocator::deallocate(this->get_alloc(), n);
             throw;
         }
     }
 
     void delete_node(node* n) {
-        destroy(&n->val);
-        node_allocator::deallocate(n);
+        forgedstl::destroy(&n->val);
+        node_allocator::deallocate(this->get_alloc(), n);
+    }
+
+    // Both move_assign overloads expect this table to be empty.
+    void move_assign(hashtable& ht, __true_type) {
+        this->get_alloc() = ht.get_alloc();
+        buckets = std::move(ht.buckets);
+        bucket_policy = ht.bucket_policy;
+        num_elements = ht.num_elements;
+        old_buckets = std::move(ht.old_buckets);
+        old_policy = ht.old_policy;
+        rehash_pos = ht.rehash_pos;
+        ht.num_elements = 0;
+        ht.rehash_pos = 0;
+    }
+    void move_assign(hashtable& ht, __false_type) {
+        if (__alloc_equal(this->get_alloc(), ht.get_alloc())) {
+            move_assign(ht, __true_type());
+        } else {
+            // ht's nodes cannot change hands, only their values can
+            for (iterator it = ht.begin(); it != ht.end(); ++it) {
+                insert_equal(std::move(*it));
+            }
+            ht.clear();
+        }
     }
 
     void erase_bucket(const size_type n, node* first, node* last);
     void erase_bucket(const size_type n, node* last);
+    // Takes p, which may be nullptr, out of chain bucket and returns it.
+    node* unlink(const node* p, size_type bucket);
+    void merge(hashtable& ht, bool unique);
 
     void copy_from(const hashtable& ht);
+    void copy_chains(vector<node*, Alloc>& to,
+                     const vector<node*, Alloc>& from);
+    // Whether the run of nodes with the key of first holds the same values
+    // in ht, in any order.
+    bool group_equal(const node* first, const hashtable& ht) const;
 };
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&
-__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::operator++() {
-    const node* old = cur;
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&
+__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::operator++() {
     cur = cur->next;
     if (cur == nullptr) {
-        size_type bucket = ht->bkt_num(old->val);
-        while (cur == nullptr && ++bucket < ht->buckets.size()) {
-            cur = ht->buckets[bucket];
-        }
+        cur = ht->first_node_from(++bucket);
     }
     return *this;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-inline __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
-__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::operator++(int) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+inline __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
+__hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::operator++(int) {
     iterator tmp = *this;
     ++*this;
     return tmp;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&
-__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::operator++() {
-    const node* old = cur;
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&
+__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::operator++() {
     cur = cur->next;
     if (cur == nullptr) {
-        size_type bucket = ht->bkt_num(old->val);
-        while (cur == nullptr && ++bucket < ht->buckets.size()) {
-            cur = ht->buckets[bucket];
-        }
+        cur = ht->first_node_from(++bucket);
     }
     return *this;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-inline __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
-__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::operator++(int) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+inline __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
+__hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::operator++(int) {
     const_iterator tmp = *this;
     ++*this;
     return tmp;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
 inline forward_iterator_tag
-iterator_category(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
+iterator_category(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
     return forward_iterator_tag();
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
 inline Value*
-value_type(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
+value_type(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
     return (Value*)nullptr;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-inline typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::difference_type*
-distance_type(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
-    return (typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+inline typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::difference_type*
+distance_type(const __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
+    return (typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
             ::difference_type*)(nullptr);
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
 inline forward_iterator_tag
-iterator_category(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
+iterator_category(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
     return forward_iterator_tag();
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
 inline Value*
-value_type(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
+value_type(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
     return (Value*)nullptr;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-inline typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::difference_type*
-distance_type(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>&) {
-    return (typename __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+inline typename __hashtable_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::difference_type*
+distance_type(const __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>&) {
+    return (typename __hashtable_const_iterator<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>
             ::difference_type*)(nullptr);
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-bool operator==(const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht1,
-                const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht2) {
-    typedef typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::node node;
-    if (ht1.buckets.size() != ht2.buckets.size()) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+bool operator==(const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht1,
+                const hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht2) {
+    typedef hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash> table;
+    typedef typename table::node node;
+    typedef typename table::const_iterator const_iterator;
+    // The layout depends on the insertion history and on how far an
+    // incremental rehash has got, so the contents are compared instead.
+    if (ht1.size() != ht2.size()) {
         return false;
     }
-    for (int n = 0; n < ht1.buckets.size(); ++n) {
-        node* cur1 = ht1.buckets[n];
-        node* cur2 = ht2.buckets[n];
-        for (; cur1 != nullptr && cur2 != nullptr && cur1->val ==cur2->val;
-             cur1 = cur1->next, cur2 = cur2->next) { }
-        if (cur1 != nullptr || cur2 != nullptr) {
+    for (const_iterator it = ht1.begin(); it != ht1.end(); ) {
+        const node* first = it.cur;
+        if (!ht1.group_equal(first, ht2)) {
             return false;
         }
+        const size_t h = ht1.node_hash(first);
+        do {
+            ++it;
+        } while (it != ht1.end() &&
+                 ht1.key_matches(it.cur, h, ht1.get_key(first->val)));
     }
     return true;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-inline void swap(hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht1,
-                 hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>& ht2) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+bool hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::group_equal(const node* first, const hashtable& ht) const {
+    const size_t h = node_hash(first);
+    const key_type& key = get_key(first->val);
+    const node* first2 = ht.find_node(key, h);
+    const node* last1 = first;
+    const node* last2 = first2;
+    for (; last1 != nullptr && key_matches(last1, h, key); last1 = last1->next) {
+        if (last2 == nullptr || !ht.key_matches(last2, h, key)) {
+            return false;
+        }
+        last2 = last2->next;
+    }
+    if (last2 != nullptr && ht.key_matches(last2, h, key)) {
+        return false;
+    }
+    for (const node* cur = first; cur != last1; cur = cur->next) {
+        size_type n1 = 0;
+        size_type n2 = 0;
+        for (const node* p = first; p != last1; p = p->next) {
+            n1 += p->val == cur->val;
+        }
+        for (const node* p = first2; p != last2; p = p->next) {
+            n2 += p->val == cur->val;
+        }
+        if (n1 != n2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+inline void swap(hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht1,
+                 hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>& ht2) {
     ht1.swap(ht2);
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::iterator, bool>
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::insert_unique_noresize(const value_type& obj) {
-    const size_type n = bkt_num(obj);
-    node* first = buckets[n];
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+template <typename Arg>
+pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator, bool>
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::__insert_unique_noresize(Arg&& obj, size_t h) {
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* first = *chain;
 
     for (node* cur = first; cur != nullptr; cur = cur->next) {
-        if (equals(get_key(cur->val), get_key(obj))) {
-            return pair<iterator, bool>(iterator(cur, this), false);
+        if (key_matches(cur, h, get_key(obj))) {
+            return pair<iterator, bool>(iterator(cur, this, bucket), false);
         }
     }
-    node* tmp = new_node(obj);
+    node* tmp = new_node(std::forward<Arg>(obj));
+    tmp->set_hash_code(h);
     tmp->next = first;
-    buckets[n] = tmp;
+    *chain = tmp;
     ++num_elements;
-    return pair<iterator, bool>(iterator(tmp, this), true);
+    return pair<iterator, bool>(iterator(tmp, this, bucket), true);
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::iterator
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::insert_equal_noresize(const value_type& obj) {
-    const size_type n = bkt_num(obj);
-    node* first = buckets[n];
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+template <typename Arg>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::__insert_equal_noresize(Arg&& obj, size_t h) {
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* tmp = new_node(std::forward<Arg>(obj));
+    tmp->set_hash_code(h);
+    __link_equal(tmp, h, chain);
+    return iterator(tmp, this, bucket);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::__link_equal(node* tmp, size_t h, node** chain) {
+    node* first = *chain;
 
     for (node* cur = first; cur != nullptr; cur = cur->next) {
-        if (equals(get_key(cur->val), get_key(obj))) {
-            node* tmp = new_node(obj);
+        if (key_matches(cur, h, get_key(tmp->val))) {
             tmp->next = cur->next;
             cur->next = tmp;
             ++num_elements;
-            return iterator(tmp, this);
+            return;
         }
     }
 
-    node* tmp = new_node(obj);
     tmp->next = first;
-    buckets[n] = tmp;
+    *chain = tmp;
     ++num_elements;
-    return iterator(tmp, this);
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::reference
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::find_or_insert(const value_type& obj) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+template <typename... Args>
+pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator, bool>
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::emplace_unique(Args&&... args) {
     resize(num_elements + 1);
 
-    size_type n = bkt_num(obj);
-    node* first = buckets[n];
+    node* tmp = new_node(std::forward<Args>(args)...);
+    size_t h;
+    try {
+        h = hash(get_key(tmp->val));
+    } catch (...) {
+        delete_node(tmp);
+        throw;
+    }
+    tmp->set_hash_code(h);
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* first = *chain;
 
     for (node* cur = first; cur != nullptr; cur = cur->next) {
-        if (equals(get_key(cur->val), get_key(obj))) {
+        if (key_matches(cur, h, get_key(tmp->val))) {
+            delete_node(tmp);
+            return pair<iterator, bool>(iterator(cur, this, bucket), false);
+        }
+    }
+    tmp->next = first;
+    *chain = tmp;
+    ++num_elements;
+    return pair<iterator, bool>(iterator(tmp, this, bucket), true);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+template <typename... Args>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::emplace_equal(Args&&... args) {
+    resize(num_elements + 1);
+
+    node* tmp = new_node(std::forward<Args>(args)...);
+    size_t h;
+    try {
+        h = hash(get_key(tmp->val));
+    } catch (...) {
+        delete_node(tmp);
+        throw;
+    }
+    tmp->set_hash_code(h);
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    __link_equal(tmp, h, chain);
+    return iterator(tmp, this, bucket);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::reference
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::find_or_insert(const value_type& obj) {
+    resize(num_elements + 1);
+
+    const size_t h = hash(get_key(obj));
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* first = *chain;
+
+    for (node* cur = first; cur != nullptr; cur = cur->next) {
+        if (key_matches(cur, h, get_key(obj))) {
             return cur->val;
         }
     }
 
     node* tmp = new_node(obj);
+    tmp->set_hash_code(h);
     tmp->next = first;
-    buckets[n] = tmp;
+    *chain = tmp;
     ++num_elements;
     return tmp->val;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::iterator,
-     typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::iterator>
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::equal_range(const key_type& key) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator,
+     typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator>
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::equal_range(const key_type& key) {
     typedef pair<iterator, iterator> pii;
-    const size_type n = bkt_num_key(key);
-
-    for (node* first = buckets[n]; first != nullptr; first = first->next) {
-        if (equals(get_key(first->val), key)) {
+    if (num_elements == 0) {
+        return pii(end(), end());
+    }
+    const size_t h = hash(key);
+    size_type bucket;
+    for (node* first = *chain_of(h, bucket); first != nullptr;
+         first = first->next) {
+        if (key_matches(first, h, key)) {
             for (node* cur = first->next; cur != nullptr; cur = cur->next) {
-                if (!equals(get_key(cur->val), key)) {
-                    return pii(iterator(first, this), iterator(cur, this));
-                }
-            }
-            for (size_type m = n + 1; m < buckets.size(); ++m) {
-                if (buckets[m] != nullptr) {
-                    return pii(iterator(first, this), iterator(buckets[m], this));
+                if (!key_matches(cur, h, key)) {
+                    return pii(iterator(first, this, bucket),
+                               iterator(cur, this, bucket));
                 }
             }
-            return pii(iterator(first, this), end());
+            size_type next = bucket + 1;
+            node* last = first_node_from(next);
+            return pii(iterator(first, this, bucket), iterator(last, this, next));
         }
     }
     return pii(end(), end());
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::const_iterator,
-     typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::const_iterator>
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::equal_range(const key_type& key) const {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::const_iterator,
+     typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::const_iterator>
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::equal_range(const key_type& key) const {
     typedef pair<const_iterator, const_iterator> pii;
-    const size_type n = bkt_num_key(key);
-
-    for (node* first = buckets[n]; first != nullptr; first = first->next) {
-        if (equals(get_key(first->val), key)) {
+    if (num_elements == 0) {
+        return pii(end(), end());
+    }
+    const size_t h = hash(key);
+    size_type bucket;
+    for (node* first = *chain_of(h, bucket); first != nullptr;
+         first = first->next) {
+        if (key_matches(first, h, key)) {
             for (node* cur = first->next; cur != nullptr; cur = cur->next) {
-                if (!equals(get_key(cur->val), key)) {
-                    return pii(const_iterator(first, this), const_iterator(cur, this));
+                if (!key_matches(cur, h, key)) {
+                    return pii(const_iterator(first, this, bucket),
+                               const_iterator(cur, this, bucket));
                 }
             }
-            for (size_type m = n + 1; m < buckets.size(); ++m) {
-                if (buckets[m] != nullptr) {
-                    return pii(const_iterator(first, this), const_iterator(buckets[m], this));
-                }
-            }
-            return pii(const_iterator(first, this), end());
+            size_type next = bucket + 1;
+            node* last = first_node_from(next);
+            return pii(const_iterator(first, this, bucket), const_iterator(last, this, next));
         }
     }
     return pii(end(), end());
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::size_type
-hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const key_type& key) {
-    const size_type n = bkt_num_key(key);
-    node* first = buckets[n];
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::size_type
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(const key_type& key) {
+    return num_elements == 0 ? 0 : erase(key, hash(key));
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::size_type
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(const key_type& key, size_t h) {
+    if (num_elements == 0) {
+        return 0;
+    }
+    if (rehashing()) {
+        rehash_some(rehash_batch);
+    }
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* first = *chain;
     size_type erased = 0;
 
     if (first != nullptr) {
         node* cur = first;
         node* next = cur->next;
         while (next != nullptr) {
-            if (equals(get_key(next->val), key)) {
+            if (key_matches(next, h, key)) {
                 cur->next = next->next;
                 delete_node(next);
                 next = cur->next;
@@ -643,8 +1356,8 @@ hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const key_ty
                 next = cur->next;
             }
         }
-        if (equals(get_key(first->val), key)) {
-            buckets[n] = first->next; // include nullptr
+        if (key_matches(first, h, key)) {
+            *chain = first->next; // include nullptr
             delete_node(first);
             ++erased;
             --num_elements;
@@ -653,41 +1366,127 @@ hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const key_ty
     return erased;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const iterator& it) {
-    if (node* const p = it.cur) {
-        const size_type n = bkt_num(p->val);
-        node* cur = buckets[n];
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(const iterator& it) {
+    if (node* const p = unlink(it.cur, it.bucket)) {
+        delete_node(p);
+    }
+}
 
-        if (cur == p) {
-            buckets[n] = cur->next;
-            delte_node(cur);
-            --num_elements;
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::node*
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::unlink(const node* p, size_type bucket) {
+    if (p == nullptr) {
+        return nullptr;
+    }
+    node** link = &bucket_ref(bucket);
+    while (*link != p) {
+        link = &(*link)->next;
+    }
+    node* cur = *link;
+    *link = cur->next;
+    --num_elements;
+    return cur;
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+pair<typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator, bool>
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::insert_unique(node_type&& nh) {
+    if (nh.empty()) {
+        return pair<iterator, bool>(end(), false);
+    }
+    if (!__alloc_equal(this->get_alloc(), nh.get_alloc())) {
+        pair<iterator, bool> result = insert_unique(std::move(nh.value()));
+        if (result.second) {
+            nh = node_type();
         }
-        else {
-            node* next = cur->next;
-            while (next != nullptr) {
-                if (next == p) {
-                    cur->next = next->next;
-                    delete_node(next);
-                    --num_elements;
-                    break;
-                }
-                else {
-                    cur = next;
-                    next = cur->next;
+        return result;
+    }
+    resize(num_elements + 1);
+    const size_t h = hash(get_key(nh.ptr->val));
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    for (node* cur = *chain; cur != nullptr; cur = cur->next) {
+        if (key_matches(cur, h, get_key(nh.ptr->val))) {
+            return pair<iterator, bool>(iterator(cur, this, bucket), false);
+        }
+    }
+    node* tmp = nh.release();
+    tmp->set_hash_code(h);
+    tmp->next = *chain;
+    *chain = tmp;
+    ++num_elements;
+    return pair<iterator, bool>(iterator(tmp, this, bucket), true);
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+typename hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::iterator
+hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::insert_equal(node_type&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    if (!__alloc_equal(this->get_alloc(), nh.get_alloc())) {
+        iterator result = insert_equal(std::move(nh.value()));
+        nh = node_type();
+        return result;
+    }
+    resize(num_elements + 1);
+    const size_t h = hash(get_key(nh.ptr->val));
+    size_type bucket;
+    node** chain = chain_of(h, bucket);
+    node* tmp = nh.release();
+    tmp->set_hash_code(h);
+    __link_equal(tmp, h, chain);
+    return iterator(tmp, this, bucket);
+}
+
+// A node leaves its chain in ht only when nothing more can throw, so a
+// throwing hash function or copy leaves both tables whole.
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::merge(hashtable& ht, bool unique) {
+    if (&ht == this) {
+        return;
+    }
+    const bool relink = __alloc_equal(this->get_alloc(), ht.get_alloc());
+    for (size_type bucket = 0; bucket < ht.bucket_end(); ++bucket) {
+        node** link = &ht.bucket_ref(bucket);
+        while (node* cur = *link) {
+            const size_t h = hash(get_key(cur->val));
+            resize(num_elements + 1);
+            size_type to;
+            node** chain = chain_of(h, to);
+            bool present = false;
+            for (node* n = *chain; unique && n != nullptr && !present;
+                 n = n->next) {
+                present = key_matches(n, h, get_key(cur->val));
+            }
+            if (present) {
+                link = &cur->next;
+            } else if (relink) {
+                *link = cur->next;
+                --ht.num_elements;
+                cur->set_hash_code(h);
+                if (unique) {
+                    cur->next = *chain;
+                    *chain = cur;
+                    ++num_elements;
+                } else {
+                    __link_equal(cur, h, chain);
                 }
+            } else {
+                __insert_equal_noresize(std::move(cur->val), h);
+                *link = cur->next;
+                --ht.num_elements;
+                ht.delete_node(cur);
             }
         }
     }
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(iterator first, iterator last) {
-    size_type f_bucket = first.cur == nullptr ?
-        bkt_num(first.cur->val) : buckets.size();
-    size_type l_bucket = last.cur == nullptr ?
-        bkt_num(last.cur->val) : buckets.size();
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(iterator first, iterator last) {
+    size_type f_bucket = first.cur != nullptr ? first.bucket : bucket_end();
+    size_type l_bucket = last.cur != nullptr ? last.bucket : bucket_end();
 
     if (first.cur == last.cur) {
         return;
@@ -696,67 +1495,105 @@ void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(iterato
         erase_bucket(f_bucket, first.cur, last.cur);
     }
     else {
-        erase_bukcet(f_bucket, first.cur, nullptr);
+        erase_bucket(f_bucket, first.cur, nullptr);
         for (size_type n = f_bucket + 1; n < l_bucket; ++n) {
             erase_bucket(n, nullptr);
         }
-        if (l_bucket != buckets.size()) {
+        if (l_bucket != bucket_end()) {
             erase_bucket(l_bucket, last.cur);
         }
     }
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const_iterator first,
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(const_iterator first,
                                                                          const_iterator last) {
     erase(iterator(const_cast<node*>(first.cur),
-                   const_cast<node*>(first.ht)),
+                   const_cast<hashtable*>(first.ht), first.bucket),
           iterator(const_cast<node*>(last.cur),
-                   const_cast<node*>(last.ht)));
+                   const_cast<hashtable*>(last.ht), last.bucket));
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase(const const_iterator& it) {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase(const const_iterator& it) {
     erase(iterator(const_cast<node*>(it.cur),
-                   const_cast<node*>(it.ht)));
+                   const_cast<hashtable*>(it.ht), it.bucket));
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::resize(size_type num_elements_hint) {
-    const size_type old_n = buckets.size();
-    if (num_elements_hint > old_n) {
-        const size_type n = next_size(num_elements_hint);
-        if (n > old_n) {
-            vector<node*, Alloc> tmp(n, (node*)nullptr);
-            try {
-                for (size_type bucket = 0; bucket < old_n; ++bucket) {
-                    node* first = buckets[bucket];
-                    while (first != nullptr) {
-                        size_type new_bucket = bkt_num(first->val, n);
-                        buckets[bucket] = first->next;
-                        first->next = tmp[new_bucket];
-                        tmp[new_bucket] = first;
-                        first = buckets[bucket];
-                    }
-                }
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::resize(size_type num_elements_hint) {
+    const size_type n_hint = buckets_for(num_elements_hint);
+    if (rehashing()) {
+        // a table that must grow again finishes the current move first
+        rehash_some(n_hint > buckets.size() ?
+                    old_buckets.size() : rehash_batch);
+    }
+    if (n_hint > buckets.size()) {
+        const BucketPolicy policy(n_hint);
+        const size_type n = policy.bucket_count();
+        if (n > buckets.size()) {
+            if (rehash_batch != 0 && num_elements != 0) {
+                vector<node*, Alloc> tmp(n, (node*)nullptr,
+                                         buckets.get_allocator());
+                old_buckets.swap(buckets);
                 buckets.swap(tmp);
+                old_policy = bucket_policy;
+                bucket_policy = policy;
+                rehash_pos = 0;
+                rehash_some(rehash_batch);
+                return;
             }
-            catch (...) {
-                for (size_type bucket = 0; bucket < tmp.size(); ++bucket) {
-                    while (tmp[bucket] != nullptr) {
-                        node* next = tmp[bucket]->next;
-                        delete_node(tmp[bucket]);
-                        tmp[bucket] = next;
-                    }
-                }
-                throw;
+            rebuild(policy);
+        }
+    }
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::rehash(size_type n) {
+    if (rehashing()) {
+        rehash_some(old_buckets.size());
+    }
+    const BucketPolicy policy(std::max(n, buckets_for(num_elements)));
+    if (policy.bucket_count() != buckets.size()) {
+        rebuild(policy);
+    }
+}
+
+// Moves every node at once into a new array of policy.bucket_count()
+// buckets. Must not be called while rehashing().
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::rebuild(const BucketPolicy& policy) {
+    const size_type old_n = buckets.size();
+    vector<node*, Alloc> tmp(policy.bucket_count(), (node*)nullptr,
+                             buckets.get_allocator());
+    try {
+        for (size_type bucket = 0; bucket < old_n; ++bucket) {
+            node* first = buckets[bucket];
+            while (first != nullptr) {
+                size_type new_bucket = policy.bucket(node_hash(first));
+                buckets[bucket] = first->next;
+                first->next = tmp[new_bucket];
+                tmp[new_bucket] = first;
+                first = buckets[bucket];
             }
         }
+        buckets.swap(tmp);
+        bucket_policy = policy;
+    }
+    catch (...) {
+        for (size_type bucket = 0; bucket < tmp.size(); ++bucket) {
+            while (tmp[bucket] != nullptr) {
+                node* next = tmp[bucket]->next;
+                delete_node(tmp[bucket]);
+                tmp[bucket] = next;
+            }
+        }
+        throw;
     }
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::clear() {
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::clear() {
     for (size_type i = 0; i < buckets.size(); ++i) {
         node* cur = buckets[i];
         while (cur != nullptr) {
@@ -766,13 +1603,45 @@ void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::clear() {
         }
         buckets[i] = nullptr;
     }
+    for (size_type i = rehash_pos; i < old_buckets.size(); ++i) {
+        node* cur = old_buckets[i];
+        while (cur != nullptr) {
+            node* next = cur->next;
+            delete_node(cur);
+            cur = next;
+        }
+    }
+    old_buckets.clear();
+    old_buckets.shrink_to_fit();
+    rehash_pos = 0;
     num_elements = 0;
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase_bucket(const size_type n,
+// Moves up to n old buckets into the new array, a node at a time, so that
+// a throwing hash function leaves every node in a valid chain.
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::rehash_some(size_type n) {
+    for (; n > 0 && rehash_pos < old_buckets.size(); --n, ++rehash_pos) {
+        node*& first = old_buckets[rehash_pos];
+        while (first != nullptr) {
+            node* cur = first;
+            const size_type bucket = bucket_policy.bucket(node_hash(cur));
+            first = cur->next;
+            cur->next = buckets[bucket];
+            buckets[bucket] = cur;
+        }
+    }
+    if (rehash_pos == old_buckets.size()) {
+        old_buckets.clear();
+        old_buckets.shrink_to_fit();
+        rehash_pos = 0;
+    }
+}
+
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase_bucket(const size_type n,
                                                                                 node* first, node* last) {
-    node* cur = buckets[n];
+    node* cur = bucket_ref(n);
     if (cur == first) {
         erase_bucket(n, last);
     }
@@ -788,35 +1657,28 @@ void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase_bucket(
     }
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::erase_bucket(const size_type n, node* last) {
-    node* cur = buckets[n];
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::erase_bucket(const size_type n, node* last) {
+    node*& first = bucket_ref(n);
+    node* cur = first;
     while (cur != last) {
         node* next = cur->next;
         delete_node(cur);
         cur = next;
-        buckets[n] = cur;
+        first = cur;
         --num_elements;
     }
 }
 
-template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc>
-void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::copy_from(const hashtable& ht) {
-    buckets.clear();
-    buckets.reserve(ht.buckets.size());
-    buckets.insert(buckets.end(), ht.buckets.size(), (node*)nullptr);
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::copy_from(const hashtable& ht) {
+    bucket_policy = ht.bucket_policy;
+    old_policy = ht.old_policy;
     try {
-        for (size_type i = 0; i < ht.buckets.size(); ++i) {
-            if (const node* cur = ht.buckets[i]) {
-                node* copy = new_node(cur->val);
-                buckets[i] = copy;
-
-                for (node* next = cur->next; next != nullptr; cur = next, next = cur->next) {
-                    copy->next = new_node(next->val);
-                    copy = copy->next;
-                }
-            }
-        }
+        // a table in the middle of a rehash is copied in the same state
+        copy_chains(buckets, ht.buckets);
+        copy_chains(old_buckets, ht.old_buckets);
+        rehash_pos = ht.rehash_pos;
         num_elements = ht.num_elements;
     }
     catch (...) {
@@ -825,6 +1687,27 @@ void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc>::copy_from(con
     }
 }
 
+template <typename Value, typename Key, typename HashFunc, typename ExtractKey, typename EqualKey, typename Alloc, typename BucketPolicy, bool CacheHash>
+void hashtable<Value, Key, HashFunc, ExtractKey, EqualKey, Alloc, BucketPolicy, CacheHash>::copy_chains(
+    vector<node*, Alloc>& to, const vector<node*, Alloc>& from) {
+    to.clear();
+    to.reserve(from.size());
+    to.insert(to.end(), from.size(), (node*)nullptr);
+    for (size_type i = 0; i < from.size(); ++i) {
+        if (const node* cur = from[i]) {
+            node* copy = new_node(cur->val);
+            copy->copy_hash_code(*cur);
+            to[i] = copy;
+
+            for (node* next = cur->next; next != nullptr; cur = next, next = cur->next) {
+                copy->next = new_node(next->val);
+                copy = copy->next;
+                copy->copy_hash_code(*next);
+            }
+        }
+    }
+}
+
 } // namespace forgedstl
 
 #endif // FORGED_STL_INTERNAL_HASHTABLE_H_
@@ -1,9 +1,17 @@
 #include <gtest/gtest.h>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include "stl_function.h"
+#include "stl_hash_map.h"
+#include "stl_hash_multimap.h"
+#include "stl_hash_multiset.h"
+#include "stl_hash_set.h"
 #include "stl_hashtable.h"
 #include "stl_hash_fun.h"
+#include "test_alloc.h"
 
 namespace forgedstl {
 
@@ -13,7 +21,8 @@ TEST(HashTableTest, Basic) {
     ASSERT_TRUE(iht.empty());
     ASSERT_EQ(0, iht.size());
     ASSERT_EQ(53, iht.bucket_count());
-    ASSERT_EQ(4294967291, iht.max_buckets_count());
+    ASSERT_EQ(sizeof(size_t) > 4 ? 18446744073709551557ull : 4294967291ull,
+              iht.max_buckets_count());
 
     iht.insert_unique(59);
     iht.insert_unique(63);
@@ -60,4 +69,535 @@ TEST(HashTableTest, Basic) {
 #endif
 }
 
+TEST(HashTableTest, StatefulAlloc) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int>,
+                      stateful_alloc> Table;
+    test_pool p1, p2;
+    {
+        Table t1(50, hash<int>(), equal_to<int>(), stateful_alloc(&p1));
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        EXPECT_LT(0, p1.bytes_in_use);
+        EXPECT_EQ(0, p2.bytes_in_use);
+
+        Table t2(t1);
+        EXPECT_EQ(&p1, t2.get_allocator().resource());
+
+        Table t3(50, hash<int>(), equal_to<int>(), stateful_alloc(&p2));
+        t3 = t1;
+        EXPECT_EQ(&p2, t3.get_allocator().resource());
+        EXPECT_EQ(100, t3.size());
+
+        t2.swap(t3);
+        EXPECT_EQ(&p2, t2.get_allocator().resource());
+        EXPECT_EQ(&p1, t3.get_allocator().resource());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+TEST(HashTableTest, MoveAndEmplace) {
+    typedef pair<const int, std::string> value;
+    typedef hashtable<value, int, hash<int>, select1st<value>,
+                      equal_to<int> > Table;
+    Table ht(50, hash<int>(), equal_to<int>());
+
+    std::string s(100, 'x');
+    EXPECT_TRUE(ht.insert_unique(value(1, std::move(s))).second);
+    EXPECT_TRUE(s.empty());
+    EXPECT_TRUE(ht.emplace_unique(2, "two").second);
+    EXPECT_FALSE(ht.emplace_unique(2, "deux").second);
+    EXPECT_EQ("two", ht.find(2)->second);
+    ht.emplace_equal(2, "deux");
+    ht.insert_equal(value(3, "three"));
+    EXPECT_EQ(4, ht.size());
+    int twos = 0;
+    for (Table::iterator it = ht.begin(); it != ht.end(); ++it) {
+        twos += it->first == 2;
+    }
+    EXPECT_EQ(2, twos);
+    EXPECT_EQ(100, ht.find(1)->second.size());
+}
+
+TEST(HashTableTest, MoveConstructAndAssign) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+        Table;
+    EXPECT_TRUE(std::is_nothrow_move_constructible<Table>::value);
+    EXPECT_TRUE(std::is_nothrow_move_assignable<Table>::value);
+
+    Table t1(50, hash<int>(), equal_to<int>());
+    for (int i = 0; i < 100; ++i) {
+        t1.insert_unique(i);
+    }
+    const int* p = &*t1.find(42);
+    Table t2(std::move(t1));
+    EXPECT_TRUE(t1.empty());
+    EXPECT_TRUE(t1.find(42) == t1.end());
+    EXPECT_EQ(0, t1.erase(42));
+    ASSERT_EQ(100, t2.size());
+    EXPECT_EQ(p, &*t2.find(42));
+
+    t1.insert_unique(1);
+    EXPECT_EQ(1, t1.size());
+
+    Table t3(50, hash<int>(), equal_to<int>());
+    t3.insert_unique(1000);
+    t3 = std::move(t2);
+    EXPECT_TRUE(t2.empty());
+    EXPECT_EQ(100, t3.size());
+    EXPECT_EQ(p, &*t3.find(42));
+    EXPECT_TRUE(t3.find(1000) == t3.end());
+}
+
+TEST(HashTableTest, BucketPolicy) {
+    unsigned long long h = 1;
+    for (int i = 0; i < __stl_num_primes; ++i) {
+        __prime_buckets policy(__stl_prime_list[i] - 1);
+        ASSERT_EQ(__stl_prime_list[i], policy.bucket_count());
+        for (int j = 0; j < 100; ++j) {
+            h = h * 6364136223846793005ull + 1442695040888963407ull;
+            EXPECT_EQ(size_t(h) % policy.bucket_count(),
+                      policy.bucket(size_t(h)));
+        }
+    }
+    EXPECT_EQ(sizeof(size_t) > 4 ? 18446744073709551557ull : 4294967291ull,
+              __prime_buckets(size_t(-1)).bucket_count());
+
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int>,
+                      alloc, __power2_buckets> Table;
+    Table iht(50, hash<int>(), equal_to<int>());
+    EXPECT_EQ(64, iht.bucket_count());
+    for (int i = 0; i < 1000; ++i) {
+        iht.insert_unique(i);
+    }
+    EXPECT_EQ(1024, iht.bucket_count());
+    size_t longest = 0;
+    for (size_t i = 0; i < iht.bucket_count(); ++i) {
+        longest = std::max(longest, iht.elems_in_buckets(i));
+    }
+    EXPECT_GE(3, longest);
+
+    for (int i = 0; i < 1000; i += 2) {
+        EXPECT_EQ(1, iht.erase(i));
+    }
+    int n = 0;
+    for (Table::iterator it = iht.begin(); it != iht.end(); ++it, ++n) {
+        EXPECT_EQ(1, *it % 2);
+    }
+    EXPECT_EQ(500, n);
+    Table copy(iht);
+    EXPECT_TRUE(copy == iht);
+    EXPECT_TRUE(copy.find(999) != copy.end());
+    EXPECT_TRUE(copy.find(998) == copy.end());
+}
+
+TEST(HashTableTest, IncrementalRehash) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+        Table;
+    Table iht(50, hash<int>(), equal_to<int>());
+    iht.set_incremental_rehash(1);
+    for (int i = 0; i < 53; ++i) {
+        iht.insert_equal(i);
+    }
+    EXPECT_FALSE(iht.rehashing());
+
+    // growing to 97 buckets moves one old bucket per insert from here on
+    iht.insert_equal(53);
+    EXPECT_TRUE(iht.rehashing());
+    EXPECT_EQ(97, iht.bucket_count());
+    for (int i = 0; i < 20; ++i) {
+        iht.insert_equal(i);
+        EXPECT_EQ(2, iht.count(i));
+    }
+    EXPECT_TRUE(iht.rehashing());
+
+    std::vector<int> seen(54, 0);
+    int n = 0;
+    for (Table::iterator it = iht.begin(); it != iht.end(); ++it, ++n) {
+        ++seen[*it];
+    }
+    EXPECT_EQ(74, n);
+    for (int i = 0; i < 54; ++i) {
+        const int copies = i < 20 ? 2 : 1;
+        EXPECT_EQ(copies, seen[i]);
+        pair<Table::iterator, Table::iterator> p = iht.equal_range(i);
+        int k = 0;
+        for (; p.first != p.second; ++p.first, ++k) {
+            EXPECT_EQ(i, *p.first);
+        }
+        EXPECT_EQ(copies, k);
+    }
+
+    Table copy(iht);
+    EXPECT_TRUE(copy.rehashing());
+    EXPECT_TRUE(copy == iht);
+    EXPECT_EQ(2, copy.count(7));
+
+    // equality looks at the contents, not at how far the rehash has got
+    Table rebuilt(50, hash<int>(), equal_to<int>());
+    for (int i = 53; i >= 0; --i) {
+        rebuilt.insert_equal(i);
+        if (i < 20) {
+            rebuilt.insert_equal(i);
+        }
+    }
+    EXPECT_FALSE(rebuilt.rehashing());
+    EXPECT_TRUE(rebuilt == copy);
+    EXPECT_TRUE(copy == rebuilt);
+    rebuilt.erase(rebuilt.find(3));
+    rebuilt.insert_equal(4);
+    EXPECT_FALSE(rebuilt == copy);
+    EXPECT_FALSE(copy == rebuilt);
+
+    EXPECT_EQ(2, iht.erase(7));
+    EXPECT_EQ(0, iht.count(7));
+    iht.erase(iht.find(8));
+    EXPECT_EQ(1, iht.count(8));
+    EXPECT_EQ(71, iht.size());
+
+    // a duplicate insert adds nothing but still moves a bucket
+    for (int i = 0; i < 53 && iht.rehashing(); ++i) {
+        EXPECT_FALSE(iht.insert_unique(20).second);
+    }
+    EXPECT_FALSE(iht.rehashing());
+    EXPECT_EQ(97, iht.bucket_count());
+    EXPECT_EQ(71, iht.size());
+    for (int i = 0; i < 54; ++i) {
+        EXPECT_EQ(i == 7 ? 0 : i < 20 && i != 8 ? 2 : 1, iht.count(i));
+    }
+
+    copy.erase(copy.begin(), copy.end());
+    EXPECT_TRUE(copy.empty());
+    EXPECT_TRUE(copy.begin() == copy.end());
+}
+
+struct counting_hash {
+    int* calls;
+    size_t operator()(int x) const {
+        ++*calls;
+        return hash<int>()(x);
+    }
+};
+
+TEST(HashTableTest, CacheHash) {
+    typedef hashtable<int, int, counting_hash, identity<int>, equal_to<int>,
+                      alloc, __prime_buckets, true> Table;
+    int calls = 0;
+    counting_hash hf = { &calls };
+    Table iht(50, hf, equal_to<int>());
+    for (int i = 0; i < 100; ++i) {
+        iht.insert_equal(i % 60);
+    }
+    EXPECT_EQ(100, calls);
+
+    // growing, walking and copying the table use the cached codes
+    iht.resize(1000);
+    EXPECT_EQ(1543, iht.bucket_count());
+    int n = 0;
+    for (Table::iterator it = iht.begin(); it != iht.end(); ++it, ++n) { }
+    EXPECT_EQ(100, n);
+    Table copy(iht);
+    EXPECT_TRUE(copy == iht);
+    copy.resize(2000);
+    EXPECT_EQ(100, calls);
+
+    pair<Table::iterator, Table::iterator> p = iht.equal_range(5);
+    EXPECT_EQ(101, calls);
+    iht.erase(p.first, p.second);
+    iht.erase(iht.begin());
+    EXPECT_EQ(101, calls);
+    EXPECT_EQ(97, iht.size());
+    EXPECT_EQ(0, copy.count(60));
+    EXPECT_EQ(1, copy.count(59));
+    EXPECT_EQ(2, copy.count(39));
+
+    // during an incremental rehash iterators still step across both arrays
+    copy.set_incremental_rehash(1);
+    copy.resize(5000);
+    EXPECT_TRUE(copy.rehashing());
+    n = 0;
+    for (Table::const_iterator it = copy.begin(); it != copy.end(); ++it) {
+        ++n;
+    }
+    EXPECT_EQ(100, n);
+    copy.erase(copy.begin(), copy.end());
+    EXPECT_TRUE(copy.empty());
+}
+
+TEST(HashTableTest, LoadFactor) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+        Table;
+    Table iht(50, hash<int>(), equal_to<int>());
+    EXPECT_EQ(1.0f, iht.max_load_factor());
+    EXPECT_EQ(0.0f, iht.load_factor());
+    iht.max_load_factor(0.5f);
+    for (int i = 0; i < 100; ++i) {
+        iht.insert_unique(i);
+    }
+    EXPECT_EQ(389, iht.bucket_count());
+    EXPECT_GE(0.5f, iht.load_factor());
+
+    iht.rehash(1000);
+    EXPECT_EQ(1543, iht.bucket_count());
+    iht.rehash(0);
+    EXPECT_EQ(389, iht.bucket_count());
+    iht.max_load_factor(4.0f);
+    EXPECT_EQ(389, iht.bucket_count());
+    iht.rehash(0);
+    EXPECT_EQ(53, iht.bucket_count());
+    iht.reserve(1000);
+    EXPECT_EQ(389, iht.bucket_count());
+    iht.max_load_factor(0.25f);
+    EXPECT_EQ(769, iht.bucket_count());
+    EXPECT_EQ(100, iht.size());
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(1, iht.count(i));
+    }
+
+    // factors that would ask for infinitely many buckets, or more than the
+    // policy can index, are ignored
+    iht.max_load_factor(0.0f);
+    iht.max_load_factor(-1.0f);
+    iht.max_load_factor(std::numeric_limits<float>::quiet_NaN());
+    iht.max_load_factor(1e-30f);
+    EXPECT_EQ(0.25f, iht.max_load_factor());
+    EXPECT_EQ(769, iht.bucket_count());
+
+    Table copy(iht);
+    EXPECT_EQ(0.25f, copy.max_load_factor());
+    Table moved(std::move(copy));
+    EXPECT_EQ(0.25f, moved.max_load_factor());
+}
+
+TEST(HashTableTest, Adapters) {
+    hash_map<int, std::string> m;
+    m[1] = "one";
+    m[2] = "two";
+    EXPECT_TRUE(m.insert(pair<const int, std::string>(3, "three")).second);
+    EXPECT_FALSE(m.emplace(3, "drei").second);
+    EXPECT_EQ("three", m[3]);
+    EXPECT_EQ(3, m.size());
+    m.max_load_factor(0.5f);
+    m.reserve(1000);
+    EXPECT_LE(2000, m.bucket_count());
+    EXPECT_EQ(1, m.erase(2));
+    EXPECT_TRUE(m.find(2) == m.end());
+    hash_map<int, std::string> m2(m);
+    EXPECT_TRUE(m == m2);
+
+    hash_multimap<int, int> mm;
+    mm.insert(pair<const int, int>(1, 10));
+    mm.insert(pair<const int, int>(1, 11));
+    mm.emplace(2, 20);
+    EXPECT_EQ(2, mm.count(1));
+    pair<hash_multimap<int, int>::iterator,
+         hash_multimap<int, int>::iterator> p = mm.equal_range(1);
+    int sum = 0;
+    for (; p.first != p.second; ++p.first) {
+        sum += p.first->second;
+    }
+    EXPECT_EQ(21, sum);
+
+    int a[] = { 3, 1, 4, 1, 5, 9, 2, 6 };
+    hash_set<int> hs(a, a + 8);
+    EXPECT_EQ(7, hs.size());
+    EXPECT_FALSE(hs.insert(4).second);
+    hs.erase(hs.find(4));
+    EXPECT_EQ(0, hs.count(4));
+    hs.rehash(500);
+    EXPECT_EQ(769, hs.bucket_count());
+
+    hash_multiset<int> hms(a, a + 8);
+    EXPECT_EQ(8, hms.size());
+    EXPECT_EQ(2, hms.count(1));
+    hms.erase(hms.begin(), hms.end());
+    EXPECT_TRUE(hms.empty());
+}
+
+TEST(HashTableTest, HashFunctions) {
+    const char text[] = "the quick brown fox jumps over the lazy dog, "
+                        "then naps under the old oak tree for an hour";
+    hash<std::string> hs;
+    hash<const char*> hc;
+    for (size_t n = 0; n < sizeof(text); ++n) {
+        const std::string s(text, n);
+        EXPECT_EQ(hs(s), __stl_hash_string(text, n));
+        EXPECT_EQ(hc(s.c_str()), hs(s));
+        for (size_t k = 0; k < n; ++k) {
+            std::string t(s);
+            t[k] ^= 1;
+            EXPECT_NE(hs(s), hs(t));
+        }
+        if (n > 0) {
+            EXPECT_NE(hs(s), hs(std::string(text, n - 1)));
+        }
+    }
+
+    EXPECT_EQ(hash<double>()(0.0), hash<double>()(-0.0));
+    EXPECT_EQ(hash<float>()(0.0f), hash<float>()(-0.0f));
+    EXPECT_NE(hash<double>()(1.0), hash<double>()(2.0));
+
+    // aligned pointers and strided 64-bit keys still fill power-of-two
+    // buckets evenly
+    static long long blocks[1024];
+    std::vector<int> used(1024, 0);
+    hash<long long*> hp;
+    hash<unsigned long long> hl;
+    for (int i = 0; i < 1024; ++i) {
+        used[hp(&blocks[i]) % 1024] = 1;
+    }
+    EXPECT_LT(600, std::count(used.begin(), used.end(), 1));
+    std::fill(used.begin(), used.end(), 0);
+    for (unsigned long long i = 0; i < 1024; ++i) {
+        used[hl(i << 32) % 1024] = 1;
+    }
+    EXPECT_LT(600, std::count(used.begin(), used.end(), 1));
+}
+
+TEST(HashTableTest, Batch) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int> >
+        Table;
+    Table iht(50, hash<int>(), equal_to<int>());
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(i * 3 % 1000);
+    }
+    Table::iterator none[10];
+    EXPECT_EQ(none + 10, iht.find_batch(keys.begin(), keys.begin() + 10,
+                                        none));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(none[i] == iht.end());
+    }
+
+    iht.set_incremental_rehash(4);
+    iht.insert_unique_batch(keys.begin(), keys.begin() + 700);
+    iht.insert_equal_batch(keys.begin(), keys.begin() + 100);
+    EXPECT_EQ(800, iht.size());
+
+    std::vector<Table::const_iterator> found(keys.size());
+    std::vector<size_t> counts(keys.size());
+    const Table& ciht = iht;
+    ciht.find_batch(keys.begin(), keys.end(), found.begin());
+    EXPECT_TRUE(iht.count_batch(keys.begin(), keys.end(), counts.begin()) ==
+                counts.end());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        EXPECT_EQ(iht.count(keys[i]), counts[i]);
+        EXPECT_EQ(i < 100 ? 2 : i < 700 ? 1 : 0, counts[i]);
+        EXPECT_TRUE(found[i] == ciht.find(keys[i]));
+    }
+
+    std::vector<Table::iterator> hits(700);
+    iht.find_batch(keys.begin(), keys.begin() + 700, hits.begin());
+    for (size_t i = 0; i < hits.size(); ++i) {
+        iht.erase(hits[i]);
+    }
+    EXPECT_EQ(100, iht.size());
+
+    typedef pair<const int, std::string> value;
+    std::vector<value> values;
+    for (int i = 0; i < 40; ++i) {
+        values.push_back(value(i % 20, std::to_string(i)));
+    }
+    hash_map<int, std::string> m;
+    m.insert_batch(values.begin(), values.end());
+    EXPECT_EQ(20, m.size());
+    EXPECT_EQ("5", m[5]);
+    hash_multiset<int> ms;
+    ms.insert_batch(keys.begin(), keys.end());
+    ms.insert_batch(keys.begin(), keys.begin() + 10);
+    size_t c[2];
+    ms.count_batch(keys.begin() + 9, keys.begin() + 11, c);
+    EXPECT_EQ(2, c[0]);
+    EXPECT_EQ(1, c[1]);
+}
+
+TEST(HashTableTest, ExtractAndMerge) {
+    typedef hashtable<int, int, hash<int>, identity<int>, equal_to<int>,
+                      stateful_alloc> Table;
+    test_pool p1, p2;
+    {
+        Table t1(50, hash<int>(), equal_to<int>(), stateful_alloc(&p1));
+        Table t2(50, hash<int>(), equal_to<int>(), stateful_alloc(&p1));
+        t2.set_incremental_rehash(2);
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        for (int i = 50; i < 150; ++i) {
+            t2.insert_unique(i);
+        }
+        t1.reserve(300);
+        t2.reserve(300);
+        const size_t allocations = p1.allocations;
+
+        const int* p = &*t1.find(10);
+        Table::node_type nh = t1.extract(10);
+        ASSERT_FALSE(nh.empty());
+        EXPECT_EQ(p, &nh.value());
+        EXPECT_EQ(99, t1.size());
+        EXPECT_EQ(0, t1.count(10));
+        EXPECT_TRUE(t1.extract(10).empty());
+
+        nh.value() = 200;
+        EXPECT_TRUE(t2.insert_unique(std::move(nh)).second);
+        EXPECT_TRUE(nh.empty());
+        EXPECT_EQ(p, &*t2.find(200));
+        nh = t2.extract(t2.find(60));
+        EXPECT_FALSE(t1.insert_unique(std::move(nh)).second);
+        EXPECT_FALSE(nh.empty());
+        t1.insert_equal(std::move(nh));
+        EXPECT_EQ(2, t1.count(60));
+
+        t1.merge_unique(t2);
+        EXPECT_EQ(151, t1.size());
+        EXPECT_EQ(49, t2.size());
+        t1.merge_equal(t2);
+        EXPECT_TRUE(t2.empty());
+        EXPECT_TRUE(t2.begin() == t2.end());
+        EXPECT_EQ(200, t1.size());
+        EXPECT_EQ(2, t1.count(99));
+        EXPECT_EQ(1, t1.count(149));
+        EXPECT_EQ(allocations, p1.allocations);
+
+        Table t3(50, hash<int>(), equal_to<int>(), stateful_alloc(&p2));
+        t3.insert_unique(0);
+        t3.merge_unique(t1);
+        EXPECT_EQ(150, t3.size());
+        EXPECT_EQ(51, t1.size());
+        nh = t1.extract(t1.begin());
+        EXPECT_FALSE(t3.insert_unique(std::move(nh)).second);
+        nh.value() = 1000;
+        EXPECT_TRUE(t3.insert_unique(std::move(nh)).second);
+        EXPECT_TRUE(nh.empty());
+        EXPECT_EQ(50, t1.size());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+
+    hash_map<int, std::string> m;
+    hash_multimap<int, std::string> mm;
+    m[1] = "one";
+    m[2] = "two";
+    mm.insert(m.extract(1));
+    mm.insert(m.extract(m.begin()));
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(2, mm.size());
+    hash_map<int, std::string> m2;
+    m2.insert(mm.extract(2));
+    m.merge(m2);
+    EXPECT_EQ("two", m[2]);
+
+    hash_set<int> s1, s2;
+    s1.insert(1);
+    s2.insert(1);
+    s2.insert(2);
+    s1.merge(s2);
+    EXPECT_EQ(2, s1.size());
+    EXPECT_EQ(1, s2.size());
+    hash_multiset<int> ms;
+    ms.insert(s1.extract(s1.begin()));
+    ms.insert(s2.extract(1));
+    EXPECT_EQ(2, ms.count(1));
+}
+
 } // namespace forgedstl
\ No newline at end of file
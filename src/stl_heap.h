@@ -23,7 +23,7 @@ template <typename RandomAccessIterator>
 inline void push_heap(RandomAccessIterator first, RandomAccessIterator last) {
     typedef typename iterator_traits<RandomAccessIterator>::difference_type difference_type;
     typedef typename iterator_traits<RandomAccessIterator>::value_type value_type;
-    __push_heap(first, difference_type((last - first) - 1), difference_type(0), value_type(*(last - 1)));
+    forgedstl::__push_heap(first, difference_type((last - first) - 1), difference_type(0), value_type(*(last - 1)));
 }
 
 #else // #if 0
@@ -32,8 +32,8 @@ template <typename RandomAccessIterator, typename Distance, typename T>
 inline void __push_heap_aux(RandomAccessIterator first,
                             RandomAccessIterator last,
                             Distance*, T*) {
-    __push_heap(first, Distance((last - first) - 1),
-                Distance(0), T(*(last - 1)));
+    forgedstl::__push_heap(first, Distance((last - first) - 1),
+                           Distance(0), T(*(last - 1)));
 }
 
 template <typename RandomAccessIterator>
@@ -61,8 +61,8 @@ template <typename RandomAccessIterator, typename Compare,
           typename Distance, typename T>
 inline void __push_heap_aux(RandomAccessIterator first, RandomAccessIterator last,
                                 Compare comp, Distance*, T*) {
-    __push_heap(first, Distance((last - first) - 1), Distance(0),
-                T(*(last - 1)), comp);
+    forgedstl::__push_heap(first, Distance((last - first) - 1), Distance(0),
+                           T(*(last - 1)), comp);
 }
 
 template <typename RandomAccessIterator, typename Compare>
@@ -88,19 +88,19 @@ void __adjust_heap(RandomAccessIterator first, Distance holeIndex,
         *(first + holeIndex) = *(first + (child - 1));
         holeIndex = child - 1;
     }
-    __push_heap(first, holeIndex, topIndex, value);
+    forgedstl::__push_heap(first, holeIndex, topIndex, value);
 }
 
 template <typename RandomAccessIterator, typename T, typename Distance>
 inline void __pop_heap(RandomAccessIterator first, RandomAccessIterator last,
                        RandomAccessIterator result, T value, Distance*) {
     *result = *first;
-    __adjust_heap(first, Distance(0), Distance(last - first), value);
+    forgedstl::__adjust_heap(first, Distance(0), Distance(last - first), value);
 }
 
 template <typename RandomAccessIterator, typename T>
 inline void __pop_heap_aux(RandomAccessIterator first, RandomAccessIterator last, T*) {
-    __pop_heap(first, last - 1, last - 1, T(*(last - 1)), distance_type(first));
+    forgedstl::__pop_heap(first, last - 1, last - 1, T(*(last - 1)), distance_type(first));
 }
 
 template <typename RandomAccessIterator>
@@ -125,7 +125,7 @@ void __adjust_heap(RandomAccessIterator first, Distance holeIndex,
         *(first + holeIndex) = *(first + (child - 1));
         holeIndex = child - 1;
     }
-    __push_heap(first, holeIndex, topIndex, value, comp);
+    forgedstl::__push_heap(first, holeIndex, topIndex, value, comp);
 }
 
 template <typename RandomAccessIterator, typename T, typename Compare, typename Distance>
@@ -133,14 +133,14 @@ inline void __pop_heap(RandomAccessIterator first, RandomAccessIterator last,
                        RandomAccessIterator result, T value, Compare comp,
                        Distance*) {
     *result = *first;
-    __adjust_heap(first, Distance(0), Distance(last - first), value, comp);
+    forgedstl::__adjust_heap(first, Distance(0), Distance(last - first), value, comp);
 }
 
 template <typename RandomAccessIterator, typename T, typename Compare>
 inline void __pop_heap_aux(RandomAccessIterator first, RandomAccessIterator last,
                            T*, Compare comp) {
-    __pop_heap(first, last - 1, last - 1, T(*(last - 1)), comp,
-               distance_type(first));
+    forgedstl::__pop_heap(first, last - 1, last - 1, T(*(last - 1)), comp,
+                          distance_type(first));
 }
 
 template <typename RandomAccessIterator, typename Compare>
@@ -158,7 +158,7 @@ inline void __make_heap(RandomAccessIterator first, RandomAccessIterator last, D
     Distance holeIndex = (len - 1 - 1) / 2;
 
     while (true) {
-        __adjust_heap(first, holeIndex, len, *(first + holeIndex));
+        forgedstl::__adjust_heap(first, holeIndex, len, *(first + holeIndex));
         if (holeIndex == 0) {
             return;
         }
@@ -168,7 +168,7 @@ inline void __make_heap(RandomAccessIterator first, RandomAccessIterator last, D
 
 template <typename RandomAccessIterator>
 inline void make_heap(RandomAccessIterator first, RandomAccessIterator last) {
-    __make_heap(first, last, distance_type(first), value_type(first));
+    forgedstl::__make_heap(first, last, distance_type(first), value_type(first));
 }
 
 template <typename RandomAccessIterator, typename Compare, typename Distance, typename T>
@@ -181,7 +181,7 @@ inline void __make_heap(RandomAccessIterator first, RandomAccessIterator last, C
     Distance holeIndex = (len - 1 - 1) / 2;
 
     while (true) {
-        __adjust_heap(first, holeIndex, len, *(first + holeIndex), comp);
+        forgedstl::__adjust_heap(first, holeIndex, len, *(first + holeIndex), comp);
         if (holeIndex == 0) {
             return;
         }
@@ -191,7 +191,7 @@ inline void __make_heap(RandomAccessIterator first, RandomAccessIterator last, C
 
 template <typename RandomAccessIterator, typename Compare>
 inline void make_heap(RandomAccessIterator first, RandomAccessIterator last, Compare comp) {
-    __make_heap(first, last, comp, distance_type(first), value_type(first));
+    forgedstl::__make_heap(first, last, comp, distance_type(first), value_type(first));
 }
 
 template <typename RandomAccessIterator>
@@ -0,0 +1,685 @@
+#ifndef FORGED_STL_INTERNAL_INTRUSIVE_H_
+#define FORGED_STL_INTERNAL_INTRUSIVE_H_
+
+#include <cstddef>
+
+#include "stl_iterator.h"
+#include "stl_list.h"
+#include "stl_pair.h"
+#include "stl_tree.h"
+
+namespace forgedstl {
+
+// Hooks for the intrusive containers. An object holds one hook for every
+// intrusive_rb_tree or intrusive_list it is to be linked into, and those
+// link the hook in place; a hook is in one container at a time.
+typedef __rb_tree_node_base intrusive_tree_hook;
+typedef __list_node_base intrusive_list_hook;
+
+// Gets from a hook back to the object around it, by the member's offset
+// as measured on storage of T's size and alignment.
+template <typename T, typename Hook, Hook T::*Member>
+struct __intrusive_member {
+    static Hook* hook(T& x) {
+        return &(x.*Member);
+    }
+    static T* object(const void* h) {
+        return reinterpret_cast<T*>((char*)h - offset());
+    }
+    static ptrdiff_t offset() {
+        alignas(T) static char storage[sizeof(T)];
+        T* p = reinterpret_cast<T*>(storage);
+        return reinterpret_cast<char*>(&(p->*Member)) - storage;
+    }
+};
+
+template <typename Value, typename Ref, typename Ptr, typename Member>
+struct __intrusive_tree_iterator : public __rb_tree_base_iterator {
+    typedef Value value_type;
+    typedef Ref reference;
+    typedef Ptr pointer;
+    typedef __intrusive_tree_iterator<Value, Value&, Value*, Member> iterator;
+    typedef __intrusive_tree_iterator<Value, const Value&, const Value*, Member>
+        const_iterator;
+    typedef __intrusive_tree_iterator<Value, Ref, Ptr, Member> self;
+
+    __intrusive_tree_iterator() { }
+    __intrusive_tree_iterator(base_ptr x) {
+        node = x;
+    }
+    __intrusive_tree_iterator(const iterator& it) {
+        node = it.node;
+    }
+
+    reference operator*() const {
+        return *Member::object(node);
+    }
+    pointer operator->() const {
+        return &(operator*());
+    }
+
+    self& operator++() {
+        increment();
+        return *this;
+    }
+    self operator++(int) {
+        self tmp = *this;
+        increment();
+        return tmp;
+    }
+    self& operator--() {
+        decrement();
+        return *this;
+    }
+    self operator--(int) {
+        self tmp = *this;
+        decrement();
+        return tmp;
+    }
+};
+
+// A red-black tree of objects that carry their own intrusive_tree_hook.
+// insert links an object's hook in place and erase unlinks it, through the
+// same rebalancing as rb_tree, so neither allocates nor copies; the tree
+// never owns its objects, which must stay put while they are linked. An
+// object with several hooks can be in several trees at once.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare,
+          intrusive_tree_hook Value::*Hook>
+class intrusive_rb_tree {
+protected:
+    typedef __rb_tree_node_base* base_ptr;
+    typedef __intrusive_member<Value, intrusive_tree_hook, Hook> member;
+
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef __intrusive_tree_iterator<value_type, reference, pointer, member>
+        iterator;
+    typedef __intrusive_tree_iterator<value_type, const_reference,
+                                      const_pointer, member> const_iterator;
+    typedef reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef reverse_iterator<iterator> reverse_iterator;
+
+    explicit intrusive_rb_tree(const Compare& comp = Compare())
+        : node_count(0), key_compare(comp) {
+        init();
+    }
+    intrusive_rb_tree(intrusive_rb_tree&& x)
+        : node_count(0), key_compare(x.key_compare) {
+        init();
+        __take_nodes(x);
+    }
+    intrusive_rb_tree& operator=(intrusive_rb_tree&& x) {
+        if (this != &x) {
+            clear();
+            key_compare = x.key_compare;
+            __take_nodes(x);
+        }
+        return *this;
+    }
+
+    intrusive_rb_tree(const intrusive_rb_tree&) = delete;
+    intrusive_rb_tree& operator=(const intrusive_rb_tree&) = delete;
+
+    Compare key_comp() const {
+        return key_compare;
+    }
+    iterator begin() {
+        return header->left;
+    }
+    const_iterator begin() const {
+        return header->left;
+    }
+    iterator end() {
+        return header;
+    }
+    const_iterator end() const {
+        return header;
+    }
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    bool empty() const {
+        return node_count == 0;
+    }
+    size_type size() const {
+        return node_count;
+    }
+    size_type max_size() const {
+        return size_type(-1);
+    }
+
+    void swap(intrusive_rb_tree& t) {
+        intrusive_rb_tree tmp(std::move(t));
+        t.__take_nodes(*this);
+        __take_nodes(tmp);
+        std::swap(key_compare, t.key_compare);
+    }
+
+    // insert_unique leaves v unlinked if its key is already here.
+    pair<iterator, bool> insert_unique(value_type& v);
+    iterator insert_equal(value_type& v);
+
+    void erase(iterator position) {
+        __rb_tree_rebalance_for_erase(position.node, header->parent,
+                                      header->left, header->right);
+        --node_count;
+    }
+    size_type erase(const key_type& k);
+    void erase(iterator first, iterator last);
+    // Forgets all of the objects at once, without touching them.
+    void clear() {
+        header->parent = nullptr;
+        header->left = header;
+        header->right = header;
+        node_count = 0;
+    }
+
+    // The position of an object linked into this tree, found in O(1).
+    iterator iterator_to(value_type& v) {
+        return iterator(member::hook(v));
+    }
+    const_iterator iterator_to(const value_type& v) const {
+        return const_iterator(member::hook(const_cast<value_type&>(v)));
+    }
+
+    iterator find(const key_type& k);
+    const_iterator find(const key_type& k) const {
+        return const_cast<intrusive_rb_tree*>(this)->find(k);
+    }
+    size_type count(const key_type& k) const;
+    iterator lower_bound(const key_type& k);
+    const_iterator lower_bound(const key_type& k) const {
+        return const_cast<intrusive_rb_tree*>(this)->lower_bound(k);
+    }
+    iterator upper_bound(const key_type& k);
+    const_iterator upper_bound(const key_type& k) const {
+        return const_cast<intrusive_rb_tree*>(this)->upper_bound(k);
+    }
+    pair<iterator, iterator> equal_range(const key_type& k) {
+        return pair<iterator, iterator>(lower_bound(k), upper_bound(k));
+    }
+    pair<const_iterator, const_iterator> equal_range(const key_type& k) const {
+        return pair<const_iterator, const_iterator>(lower_bound(k),
+                                                    upper_bound(k));
+    }
+
+    bool __rb_verify() const;
+
+protected:
+    __rb_tree_node_base header_node;
+    base_ptr header;
+    size_type node_count;
+    Compare key_compare;
+
+    static const key_type& key(base_ptr x) {
+        return KeyOfValue()(*member::object(x));
+    }
+
+private:
+    iterator __link(base_ptr y, bool left, value_type& v);
+
+    void __take_nodes(intrusive_rb_tree& x) {
+        if (x.header->parent != nullptr) {
+            header->parent = x.header->parent;
+            header->left = x.header->left;
+            header->right = x.header->right;
+            header->parent->parent = header;
+            node_count = x.node_count;
+            x.clear();
+        }
+    }
+    void init() {
+        header = &header_node;
+        header->color = __rb_tree_red;
+        clear();
+    }
+};
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+inline void swap(intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>& x,
+                 intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>& y) {
+    x.swap(y);
+}
+
+// Links v's hook as the left or right child of y, which is the header for
+// the first node.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::__link(base_ptr y, bool left, value_type& v) {
+    base_ptr z = member::hook(v);
+    if (y == header || left) {
+        y->left = z;
+        if (y == header) {
+            header->parent = z;
+            header->right = z;
+        } else if (y == header->left) {
+            header->left = z;
+        }
+    } else {
+        y->right = z;
+        if (y == header->right) {
+            header->right = z;
+        }
+    }
+    z->parent = y;
+    z->left = nullptr;
+    z->right = nullptr;
+    __rb_tree_rebalance(z, header->parent);
+    ++node_count;
+    return iterator(z);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+pair<typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator, bool>
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::insert_unique(value_type& v) {
+    const key_type& k = KeyOfValue()(v);
+    base_ptr y = header;
+    base_ptr x = header->parent;
+    bool comp = true;
+    while (x != nullptr) {
+        y = x;
+        comp = key_compare(k, key(x));
+        x = comp ? x->left : x->right;
+    }
+    iterator j = iterator(y);
+    if (comp) {
+        if (j == begin()) {
+            return pair<iterator, bool>(__link(y, true, v), true);
+        }
+        --j;
+    }
+    if (key_compare(key(j.node), k)) {
+        return pair<iterator, bool>(__link(y, comp, v), true);
+    }
+    return pair<iterator, bool>(j, false);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::insert_equal(value_type& v) {
+    const key_type& k = KeyOfValue()(v);
+    base_ptr y = header;
+    base_ptr x = header->parent;
+    bool comp = true;
+    while (x != nullptr) {
+        y = x;
+        comp = key_compare(k, key(x));
+        x = comp ? x->left : x->right;
+    }
+    return __link(y, comp, v);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::size_type
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::erase(const key_type& k) {
+    pair<iterator, iterator> p = equal_range(k);
+    size_type n = 0;
+    distance(p.first, p.second, n);
+    erase(p.first, p.second);
+    return n;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+void intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::erase(iterator first, iterator last) {
+    if (first == begin() && last == end()) {
+        clear();
+    } else {
+        while (first != last) {
+            erase(first++);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::find(const key_type& k) {
+    iterator j = lower_bound(k);
+    return (j == end() || key_compare(k, key(j.node))) ? end() : j;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::size_type
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::count(const key_type& k) const {
+    pair<const_iterator, const_iterator> p = equal_range(k);
+    size_type n = 0;
+    distance(p.first, p.second, n);
+    return n;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::lower_bound(const key_type& k) {
+    base_ptr y = header;
+    base_ptr x = header->parent;
+    while (x != nullptr) {
+        if (!key_compare(key(x), k)) {
+            y = x, x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+    return iterator(y);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+typename intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::iterator
+intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::upper_bound(const key_type& k) {
+    base_ptr y = header;
+    base_ptr x = header->parent;
+    while (x != nullptr) {
+        if (key_compare(k, key(x))) {
+            y = x, x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+    return iterator(y);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, intrusive_tree_hook Value::*Hook>
+bool intrusive_rb_tree<Key, Value, KeyOfValue, Compare, Hook>::__rb_verify() const {
+    base_ptr root = header->parent;
+    if (node_count == 0 || root == nullptr) {
+        return node_count == 0 && root == nullptr &&
+            header->left == header && header->right == header;
+    }
+
+    const int len = __black_count(header->left, root);
+    size_type n = 0;
+    for (const_iterator it = begin(); it != end(); ++it, ++n) {
+        base_ptr x = it.node;
+        base_ptr L = x->left;
+        base_ptr R = x->right;
+        if (x->color == __rb_tree_red &&
+            ((L != nullptr && L->color == __rb_tree_red) ||
+             (R != nullptr && R->color == __rb_tree_red))) {
+            return false;
+        }
+        if (L != nullptr && key_compare(key(x), key(L))) {
+            return false;
+        }
+        if (R != nullptr && key_compare(key(R), key(x))) {
+            return false;
+        }
+        if (L == nullptr && R == nullptr && __black_count(x, root) != len) {
+            return false;
+        }
+    }
+    return n == node_count &&
+        header->left == __rb_tree_node_base::minimum(root) &&
+        header->right == __rb_tree_node_base::maximum(root);
+}
+
+template <typename T, typename Ref, typename Ptr, typename Member>
+struct __intrusive_list_iterator {
+    typedef __intrusive_list_iterator<T, T&, T*, Member> iterator;
+    typedef __intrusive_list_iterator<T, const T&, const T*, Member>
+        const_iterator;
+    typedef __intrusive_list_iterator<T, Ref, Ptr, Member> self;
+
+    typedef bidirectional_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef Ptr pointer;
+    typedef Ref reference;
+    typedef __list_node_base* link_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    link_type node;
+
+    __intrusive_list_iterator(link_type x) : node(x) { }
+    __intrusive_list_iterator() { }
+    __intrusive_list_iterator(const iterator& x) : node(x.node) { }
+
+    bool operator==(const self& x) const {
+        return node == x.node;
+    }
+    bool operator!=(const self& x) const {
+        return node != x.node;
+    }
+    reference operator*() const {
+        return *Member::object(node);
+    }
+    pointer operator->() const {
+        return &(operator*());
+    }
+
+    self& operator++() {
+        node = (link_type)node->next;
+        return *this;
+    }
+    self operator++(int) {
+        self tmp = *this;
+        ++*this;
+        return tmp;
+    }
+    self& operator--() {
+        node = (link_type)node->prev;
+        return *this;
+    }
+    self operator--(int) {
+        self tmp = *this;
+        --*this;
+        return tmp;
+    }
+};
+
+// A doubly linked list of objects that carry their own
+// intrusive_list_hook, linked and unlinked in place like the nodes of
+// list; the list never owns its objects, and size() counts them.
+template <typename T, intrusive_list_hook T::*Hook>
+class intrusive_list {
+protected:
+    typedef __list_node_base* link_type;
+    typedef __intrusive_member<T, intrusive_list_hook, Hook> member;
+
+public:
+    typedef T value_type;
+    typedef value_type* pointer;
+    typedef const value_type* const_pointer;
+    typedef value_type& reference;
+    typedef const value_type& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef __intrusive_list_iterator<T, T&, T*, member> iterator;
+    typedef __intrusive_list_iterator<T, const T&, const T*, member>
+        const_iterator;
+    typedef reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef reverse_iterator<iterator> reverse_iterator;
+
+    intrusive_list() {
+        empty_initialize();
+    }
+    intrusive_list(intrusive_list&& x) {
+        empty_initialize();
+        take_nodes(x);
+    }
+    intrusive_list& operator=(intrusive_list&& x) {
+        if (this != &x) {
+            clear();
+            take_nodes(x);
+        }
+        return *this;
+    }
+
+    intrusive_list(const intrusive_list&) = delete;
+    intrusive_list& operator=(const intrusive_list&) = delete;
+
+    iterator begin() {
+        return (link_type)node->next;
+    }
+    const_iterator begin() const {
+        return (link_type)node->next;
+    }
+    iterator end() {
+        return node;
+    }
+    const_iterator end() const {
+        return node;
+    }
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+    bool empty() const {
+        return node->next == node;
+    }
+    size_type size() const {
+        size_type n = 0;
+        distance(begin(), end(), n);
+        return n;
+    }
+    size_type max_size() const {
+        return size_type(-1);
+    }
+    reference front() {
+        return *begin();
+    }
+    const_reference front() const {
+        return *begin();
+    }
+    reference back() {
+        return *(--end());
+    }
+    const_reference back() const {
+        return *(--end());
+    }
+
+    void swap(intrusive_list& x) {
+        intrusive_list tmp(std::move(x));
+        x.take_nodes(*this);
+        take_nodes(tmp);
+    }
+
+    iterator insert(iterator position, value_type& x) {
+        link_type tmp = member::hook(x);
+        tmp->next = position.node;
+        tmp->prev = position.node->prev;
+        ((link_type)position.node->prev)->next = tmp;
+        position.node->prev = tmp;
+        return tmp;
+    }
+    void push_front(value_type& x) {
+        insert(begin(), x);
+    }
+    void push_back(value_type& x) {
+        insert(end(), x);
+    }
+    iterator erase(iterator position) {
+        link_type next_node = (link_type)position.node->next;
+        link_type prev_node = (link_type)position.node->prev;
+        prev_node->next = next_node;
+        next_node->prev = prev_node;
+        return next_node;
+    }
+    iterator erase(iterator first, iterator last) {
+        if (first != last) {
+            ((link_type)first.node->prev)->next = last.node;
+            last.node->prev = first.node->prev;
+        }
+        return last;
+    }
+    void pop_front() {
+        erase(begin());
+    }
+    void pop_back() {
+        erase(--end());
+    }
+    // Forgets all of the objects at once, without touching them.
+    void clear() {
+        node->next = node;
+        node->prev = node;
+    }
+
+    // The position of an object linked into this list, found in O(1).
+    iterator iterator_to(value_type& x) {
+        return iterator(member::hook(x));
+    }
+    const_iterator iterator_to(const value_type& x) const {
+        return const_iterator(member::hook(const_cast<value_type&>(x)));
+    }
+
+    void splice(iterator position, intrusive_list& x) {
+        if (!x.empty()) {
+            transfer(position, x.begin(), x.end());
+        }
+    }
+    void splice(iterator position, intrusive_list&, iterator i) {
+        iterator j = i;
+        ++j;
+        if (position == i || position == j) {
+            return;
+        }
+        transfer(position, i, j);
+    }
+    void splice(iterator position, intrusive_list&, iterator first, iterator last) {
+        if (first != last) {
+            transfer(position, first, last);
+        }
+    }
+
+protected:
+    // The sentinel lives inside the list; node always points at it.
+    __list_node_base sentinel;
+    link_type node;
+
+    void empty_initialize() {
+        node = &sentinel;
+        clear();
+    }
+    // Relinks all of x's objects onto this list, which must be empty.
+    void take_nodes(intrusive_list& x) {
+        if (!x.empty()) {
+            node->next = x.node->next;
+            node->prev = x.node->prev;
+            ((link_type)node->next)->prev = node;
+            ((link_type)node->prev)->next = node;
+            x.clear();
+        }
+    }
+    void transfer(iterator position, iterator first, iterator last) {
+        ((link_type)last.node->prev)->next = position.node;
+        ((link_type)first.node->prev)->next = last.node;
+        ((link_type)position.node->prev)->next = first.node;
+        link_type tmp = (link_type)position.node->prev;
+        position.node->prev = last.node->prev;
+        last.node->prev = first.node->prev;
+        first.node->prev = tmp;
+    }
+};
+
+template <typename T, intrusive_list_hook T::*Hook>
+inline void swap(intrusive_list<T, Hook>& x, intrusive_list<T, Hook>& y) {
+    x.swap(y);
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_INTRUSIVE_H_
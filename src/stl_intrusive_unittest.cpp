@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <string>
+
+#include "stl_function.h"
+#include "stl_intrusive.h"
+
+namespace forgedstl {
+
+// An entry of a cache, indexed by id and by expiry time, and kept in
+// least recently used order, all without a node of its own anywhere.
+struct cache_entry {
+    int id;
+    int expiry;
+    std::string name;
+    intrusive_tree_hook by_id;
+    intrusive_tree_hook by_expiry;
+    intrusive_list_hook lru;
+};
+
+struct entry_id {
+    const int& operator()(const cache_entry& e) const {
+        return e.id;
+    }
+};
+
+struct entry_expiry {
+    const int& operator()(const cache_entry& e) const {
+        return e.expiry;
+    }
+};
+
+typedef intrusive_rb_tree<int, cache_entry, entry_id, std::less<int>,
+                          &cache_entry::by_id> id_index;
+typedef intrusive_rb_tree<int, cache_entry, entry_expiry, std::less<int>,
+                          &cache_entry::by_expiry> expiry_index;
+typedef intrusive_list<cache_entry, &cache_entry::lru> lru_list;
+
+TEST(IntrusiveTest, Tree) {
+    cache_entry entries[1000];
+    id_index ids;
+    EXPECT_TRUE(ids.empty());
+    EXPECT_TRUE(ids.find(1) == ids.end());
+    EXPECT_TRUE(ids.__rb_verify());
+
+    std::multiset<int> expected;
+    unsigned x = 2463534242u;
+    for (int i = 0; i < 1000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        entries[i].id = int(x % 600);
+        if (ids.insert_unique(entries[i]).second) {
+            expected.insert(entries[i].id);
+        }
+    }
+    ASSERT_TRUE(ids.__rb_verify());
+    ASSERT_EQ(expected.size(), ids.size());
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), ids.begin(),
+                           [](int k, const cache_entry& e) {
+                               return k == e.id;
+                           }));
+
+    // the found object is the one linked, not a copy
+    const int k = entries[10].id;
+    EXPECT_EQ(1, ids.count(k));
+    EXPECT_EQ(k, ids.find(k)->id);
+    EXPECT_TRUE(&*ids.iterator_to(*ids.find(k)) == &*ids.find(k));
+
+    for (int i = 0; i < 600; i += 3) {
+        expected.erase(i);
+        ids.erase(i);
+    }
+    ASSERT_TRUE(ids.__rb_verify());
+    ASSERT_EQ(expected.size(), ids.size());
+    while (!ids.empty()) {
+        ids.erase(ids.begin());
+        ASSERT_TRUE(ids.__rb_verify());
+    }
+
+    // equal keys, move and swap
+    id_index equal;
+    for (int i = 0; i < 100; ++i) {
+        entries[i].id = i % 10;
+        equal.insert_equal(entries[i]);
+    }
+    EXPECT_TRUE(equal.__rb_verify());
+    EXPECT_EQ(10, equal.count(3));
+    EXPECT_EQ(&entries[3], &*equal.lower_bound(3));
+    EXPECT_EQ(&entries[93], &*--equal.upper_bound(3));
+    EXPECT_EQ(10, equal.erase(3));
+    id_index moved(std::move(equal));
+    EXPECT_TRUE(equal.empty());
+    EXPECT_EQ(90, moved.size());
+    EXPECT_TRUE(moved.__rb_verify());
+    equal.insert_unique(entries[500]);
+    equal.swap(moved);
+    EXPECT_EQ(90, equal.size());
+    EXPECT_EQ(1, moved.size());
+    EXPECT_TRUE(equal.__rb_verify());
+    EXPECT_TRUE(moved.__rb_verify());
+    equal.clear();
+    EXPECT_TRUE(equal.__rb_verify());
+}
+
+TEST(IntrusiveTest, List) {
+    cache_entry entries[10];
+    lru_list l;
+    EXPECT_TRUE(l.empty());
+    for (int i = 0; i < 10; ++i) {
+        entries[i].id = i;
+        l.push_back(entries[i]);
+    }
+    EXPECT_EQ(10, l.size());
+    EXPECT_EQ(0, l.front().id);
+    EXPECT_EQ(9, l.back().id);
+
+    // touching an entry moves it to the back in O(1)
+    l.splice(l.end(), l, l.iterator_to(entries[3]));
+    EXPECT_EQ(3, l.back().id);
+    l.pop_front();
+    EXPECT_EQ(1, l.front().id);
+    EXPECT_EQ(9, l.size());
+    l.erase(l.iterator_to(entries[5]));
+    l.push_front(entries[5]);
+    const int order[] = { 5, 1, 2, 4, 6, 7, 8, 9, 3 };
+    int n = 0;
+    for (lru_list::iterator it = l.begin(); it != l.end(); ++it, ++n) {
+        EXPECT_EQ(order[n], it->id);
+    }
+    EXPECT_EQ(9, n);
+
+    lru_list other(std::move(l));
+    EXPECT_TRUE(l.empty());
+    l.splice(l.begin(), other, other.begin(), other.iterator_to(entries[4]));
+    EXPECT_EQ(3, l.size());
+    EXPECT_EQ(6, other.size());
+    l.swap(other);
+    EXPECT_EQ(6, l.size());
+    EXPECT_EQ(4, l.front().id);
+    l.erase(l.begin(), l.end());
+    EXPECT_TRUE(l.empty());
+}
+
+TEST(IntrusiveTest, SeveralIndexes) {
+    cache_entry entries[100];
+    id_index ids;
+    expiry_index expiries;
+    lru_list lru;
+    for (int i = 0; i < 100; ++i) {
+        entries[i].id = i;
+        entries[i].expiry = (i * 37) % 100;
+        ids.insert_unique(entries[i]);
+        expiries.insert_equal(entries[i]);
+        lru.push_back(entries[i]);
+    }
+
+    // expire everything before time 50, through all three indexes
+    while (!expiries.empty() && expiries.begin()->expiry < 50) {
+        cache_entry& e = *expiries.begin();
+        expiries.erase(expiries.begin());
+        ids.erase(ids.iterator_to(e));
+        lru.erase(lru.iterator_to(e));
+    }
+    EXPECT_EQ(50, ids.size());
+    EXPECT_EQ(50, expiries.size());
+    EXPECT_EQ(50, lru.size());
+    EXPECT_TRUE(ids.__rb_verify());
+    EXPECT_TRUE(expiries.__rb_verify());
+    for (id_index::iterator it = ids.begin(); it != ids.end(); ++it) {
+        EXPECT_GE(it->expiry, 50);
+    }
+    EXPECT_TRUE(ids.find(0) == ids.end());
+    EXPECT_EQ(&entries[2], &*ids.find(2));
+}
+
+} // namespace forgedstl
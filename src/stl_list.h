@@ -10,11 +10,14 @@
 
 namespace forgedstl {
 
-template <typename T>
-struct __list_node {
+struct __list_node_base {
     typedef void* void_pointer;
     void_pointer prev;
     void_pointer next;
+};
+
+template <typename T>
+struct __list_node : public __list_node_base {
     T data;
 };
 
@@ -88,8 +91,15 @@ inline ptrdiff_t* distance_type(const __list_iterator<T, Ref, Ptr>&) {
 }
 
 template <typename T, typename Alloc = alloc>
-class list {
+class list;
+
+template <typename T, typename Alloc>
+inline bool operator==(const list<T, Alloc>& x, const list<T, Alloc>& y);
+
+template <typename T, typename Alloc>
+class list : protected __alloc_holder<Alloc> {
 protected:
+    typedef __alloc_holder<Alloc> base;
     typedef void* void_pointer;
     typedef __list_node<T> list_node;
     typedef simple_alloc<list_node, Alloc> list_node_allocator;
@@ -103,6 +113,7 @@ public:
     typedef list_node* link_type;
     typedef size_t size_type;
     typedef ptrdiff_t difference_type;
+    typedef Alloc allocator_type;
 
     typedef __list_iterator<T, T&, T*> iterator;
     typedef __list_iterator<T, const T&, const T*> const_iterator;
@@ -112,30 +123,54 @@ public:
     list() {
         empty_initialize();
     }
-    list(size_type n, const T& value) {
+    explicit list(const allocator_type& a) : base(a) {
+        empty_initialize();
+    }
+    list(size_type n, const T& value,
+         const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    list(int n, const T& value) {
+    list(int n, const T& value,
+         const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    list(long n, const T& value) {
+    list(long n, const T& value,
+         const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    explicit list(size_type n) {
+    explicit list(size_type n, const allocator_type& a = allocator_type())
+        : base(a) {
         fill_initialize(n, T());
     }
     template <typename InputIterator>
-    list(InputIterator first, InputIterator last) {
+    list(InputIterator first, InputIterator last,
+         const allocator_type& a = allocator_type()) : base(a) {
         range_initialize(first, last);
     }
-    list(const list<T, Alloc>& x) {
+    list(const list<T, Alloc>& x) : base(x.get_alloc()) {
         range_initialize(x.begin(), x.end());
     }
+    list(list<T, Alloc>&& x) noexcept : base(x.get_alloc()) {
+        empty_initialize();
+        take_nodes(x);
+    }
     ~list() {
         clear();
-        put_node(node);
     }
     list<T, Alloc>& operator=(const list<T, Alloc>& x);
+    list<T, Alloc>& operator=(list<T, Alloc>&& x)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment) {
+        if (this != &x) {
+            clear();
+            move_assign(x, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
+
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
 
     iterator begin() {
         return (link_type)(node->next);
@@ -185,10 +220,23 @@ public:
         return *(--end());
     }
     void swap(list<T, Alloc>& x) {
-        std::swap(node, x.node);
+        list<T, Alloc> tmp(this->get_alloc());
+        tmp.take_nodes(*this);
+        take_nodes(x);
+        x.take_nodes(tmp);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), x.get_alloc());
+        }
     }
     iterator insert(iterator position, const T& x) {
-        link_type tmp = create_node(x);
+        return emplace(position, x);
+    }
+    iterator insert(iterator position, T&& x) {
+        return emplace(position, std::move(x));
+    }
+    template <typename... Args>
+    iterator emplace(iterator position, Args&&... args) {
+        link_type tmp = create_node(std::forward<Args>(args)...);
         tmp->next = position.node;
         tmp->prev = position.node->prev;
         (link_type(position.node->prev))->next = tmp;
@@ -211,9 +259,23 @@ public:
     void push_front(const T& x) {
         insert(begin(), x);
     }
+    void push_front(T&& x) {
+        insert(begin(), std::move(x));
+    }
     void push_back(const T& x) {
         insert(end(), x);
     }
+    void push_back(T&& x) {
+        insert(end(), std::move(x));
+    }
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
+        emplace(begin(), std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        emplace(end(), std::forward<Args>(args)...);
+    }
     iterator erase(iterator position) {
         if (position.node != node) {
             link_type next_node = link_type(position.node->next);
@@ -277,31 +339,36 @@ public:
     friend bool operator==<>(const list& x, const list& y);
 
 protected:
+    // The sentinel lives inside the list, so an empty list owns no
+    // memory and moving one cannot throw; node always points at it.
+    __list_node_base sentinel;
     link_type node;
 
     link_type get_node() {
-        return list_node_allocator::allocate();
+        return list_node_allocator::allocate(this->get_alloc());
     }
     void put_node(link_type p) {
-        list_node_allocator::deallocate(p);
+        list_node_allocator::deallocate(this->get_alloc(), p);
     }
 
-    link_type create_node(const T& x) {
+    template <typename... Args>
+    link_type create_node(Args&&... args) {
         link_type p = get_node();
         try {
-            construct(&p->data, x);
+            forgedstl::construct(&p->data, std::forward<Args>(args)...);
         } catch (...) {
             put_node(p);
+            throw;
         }
         return p;
     }
     void destroy_node(link_type p) {
-        destroy(p);
+        forgedstl::destroy(p);
         put_node(p);
     }
 
     void empty_initialize() {
-        node = get_node();
+        node = (link_type)&sentinel;
         node->next = node;
         node->prev = node;
     }
@@ -311,7 +378,6 @@ protected:
             insert(begin(), n, value);
         } catch (...) {
             clear();
-            put_node(node);
             throw;
         }
     }
@@ -322,11 +388,37 @@ protected:
             insert(begin(), first, last);
         } catch (...) {
             clear();
-            put_node(node);
             throw;
         }
     }
 
+    // Relinks all of x's nodes onto this list, which must be empty.
+    void take_nodes(list<T, Alloc>& x) {
+        if (x.node->next != x.node) {
+            node->next = x.node->next;
+            node->prev = x.node->prev;
+            link_type(node->next)->prev = node;
+            link_type(node->prev)->next = node;
+            x.node->next = x.node;
+            x.node->prev = x.node;
+        }
+    }
+    void move_assign(list<T, Alloc>& x, __true_type) {
+        this->get_alloc() = x.get_alloc();
+        take_nodes(x);
+    }
+    void move_assign(list<T, Alloc>& x, __false_type) {
+        if (__alloc_equal(this->get_alloc(), x.get_alloc())) {
+            take_nodes(x);
+        } else {
+            // x's nodes cannot change hands, only their values can
+            for (iterator it = x.begin(); it != x.end(); ++it) {
+                emplace_back(std::move(*it));
+            }
+            x.clear();
+        }
+    }
+
     void transfer(iterator position, iterator first, iterator last) {
         (link_type(last.node->prev))->next = position.node;
         (link_type(first.node->prev))->next = last.node;
@@ -416,6 +508,13 @@ void list<T, Alloc>::clear() {
 template <typename T, typename Alloc>
 list<T, Alloc>& list<T, Alloc>::operator=(const list<T, Alloc>& x) {
     if (this != &x) {
+        if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+            if (!__alloc_equal(this->get_alloc(), x.get_alloc())) {
+                // our nodes must go back to the allocator being replaced
+                clear();
+            }
+            this->get_alloc() = x.get_alloc();
+        }
         iterator node1 = begin();
         iterator last1 = end();
         const_iterator node2 = x.begin();
@@ -504,27 +603,38 @@ void list<T, Alloc>::sort() {
     if (node->next == node || link_type(node->next)->next == node) {
         return;
     }
-    list<T, Alloc> carry;
+    // Nodes only move between the temporaries, whose allocators may not
+    // be ours. If the comparison throws, every node goes back into *this
+    // before the exception leaves, so none is freed by a temporary.
+    list<T, Alloc> carry(this->get_alloc());
     list<T, Alloc> counter[64];
     int fill = 0;
-    while (!empty()) {
-        carry.splice(carry.begin(), *this, begin());
-        int i = 0;
-        while (i < fill && !counter[i].empty()) {
-            counter[i].merge(carry);
+    try {
+        while (!empty()) {
+            carry.splice(carry.begin(), *this, begin());
+            int i = 0;
+            while (i < fill && !counter[i].empty()) {
+                counter[i].merge(carry);
+                carry.swap(counter[i]);
+                ++i;
+            }
             carry.swap(counter[i]);
-            ++i;
-        }
-        carry.swap(counter[i]);
-        if (i == fill) {
-            ++fill;
+            if (i == fill) {
+                ++fill;
+            }
         }
-    }
 
-    for (int i = 1; i < fill; ++i) {
-        counter[i].merge(counter[i - 1]);
+        for (int i = 1; i < fill; ++i) {
+            counter[i].merge(counter[i - 1]);
+        }
+    } catch (...) {
+        splice(end(), carry);
+        for (int i = 0; i < fill; ++i) {
+            splice(end(), counter[i]);
+        }
+        throw;
     }
-    swap(counter[fill - 1]);
+    splice(end(), counter[fill - 1]);
 }
 
 template <typename T, typename Alloc>
@@ -589,26 +699,37 @@ void list<T, Alloc>::sort(StrictWeakOrdering comp) {
     if (node->next == node || link_type(node->next)->next == node) {
         return;
     }
-    list<T, Alloc> carry;
+    // Nodes only move between the temporaries, whose allocators may not
+    // be ours. If the comparison throws, every node goes back into *this
+    // before the exception leaves, so none is freed by a temporary.
+    list<T, Alloc> carry(this->get_alloc());
     list<T, Alloc> counter[64];
     int fill = 0;
-    while (!empty()) {
-        carry.splice(carry.begin(), *this, begin());
-        int i = 0;
-        while (i < fill && !counter[i].empty()) {
-            counter[i].merge(carry, comp);
+    try {
+        while (!empty()) {
+            carry.splice(carry.begin(), *this, begin());
+            int i = 0;
+            while (i < fill && !counter[i].empty()) {
+                counter[i].merge(carry, comp);
+                carry.swap(counter[i]);
+                ++i;
+            }
             carry.swap(counter[i]);
-            ++i;
+            if (i == fill) {
+                ++fill;
+            }
         }
-        carry.swap(counter[i]);
-        if (i == fill) {
-            ++fill;
+        for (int i = 1; i < fill; ++i) {
+            counter[i].merge(counter[i - 1], comp);
         }
+    } catch (...) {
+        splice(end(), carry);
+        for (int i = 0; i < fill; ++i) {
+            splice(end(), counter[i]);
+        }
+        throw;
     }
-    for (int i = 1; i < fill; ++i) {
-        counter[i].merge(counter[i - 1], comp);
-    }
-    swap(counter[fill - 1]);
+    splice(end(), counter[fill - 1]);
 }
 
 } // namespace forgedstl
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
+#include <memory>
+#include <string>
 
 #include "stl_list.h"
+#include "test_alloc.h"
 
 namespace forgedstl {
 
@@ -250,4 +253,131 @@ TEST(ListTest, Algo) {
     }
 }
 
+TEST(ListTest, StatefulAlloc) {
+    EXPECT_EQ(3 * sizeof(void*), sizeof(list<int>));
+
+    test_pool p1, p2;
+    {
+        list<int, stateful_alloc> l1((stateful_alloc(&p1)));
+        for (int i = 0; i < 100; ++i) {
+            l1.push_front(i);
+        }
+        EXPECT_EQ(100, p1.allocations);
+        EXPECT_EQ(0, p2.bytes_in_use);
+
+        list<int, stateful_alloc> l2(l1);
+        EXPECT_EQ(&p1, l2.get_allocator().resource());
+
+        list<int, stateful_alloc> l3(10, 7, stateful_alloc(&p2));
+        l3 = l1;
+        EXPECT_EQ(&p2, l3.get_allocator().resource());
+
+        l3.sort();
+        EXPECT_EQ(&p2, l3.get_allocator().resource());
+        int i = 0;
+        for (list<int, stateful_alloc>::iterator it = l3.begin();
+             it != l3.end(); ++it, ++i) {
+            EXPECT_EQ(i, *it);
+        }
+
+        l1.swap(l3);
+        EXPECT_EQ(&p2, l1.get_allocator().resource());
+        EXPECT_EQ(&p1, l3.get_allocator().resource());
+
+        list<int, stateful_alloc> l4(50, stateful_alloc(&p2));
+        EXPECT_EQ(50, l4.size());
+        EXPECT_EQ(0, l4.back());
+        EXPECT_EQ(&p2, l4.get_allocator().resource());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+TEST(ListTest, SortThrows) {
+    test_pool p;
+    {
+        list<int, stateful_alloc> l((stateful_alloc(&p)));
+        for (int i = 0; i < 100; ++i) {
+            l.push_back((i * 37) % 100);
+        }
+        int calls = 0;
+        EXPECT_THROW(l.sort([&calls](int x, int y) {
+            if (++calls == 300) {
+                throw 1;
+            }
+            return x < y;
+        }), int);
+
+        // every element is back in l, in some order
+        EXPECT_EQ(100, l.size());
+        l.sort();
+        int i = 0;
+        for (list<int, stateful_alloc>::iterator it = l.begin();
+             it != l.end(); ++it, ++i) {
+            EXPECT_EQ(i, *it);
+        }
+    }
+    EXPECT_EQ(0, p.bytes_in_use);
+}
+
+TEST(ListTest, MoveAndEmplace) {
+    list<std::unique_ptr<int> > pl;
+    pl.push_back(std::unique_ptr<int>(new int(1)));
+    pl.push_front(std::unique_ptr<int>(new int(0)));
+    pl.emplace_back(new int(3));
+    list<std::unique_ptr<int> >::iterator it = pl.begin();
+    ++it;
+    ++it;
+    pl.insert(it, std::unique_ptr<int>(new int(2)));
+    pl.emplace_front(new int(-1));
+    ASSERT_EQ(5, pl.size());
+    int i = -1;
+    for (it = pl.begin(); it != pl.end(); ++it, ++i) {
+        EXPECT_EQ(i, **it);
+    }
+
+    list<std::string> sl;
+    std::string s(100, 'x');
+    sl.push_back(std::move(s));
+    EXPECT_TRUE(s.empty());
+    sl.emplace(sl.begin(), 2, 'y');
+    EXPECT_EQ("yy", sl.front());
+}
+
+TEST(ListTest, MoveConstructAndAssign) {
+    EXPECT_TRUE(std::is_nothrow_move_constructible<list<int> >::value);
+    EXPECT_TRUE(std::is_nothrow_move_assignable<list<int> >::value);
+
+    list<int> l1;
+    for (int i = 0; i < 10; ++i) {
+        l1.push_back(i);
+    }
+    const int* first = &l1.front();
+    list<int> l2(std::move(l1));
+    EXPECT_TRUE(l1.empty());
+    ASSERT_EQ(10, l2.size());
+    EXPECT_EQ(first, &l2.front());
+    EXPECT_EQ(9, l2.back());
+
+    list<int> l3(3, 1);
+    l3 = std::move(l2);
+    EXPECT_TRUE(l2.empty());
+    EXPECT_EQ(first, &l3.front());
+    l2.push_back(1);
+    EXPECT_EQ(1, l2.size());
+
+    l2.swap(l3);
+    EXPECT_EQ(10, l2.size());
+    EXPECT_EQ(1, l3.size());
+    l3.clear();
+    l3.swap(l2);
+    EXPECT_TRUE(l2.empty());
+    EXPECT_EQ(first, &l3.front());
+    EXPECT_EQ(9, l3.back());
+
+    list<list<int> > ll;
+    ll.push_back(std::move(l3));
+    EXPECT_EQ(first, &ll.front().front());
+}
+
 } // namespace forgedstl
\ No newline at end of file
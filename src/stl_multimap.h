@@ -7,7 +7,26 @@
 
 namespace forgedstl {
 
-template <typename Key, typename T, typename Compare = std::less<int>, typename Alloc = alloc>
+// Tree is the ordered representation behind the multimap: rb_tree, or btree
+// from stl_btree.h, which is denser and faster to search and scan but
+// moves its elements, so that every insert and erase invalidates
+// iterators.
+template <typename Key, typename T, typename Compare = std::less<Key>, typename Alloc = alloc,
+          template <typename, typename, typename, typename, typename> class Tree = unranked_rb_tree>
+class multimap;
+
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const multimap<Key, T, Compare, Alloc, Tree>& x,
+                       const multimap<Key, T, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const multimap<Key, T, Compare, Alloc, Tree>& x,
+                      const multimap<Key, T, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
 class multimap {
 public:
     typedef Key key_type;
@@ -16,8 +35,8 @@ public:
     typedef pair<const Key, T> value_type;
     typedef Compare key_compare;
 
-    class value_compare : public std::binary_function<value_type, value_type, bool> {
-        friend class multimap<Key, T, Compare, Alloc>;
+    class value_compare : public binary_function<value_type, value_type, bool> {
+        friend class multimap<Key, T, Compare, Alloc, Tree>;
     public:
         bool operator()(const value_type& x, const value_type& y) const {
             return comp(x.first, y.first);
@@ -28,9 +47,10 @@ public:
     };
 
 private:
-    typedef rb_tree<key_type, value_type,
+    typedef Tree<key_type, value_type,
         select1st<value_type>, key_compare, Alloc> rep_type;
 
+public:
     typedef typename rep_type::pointer pointer;
     typedef typename rep_type::const_pointer const_pointer;
     typedef typename rep_type::reference reference;
@@ -41,6 +61,7 @@ private:
     typedef typename rep_type::const_reverse_iterator const_reverse_iterator;
     typedef typename rep_type::size_type size_type;
     typedef typename rep_type::difference_type difference_type;
+    typedef typename rep_type::node_type node_type;
 
     multimap() : t(Compare()) { }
     explicit multimap(const Compare& comp) : t(comp) { }
@@ -54,15 +75,33 @@ private:
         : t(comp) {
         t.insert_equal(first, last);
     }
+    // For a range already sorted by key; see rb_tree::insert_equal_sorted.
+    template <typename InputIterator>
+    multimap(sorted_equal_t, InputIterator first, InputIterator last) : t(Compare()) {
+        t.insert_equal_sorted(first, last);
+    }
+    template <typename InputIterator>
+    multimap(sorted_equal_t, InputIterator first, InputIterator last,
+             const Compare& comp) : t(comp) {
+        t.insert_equal_sorted(first, last);
+    }
 
-    multimap(const multimap<Key, T, Compare, Alloc>& x) : t(x.t) { }
-    multimap<Key, T, Compare, Alloc>& operator=(const multimap<Key, T, Compare, Alloc>& x) {
+    multimap(const multimap<Key, T, Compare, Alloc, Tree>& x) : t(x.t) { }
+    multimap(multimap<Key, T, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_constructible<rep_type>::value)
+        : t(std::move(x.t)) { }
+    multimap<Key, T, Compare, Alloc, Tree>& operator=(const multimap<Key, T, Compare, Alloc, Tree>& x) {
         t = x.t;
         return *this;
     }
+    multimap<Key, T, Compare, Alloc, Tree>& operator=(multimap<Key, T, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_assignable<rep_type>::value) {
+        t = std::move(x.t);
+        return *this;
+    }
 
     key_compare key_comp() const {
-        return t.key_comp() :
+        return t.key_comp();
     }
     value_compare value_comp() const {
         return value_compare(t.key_comp());
@@ -79,6 +118,18 @@ private:
     const_iterator end() const {
         return t.end();
     }
+    reverse_iterator rbegin() {
+        return t.rbegin();
+    }
+    const_reverse_iterator rbegin() const {
+        return t.rbegin();
+    }
+    reverse_iterator rend() {
+        return t.rend();
+    }
+    const_reverse_iterator rend() const {
+        return t.rend();
+    }
     bool empty() const {
         return t.empty();
     }
@@ -88,23 +139,38 @@ private:
     size_type max_size() const {
         return t.max_size();
     }
-    T& operator[](const key_type& k) {
-        return (*((insert(value_type(k, T()))).first)).second;
-    }
-    void swap(multimap<Key, T, Compare, Alloc>& x) {
+    void swap(multimap<Key, T, Compare, Alloc, Tree>& x) {
         t.swap(x.t);
     }
 
-    pair<iterator, bool> insert(const value_type& x) {
+    iterator insert(const value_type& x) {
         return t.insert_equal(x);
     }
+    iterator insert(value_type&& x) {
+        return t.insert_equal(std::move(x));
+    }
     iterator insert(iterator position, const value_type& x) {
         return t.insert_equal(position, x);
     }
+    iterator insert(iterator position, value_type&& x) {
+        return t.insert_equal(position, std::move(x));
+    }
+    template <typename... Args>
+    iterator emplace(Args&&... args) {
+        return t.emplace_equal(std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    iterator emplace_hint(iterator position, Args&&... args) {
+        return t.emplace_hint_equal(position, std::forward<Args>(args)...);
+    }
     template <typename InputIterator>
     void insert(InputIterator first, InputIterator last) {
         t.insert_equal(first, last);
     }
+    template <typename InputIterator>
+    void insert(sorted_equal_t, InputIterator first, InputIterator last) {
+        t.insert_equal_sorted(first, last);
+    }
 
     void erase(iterator position) {
         t.erase(position);
@@ -115,6 +181,27 @@ private:
     void erase(iterator first, iterator last) {
         t.erase(first, last);
     }
+    // extract and insert move an element between maps and multimaps of
+    // the same types; see rb_tree::extract and btree::extract.
+    node_type extract(iterator position) {
+        return t.extract(position);
+    }
+    node_type extract(const key_type& x) {
+        return t.extract(x);
+    }
+    iterator insert(node_type&& nh) {
+        return t.insert_equal(std::move(nh));
+    }
+    void merge(multimap<Key, T, Compare, Alloc, Tree>& x) {
+        t.merge_equal(x.t);
+    }
+    // Only with rb_tree for Tree; see rb_tree::split.
+    void split(const key_type& k, multimap<Key, T, Compare, Alloc, Tree>& x) {
+        t.split(k, x.t);
+    }
+    void join(multimap<Key, T, Compare, Alloc, Tree>& x) {
+        t.join_equal(x.t);
+    }
     void clear() {
         t.clear();
     }
@@ -148,6 +235,20 @@ private:
         return t.equal_range(x);
     }
 
+    // Only with ranked_rb_tree for Tree; see rb_tree::rank.
+    size_type rank(const key_type& x) const {
+        return t.rank(x);
+    }
+    size_type rank(const_iterator position) const {
+        return t.rank(position);
+    }
+    iterator select(size_type n) {
+        return t.select(n);
+    }
+    const_iterator select(size_type n) const {
+        return t.select(n);
+    }
+
     friend bool operator== <> (const multimap&, const multimap&);
     friend bool operator< <> (const multimap&, const multimap&);
 
@@ -155,21 +256,24 @@ private:
     rep_type t;
 };
 
-template <typename Key, typename T, typename Compare, typename Alloc>
-inline bool operator==(const multimap<Key, T, Compare, Alloc>& x,
-                       const multimap<Key, T, Compare, Alloc>& y) {
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const multimap<Key, T, Compare, Alloc, Tree>& x,
+                       const multimap<Key, T, Compare, Alloc, Tree>& y) {
     return x.t == y.t;
 }
 
-template <typename Key, typename T, typename Compare, typename Alloc>
-inline bool operator<(const multimap<Key, T, Compare, Alloc>& x,
-    const multimap<Key, T, Compare, Alloc>& y) {
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const multimap<Key, T, Compare, Alloc, Tree>& x,
+    const multimap<Key, T, Compare, Alloc, Tree>& y) {
     return x.t < y.t;
 }
 
-template <typename Key, typename T, typename Compare, typename Alloc>
-inline void swap(multimap<Key, T, Compare, Alloc>& x,
-                 multimap<Key, T, Compare, Alloc>& y) {
+template <typename Key, typename T, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline void swap(multimap<Key, T, Compare, Alloc, Tree>& x,
+                 multimap<Key, T, Compare, Alloc, Tree>& y) {
     x.swap(y);
 }
 
@@ -8,7 +8,26 @@
 
 namespace forgedstl {
 
-template <typename Key, typename Compare = std::less<Key>, typename Alloc = alloc>
+// Tree is the ordered representation behind the multiset: rb_tree, or btree
+// from stl_btree.h, which is denser and faster to search and scan but
+// moves its elements, so that every insert and erase invalidates
+// iterators.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = alloc,
+          template <typename, typename, typename, typename, typename> class Tree = unranked_rb_tree>
+class multiset;
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const multiset<Key, Compare, Alloc, Tree>& x,
+                       const multiset<Key, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const multiset<Key, Compare, Alloc, Tree>& x,
+                      const multiset<Key, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
 class multiset {
 public:
     typedef Key key_type;
@@ -17,7 +36,7 @@ public:
     typedef Compare value_compare;
 
 private:
-    typedef rb_tree<key_type, value_type,
+    typedef Tree<key_type, value_type,
         identity<value_type>, key_compare, Alloc> rep_type;
 
 public:
@@ -31,6 +50,7 @@ public:
     typedef typename rep_type::const_reverse_iterator const_reverse_iterator;
     typedef typename rep_type::size_type size_type;
     typedef typename rep_type::difference_type difference_type;
+    typedef typename rep_type::node_type node_type;
 
     multiset() : t(Compare()) { }
     explicit multiset(const Compare& comp) : t(comp) { }
@@ -45,12 +65,30 @@ public:
         : t(comp) {
         t.insert_equal(first, last);
     }
+    // For a range already sorted by key; see rb_tree::insert_equal_sorted.
+    template <typename InputIterator>
+    multiset(sorted_equal_t, InputIterator first, InputIterator last) : t(Compare()) {
+        t.insert_equal_sorted(first, last);
+    }
+    template <typename InputIterator>
+    multiset(sorted_equal_t, InputIterator first, InputIterator last,
+             const Compare& comp) : t(comp) {
+        t.insert_equal_sorted(first, last);
+    }
 
-    multiset(const multiset<key, Compare, Alloc>& x) : t(x.t) { }
-    multiset<key, Compare, Alloc>& operator=(const multiset<Key, Compare, Alloc>& x) {
+    multiset(const multiset<Key, Compare, Alloc, Tree>& x) : t(x.t) { }
+    multiset(multiset<Key, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_constructible<rep_type>::value)
+        : t(std::move(x.t)) { }
+    multiset<Key, Compare, Alloc, Tree>& operator=(const multiset<Key, Compare, Alloc, Tree>& x) {
         t = x.t;
         return *this;
     }
+    multiset<Key, Compare, Alloc, Tree>& operator=(multiset<Key, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_assignable<rep_type>::value) {
+        t = std::move(x.t);
+        return *this;
+    }
 
     key_compare key_comp() const {
         return t.key_comp();
@@ -64,6 +102,12 @@ public:
     iterator end() const {
         return t.end();
     }
+    reverse_iterator rbegin() const {
+        return t.rbegin();
+    }
+    reverse_iterator rend() const {
+        return t.rend();
+    }
     bool empty() const {
         return t.empty();
     }
@@ -73,23 +117,43 @@ public:
     size_type max_size() const {
         return t.max_size();
     }
-    void swap(multiset<Key, Compare, Alloc>& x) {
-        t.swap(x);
+    void swap(multiset<Key, Compare, Alloc, Tree>& x) {
+        t.swap(x.t);
     }
 
     typedef pair<iterator, bool> pair_iterator_bool;
-    pair<iterator, bool> insert(const value_type& x) {
-        pair<typename rep_type::iterator, bool> p = t.insert_equal(x);
-        return pair<iterator, bool>(p.first, p.second);
+    iterator insert(const value_type& x) {
+        return t.insert_equal(x);
+    }
+    iterator insert(value_type&& x) {
+        return t.insert_equal(std::move(x));
     }
     iterator insert(iterator position, const value_type& x) {
         typedef typename rep_type::iterator rep_iterator;
         return t.insert_equal((rep_iterator&)position, x);
     }
+    iterator insert(iterator position, value_type&& x) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.insert_equal((rep_iterator&)position, std::move(x));
+    }
+    template <typename... Args>
+    iterator emplace(Args&&... args) {
+        return t.emplace_equal(std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    iterator emplace_hint(iterator position, Args&&... args) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.emplace_hint_equal((rep_iterator&)position,
+                                    std::forward<Args>(args)...);
+    }
     template <typename InputIterator>
     void insert(InputIterator first, InputIterator last) {
         t.insert_equal(first, last);
     }
+    template <typename InputIterator>
+    void insert(sorted_equal_t, InputIterator first, InputIterator last) {
+        t.insert_equal_sorted(first, last);
+    }
     void erase(iterator position) {
         typedef typename rep_type::iterator rep_iterator;
         t.erase((rep_iterator&)position);
@@ -101,6 +165,28 @@ public:
         typedef typename rep_type::iterator rep_iterator;
         t.erase((rep_iterator&)first, (rep_iterator&)last);
     }
+    // extract and insert move an element between sets and multisets of
+    // the same types; see rb_tree::extract and btree::extract.
+    node_type extract(iterator position) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.extract((rep_iterator&)position);
+    }
+    node_type extract(const key_type& x) {
+        return t.extract(x);
+    }
+    iterator insert(node_type&& nh) {
+        return t.insert_equal(std::move(nh));
+    }
+    void merge(multiset<Key, Compare, Alloc, Tree>& x) {
+        t.merge_equal(x.t);
+    }
+    // Only with rb_tree for Tree; see rb_tree::split.
+    void split(const key_type& k, multiset<Key, Compare, Alloc, Tree>& x) {
+        t.split(k, x.t);
+    }
+    void join(multiset<Key, Compare, Alloc, Tree>& x) {
+        t.join_equal(x.t);
+    }
     void clear() {
         t.clear();
     }
@@ -120,6 +206,18 @@ public:
     pair<iterator, iterator> equal_range(const key_type& x) const {
         return t.equal_range(x);
     }
+
+    // Only with ranked_rb_tree for Tree; see rb_tree::rank.
+    size_type rank(const key_type& x) const {
+        return t.rank(x);
+    }
+    size_type rank(const_iterator position) const {
+        return t.rank(position);
+    }
+    iterator select(size_type n) const {
+        return t.select(n);
+    }
+
     friend bool operator== <> (const multiset&, const multiset&);
     friend bool operator< <> (const multiset&, const multiset&);
 
@@ -127,21 +225,24 @@ private:
     rep_type t;
 };
 
-template <typename Key, typename Compare, typename Alloc>
-inline bool operator==(const multiset<Key, Compare, Alloc>& x,
-                       const multiset<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const multiset<Key, Compare, Alloc, Tree>& x,
+                       const multiset<Key, Compare, Alloc, Tree>& y) {
     return x.t == y.t;
 }
 
-template <typename Key, typename Compare, typename Alloc>
-inline bool operator<(const multiset<Key, Compare, Alloc>& x,
-    const multiset<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const multiset<Key, Compare, Alloc, Tree>& x,
+    const multiset<Key, Compare, Alloc, Tree>& y) {
     return x.t < y.t;
 }
 
-template <typename Key, typename Compare, typename Alloc>
-inline void swap(multiset<Key, Compare, Alloc>& x,
-                 multiset<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline void swap(multiset<Key, Compare, Alloc, Tree>& x,
+                 multiset<Key, Compare, Alloc, Tree>& y) {
     x.swap(y);
 }
 
@@ -0,0 +1,104 @@
+#ifndef FORGED_STL_INTERNAL_NODE_HANDLE_H_
+#define FORGED_STL_INTERNAL_NODE_HANDLE_H_
+
+#include <utility>
+
+#include "stl_alloc.h"
+#include "stl_construct.h"
+
+namespace forgedstl {
+
+// Owns a node that extract took out of an rb_tree, a btree or a
+// hashtable, with a copy of the allocator that made it, until the node is
+// inserted into another container of the same kind or the handle is
+// destroyed. The containers find the element of a Node through
+// __node_value.
+//
+// Containers that share a node type, such as a map and a multimap with
+// the same template arguments, share their handles too.
+template <typename Node, typename Value, typename Alloc>
+class __node_handle : protected __alloc_holder<Alloc> {
+public:
+    typedef Value value_type;
+    typedef Alloc allocator_type;
+
+    __node_handle() : ptr(nullptr) { }
+    __node_handle(__node_handle&& nh) noexcept
+        : base(nh.get_alloc()), ptr(nh.ptr) {
+        nh.ptr = nullptr;
+    }
+    __node_handle& operator=(__node_handle&& nh) {
+        if (this != &nh) {
+            reset();
+            this->get_alloc() = nh.get_alloc();
+            ptr = nh.ptr;
+            nh.ptr = nullptr;
+        }
+        return *this;
+    }
+    ~__node_handle() {
+        reset();
+    }
+
+    __node_handle(const __node_handle&) = delete;
+    __node_handle& operator=(const __node_handle&) = delete;
+
+    bool empty() const {
+        return ptr == nullptr;
+    }
+    explicit operator bool() const {
+        return ptr != nullptr;
+    }
+    // The element, which may be changed before it is inserted again; the
+    // key of a map element stays const.
+    value_type& value() const {
+        return __node_value(ptr);
+    }
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+
+    void swap(__node_handle& nh) {
+        std::swap(ptr, nh.ptr);
+        std::swap(this->get_alloc(), nh.get_alloc());
+    }
+
+private:
+    typedef __alloc_holder<Alloc> base;
+    typedef simple_alloc<Node, Alloc> node_allocator;
+
+    template <typename, typename, typename, typename, typename, bool>
+    friend class rb_tree;
+    template <typename, typename, typename, typename, typename>
+    friend class btree;
+    template <typename, typename, typename, typename, typename, typename,
+              typename, bool>
+    friend class hashtable;
+
+    Node* ptr;
+
+    __node_handle(Node* p, const Alloc& a) : base(a), ptr(p) { }
+
+    Node* release() {
+        Node* p = ptr;
+        ptr = nullptr;
+        return p;
+    }
+    void reset() {
+        if (ptr != nullptr) {
+            forgedstl::destroy(&__node_value(ptr));
+            node_allocator::deallocate(this->get_alloc(), ptr);
+            ptr = nullptr;
+        }
+    }
+};
+
+template <typename Node, typename Value, typename Alloc>
+inline void swap(__node_handle<Node, Value, Alloc>& x,
+                 __node_handle<Node, Value, Alloc>& y) {
+    x.swap(y);
+}
+
+} // namespace forgedstl
+
+#endif // FORGED_STL_INTERNAL_NODE_HANDLE_H_
@@ -1,6 +1,8 @@
 #ifndef FORGED_STL_INTERNAL_PAIR_H_
 #define FORGED_STL_INTERNAL_PAIR_H_
 
+#include <utility>
+
 namespace forgedstl {
 
 template <typename T1, typename T2>
@@ -13,8 +15,15 @@ struct pair {
     pair() : first(T1()), second(T2()) { }
     pair(const T1& a, const T2& b) : first(a), second(b) { }
 
+    template <typename U1, typename U2>
+    pair(U1&& a, U2&& b)
+        : first(std::forward<U1>(a)), second(std::forward<U2>(b)) { }
+
     template <typename U1, typename U2>
     pair(const pair<U1, U2>& p) : first(p.first), second(p.second) { }
+    template <typename U1, typename U2>
+    pair(pair<U1, U2>&& p)
+        : first(std::move(p.first)), second(std::move(p.second)) { }
 };
 
 template <typename T1, typename T2>
@@ -8,6 +8,15 @@
 namespace forgedstl {
 
 template <typename T, typename Sequence = deque<T> >
+class queue;
+
+template <typename T, typename Sequence>
+bool operator==(const queue<T, Sequence>& x, const queue<T, Sequence>& y);
+
+template <typename T, typename Sequence>
+bool operator<(const queue<T, Sequence>& x, const queue<T, Sequence>& y);
+
+template <typename T, typename Sequence>
 class queue {
     friend bool operator== <> (const queue&, const queue&);
     friend bool operator< <> (const queue&, const queue&);
@@ -43,6 +52,13 @@ public:
     void push(const value_type& x) {
         c.push_back(x);
     }
+    void push(value_type&& x) {
+        c.push_back(std::move(x));
+    }
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        c.emplace_back(std::forward<Args>(args)...);
+    }
 
     void pop() {
         c.pop_front();
@@ -102,6 +118,25 @@ public:
             throw;
         }
     }
+    void push(value_type&& x) {
+        try {
+            c.push_back(std::move(x));
+            forgedstl::push_heap(c.begin(), c.end(), comp);
+        } catch (...) {
+            c.clear();
+            throw;
+        }
+    }
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        try {
+            c.emplace_back(std::forward<Args>(args)...);
+            forgedstl::push_heap(c.begin(), c.end(), comp);
+        } catch (...) {
+            c.clear();
+            throw;
+        }
+    }
     void pop() {
         try {
             forgedstl::pop_heap(c.begin(), c.end(), comp);
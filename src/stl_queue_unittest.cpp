@@ -39,4 +39,21 @@ TEST(QueueTest, PriorityQueue) {
     }
 }
 
+TEST(QueueTest, Move) {
+    queue<int> q1;
+    q1.push(1);
+    q1.push(2);
+    queue<int> q2(std::move(q1));
+    EXPECT_TRUE(q1.empty());
+    EXPECT_EQ(2, q2.size());
+
+    priority_queue<int> p1;
+    p1.push(1);
+    p1.push(3);
+    priority_queue<int> p2;
+    p2 = std::move(p1);
+    EXPECT_TRUE(p1.empty());
+    EXPECT_EQ(3, p2.top());
+}
+
 } // namespace forgedstl
\ No newline at end of file
@@ -8,7 +8,26 @@
 
 namespace forgedstl {
 
-template <typename Key, typename Compare = std::less<Key>, typename Alloc = alloc>
+// Tree is the ordered representation behind the set: rb_tree, or btree
+// from stl_btree.h, which is denser and faster to search and scan but
+// moves its elements, so that every insert and erase invalidates
+// iterators.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = alloc,
+          template <typename, typename, typename, typename, typename> class Tree = unranked_rb_tree>
+class set;
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const set<Key, Compare, Alloc, Tree>& x,
+                       const set<Key, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const set<Key, Compare, Alloc, Tree>& x,
+                      const set<Key, Compare, Alloc, Tree>& y);
+
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
 class set {
 public:
     typedef Key key_type;
@@ -17,7 +36,7 @@ public:
     typedef Compare value_compare;
 
 private:
-    typedef rb_tree<key_type, value_type,
+    typedef Tree<key_type, value_type,
         identity<value_type>, key_compare, Alloc> rep_type;
 
 public:
@@ -31,6 +50,7 @@ public:
     typedef typename rep_type::const_reverse_iterator const_reverse_iterator;
     typedef typename rep_type::size_type size_type;
     typedef typename rep_type::difference_type difference_type;
+    typedef typename rep_type::node_type node_type;
 
     set() : t(Compare()) { }
     explicit set(const Compare& comp) : t(comp) { }
@@ -45,12 +65,30 @@ public:
         : t(comp) {
         t.insert_unique(first, last);
     }
+    // For a range already sorted by key; see rb_tree::insert_unique_sorted.
+    template <typename InputIterator>
+    set(sorted_unique_t, InputIterator first, InputIterator last) : t(Compare()) {
+        t.insert_unique_sorted(first, last);
+    }
+    template <typename InputIterator>
+    set(sorted_unique_t, InputIterator first, InputIterator last,
+        const Compare& comp) : t(comp) {
+        t.insert_unique_sorted(first, last);
+    }
 
-    set(const set<key, Compare, Alloc>& x) : t(x.t) { }
-    set<key, Compare, Alloc>& operator=(const set<Key, Compare, Alloc>& x) {
+    set(const set<Key, Compare, Alloc, Tree>& x) : t(x.t) { }
+    set(set<Key, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_constructible<rep_type>::value)
+        : t(std::move(x.t)) { }
+    set<Key, Compare, Alloc, Tree>& operator=(const set<Key, Compare, Alloc, Tree>& x) {
         t = x.t;
         return *this;
     }
+    set<Key, Compare, Alloc, Tree>& operator=(set<Key, Compare, Alloc, Tree>&& x)
+        noexcept(std::is_nothrow_move_assignable<rep_type>::value) {
+        t = std::move(x.t);
+        return *this;
+    }
 
     key_compare key_comp() const {
         return t.key_comp();
@@ -64,6 +102,12 @@ public:
     iterator end() const {
         return t.end();
     }
+    reverse_iterator rbegin() const {
+        return t.rbegin();
+    }
+    reverse_iterator rend() const {
+        return t.rend();
+    }
     bool empty() const {
         return t.empty();
     }
@@ -73,8 +117,8 @@ public:
     size_type max_size() const {
         return t.max_size();
     }
-    void swap(set<Key, Compare, Alloc>& x) {
-        t.swap(x);
+    void swap(set<Key, Compare, Alloc, Tree>& x) {
+        t.swap(x.t);
     }
 
     typedef pair<iterator, bool> pair_iterator_bool;
@@ -82,14 +126,39 @@ public:
         pair<typename rep_type::iterator, bool> p = t.insert_unique(x);
         return pair<iterator, bool>(p.first, p.second);
     }
+    pair<iterator, bool> insert(value_type&& x) {
+        pair<typename rep_type::iterator, bool> p =
+            t.insert_unique(std::move(x));
+        return pair<iterator, bool>(p.first, p.second);
+    }
     iterator insert(iterator position, const value_type& x) {
         typedef typename rep_type::iterator rep_iterator;
         return t.insert_unique((rep_iterator&)position, x);
     }
+    iterator insert(iterator position, value_type&& x) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.insert_unique((rep_iterator&)position, std::move(x));
+    }
+    template <typename... Args>
+    pair<iterator, bool> emplace(Args&&... args) {
+        pair<typename rep_type::iterator, bool> p =
+            t.emplace_unique(std::forward<Args>(args)...);
+        return pair<iterator, bool>(p.first, p.second);
+    }
+    template <typename... Args>
+    iterator emplace_hint(iterator position, Args&&... args) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.emplace_hint_unique((rep_iterator&)position,
+                                     std::forward<Args>(args)...);
+    }
     template <typename InputIterator>
     void insert(InputIterator first, InputIterator last) {
         t.insert_unique(first, last);
     }
+    template <typename InputIterator>
+    void insert(sorted_unique_t, InputIterator first, InputIterator last) {
+        t.insert_unique_sorted(first, last);
+    }
     void erase(iterator position) {
         typedef typename rep_type::iterator rep_iterator;
         t.erase((rep_iterator&)position);
@@ -101,6 +170,40 @@ public:
         typedef typename rep_type::iterator rep_iterator;
         t.erase((rep_iterator&)first, (rep_iterator&)last);
     }
+    // extract and insert move an element between sets and multisets of
+    // the same types; see rb_tree::extract and btree::extract.
+    node_type extract(iterator position) {
+        typedef typename rep_type::iterator rep_iterator;
+        return t.extract((rep_iterator&)position);
+    }
+    node_type extract(const key_type& x) {
+        return t.extract(x);
+    }
+    pair<iterator, bool> insert(node_type&& nh) {
+        pair<typename rep_type::iterator, bool> p =
+            t.insert_unique(std::move(nh));
+        return pair<iterator, bool>(p.first, p.second);
+    }
+    void merge(set<Key, Compare, Alloc, Tree>& x) {
+        t.merge_unique(x.t);
+    }
+    // Only with rb_tree for Tree; see rb_tree::split.
+    void split(const key_type& k, set<Key, Compare, Alloc, Tree>& x) {
+        t.split(k, x.t);
+    }
+    void join(set<Key, Compare, Alloc, Tree>& x) {
+        t.join_unique(x.t);
+    }
+    // Only with rb_tree for Tree; see rb_tree::unite.
+    void unite(set<Key, Compare, Alloc, Tree>& x, unsigned threads = 1) {
+        t.unite(x.t, threads);
+    }
+    void intersect(set<Key, Compare, Alloc, Tree>& x, unsigned threads = 1) {
+        t.intersect(x.t, threads);
+    }
+    void subtract(set<Key, Compare, Alloc, Tree>& x, unsigned threads = 1) {
+        t.subtract(x.t, threads);
+    }
     void clear() {
         t.clear();
     }
@@ -120,6 +223,18 @@ public:
     pair<iterator, iterator> equal_range(const key_type& x) const {
         return t.equal_range(x);
     }
+
+    // Only with ranked_rb_tree for Tree; see rb_tree::rank.
+    size_type rank(const key_type& x) const {
+        return t.rank(x);
+    }
+    size_type rank(const_iterator position) const {
+        return t.rank(position);
+    }
+    iterator select(size_type n) const {
+        return t.select(n);
+    }
+
     friend bool operator== <> (const set&, const set&);
     friend bool operator< <> (const set&, const set&);
 
@@ -127,21 +242,24 @@ private:
     rep_type t;
 };
 
-template <typename Key, typename Compare, typename Alloc>
-inline bool operator==(const set<Key, Compare, Alloc>& x,
-                       const set<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator==(const set<Key, Compare, Alloc, Tree>& x,
+                       const set<Key, Compare, Alloc, Tree>& y) {
     return x.t == y.t;
 }
 
-template <typename Key, typename Compare, typename Alloc>
-inline bool operator<(const set<Key, Compare, Alloc>& x,
-                      const set<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline bool operator<(const set<Key, Compare, Alloc, Tree>& x,
+                      const set<Key, Compare, Alloc, Tree>& y) {
     return x.t < y.t;
 }
 
-template <typename Key, typename Compare, typename Alloc>
-inline void swap(set<Key, Compare, Alloc>& x,
-                 set<Key, Compare, Alloc>& y) {
+template <typename Key, typename Compare, typename Alloc,
+          template <typename, typename, typename, typename, typename> class Tree>
+inline void swap(set<Key, Compare, Alloc, Tree>& x,
+                 set<Key, Compare, Alloc, Tree>& y) {
     x.swap(y);
 }
 
@@ -6,6 +6,15 @@
 namespace forgedstl {
 
 template <typename T, typename Sequence = deque<T> >
+class stack;
+
+template <typename T, typename Sequence>
+bool operator==(const stack<T, Sequence>& x, const stack<T, Sequence>& y);
+
+template <typename T, typename Sequence>
+bool operator<(const stack<T, Sequence>& x, const stack<T, Sequence>& y);
+
+template <typename T, typename Sequence>
 class stack {
     friend bool operator== <> (const stack&, const stack&);
     friend bool operator< <> (const stack&, const stack&);
@@ -35,6 +44,13 @@ public:
     void push(const value_type& x) {
         c.push_back(x);
     }
+    void push(value_type&& x) {
+        c.push_back(std::move(x));
+    }
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        c.emplace_back(std::forward<Args>(args)...);
+    }
 
     void pop() {
         c.pop_back();
@@ -29,4 +29,14 @@ TEST(StackTest, Test) {
     ASSERT_TRUE(is.empty());
 }
 
+TEST(StackTest, Move) {
+    stack<int> s1;
+    s1.push(1);
+    s1.push(2);
+    stack<int> s2;
+    s2 = std::move(s1);
+    EXPECT_TRUE(s1.empty());
+    EXPECT_EQ(2, s2.top());
+}
+
 } // namespace forgedstl
\ No newline at end of file
@@ -1,8 +1,12 @@
 #ifndef FORGED_STL_INTERNAL_TREE_H_
 #define FORGED_STL_INTERNAL_TREE_H_
 
+#include <thread>
+
 #include "stl_alloc.h"
 #include "stl_construct.h"
+#include "stl_iterator.h"
+#include "stl_node_handle.h"
 #include "stl_pair.h"
 
 namespace forgedstl {
@@ -41,9 +45,85 @@ struct __rb_tree_node : public __rb_tree_node_base {
     Value value_field;
 };
 
+template <class Value>
+inline Value& __node_value(__rb_tree_node<Value>* p) {
+    return p->value_field;
+}
+
+// The node of a ranked tree also counts the nodes of its subtree. The
+// count comes after the value, so iterators find the value where they
+// find it in a plain node.
+template <class Value>
+struct __rb_tree_ranked_node : public __rb_tree_node<Value> {
+    size_t size;
+};
+
+// How the rebalancing functions keep subtree sizes: update recomputes x
+// from its children, grow counts in the leaf x just linked, shrink counts
+// out y before it is unlinked, and copy takes the size of a cloned node.
+// Plain trees keep no sizes, and all of these do nothing for them.
+struct __rb_tree_unsized {
+    typedef __rb_tree_node_base* base_ptr;
+
+    static void update(base_ptr) { }
+    static void grow(base_ptr, base_ptr) { }
+    static void shrink(base_ptr, base_ptr) { }
+    static void copy(base_ptr, base_ptr) { }
+    static bool check(base_ptr) {
+        return true;
+    }
+};
+
+template <class Value>
+struct __rb_tree_sized {
+    typedef __rb_tree_node_base* base_ptr;
+
+    static size_t& size(base_ptr x) {
+        return static_cast<__rb_tree_ranked_node<Value>*>(x)->size;
+    }
+    static size_t size_of(base_ptr x) {
+        return x == nullptr ? 0 : size(x);
+    }
+
+    static void update(base_ptr x) {
+        size(x) = 1 + size_of(x->left) + size_of(x->right);
+    }
+    static void grow(base_ptr x, base_ptr root) {
+        size(x) = 1;
+        while (x != root) {
+            x = x->parent;
+            ++size(x);
+        }
+    }
+    static void shrink(base_ptr y, base_ptr root) {
+        while (y != root) {
+            y = y->parent;
+            --size(y);
+        }
+    }
+    static void copy(base_ptr x, base_ptr from) {
+        size(x) = size(from);
+    }
+    static bool check(base_ptr x) {
+        return size(x) == 1 + size_of(x->left) + size_of(x->right);
+    }
+};
+
+template <class Value, bool Ranked>
+struct __rb_tree_node_traits {
+    typedef __rb_tree_node<Value> node;
+    typedef __rb_tree_unsized sizes;
+};
+
+template <class Value>
+struct __rb_tree_node_traits<Value, true> {
+    typedef __rb_tree_ranked_node<Value> node;
+    typedef __rb_tree_sized<Value> sizes;
+};
+
 struct __rb_tree_base_iterator {
     typedef __rb_tree_node_base::base_ptr base_ptr;
-    typedef bidirectional_iterator_tag iteraotr_category;
+    typedef bidirectional_iterator_tag iterator_category;
     typedef ptrdiff_t difference_type;
     base_ptr node;
 
@@ -160,8 +240,9 @@ inline Value* value_type(const __rb_tree_iterator<Value, Ref, Ptr>&) {
     return (Value*)0;
 }
 
+template <class Sizes = __rb_tree_unsized>
 inline void
-__rb_tree_rotate_left(__rb_tree_node_base* x, __rb_tree_node_base* root) {
+__rb_tree_rotate_left(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
     __rb_tree_node_base* y = x->right;
     x->right = y->left;
     if (y->left != nullptr) {
@@ -180,10 +261,13 @@ __rb_tree_rotate_left(__rb_tree_node_base* x, __rb_tree_node_base* root) {
     }
     y->left = x;
     x->parent = y;
+    Sizes::update(x);
+    Sizes::update(y);
 }
 
+template <class Sizes = __rb_tree_unsized>
 inline void
-__rb_tree_rotate_right(__rb_tree_node_base* x, __rb_tree_node_base* root) {
+__rb_tree_rotate_right(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
     __rb_tree_node_base* y = x->left;
     x->left = y->right;
     if (y->right != 0) {
@@ -202,11 +286,15 @@ __rb_tree_rotate_right(__rb_tree_node_base* x, __rb_tree_node_base* root) {
     }
     y->right = x;
     x->parent = y;
+    Sizes::update(x);
+    Sizes::update(y);
 }
 
+// Restores the red-black properties above x, a red node whose parent may
+// be red too. The root may be left red, for the caller to paint black.
+template <class Sizes = __rb_tree_unsized>
 inline void
-__rb_tree_rebalance(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
-    x->color = __rb_tree_red;
+__rb_tree_fix_red(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
     while (x != root && x->parent->color == __rb_tree_red) {
         if (x->parent == x->parent->parent->left) {
             __rb_tree_node_base* y = x->parent->parent->right;
@@ -219,11 +307,11 @@ __rb_tree_rebalance(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
             else {
                 if (x == x->parent->right) {
                     x = x->parent;
-                    __rb_tree_rotate_left(x, root);
+                    __rb_tree_rotate_left<Sizes>(x, root);
                 }
                 x->parent->color = __rb_tree_black;
                 x->parent->parent->color = __rb_tree_red;
-                __rb_tree_rotate_right(x->parent->parent, root);
+                __rb_tree_rotate_right<Sizes>(x->parent->parent, root);
             }
         }
         else {
@@ -237,17 +325,26 @@ __rb_tree_rebalance(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
             else {
                 if (x == x->parent->left) {
                     x = x->parent;
-                    __rb_tree_rotate_right(x, root);
+                    __rb_tree_rotate_right<Sizes>(x, root);
                 }
                 x->parent->color = __rb_tree_black;
                 x->parent->parent->color = __rb_tree_red;
-                __rb_tree_rotate_left(x->parent->parent, root);
+                __rb_tree_rotate_left<Sizes>(x->parent->parent, root);
             }
         }
     }
+}
+
+template <class Sizes = __rb_tree_unsized>
+inline void
+__rb_tree_rebalance(__rb_tree_node_base* x, __rb_tree_node_base*& root) {
+    Sizes::grow(x, root);
+    x->color = __rb_tree_red;
+    __rb_tree_fix_red<Sizes>(x, root);
     root->color = __rb_tree_black;
 }
 
+template <class Sizes = __rb_tree_unsized>
 inline __rb_tree_node_base*
 __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                               __rb_tree_node_base*& root,
@@ -269,6 +366,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
             x = y->right;
         }
     }
+    Sizes::shrink(y, root);
     if (y != z) { // y is z's successor
         z->left->parent = y;
         y->left = z->left;
@@ -291,6 +389,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
             z->parent->right = y;
         }
         y->parent = z->parent;             // transplant(T, z, y) end
+        Sizes::update(y);
         std::swap(y->color, z->color);
         y = z; // y points to nodes to be deleted
     } else { // y == z, need to deal with leftmost or rightmost
@@ -301,7 +400,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
         if (root == z) {                  // transplant(T, z, x) begin
             root = x;
         } else {
-            if (z->parent->left = z) {
+            if (z->parent->left == z) {
                 z->parent->left = x;
             } else {
                 z->parent->right = x;     // transplant(T, z, x) begin
@@ -329,20 +428,21 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                 if (w->color == __rb_tree_red) {
                     w->color = __rb_tree_black;
                     x_parent->color = __rb_tree_red;
-                    __rb_tree_rotate_left(x_parent, root);
+                    __rb_tree_rotate_left<Sizes>(x_parent, root);
                     w = x_parent->right;
                 }
                 if ((w->left == nullptr || w->left->color == __rb_tree_black) &&
                     (w->right == nullptr || w->right->color == __rb_tree_black)) {
-                    w->color = __rb_tree_black;
+                    w->color = __rb_tree_red;
                     x = x_parent;
                     x_parent = x_parent->parent;
                 } else {
                     if (w->right == nullptr || w->right->color == __rb_tree_black) {
                         if (w->left != nullptr) {
-                            w->left->color = __rb_tree_red;
+                            w->left->color = __rb_tree_black;
                         }
-                        __rb_tree_rotate_right(w, root);
+                        w->color = __rb_tree_red;
+                        __rb_tree_rotate_right<Sizes>(w, root);
                         w = x_parent->right;
                     }
                     w->color = x_parent->color;
@@ -350,7 +450,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                     if (w->right != nullptr) {
                         w->right->color = __rb_tree_black;
                     }
-                    __rb_tree_rotate_left(x_parent, root);
+                    __rb_tree_rotate_left<Sizes>(x_parent, root);
                     break;
                 }
             } else { // x == x_parent->right
@@ -358,12 +458,12 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                 if (w->color == __rb_tree_red) {
                     w->color = __rb_tree_black;
                     x_parent->color = __rb_tree_red;
-                    __rb_tree_rotate_right(x_parent, root);
+                    __rb_tree_rotate_right<Sizes>(x_parent, root);
                     w = x_parent->left;
                 }
                 if ((w->right == nullptr || w->right->color == __rb_tree_black) &&
                     (w->left == nullptr || w->left->color == __rb_tree_black)) {
-                    w->color = __rb_tree_black;
+                    w->color = __rb_tree_red;
                     x = x_parent;
                     x_parent = x_parent->parent;
                 } else {
@@ -372,7 +472,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                             w->right->color = __rb_tree_black;
                         }
                         w->color = __rb_tree_red;
-                        __rb_tree_rotate_left(w, root);
+                        __rb_tree_rotate_left<Sizes>(w, root);
                         w = x_parent->left;
                     }
                     w->color = x_parent->color;
@@ -380,7 +480,7 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
                     if (w->left != nullptr) {
                         w->left->color = __rb_tree_black;
                     }
-                    __rb_tree_rotate_right(x_parent, root);
+                    __rb_tree_rotate_right<Sizes>(x_parent, root);
                     break;
                 }
             }
@@ -392,13 +492,180 @@ __rb_tree_rebalance_for_erase(__rb_tree_node_base* z,
     return y;
 }
 
+inline int __rb_tree_black_height(__rb_tree_node_base* x) {
+    int h = 0;
+    for (; x != nullptr; x = x->left) {
+        if (x->color == __rb_tree_black) {
+            ++h;
+        }
+    }
+    return h;
+}
+
+// A tree cut loose for split and join: a black root without a parent, or
+// null, and the number of black nodes on every path down from it.
+struct __rb_tree_piece {
+    __rb_tree_node_base* root;
+    int height;
+};
+
+// Cuts x loose from its parent; height is x's black height in the tree it
+// came from, which grows by one if x is red and turns black.
+inline __rb_tree_piece __rb_tree_make_piece(__rb_tree_node_base* x, int height) {
+    __rb_tree_piece p = { x, height };
+    if (x != nullptr) {
+        x->parent = nullptr;
+        if (x->color == __rb_tree_red) {
+            x->color = __rb_tree_black;
+            ++p.height;
+        }
+    }
+    return p;
+}
+
+// Joins l, k and r, where l's keys come before k's and r's after, in
+// O(|l.height - r.height| + 1): k goes in red down the near spine of the
+// taller piece, at the first black node as high as the other piece.
+template <class Sizes>
+inline __rb_tree_piece
+__rb_tree_join(__rb_tree_piece l, __rb_tree_node_base* k, __rb_tree_piece r) {
+    if (l.height == r.height) {
+        k->left = l.root;
+        k->right = r.root;
+        k->parent = nullptr;
+        k->color = __rb_tree_black;
+        if (l.root != nullptr) {
+            l.root->parent = k;
+        }
+        if (r.root != nullptr) {
+            r.root->parent = k;
+        }
+        Sizes::update(k);
+        __rb_tree_piece p = { k, l.height + 1 };
+        return p;
+    }
+    const bool down_right = l.height > r.height;
+    __rb_tree_piece p = down_right ? l : r;
+    const int target = down_right ? r.height : l.height;
+    __rb_tree_node_base* y = nullptr;
+    __rb_tree_node_base* c = p.root;
+    for (int h = p.height; h > target || (c != nullptr && c->color == __rb_tree_red); ) {
+        if (c->color == __rb_tree_black) {
+            --h;
+        }
+        y = c;
+        c = down_right ? c->right : c->left;
+    }
+    if (down_right) {
+        k->left = c;
+        k->right = r.root;
+        y->right = k;
+    } else {
+        k->left = l.root;
+        k->right = c;
+        y->left = k;
+    }
+    k->parent = y;
+    if (k->left != nullptr) {
+        k->left->parent = k;
+    }
+    if (k->right != nullptr) {
+        k->right->parent = k;
+    }
+    for (__rb_tree_node_base* x = k; x != nullptr; x = x->parent) {
+        Sizes::update(x);
+    }
+    k->color = __rb_tree_red;
+    __rb_tree_fix_red<Sizes>(k, p.root);
+    if (p.root->color == __rb_tree_red) {
+        p.root->color = __rb_tree_black;
+        ++p.height;
+    }
+    return p;
+}
+
+// Joins l and r with r's first node taken out for the middle.
+template <class Sizes>
+inline __rb_tree_piece
+__rb_tree_join(__rb_tree_piece l, __rb_tree_piece r) {
+    if (l.root == nullptr) {
+        return r;
+    }
+    if (r.root == nullptr) {
+        return l;
+    }
+    __rb_tree_node_base* k = __rb_tree_node_base::minimum(r.root);
+    __rb_tree_node_base* leftmost = k;
+    __rb_tree_node_base* rightmost = nullptr;
+    __rb_tree_rebalance_for_erase<Sizes>(k, r.root, leftmost, rightmost);
+    r.height = __rb_tree_black_height(r.root);
+    return __rb_tree_join<Sizes>(l, k, r);
+}
+
+// Subtrees that split and join leave over, chained through the parent
+// links of their roots, to be freed once the worker threads are done.
+struct __rb_tree_garbage {
+    __rb_tree_node_base* head;
+    __rb_tree_node_base* tail;
+
+    void push(__rb_tree_node_base* x) {
+        if (x != nullptr) {
+            x->parent = nullptr;
+            if (tail != nullptr) {
+                tail->parent = x;
+            } else {
+                head = x;
+            }
+            tail = x;
+        }
+    }
+    void push_node(__rb_tree_node_base* x) {
+        x->left = nullptr;
+        x->right = nullptr;
+        push(x);
+    }
+    void splice(__rb_tree_garbage& g) {
+        if (g.head != nullptr) {
+            if (tail != nullptr) {
+                tail->parent = g.head;
+            } else {
+                head = g.head;
+            }
+            tail = g.tail;
+        }
+    }
+};
+
+enum __rb_tree_set_op {
+    __rb_tree_union,
+    __rb_tree_intersection,
+    __rb_tree_difference
+};
+
+// Below this black height a set operation is not worth another thread. A
+// black height of h means at least 2^h - 1 nodes, and in practice 2^1.5h.
+const int __rb_tree_parallel_height = 9;
+
+// Tags for building from input that is already sorted by key: strictly
+// ascending for sorted_unique, where a repeated key is dropped, and
+// ascending for sorted_equal.
+struct sorted_unique_t { };
+struct sorted_equal_t { };
+const sorted_unique_t sorted_unique = sorted_unique_t();
+const sorted_equal_t sorted_equal = sorted_equal_t();
+
+// A ranked tree keeps the size of every subtree in its nodes, at the cost
+// of a word per node and a walk to the root on every insert and erase,
+// and answers rank, select and count in O(log n).
 template <typename Key, typename Value, typename KeyOfValue, typename Compare,
-          typename Alloc = alloc>
-class rb_tree {
+          typename Alloc = alloc, bool Ranked = false>
+class rb_tree : protected __alloc_holder<Alloc> {
 protected:
+    typedef __alloc_holder<Alloc> base;
     typedef void* void_pointer;
     typedef __rb_tree_node_base* base_ptr;
-    typedef __rb_tree_node<Value> rb_tree_node;
+    typedef typename __rb_tree_node_traits<Value, Ranked>::node rb_tree_node;
+    typedef typename __rb_tree_node_traits<Value, Ranked>::sizes sizes;
     typedef simple_alloc<rb_tree_node, Alloc> rb_tree_node_allocator;
     typedef __rb_tree_color_type color_type;
 
@@ -412,46 +679,60 @@ public:
     typedef rb_tree_node* link_type;
     typedef size_t size_type;
     typedef ptrdiff_t difference_type;
+    typedef Alloc allocator_type;
 
     typedef __rb_tree_iterator<value_type, reference, pointer> iterator;
     typedef __rb_tree_iterator<value_type, const_reference, const_pointer>
         const_iterator;
+    typedef reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef reverse_iterator<iterator> reverse_iterator;
+    typedef __node_handle<rb_tree_node, Value, Alloc> node_type;
 
-    rb_tree(const Compare& comp = Compare()) : node_count(0),
-        key_compare(comp) {
+    rb_tree(const Compare& comp = Compare(),
+            const allocator_type& a = allocator_type()) : base(a),
+        node_count(0), key_compare(comp) {
         init();
     }
-    rb_tree(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x)
-        : node_count(0), key_compare(x.key_compare) {
-        header = get_node();
-        color(header) = __rb_tree_red;
-        if (x.root() == nullptr) {
-            root() = nullptr;
-            leftmost() = header;
-            rightmost() = header;
-        } else {
-            try {
-                root() = __copy(x.root(), header);
-            } catch (...) {
-                put_node(header);
-                throw;
-            }
+    rb_tree(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x)
+        : base(x.get_alloc()), node_count(0), key_compare(x.key_compare) {
+        init();
+        if (x.root() != nullptr) {
+            root() = __copy(x.root(), header);
             leftmost() = minimum(root());
             rightmost() = maximum(root());
         }
         node_count = x.node_count;
     }
+    rb_tree(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>&& x)
+        noexcept(std::is_nothrow_copy_constructible<Compare>::value)
+        : base(x.get_alloc()), node_count(0), key_compare(x.key_compare) {
+        init();
+        __take_nodes(x);
+    }
     ~rb_tree() {
         clear();
-        put_node(header);
     }
 
-    rb_tree<Key, Value, KeyOfValue, Compare, Alloc>&
-    operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x);
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>&
+    operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x);
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>&
+    operator=(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>&& x)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment &&
+                 std::is_nothrow_copy_assignable<Compare>::value) {
+        if (this != &x) {
+            clear();
+            __move_assign(x, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
 
     Compare key_comp() const {
         return key_compare;
     }
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
     iterator begin() {
         return leftmost();
     }
@@ -464,6 +745,18 @@ public:
     const_iterator end() const {
         return header;
     }
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
 
     bool empty() const {
         return node_count == 0;
@@ -475,27 +768,122 @@ public:
         return size_type(-1);
     }
 
-    void swap(rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& t) {
-        std::swap(header, t.header);
-        std::swap(node_count, t.node_count);
+    void swap(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+        if (root() == nullptr) {
+            __take_nodes(t);
+        } else if (t.root() == nullptr) {
+            t.__take_nodes(*this);
+        } else {
+            std::swap(root(), t.root());
+            std::swap(leftmost(), t.leftmost());
+            std::swap(rightmost(), t.rightmost());
+            root()->parent = header;
+            t.root()->parent = t.header;
+            std::swap(node_count, t.node_count);
+        }
         std::swap(key_compare, t.key_compare);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), t.get_alloc());
+        }
     }
 
-    pair<iterator, bool> insert_unique(const value_type& x);
-    iterator insert_equal(const value_type& x);
+    pair<iterator, bool> insert_unique(const value_type& x) {
+        return __insert_unique(x);
+    }
+    pair<iterator, bool> insert_unique(value_type&& x) {
+        return __insert_unique(std::move(x));
+    }
+    iterator insert_equal(const value_type& x) {
+        return __insert_equal(x);
+    }
+    iterator insert_equal(value_type&& x) {
+        return __insert_equal(std::move(x));
+    }
+
+    iterator insert_unique(iterator position, const value_type& x) {
+        return __insert_unique(position, x);
+    }
+    iterator insert_unique(iterator position, value_type&& x) {
+        return __insert_unique(position, std::move(x));
+    }
+    iterator insert_equal(iterator position, const value_type& x) {
+        return __insert_equal(position, x);
+    }
+    iterator insert_equal(iterator position, value_type&& x) {
+        return __insert_equal(position, std::move(x));
+    }
 
-    iterator insert_unique(iterator position, const value_type& x);
-    iterator insert_equal(iterator position, const value_type& x);
+    // The node is built first and dropped again if the key turns out to be
+    // a duplicate.
+    template <typename... Args>
+    pair<iterator, bool> emplace_unique(Args&&... args);
+    template <typename... Args>
+    iterator emplace_equal(Args&&... args);
+    template <typename... Args>
+    iterator emplace_hint_unique(iterator position, Args&&... args);
+    template <typename... Args>
+    iterator emplace_hint_equal(iterator position, Args&&... args);
 
     template <typename InputIterator>
     void insert_unique(InputIterator first, InputIterator last);
     template <typename InputIterator>
     void insert_equal(InputIterator first, InputIterator last);
+    // For input sorted by key. An empty tree is built in one pass, with no
+    // rebalancing and no comparisons beyond those that check the order;
+    // from the first element out of order on, and into a tree that is not
+    // empty, the elements are inserted one at a time.
+    template <typename InputIterator>
+    void insert_unique_sorted(InputIterator first, InputIterator last) {
+        __insert_sorted(first, last, true);
+    }
+    template <typename InputIterator>
+    void insert_equal_sorted(InputIterator first, InputIterator last) {
+        __insert_sorted(first, last, false);
+    }
 
     void erase(iterator position);
     size_type erase(const key_type& x);
     void erase(iterator first, iterator last);
 
+    // extract unlinks a node without freeing it, and the node_type
+    // inserts link one in without allocating. A node_type insert_unique
+    // that finds the key already present leaves the node in nh.
+    node_type extract(iterator position);
+    node_type extract(const key_type& x);
+    pair<iterator, bool> insert_unique(node_type&& nh);
+    iterator insert_equal(node_type&& nh);
+    // Moves the nodes of t into this tree; merge_unique leaves behind
+    // those whose keys are already here. Between trees with unequal
+    // allocators the values are moved instead of the nodes.
+    void merge_unique(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t);
+    void merge_equal(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t);
+
+    // split moves the elements with keys not less than k into t, whose own
+    // elements are dropped, and join moves all of t's elements onto the
+    // end of this tree. Between trees with equal allocators both relink
+    // O(log n) nodes; a split tree that is not ranked also counts its
+    // smaller half. When t's first key does not follow this tree's last,
+    // join_unique and join_equal fall back on merge_unique and merge_equal.
+    void split(const key_type& k, rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t);
+    void join_unique(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t);
+    void join_equal(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t);
+
+    // Set algebra for trees with unique keys, in O(m log(n/m + 1)) for
+    // m <= n elements: the result replaces this tree's elements and t is
+    // left empty; of two elements with one key, this tree's is kept. With
+    // threads > 1 large subproblems are shared out over up to that many
+    // threads, so key_compare must be safe to call concurrently. It must
+    // not throw in any case.
+    void unite(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t, unsigned threads = 1) {
+        __set_operation(__rb_tree_union, t, threads);
+    }
+    void intersect(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t, unsigned threads = 1) {
+        __set_operation(__rb_tree_intersection, t, threads);
+    }
+    void subtract(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t, unsigned threads = 1) {
+        __set_operation(__rb_tree_difference, t, threads);
+    }
+
     void clear() {
         if (node_count != 0) {
             __erase(root());
@@ -508,7 +896,9 @@ public:
 
     iterator find(const key_type& x);
     const_iterator find(const key_type& x) const;
-    size_type count(const key_type& x) const;
+    size_type count(const key_type& x) const {
+        return __count(x, typename __bool_type<Ranked>::type());
+    }
     iterator lower_bound(const key_type& x);
     const_iterator lower_bound(const key_type& x) const;
     iterator upper_bound(const key_type& x);
@@ -516,25 +906,37 @@ public:
     pair<iterator, iterator> equal_range(const key_type& x);
     pair<const_iterator, const_iterator> equal_range(const key_type& x) const;
 
+    // Only for ranked trees: rank(x) counts the elements with keys less
+    // than x, and rank(position) the elements before position; select(n)
+    // is the element with n elements before it, or end().
+    size_type rank(const key_type& x) const;
+    size_type rank(const_iterator position) const;
+    iterator select(size_type n);
+    const_iterator select(size_type n) const;
+
     bool __rb_verify() const;
 
 protected:
+    // The header lives inside the tree, so moving a tree needs no
+    // allocation; header always points at header_node.
+    __rb_tree_node_base header_node;
     size_type node_count;
     link_type header;
     Compare key_compare;
 
     link_type get_node() {
-        return rb_tree_node_allocator::allocate();
+        return rb_tree_node_allocator::allocate(this->get_alloc());
     }
 
     void put_node(link_type p) {
-        rb_tree_node_allocator::deallocate(p);
+        rb_tree_node_allocator::deallocate(this->get_alloc(), p);
     }
 
-    link_type create_node(const value_type& x) {
+    template <typename... Args>
+    link_type create_node(Args&&... args) {
         link_type tmp = get_node();
         try {
-            construct(&tmp->value_field, x);
+            forgedstl::construct(&tmp->value_field, std::forward<Args>(args)...);
         } catch (...) {
             put_node(tmp);
             throw;
@@ -547,11 +949,12 @@ protected:
         tmp->color = x->color;
         tmp->left = nullptr;
         tmp->right = nullptr;
+        sizes::copy(tmp, x);
         return tmp;
     }
 
     void destroy_node(link_type p) {
-        destroy(&p->value_field);
+        forgedstl::destroy(&p->value_field);
         put_node(p);
     }
 
@@ -612,11 +1015,109 @@ protected:
     }
 
 private:
-    iterator __insert(base_ptr x, base_ptr y, const value_type& v);
+    // Insert positions are (x, y) pairs for __insert: y is the parent to
+    // be, x is non-null to force a left child. For unique keys a null y
+    // means the key exists already, and x is its node.
+    pair<base_ptr, base_ptr> __get_insert_unique_pos(const key_type& k);
+    pair<base_ptr, base_ptr> __get_insert_equal_pos(const key_type& k);
+    pair<base_ptr, base_ptr> __get_insert_hint_unique_pos(iterator position,
+                                                          const key_type& k);
+    pair<base_ptr, base_ptr> __get_insert_hint_equal_pos(iterator position,
+                                                         const key_type& k);
+
+    template <typename Arg>
+    pair<iterator, bool> __insert_unique(Arg&& v);
+    template <typename Arg>
+    iterator __insert_equal(Arg&& v);
+    template <typename Arg>
+    iterator __insert_unique(iterator position, Arg&& v);
+    template <typename Arg>
+    iterator __insert_equal(iterator position, Arg&& v);
+
+    template <typename Arg>
+    iterator __insert(base_ptr x, base_ptr y, Arg&& v);
+    iterator __insert_node(base_ptr x, base_ptr y, link_type z);
+    template <typename InputIterator>
+    void __insert_sorted(InputIterator first, InputIterator last, bool unique);
+    link_type __build(link_type& list, size_type n, int depth, int red_depth);
     link_type __copy(link_type x, link_type p);
-    void __erase(link_type x);
+    size_type __erase(link_type x);
+    size_type __count(const key_type& k, __false_type) const;
+    size_type __count(const key_type& k, __true_type) const;
+
+    void __split(__rb_tree_piece x, const key_type& k, __rb_tree_piece& l,
+                 __rb_tree_piece& r, base_ptr* mid) const;
+    void __count_split(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t,
+                       size_type n, __false_type);
+    void __count_split(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t,
+                       size_type n, __true_type);
+    void __set_operation(__rb_tree_set_op op,
+                         rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t,
+                         unsigned threads);
+    __rb_tree_piece __combine(__rb_tree_set_op op, __rb_tree_piece a,
+                              __rb_tree_piece b, __rb_tree_garbage& g,
+                              unsigned threads) const;
+    size_type __free(__rb_tree_garbage& g);
+
+    // Cuts all of the nodes loose as a piece, leaving the tree empty, and
+    // takes the n nodes of p into an empty tree.
+    __rb_tree_piece __detach() {
+        __rb_tree_piece p = { root(), __rb_tree_black_height(root()) };
+        if (p.root != nullptr) {
+            p.root->parent = nullptr;
+            root() = nullptr;
+            leftmost() = header;
+            rightmost() = header;
+            node_count = 0;
+        }
+        return p;
+    }
+    void __attach(__rb_tree_piece p, size_type n) {
+        if (p.root != nullptr) {
+            root() = (link_type)p.root;
+            root()->parent = header;
+            leftmost() = minimum(root());
+            rightmost() = maximum(root());
+        }
+        node_count = n;
+    }
+
+    // Moves all of x's nodes into this tree, which must be empty. The
+    // root's parent link names the header, so it has to be rewired.
+    void __take_nodes(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x) {
+        if (x.root() != nullptr) {
+            root() = x.root();
+            leftmost() = x.leftmost();
+            rightmost() = x.rightmost();
+            root()->parent = header;
+            node_count = x.node_count;
+            x.root() = nullptr;
+            x.leftmost() = x.header;
+            x.rightmost() = x.header;
+            x.node_count = 0;
+        }
+    }
+    void __move_assign(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x,
+                       __true_type) {
+        this->get_alloc() = x.get_alloc();
+        key_compare = x.key_compare;
+        __take_nodes(x);
+    }
+    void __move_assign(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x,
+                       __false_type) {
+        if (__alloc_equal(this->get_alloc(), x.get_alloc())) {
+            __move_assign(x, __true_type());
+        } else {
+            // x's nodes cannot change hands, only their values can
+            key_compare = x.key_compare;
+            for (iterator it = x.begin(); it != x.end(); ++it) {
+                __insert_equal(end(), std::move(*it));
+            }
+            x.clear();
+        }
+    }
     void init() {
-        header = get_node();
+        header = (link_type)&header_node;
         color(header) = __rb_tree_red;
 
         root() = nullptr;
@@ -625,31 +1126,45 @@ private:
     }
 };
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-inline bool operator==(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x,
-                       const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline bool operator==(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x,
+                       const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& y) {
     return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-inline bool operator<(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x,
-    const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline bool operator<(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x,
+    const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& y) {
     return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-inline void swap(rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x,
-                 rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& y) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline void swap(rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x,
+                 rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& y) {
     x.swap(y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>&
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
-operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x) {
+// rb_tree with the five parameters of the Tree argument of map, multimap,
+// set and multiset. rb_tree itself has six, and a template template
+// parameter only binds it where the compiler implements P0522.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare,
+          typename Alloc = alloc>
+using unranked_rb_tree = rb_tree<Key, Value, KeyOfValue, Compare, Alloc, false>;
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare,
+          typename Alloc = alloc>
+using ranked_rb_tree = rb_tree<Key, Value, KeyOfValue, Compare, Alloc, true>;
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>&
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::
+operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& x) {
     if (this != &x) {
         clear();
         node_count = 0;
+        if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+            this->get_alloc() = x.get_alloc();
+        }
         key_compare = x.key_compare;
         if (x.root() == nullptr) {
             root() = nullptr;
@@ -665,138 +1180,343 @@ operator=(const rb_tree<Key, Value, KeyOfValue, Compare, Alloc>& x) {
     return *this;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator, bool>
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(const value_type& v) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr,
+     typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__get_insert_unique_pos(const key_type& k) {
+    typedef pair<base_ptr, base_ptr> res;
     link_type y = header;
     link_type x = root();
     bool comp = true;
     while (x != nullptr) {
         y = x;
-        comp = key_compare(KeyOfValue()(v), key(x));
+        comp = key_compare(k, key(x));
         x = comp ? left(x) : right(x);
     }
     iterator j = iterator(y);
     if (comp) {
         if (j == begin()) {
-            return pair<iterator, bool>(__insert(x, y, v), true);
+            return res(x, y);
         }
         else {
             --j;
         }
     }
-    if (key_compare(key(j.node), KeyOfValue()(v))) {
-        return pair<iterator, bool>(__insert(x, y, v), true);
+    if (key_compare(key(j.node), k)) {
+        return res(x, y);
     }
-    return pair<iterator, bool>(j, false);
+    return res(j.node, nullptr);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(const value_type& v) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr,
+     typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__get_insert_equal_pos(const key_type& k) {
+    typedef pair<base_ptr, base_ptr> res;
     link_type y = header;
     link_type x = root();
     while (x != nullptr) {
         y = x;
-        x = key_compare(KeyOfValue()(v), key(x)) ? left(x) : right(x);
+        x = key_compare(k, key(x)) ? left(x) : right(x);
     }
-    return __insert(x, y, v);
+    return res(x, y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(iterator position, const value_type& v) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr,
+     typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__get_insert_hint_unique_pos(iterator position, const key_type& k) {
+    typedef pair<base_ptr, base_ptr> res;
     if (position.node == header->left) { // begin()
-        if (size() > 0 && key_compare(KeyOfValue()(v), key(position.node))) {
-            return __insert(position.node, position.node, v);
+        if (size() > 0 && key_compare(k, key(position.node))) {
+            return res(position.node, position.node);
         }
         else {
-            return insert_unique(v).first;
+            return __get_insert_unique_pos(k);
         }
     }
     else if (position.node == header) { // end()
-        if (key_compare(key(rightmost()), KeyOfValue()(v))) {
-            return __insert(nullptr, rightmost(), v);
+        if (key_compare(key(rightmost()), k)) {
+            return res(nullptr, rightmost());
         }
         else {
-            return insert_unique(v).first;
+            return __get_insert_unique_pos(k);
         }
     }
     else {
         iterator before = position;
         --before;
-        if (key_compare(key(before.node), KeyOfValue()(v))
-            && key_compare(KeyOfValue()(v), key(position.node))) {
+        if (key_compare(key(before.node), k)
+            && key_compare(k, key(position.node))) {
             if (right(before.node) == 0) {
-                return __insert(nullptr, before.node, v);
+                return res(nullptr, before.node);
             }
             else {
-                return __insert(position.node, position.node, v);
+                return res(position.node, position.node);
             }
         }
         else {
-            return insert_unique(v).first;
+            return __get_insert_unique_pos(k);
         }
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(iterator position, const value_type& v) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr,
+     typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::base_ptr>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__get_insert_hint_equal_pos(iterator position, const key_type& k) {
+    typedef pair<base_ptr, base_ptr> res;
     if (position.node == header->left) { // begin()
-        if (size() > 0 && key_compare(KeyOfValue()(v), key(position.node))) {
-            return __insert(position.node, position.node, v);
+        if (size() > 0 && !key_compare(key(position.node), k)) {
+            return res(position.node, position.node);
         }
         else {
-            return inert_euqal(v);
+            return __get_insert_equal_pos(k);
         }
     }
     else if (position.node == header) { // end()
-        if (!key_compare(KeyOfValue()(v), key(rightmost()))) {
-            return __insert(nullptr, rightmost(), v);
+        if (!key_compare(k, key(rightmost()))) {
+            return res(nullptr, rightmost());
         }
         else {
-            return inert_euqal(v);
+            return __get_insert_equal_pos(k);
         }
     }
     else {
         iterator before = position;
         --before;
-        if (!key_compare(KeyOfValue()(v), key(before.node))
-            && !key_compare(key(position.node), KeyOfValue()(v))) {
+        if (!key_compare(k, key(before.node))
+            && !key_compare(key(position.node), k)) {
             if (right(before.node) == 0) {
-                return __insert(nullptr, before.node, v);
+                return res(nullptr, before.node);
             }
             else {
-                return __insert(position.node, position.node, v);
+                return res(position.node, position.node);
             }
         }
         else {
-            return inert_euqal(v);
+            return __get_insert_equal_pos(k);
         }
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename Arg>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__insert_unique(Arg&& v) {
+    pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(KeyOfValue()(v));
+    if (pos.second != nullptr) {
+        return pair<iterator, bool>(
+            __insert(pos.first, pos.second, std::forward<Arg>(v)), true);
+    }
+    return pair<iterator, bool>(iterator(link_type(pos.first)), false);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename Arg>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__insert_equal(Arg&& v) {
+    pair<base_ptr, base_ptr> pos = __get_insert_equal_pos(KeyOfValue()(v));
+    return __insert(pos.first, pos.second, std::forward<Arg>(v));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename Arg>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__insert_unique(iterator position, Arg&& v) {
+    pair<base_ptr, base_ptr> pos =
+        __get_insert_hint_unique_pos(position, KeyOfValue()(v));
+    if (pos.second != nullptr) {
+        return __insert(pos.first, pos.second, std::forward<Arg>(v));
+    }
+    return iterator(link_type(pos.first));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename Arg>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__insert_equal(iterator position, Arg&& v) {
+    pair<base_ptr, base_ptr> pos =
+        __get_insert_hint_equal_pos(position, KeyOfValue()(v));
+    return __insert(pos.first, pos.second, std::forward<Arg>(v));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename... Args>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::emplace_unique(Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(key(z));
+    if (pos.second != nullptr) {
+        return pair<iterator, bool>(__insert_node(pos.first, pos.second, z),
+                                    true);
+    }
+    destroy_node(z);
+    return pair<iterator, bool>(iterator(link_type(pos.first)), false);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename... Args>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::emplace_equal(Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    pair<base_ptr, base_ptr> pos = __get_insert_equal_pos(key(z));
+    return __insert_node(pos.first, pos.second, z);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename... Args>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::emplace_hint_unique(iterator position, Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    pair<base_ptr, base_ptr> pos = __get_insert_hint_unique_pos(position, key(z));
+    if (pos.second != nullptr) {
+        return __insert_node(pos.first, pos.second, z);
+    }
+    destroy_node(z);
+    return iterator(link_type(pos.first));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename... Args>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::emplace_hint_equal(iterator position, Args&&... args) {
+    link_type z = create_node(std::forward<Args>(args)...);
+    pair<base_ptr, base_ptr> pos = __get_insert_hint_equal_pos(position, key(z));
+    return __insert_node(pos.first, pos.second, z);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
 template <typename InputIterator>
-void rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_unique(InputIterator first, InputIterator last) {
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::insert_unique(InputIterator first, InputIterator last) {
     for (; first != last; ++first) {
         insert_unique(*first);
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
 template <typename InputIterator>
-void rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::insert_equal(InputIterator first, InputIterator last) {
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::insert_equal(InputIterator first, InputIterator last) {
     for (; first != last; ++first) {
         insert_equal(*first);
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+// The nodes are created first, in input order, and chained through their
+// right links; __build then hangs them into a balanced tree.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename InputIterator>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__insert_sorted(InputIterator first, InputIterator last, bool unique) {
+    if (node_count != 0) {
+        for (; first != last; ++first) {
+            if (unique) {
+                __insert_unique(end(), *first);
+            } else {
+                __insert_equal(end(), *first);
+            }
+        }
+        return;
+    }
+
+    link_type head = nullptr;
+    link_type tail = nullptr;
+    link_type stray = nullptr;  // the first node out of order
+    size_type n = 0;
+    try {
+        for (; first != last; ++first) {
+            link_type y = create_node(*first);
+            if (tail != nullptr && key_compare(key(y), key(tail))) {
+                stray = y;
+                ++first;
+                break;
+            }
+            if (tail != nullptr && unique && !key_compare(key(tail), key(y))) {
+                destroy_node(y);
+                continue;
+            }
+            right(y) = nullptr;
+            if (tail == nullptr) {
+                head = y;
+            } else {
+                right(tail) = y;
+            }
+            tail = y;
+            ++n;
+        }
+    } catch (...) {
+        while (head != nullptr) {
+            link_type next = right(head);
+            destroy_node(head);
+            head = next;
+        }
+        throw;
+    }
+
+    if (n != 0) {
+        // a tree that is not perfect has its deepest level red
+        int red_depth = -1;
+        if ((n & (n + 1)) != 0) {
+            red_depth = 0;
+            for (size_type m = n; m > 1; m >>= 1) {
+                ++red_depth;
+            }
+        }
+        root() = __build(head, n, 0, red_depth);
+        root()->parent = header;
+        leftmost() = minimum(root());
+        rightmost() = maximum(root());
+        node_count = n;
+    }
+
+    if (stray != nullptr) {
+        pair<base_ptr, base_ptr> pos = unique ? __get_insert_unique_pos(key(stray))
+                                              : __get_insert_equal_pos(key(stray));
+        if (pos.second != nullptr) {
+            __insert_node(pos.first, pos.second, stray);
+        } else {
+            destroy_node(stray);
+        }
+        for (; first != last; ++first) {
+            if (unique) {
+                __insert_unique(*first);
+            } else {
+                __insert_equal(*first);
+            }
+        }
+    }
+}
+
+// Takes the first n nodes of list, in order, as a subtree whose halves
+// differ in size by at most one, so that all of its null links lie on two
+// adjacent levels; the nodes at red_depth are red and the rest black.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::link_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__build(link_type& list, size_type n, int depth, int red_depth) {
+    if (n == 0) {
+        return nullptr;
+    }
+    const size_type left_n = (n - 1) / 2;
+    link_type l = __build(list, left_n, depth + 1, red_depth);
+    link_type x = list;
+    list = right(list);
+    left(x) = l;
+    if (l != nullptr) {
+        parent(l) = x;
+    }
+    link_type r = __build(list, n - 1 - left_n, depth + 1, red_depth);
+    right(x) = r;
+    if (r != nullptr) {
+        parent(r) = x;
+    }
+    color(x) = depth == red_depth ? __rb_tree_red : __rb_tree_black;
+    sizes::update(x);
+    return x;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
 inline void
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator position) {
-    link_type y = (link_type)__rb_tree_rebalance_for_erase(position.node,
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::erase(iterator position) {
+    link_type y = (link_type)__rb_tree_rebalance_for_erase<sizes>(position.node,
                                                            header->parent,
                                                            header->left,
                                                            header->right);
@@ -804,18 +1524,18 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator position) {
     --node_count;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(const key_type& x) {
-    pair<iterator, iterator> p = euqal_range(x);
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::erase(const key_type& x) {
+    pair<iterator, iterator> p = equal_range(x);
     size_type n = 0;
     distance(p.first, p.second, n);
     erase(p.first, p.second);
     return n;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-void rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator first, iterator last) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::erase(iterator first, iterator last) {
     if (first == begin() && last == end()) {
         clear();
     }
@@ -826,9 +1546,313 @@ void rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::erase(iterator first, iter
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::node_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::extract(iterator position) {
+    link_type y = (link_type)__rb_tree_rebalance_for_erase<sizes>(position.node,
+                                                           header->parent,
+                                                           header->left,
+                                                           header->right);
+    --node_count;
+    return node_type(y, this->get_alloc());
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::node_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::extract(const key_type& x) {
+    iterator position = find(x);
+    return position == end() ? node_type() : extract(position);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator, bool>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::insert_unique(node_type&& nh) {
+    if (nh.empty()) {
+        return pair<iterator, bool>(end(), false);
+    }
+    if (!__alloc_equal(this->get_alloc(), nh.get_alloc())) {
+        pair<iterator, bool> result = __insert_unique(std::move(nh.value()));
+        if (result.second) {
+            nh = node_type();
+        }
+        return result;
+    }
+    pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(key(nh.ptr));
+    if (pos.second != nullptr) {
+        return pair<iterator, bool>(
+            __insert_node(pos.first, pos.second, nh.release()), true);
+    }
+    return pair<iterator, bool>(iterator(link_type(pos.first)), false);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::insert_equal(node_type&& nh) {
+    if (nh.empty()) {
+        return end();
+    }
+    if (!__alloc_equal(this->get_alloc(), nh.get_alloc())) {
+        iterator result = __insert_equal(std::move(nh.value()));
+        nh = node_type();
+        return result;
+    }
+    pair<base_ptr, base_ptr> pos = __get_insert_equal_pos(key(nh.ptr));
+    return __insert_node(pos.first, pos.second, nh.release());
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::merge_unique(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+    if (&t == this) {
+        return;
+    }
+    const bool relink = __alloc_equal(this->get_alloc(), t.get_alloc());
+    for (iterator it = t.begin(); it != t.end(); ) {
+        iterator cur = it++;
+        pair<base_ptr, base_ptr> pos = __get_insert_unique_pos(key(cur.node));
+        if (pos.second == nullptr) {
+            continue;
+        }
+        if (relink) {
+            __insert_node(pos.first, pos.second,
+                          t.extract(cur).release());
+        } else {
+            __insert(pos.first, pos.second, std::move(*cur));
+            t.erase(cur);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::merge_equal(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+    if (&t == this) {
+        return;
+    }
+    const bool relink = __alloc_equal(this->get_alloc(), t.get_alloc());
+    for (iterator it = t.begin(); it != t.end(); ) {
+        iterator cur = it++;
+        pair<base_ptr, base_ptr> pos = __get_insert_equal_pos(key(cur.node));
+        if (relink) {
+            __insert_node(pos.first, pos.second,
+                          t.extract(cur).release());
+        } else {
+            __insert(pos.first, pos.second, std::move(*cur));
+            t.erase(cur);
+        }
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::split(
+    const key_type& k, rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+    if (&t == this) {
+        return;
+    }
+    t.clear();
+    if (!__alloc_equal(this->get_alloc(), t.get_alloc())) {
+        iterator first = lower_bound(k);
+        for (iterator it = first; it != end(); ++it) {
+            t.__insert_equal(t.end(), std::move(*it));
+        }
+        erase(first, end());
+        return;
+    }
+    const size_type n = node_count;
+    __rb_tree_piece l, r;
+    __split(__detach(), k, l, r, nullptr);
+    __attach(l, 0);
+    t.__attach(r, 0);
+    __count_split(t, n, typename __bool_type<Ranked>::type());
+}
+
+// The halves are walked side by side until the smaller one runs out.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__count_split(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t, size_type n, __false_type) {
+    const_iterator i = begin();
+    const_iterator j = t.begin();
+    size_type c = 0;
+    for (; i != end() && j != t.end(); ++i, ++j) {
+        ++c;
+    }
+    node_count = i == end() ? c : n - c;
+    t.node_count = n - node_count;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__count_split(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t, size_type n, __true_type) {
+    node_count = sizes::size_of(root());
+    t.node_count = n - node_count;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::join_unique(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+    if (&t == this || t.empty()) {
+        return;
+    }
+    if (!__alloc_equal(this->get_alloc(), t.get_alloc()) ||
+        (!empty() && !key_compare(key(rightmost()), key(t.leftmost())))) {
+        merge_unique(t);
+        return;
+    }
+    const size_type n = node_count + t.node_count;
+    __rb_tree_piece l = __detach();
+    __attach(__rb_tree_join<sizes>(l, t.__detach()), n);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::join_equal(
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t) {
+    if (&t == this || t.empty()) {
+        return;
+    }
+    if (!__alloc_equal(this->get_alloc(), t.get_alloc()) ||
+        (!empty() && key_compare(key(t.leftmost()), key(rightmost())))) {
+        merge_equal(t);
+        return;
+    }
+    const size_type n = node_count + t.node_count;
+    __rb_tree_piece l = __detach();
+    __attach(__rb_tree_join<sizes>(l, t.__detach()), n);
+}
+
+// Each level joins the subtree it keeps whole with what the level below
+// returned. The joined heights only grow on the way up, so the joins cost
+// O(log n) together.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__split(
+    __rb_tree_piece x, const key_type& k, __rb_tree_piece& l, __rb_tree_piece& r,
+    base_ptr* mid) const {
+    if (x.root == nullptr) {
+        l = x;
+        r = x;
+        return;
+    }
+    base_ptr y = x.root;
+    __rb_tree_piece yl = __rb_tree_make_piece(y->left, x.height - 1);
+    __rb_tree_piece yr = __rb_tree_make_piece(y->right, x.height - 1);
+    __rb_tree_piece rest;
+    if (key_compare(key(y), k)) {
+        __split(yr, k, rest, r, mid);
+        l = __rb_tree_join<sizes>(yl, y, rest);
+    } else if (mid != nullptr && !key_compare(k, key(y))) {
+        *mid = y;
+        l = yl;
+        r = yr;
+    } else {
+        __split(yl, k, l, rest, mid);
+        r = __rb_tree_join<sizes>(rest, y, yr);
+    }
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+void rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__set_operation(
+    __rb_tree_set_op op, rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>& t,
+    unsigned threads) {
+    if (&t == this) {
+        if (op == __rb_tree_difference) {
+            clear();
+        }
+        return;
+    }
+    if (!__alloc_equal(this->get_alloc(), t.get_alloc())) {
+        // t's nodes cannot change hands, so this goes one key at a time
+        if (op == __rb_tree_union) {
+            merge_unique(t);
+        } else if (op == __rb_tree_intersection) {
+            for (iterator it = begin(); it != end(); ) {
+                iterator cur = it++;
+                if (t.find(key(cur.node)) == t.end()) {
+                    erase(cur);
+                }
+            }
+        } else {
+            for (iterator it = t.begin(); it != t.end(); ++it) {
+                erase(key(it.node));
+            }
+        }
+        t.clear();
+        return;
+    }
+    const size_type n = node_count + t.node_count;
+    __rb_tree_garbage g = { nullptr, nullptr };
+    __rb_tree_piece a = __detach();
+    __rb_tree_piece p = __combine(op, a, t.__detach(), g, threads);
+    __attach(p, n - __free(g));
+}
+
+// a's root splits b, the halves combine recursively, and the root joins
+// them again unless the operation drops it; b's node with the same key,
+// if any, is dropped in any case.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+__rb_tree_piece
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__combine(
+    __rb_tree_set_op op, __rb_tree_piece a, __rb_tree_piece b,
+    __rb_tree_garbage& g, unsigned threads) const {
+    if (a.root == nullptr) {
+        if (op == __rb_tree_union) {
+            return b;
+        }
+        g.push(b.root);
+        return a;
+    }
+    if (b.root == nullptr) {
+        if (op != __rb_tree_intersection) {
+            return a;
+        }
+        g.push(a.root);
+        return b;
+    }
+    const bool parallel = threads > 1 &&
+                          a.height >= __rb_tree_parallel_height &&
+                          b.height >= __rb_tree_parallel_height;
+    base_ptr x = a.root;
+    __rb_tree_piece al = __rb_tree_make_piece(x->left, a.height - 1);
+    __rb_tree_piece ar = __rb_tree_make_piece(x->right, a.height - 1);
+    __rb_tree_piece bl, br;
+    base_ptr dup = nullptr;
+    __split(b, key(x), bl, br, &dup);
+    __rb_tree_piece l, r;
+    if (parallel) {
+        __rb_tree_garbage lg = { nullptr, nullptr };
+        std::thread left([&]() {
+            l = __combine(op, al, bl, lg, threads / 2);
+        });
+        r = __combine(op, ar, br, g, threads - threads / 2);
+        left.join();
+        g.splice(lg);
+    } else {
+        l = __combine(op, al, bl, g, 1);
+        r = __combine(op, ar, br, g, 1);
+    }
+    if (dup != nullptr) {
+        g.push_node(dup);
+    }
+    if (op == __rb_tree_union || (op == __rb_tree_intersection) == (dup != nullptr)) {
+        return __rb_tree_join<sizes>(l, x, r);
+    }
+    g.push_node(x);
+    return __rb_tree_join<sizes>(l, r);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__free(__rb_tree_garbage& g) {
+    size_type n = 0;
+    for (base_ptr x = g.head; x != nullptr; ) {
+        base_ptr next = x->parent;
+        n += __erase((link_type)x);
+        x = next;
+    }
+    return n;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::find(const key_type& k) {
     link_type y = header;
     link_type x = root();
 
@@ -845,10 +1869,10 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) {
     return (j == end() || key_compare(k, key(j.node))) ? end() : j;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) const {
-    link_type y = header();
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::find(const key_type& k) const {
+    link_type y = header;
     link_type x = root();
 
     while (x != nullptr) {
@@ -864,18 +1888,87 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::find(const key_type& k) const {
     return (j == end() || key_compare(k, key(j.node))) ? end() : j;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::size_type
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::count(const key_type& k) const {
-    pair<const_iterator, const_iterator> p = euqal_range(k);
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__count(const key_type& k, __false_type) const {
+    pair<const_iterator, const_iterator> p = equal_range(k);
     size_type n = 0;
     distance(p.first, p.second, n);
     return n;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__count(const key_type& k, __true_type) const {
+    return rank(upper_bound(k)) - rank(lower_bound(k));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::rank(const key_type& k) const {
+    static_assert(Ranked, "rank needs a ranked tree");
+    size_type r = 0;
+    link_type x = root();
+    while (x != nullptr) {
+        if (key_compare(key(x), k)) {
+            r += sizes::size_of(x->left) + 1;
+            x = right(x);
+        } else {
+            x = left(x);
+        }
+    }
+    return r;
+}
+
+// The elements before position are those of its left subtree, and those of
+// every ancestor it lies to the right of, with their left subtrees.
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::rank(const_iterator position) const {
+    static_assert(Ranked, "rank needs a ranked tree");
+    if (position == end()) {
+        return node_count;
+    }
+    base_ptr x = position.node;
+    size_type r = sizes::size_of(x->left);
+    while (x != root()) {
+        base_ptr p = x->parent;
+        if (x == p->right) {
+            r += sizes::size_of(p->left) + 1;
+        }
+        x = p;
+    }
+    return r;
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::select(size_type n) {
+    static_assert(Ranked, "select needs a ranked tree");
+    link_type x = root();
+    while (x != nullptr) {
+        const size_type l = sizes::size_of(x->left);
+        if (n < l) {
+            x = left(x);
+        } else if (n == l) {
+            return iterator(x);
+        } else {
+            n -= l + 1;
+            x = right(x);
+        }
+    }
+    return end();
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::select(size_type n) const {
+    return const_cast<rb_tree*>(this)->select(n);
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::lower_bound(const key_type& k) {
     link_type y = header;
     link_type x = root();
 
@@ -891,9 +1984,9 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k)
     return iterator(y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k) const {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::lower_bound(const key_type& k) const {
     link_type y = header;
     link_type x = root();
 
@@ -909,9 +2002,9 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::lower_bound(const key_type& k)
     return const_iterator(y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::upper_bound(const key_type& k) {
     link_type y = header;
     link_type x = root();
 
@@ -927,9 +2020,9 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k)
     return iterator(y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k) const {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::upper_bound(const key_type& k) const {
     link_type y = header;
     link_type x = root();
 
@@ -945,30 +2038,36 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::upper_bound(const key_type& k)
     return const_iterator(y);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-inline pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator,
-                 typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator>
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::equal_range(const key_type& k) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator,
+                 typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator>
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::equal_range(const key_type& k) {
     return pair<iterator, iterator>(lower_bound(k), upper_bound(k));
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-inline pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator,
-                 typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::const_iterator>
-    rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::equal_range(const key_type& k) const {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+inline pair<typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator,
+                 typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::const_iterator>
+    rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::equal_range(const key_type& k) const {
     return pair<const_iterator, const_iterator>(lower_bound(k), upper_bound(k));
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::iterator
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::
-__insert(base_ptr x_, base_ptr y_, const value_type& v) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+template <typename Arg>
+inline typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::
+__insert(base_ptr x, base_ptr y, Arg&& v) {
+    return __insert_node(x, y, create_node(std::forward<Arg>(v)));
+}
+
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::iterator
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::
+__insert_node(base_ptr x_, base_ptr y_, link_type z) {
     link_type x = (link_type)x_;
     link_type y = (link_type)y_;
-    link_type z;
 
-    if (y == header || x != nullptr || key_compare(KeyOfValue()(v), key(y))) {
-        z = create_node(v);
+    if (y == header || x != nullptr || key_compare(key(z), key(y))) {
         left(y) = z;
         if (y == header) {
             root() = z;
@@ -979,7 +2078,6 @@ __insert(base_ptr x_, base_ptr y_, const value_type& v) {
         }
     }
     else {
-        z = create_node(v);
         right(y) = z;
         if (y == rightmost()) {
             rightmost() = z;
@@ -988,14 +2086,14 @@ __insert(base_ptr x_, base_ptr y_, const value_type& v) {
     parent(z) = y;
     left(z) = nullptr;
     right(z) = nullptr;
-    __rb_tree_rebalance(z, header->parent);
+    __rb_tree_rebalance<sizes>(z, header->parent);
     ++node_count;
     return iterator(z);
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::link_type
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__copy(link_type x, link_type p) {
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::link_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__copy(link_type x, link_type p) {
     link_type top = clone_node(x);
     top->parent = p;
 
@@ -1018,18 +2116,23 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__copy(link_type x, link_type p
         }
     } catch (...) {
         __erase(top);
+        throw;
     }
     return top;
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
-void rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__erase(link_type x) { // without rebalancing
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
+typename rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::size_type
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__erase(link_type x) { // without rebalancing
+    size_type n = 0;
     while (x != nullptr) {
-        __erase(right(x));
+        n += __erase(right(x));
         link_type y = left(x);
         destroy_node(x);
         x = y;
+        ++n;
     }
+    return n;
 }
 
 inline int __black_count(__rb_tree_node_base* node, __rb_tree_node_base* root) {
@@ -1047,9 +2150,9 @@ inline int __black_count(__rb_tree_node_base* node, __rb_tree_node_base* root) {
     }
 }
 
-template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc>
+template <typename Key, typename Value, typename KeyOfValue, typename Compare, typename Alloc, bool Ranked>
 bool
-rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__rb_verify() const {
+rb_tree<Key, Value, KeyOfValue, Compare, Alloc, Ranked>::__rb_verify() const {
     if (node_count == 0 || begin() == end()) {
         return node_count == 0 && begin() == end() &&
             header->left == header && header->right == header;
@@ -1063,7 +2166,7 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__rb_verify() const {
 
         if (x->color == __rb_tree_red) {
             if ((L != nullptr && L->color == __rb_tree_red) ||
-                (R != nullptr && R->color == __rb_tree_black)) {
+                (R != nullptr && R->color == __rb_tree_red)) {
                 return false;
             }
         }
@@ -1078,6 +2181,9 @@ rb_tree<Key, Value, KeyOfValue, Compare, Alloc>::__rb_verify() const {
         if (L == nullptr && R == nullptr && __black_count(x, root()) != len) {
             return false;
         }
+        if (!sizes::check(x)) {
+            return false;
+        }
     }
 
     if (leftmost() != __rb_tree_node_base::minimum(root())) {
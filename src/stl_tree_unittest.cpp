@@ -1,13 +1,22 @@
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "stl_function.h"
+#include "stl_map.h"
+#include "stl_multimap.h"
+#include "stl_multiset.h"
+#include "stl_set.h"
 #include "stl_tree.h"
+#include "test_alloc.h"
 
 namespace forgedstl {
 
-#if 0
-
 TEST(RBTreeTest, Basic) {
     ASSERT_EQ(10, identity<int>()(10));
 
@@ -65,6 +74,563 @@ TEST(RBTreeTest, Basic) {
     ASSERT_TRUE(itree2.__rb_verify());
 }
 
-#endif
+TEST(RBTreeTest, EraseKeepsBalance) {
+    rb_tree<int, int, identity<int>, std::less<int> > itree;
+    unsigned x = 88172645u;
+    for (int i = 0; i < 2000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        itree.insert_equal(int(x % 500));
+    }
+    ASSERT_TRUE(itree.__rb_verify());
+
+    // every sibling case of the erase fix-up, on both sides of the parent
+    size_t n = itree.size();
+    for (int k = 0; k < 500; k += 2) {
+        n -= itree.erase(k);
+        ASSERT_EQ(n, itree.size());
+        ASSERT_TRUE(itree.__rb_verify());
+    }
+    while (!itree.empty()) {
+        rb_tree<int, int, identity<int>, std::less<int> >::iterator it =
+            itree.size() % 2 == 0 ? itree.begin() : --itree.end();
+        itree.erase(it);
+        ASSERT_TRUE(itree.__rb_verify());
+    }
+    EXPECT_EQ(0, itree.size());
+}
+
+TEST(RBTreeTest, MoveAndEmplace) {
+    rb_tree<int, int, identity<int>, std::less<int> > itree;
+    for (int i = 0; i < 100; ++i) {
+        itree.emplace_unique(i);
+        itree.emplace_hint_unique(itree.end(), i);
+    }
+    EXPECT_EQ(100, itree.size());
+    EXPECT_TRUE(itree.__rb_verify());
+
+    map<std::string, std::unique_ptr<int> > m;
+    std::string key(100, 'k');
+    m[std::move(key)].reset(new int(1));
+    EXPECT_TRUE(key.empty());
+    EXPECT_TRUE(m.emplace("a", std::unique_ptr<int>(new int(2))).second);
+    EXPECT_FALSE(m.emplace("a", std::unique_ptr<int>(new int(3))).second);
+    m.emplace_hint(m.end(), "z", std::unique_ptr<int>(new int(4)));
+    ASSERT_EQ(3, m.size());
+    EXPECT_EQ(2, *m["a"]);
+    EXPECT_EQ(1, *m[std::string(100, 'k')]);
+    EXPECT_EQ(4, *m.rbegin()->second);
+
+    set<std::string> s;
+    s.emplace(3, 'a');
+    s.insert(std::string("b"));
+    EXPECT_FALSE(s.emplace("aaa").second);
+    EXPECT_EQ(2, s.size());
+
+    multiset<int> ms;
+    ms.emplace(1);
+    ms.insert(1);
+    ms.emplace_hint(ms.begin(), 0);
+    EXPECT_EQ(3, ms.size());
+    EXPECT_EQ(2, ms.count(1));
+}
+
+TEST(RBTreeTest, MoveConstructAndAssign) {
+    typedef rb_tree<int, int, identity<int>, std::less<int> > Tree;
+    EXPECT_TRUE(std::is_nothrow_move_constructible<Tree>::value);
+    EXPECT_TRUE(std::is_nothrow_move_assignable<Tree>::value);
+
+    Tree t1;
+    for (int i = 0; i < 100; ++i) {
+        t1.insert_unique(i);
+    }
+    const int* p = &*t1.find(42);
+    Tree t2(std::move(t1));
+    EXPECT_TRUE(t1.empty());
+    EXPECT_TRUE(t1.begin() == t1.end());
+    ASSERT_EQ(100, t2.size());
+    EXPECT_EQ(p, &*t2.find(42));
+    EXPECT_TRUE(t2.__rb_verify());
+    t1.insert_unique(1);
+    EXPECT_TRUE(t1.__rb_verify());
+
+    Tree t3;
+    t3.insert_unique(1000);
+    t3 = std::move(t2);
+    EXPECT_TRUE(t2.empty());
+    EXPECT_EQ(100, t3.size());
+    EXPECT_EQ(p, &*t3.find(42));
+    EXPECT_TRUE(t3.__rb_verify());
+
+    t3.swap(t1);
+    EXPECT_EQ(1, t3.size());
+    EXPECT_EQ(100, t1.size());
+    EXPECT_TRUE(t1.__rb_verify());
+    EXPECT_TRUE(t3.__rb_verify());
+    t2.swap(t1);
+    EXPECT_TRUE(t1.empty());
+    EXPECT_EQ(100, t2.size());
+    EXPECT_TRUE(t2.__rb_verify());
+
+    map<int, std::string> m1;
+    m1[1] = "one";
+    map<int, std::string> m2(std::move(m1));
+    EXPECT_TRUE(m1.empty());
+    EXPECT_EQ("one", m2[1]);
+    set<int> s1;
+    s1.insert(1);
+    set<int> s2;
+    s2 = std::move(s1);
+    EXPECT_TRUE(s1.empty());
+    EXPECT_EQ(1, s2.size());
+}
+
+TEST(RBTreeTest, ExtractAndMerge) {
+    typedef rb_tree<int, int, identity<int>, std::less<int>,
+                    stateful_alloc> Tree;
+    test_pool p1, p2;
+    {
+        const std::less<int> less;
+        Tree t1(less, stateful_alloc(&p1));
+        Tree t2(less, stateful_alloc(&p1));
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        for (int i = 50; i < 150; ++i) {
+            t2.insert_unique(i);
+        }
+        const size_t allocations = p1.allocations;
+
+        const int* p = &*t1.find(10);
+        Tree::node_type nh = t1.extract(10);
+        ASSERT_FALSE(nh.empty());
+        EXPECT_EQ(10, nh.value());
+        EXPECT_EQ(p, &nh.value());
+        EXPECT_EQ(99, t1.size());
+        EXPECT_TRUE(t1.__rb_verify());
+        EXPECT_TRUE(t1.extract(10).empty());
+
+        nh.value() = 200;
+        EXPECT_TRUE(t2.insert_unique(std::move(nh)).second);
+        EXPECT_TRUE(nh.empty());
+        EXPECT_EQ(p, &*t2.find(200));
+        nh = t2.extract(t2.find(60));
+        EXPECT_FALSE(t1.insert_unique(std::move(nh)).second);
+        EXPECT_FALSE(nh.empty());
+        t1.insert_equal(std::move(nh));
+        EXPECT_EQ(2, t1.count(60));
+        EXPECT_TRUE(t1.__rb_verify());
+        EXPECT_TRUE(t1.insert_unique(Tree::node_type()).first == t1.end());
+
+        // t2 adds 100 to 149 and 200; 50 to 99 are in both
+        t1.merge_unique(t2);
+        EXPECT_EQ(151, t1.size());
+        EXPECT_EQ(49, t2.size());
+        EXPECT_TRUE(t1.__rb_verify());
+        EXPECT_TRUE(t2.__rb_verify());
+        t1.merge_equal(t2);
+        EXPECT_TRUE(t2.empty());
+        EXPECT_EQ(200, t1.size());
+        EXPECT_EQ(2, t1.count(99));
+        EXPECT_TRUE(t1.__rb_verify());
+        EXPECT_EQ(allocations, p1.allocations);
+
+        // across pools the values move instead
+        Tree t3(less, stateful_alloc(&p2));
+        t3.insert_unique(0);
+        t3.merge_unique(t1);
+        EXPECT_EQ(150, t3.size());
+        EXPECT_EQ(51, t1.size());
+        EXPECT_TRUE(t3.__rb_verify());
+        nh = t1.extract(t1.begin());
+        EXPECT_FALSE(t3.insert_unique(std::move(nh)).second);
+        nh.value() = 1000;
+        EXPECT_TRUE(t3.insert_unique(std::move(nh)).second);
+        EXPECT_TRUE(nh.empty());
+        EXPECT_EQ(50, t1.size());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+
+    map<int, std::string> m;
+    multimap<int, std::string> mm;
+    m[1] = "one";
+    m[2] = "two";
+    mm.insert(std::move(m.extract(1)));
+    mm.insert(m.extract(m.begin()));
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(2, mm.size());
+    map<int, std::string> m2;
+    m2.insert(mm.extract(2));
+    m.merge(m2);
+    EXPECT_EQ("two", m[2]);
+
+    set<int> s1, s2;
+    s1.insert(1);
+    s2.insert(1);
+    s2.insert(2);
+    s1.merge(s2);
+    EXPECT_EQ(2, s1.size());
+    EXPECT_EQ(1, s2.size());
+    multiset<int> ms;
+    ms.insert(s1.extract(s1.begin()));
+    ms.insert(s2.extract(1));
+    EXPECT_EQ(2, ms.count(1));
+}
+
+TEST(RBTreeTest, SortedBuild) {
+    typedef rb_tree<int, int, identity<int>, std::less<int> > Tree;
+    int a[300];
+    for (int i = 0; i < 300; ++i) {
+        a[i] = i / 2;
+    }
+    // every size up to 300, perfect trees and the rest
+    for (int n = 0; n <= 300; ++n) {
+        Tree u;
+        u.insert_unique_sorted(a, a + n);
+        ASSERT_EQ(size_t((n + 1) / 2), u.size());
+        ASSERT_TRUE(u.__rb_verify());
+        Tree e;
+        e.insert_equal_sorted(a, a + n);
+        ASSERT_EQ(size_t(n), e.size());
+        ASSERT_TRUE(e.__rb_verify());
+        ASSERT_TRUE(std::equal(a, a + n, e.begin()));
+    }
+
+    // out of order from the fifth element on
+    int b[] = { 1, 3, 5, 7, 2, 9, 3, 0 };
+    Tree u;
+    u.insert_unique_sorted(b, b + 8);
+    EXPECT_EQ(7, u.size());
+    EXPECT_TRUE(u.__rb_verify());
+    EXPECT_EQ(0, *u.begin());
+    Tree e;
+    e.insert_equal_sorted(b, b + 8);
+    EXPECT_EQ(8, e.size());
+    EXPECT_EQ(2, e.count(3));
+    EXPECT_TRUE(e.__rb_verify());
+    // into a tree that is not empty
+    e.insert_equal_sorted(a, a + 300);
+    EXPECT_EQ(308, e.size());
+    EXPECT_TRUE(e.__rb_verify());
+
+    pair<const int, std::string> p[] = {
+        pair<const int, std::string>(1, "one"),
+        pair<const int, std::string>(2, "two"),
+        pair<const int, std::string>(2, "deux"),
+        pair<const int, std::string>(0, "zero")
+    };
+    map<int, std::string> m(sorted_unique, p, p + 3);
+    EXPECT_EQ(2, m.size());
+    EXPECT_EQ("two", m[2]);
+    m.insert(sorted_unique, p + 3, p + 4);
+    EXPECT_EQ(3, m.size());
+    set<int> s(sorted_unique, a, a + 300, std::less<int>());
+    EXPECT_EQ(150, s.size());
+    multiset<int> ms(sorted_equal, a, a + 300);
+    EXPECT_EQ(300, ms.size());
+    EXPECT_EQ(2, ms.count(149));
+}
+
+TEST(RBTreeTest, RankAndSelect) {
+    typedef rb_tree<int, int, identity<int>, std::less<int>, alloc,
+                    true> Tree;
+    Tree t;
+    EXPECT_EQ(0, t.rank(5));
+    EXPECT_TRUE(t.select(0) == t.end());
+
+    std::multiset<int> expected;
+    unsigned x = 2463534242u;
+    for (int round = 0; round < 6000; ++round) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        const int v = int(x / 4 % 500);
+        if (x % 4 == 0 && t.find(v) != t.end()) {
+            t.erase(t.find(v));
+            expected.erase(expected.find(v));
+        } else if (x % 4 == 1) {
+            t.insert_unique(v);
+            expected.insert(v);
+            if (expected.count(v) > 1) {
+                expected.erase(expected.find(v));
+            }
+        } else {
+            t.insert_equal(v);
+            expected.insert(v);
+        }
+        if (round % 1000 == 0) {
+            ASSERT_TRUE(t.__rb_verify());
+        }
+    }
+    ASSERT_TRUE(t.__rb_verify());
+    ASSERT_EQ(expected.size(), t.size());
+
+    size_t n = 0;
+    for (std::multiset<int>::const_iterator it = expected.begin();
+         it != expected.end(); ++it, ++n) {
+        ASSERT_EQ(*it, *t.select(n));
+        ASSERT_EQ(n, t.rank(t.select(n)));
+    }
+    EXPECT_TRUE(t.select(n) == t.end());
+    EXPECT_EQ(n, t.rank(t.end()));
+    for (int k = -1; k <= 500; ++k) {
+        ASSERT_EQ(size_t(std::distance(expected.begin(),
+                                       expected.lower_bound(k))),
+                  t.rank(k));
+        ASSERT_EQ(expected.count(k), t.count(k));
+    }
+
+    // copies, bulk builds and moved nodes keep their sizes
+    Tree copy(t);
+    EXPECT_TRUE(copy.__rb_verify());
+    EXPECT_EQ(*t.select(100), *copy.select(100));
+    Tree sorted;
+    sorted.insert_equal_sorted(expected.begin(), expected.end());
+    EXPECT_TRUE(sorted.__rb_verify());
+    EXPECT_EQ(*t.select(200), *sorted.select(200));
+    sorted.merge_equal(copy);
+    EXPECT_TRUE(sorted.__rb_verify());
+    EXPECT_EQ(2 * t.size(), sorted.size());
+    EXPECT_EQ(2 * t.count(7), sorted.count(7));
+
+    set<int, std::less<int>, alloc, ranked_rb_tree> s;
+    for (int i = 0; i < 100; ++i) {
+        s.insert(i * 10);
+    }
+    EXPECT_EQ(50, s.rank(500));
+    EXPECT_EQ(51, s.rank(501));
+    EXPECT_EQ(990, *s.select(99));
+    EXPECT_EQ(10, s.rank(s.find(100)));
+    multimap<int, std::string, std::less<int>, alloc, ranked_rb_tree> mm;
+    for (int i = 0; i < 1000; ++i) {
+        mm.insert(pair<const int, std::string>(i % 10, "x"));
+    }
+    EXPECT_EQ(100, mm.count(3));
+    EXPECT_EQ(300, mm.rank(3));
+    EXPECT_EQ(9, mm.select(999)->first);
+}
+
+template <typename Tree>
+static void check_split_and_join() {
+    const int sizes[] = { 0, 1, 2, 3, 10, 100, 1000 };
+    for (int s = 0; s < 7; ++s) {
+        const int n = sizes[s];
+        for (int k = -1; k <= 2 * n + 1; k += n / 4 + 1) {
+            Tree t, r;
+            for (int i = 0; i < n; ++i) {
+                t.insert_equal(2 * i);
+            }
+            r.insert_equal(-5);
+            t.split(k, r);
+            ASSERT_TRUE(t.__rb_verify());
+            ASSERT_TRUE(r.__rb_verify());
+            const int below = k <= 0 ? 0 : std::min(n, (k + 1) / 2);
+            ASSERT_EQ(size_t(below), t.size());
+            ASSERT_EQ(size_t(n - below), r.size());
+            if (!t.empty()) {
+                EXPECT_EQ(0, *t.begin());
+                EXPECT_EQ(2 * (below - 1), *--t.end());
+            }
+            if (!r.empty()) {
+                EXPECT_EQ(2 * below, *r.begin());
+                EXPECT_EQ(2 * (n - 1), *--r.end());
+            }
+            t.join_equal(r);
+            ASSERT_TRUE(t.__rb_verify());
+            ASSERT_EQ(size_t(n), t.size());
+            EXPECT_TRUE(r.empty());
+            int expected = 0;
+            for (typename Tree::iterator it = t.begin(); it != t.end(); ++it) {
+                ASSERT_EQ(expected, *it);
+                expected += 2;
+            }
+        }
+    }
+
+    // every copy of the key goes right, and joins of uneven heights
+    Tree t, r;
+    for (int i = 0; i < 300; ++i) {
+        t.insert_equal(i % 30);
+    }
+    t.split(12, r);
+    EXPECT_EQ(120, t.size());
+    EXPECT_EQ(180, r.size());
+    EXPECT_EQ(12, *r.begin());
+    for (int i = 0; i < 5; ++i) {
+        Tree small;
+        small.insert_equal(100 + i);
+        r.join_equal(small);
+        ASSERT_TRUE(r.__rb_verify());
+        small.insert_equal(-1 - i);
+        small.join_equal(t);
+        ASSERT_TRUE(small.__rb_verify());
+        t.swap(small);
+    }
+    EXPECT_EQ(125, t.size());
+    EXPECT_EQ(-5, *t.begin());
+    EXPECT_EQ(185, r.size());
+    EXPECT_EQ(104, *--r.end());
+
+    // out of order, join falls back on merge
+    Tree u, v;
+    for (int i = 0; i < 10; ++i) {
+        u.insert_unique(i);
+        v.insert_unique(i + 5);
+    }
+    u.join_unique(v);
+    EXPECT_TRUE(u.__rb_verify());
+    EXPECT_EQ(15, u.size());
+    EXPECT_EQ(5, v.size());
+}
+
+TEST(RBTreeTest, SplitAndJoin) {
+    check_split_and_join<rb_tree<int, int, identity<int>, std::less<int> > >();
+    check_split_and_join<ranked_rb_tree<int, int, identity<int>,
+                                        std::less<int> > >();
+
+    // between allocators that cannot share nodes, values move instead
+    typedef rb_tree<int, int, identity<int>, std::less<int>,
+                    stateful_alloc> Tree;
+    test_pool p1, p2;
+    {
+        const std::less<int> less;
+        Tree t1(less, stateful_alloc(&p1));
+        Tree t2(less, stateful_alloc(&p2));
+        for (int i = 0; i < 100; ++i) {
+            t1.insert_unique(i);
+        }
+        t1.split(60, t2);
+        EXPECT_EQ(60, t1.size());
+        EXPECT_EQ(40, t2.size());
+        EXPECT_EQ(40, p2.allocations);
+        t1.join_unique(t2);
+        EXPECT_EQ(100, t1.size());
+        EXPECT_TRUE(t2.empty());
+        EXPECT_TRUE(t1.__rb_verify());
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+
+    // dropping a time window's old entries
+    map<int, std::string> events;
+    for (int time = 0; time < 1000; ++time) {
+        events[time] = "event";
+    }
+    map<int, std::string> recent;
+    events.split(900, recent);
+    events.swap(recent);
+    EXPECT_EQ(100, events.size());
+    EXPECT_EQ(900, events.begin()->first);
+    EXPECT_EQ(900, recent.size());
+    multiset<int> ms, tail;
+    for (int i = 0; i < 100; ++i) {
+        ms.insert(i % 10);
+    }
+    ms.split(5, tail);
+    EXPECT_EQ(50, tail.size());
+    EXPECT_EQ(10, tail.count(5));
+    ms.join(tail);
+    EXPECT_EQ(100, ms.size());
+}
+
+template <typename Tree>
+static void check_set_algebra(unsigned threads) {
+    test_pool pool;
+    {
+        const std::less<int> less;
+        std::set<int> a, b;
+        unsigned x = 2463534242u;
+        for (int i = 0; i < 60000; ++i) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            a.insert(int(x % 100000));
+            b.insert(int(x / 7 % 100000));
+        }
+        b.insert(a.begin(), a.end());
+        for (int i = 0; i < 20000; ++i) {
+            a.erase(i * 5);
+        }
+        std::vector<int> expected[3];
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                       std::back_inserter(expected[0]));
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                              std::back_inserter(expected[1]));
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                            std::back_inserter(expected[2]));
+        for (int op = 0; op < 3; ++op) {
+            Tree t(less, stateful_alloc(&pool));
+            Tree u(less, stateful_alloc(&pool));
+            t.insert_unique(a.begin(), a.end());
+            u.insert_unique(b.begin(), b.end());
+            const size_t node_bytes = pool.bytes_in_use / (t.size() + u.size());
+            if (op == 0) {
+                t.unite(u, threads);
+            } else if (op == 1) {
+                t.intersect(u, threads);
+            } else {
+                t.subtract(u, threads);
+            }
+            ASSERT_TRUE(t.__rb_verify());
+            ASSERT_TRUE(u.empty());
+            ASSERT_EQ(expected[op].size(), t.size());
+            ASSERT_TRUE(std::equal(t.begin(), t.end(), expected[op].begin()));
+            EXPECT_EQ(t.size() * node_bytes, pool.bytes_in_use);
+        }
+        EXPECT_EQ(0, pool.bytes_in_use);
+    }
+}
+
+TEST(RBTreeTest, SetAlgebra) {
+    typedef rb_tree<int, int, identity<int>, std::less<int>,
+                    stateful_alloc> Tree;
+    typedef rb_tree<int, int, identity<int>, std::less<int>,
+                    stateful_alloc, true> RankedTree;
+    check_set_algebra<Tree>(1);
+    check_set_algebra<Tree>(4);
+    check_set_algebra<RankedTree>(1);
+    check_set_algebra<RankedTree>(3);
+
+    // small cases, and this tree's elements win
+    map<int, int> m1, m2;
+    for (int i = 0; i < 10; ++i) {
+        m1[i] = 1;
+        m2[i + 5] = 2;
+    }
+    map<int, int> c1(m1), c2(m2);
+    c1.unite(c2);
+    EXPECT_EQ(15, c1.size());
+    EXPECT_EQ(1, c1[7]);
+    EXPECT_EQ(2, c1[14]);
+    c1 = m1;
+    c2 = m2;
+    c1.intersect(c2);
+    EXPECT_EQ(5, c1.size());
+    EXPECT_EQ(1, c1.begin()->second);
+    c1 = m1;
+    c2 = m2;
+    c1.subtract(c2);
+    EXPECT_EQ(5, c1.size());
+    EXPECT_EQ(4, (--c1.end())->first);
+    c2 = m2;
+    c1.unite(c1);
+    EXPECT_EQ(5, c1.size());
+    c1.subtract(c1);
+    EXPECT_TRUE(c1.empty());
+    c1.intersect(c2);
+    EXPECT_TRUE(c1.empty());
+    EXPECT_TRUE(c2.empty());
+
+    set<int> s1, s2;
+    for (int i = 0; i < 100; ++i) {
+        s1.insert(i * 2);
+        s2.insert(i * 3);
+    }
+    s1.unite(s2);
+    EXPECT_EQ(166, s1.size());
+    EXPECT_TRUE(s2.empty());
+}
 
 } // namespace forgedstl
\ No newline at end of file
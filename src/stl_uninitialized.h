@@ -7,6 +7,8 @@
 
 #include <algorithm>
 #include <iterator>
+#include <type_traits>
+#include <utility>
 
 namespace forgedstl {
 
@@ -28,7 +30,7 @@ __uninitialized_fill_n_aux(ForwardIterator first, Size n,
         }
         return cur;
     } catch (...) {
-        destroy(first, cur);
+        forgedstl::destroy(first, cur);
         throw;
     }
 }
@@ -64,7 +66,7 @@ __uninitialized_copy_aux(InputIterator first, InputIterator last,
         }
         return cur;
     } catch (...) {
-        destroy(result, cur);
+        forgedstl::destroy(result, cur);
         throw;
     }
 }
@@ -94,6 +96,78 @@ inline wchar_t* uninitialized_copy(const wchar_t* first, const wchar_t* last,
     return result + (last - first);
 }
 
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+__uninitialized_move_aux(InputIterator first, InputIterator last,
+                         ForwardIterator result, __true_type) {
+    return std::copy(first, last, result);
+}
+
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+__uninitialized_move_aux(InputIterator first, InputIterator last,
+                         ForwardIterator result, __false_type) {
+    ForwardIterator cur = result;
+    try {
+        for (; first != last; ++first, ++cur) {
+            construct(&*cur, std::move(*first));
+        }
+        return cur;
+    } catch (...) {
+        forgedstl::destroy(result, cur);
+        throw;
+    }
+}
+
+template <typename InputIterator, typename ForwardIterator, typename T>
+inline ForwardIterator
+__uninitialized_move(InputIterator first, InputIterator last,
+                     ForwardIterator result, T*) {
+    typedef typename __type_traits<T>::is_POD_type is_POD;
+    return __uninitialized_move_aux(first, last, result, is_POD());
+}
+
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+uninitialized_move(InputIterator first, InputIterator last, ForwardIterator result) {
+    return __uninitialized_move(first, last, result, value_type(result));
+}
+
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+__uninitialized_move_if_noexcept_aux(InputIterator first, InputIterator last,
+                                     ForwardIterator result, __true_type) {
+    return forgedstl::uninitialized_move(first, last, result);
+}
+
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+__uninitialized_move_if_noexcept_aux(InputIterator first, InputIterator last,
+                                     ForwardIterator result, __false_type) {
+    return forgedstl::uninitialized_copy(first, last, result);
+}
+
+template <typename InputIterator, typename ForwardIterator, typename T>
+inline ForwardIterator
+__uninitialized_move_if_noexcept(InputIterator first, InputIterator last,
+                                 ForwardIterator result, T*) {
+    typedef typename __bool_type<std::is_nothrow_move_constructible<T>::value ||
+                                 !std::is_copy_constructible<T>::value>::type
+        use_move;
+    return __uninitialized_move_if_noexcept_aux(first, last, result, use_move());
+}
+
+// Relocation into fresh storage. Elements are moved when that cannot throw
+// (or when they cannot be copied at all) and copied otherwise, so a failed
+// reallocation leaves the source range intact.
+template <typename InputIterator, typename ForwardIterator>
+inline ForwardIterator
+uninitialized_move_if_noexcept(InputIterator first, InputIterator last,
+                               ForwardIterator result) {
+    return __uninitialized_move_if_noexcept(first, last, result,
+                                            value_type(result));
+}
+
 template <typename ForwardIterator, typename T>
 inline void
 __uninitialized_fill_aux(ForwardIterator first, ForwardIterator last,
@@ -111,7 +185,7 @@ __uninitialized_fill_aux(ForwardIterator first, ForwardIterator last,
             construct(&*cur, x);
         }
     } catch (...) {
-        destroy(first, cur);
+        forgedstl::destroy(first, cur);
         throw;
     }
 }
@@ -133,11 +207,11 @@ template <typename ForwardIterator, typename T, typename InputIterator>
 inline ForwardIterator
 __uninitialized_fill_copy(ForwardIterator result, ForwardIterator mid, const T& x,
                           InputIterator first, InputIterator last) {
-    uninitialized_fill(result, mid, x);
+    forgedstl::uninitialized_fill(result, mid, x);
     try {
-        return uninitialized_copy(first, last, mid);
+        return forgedstl::uninitialized_copy(first, last, mid);
     } catch (...) {
-        destroy(result, mid);
+        forgedstl::destroy(result, mid);
         throw;
     }
 }
@@ -146,11 +220,11 @@ template <typename InputIterator, typename ForwardIterator, typename T>
 inline void __uninitialized_copy_fill(InputIterator first1, InputIterator last1,
                                       ForwardIterator first2, ForwardIterator last2,
                                       const T& x) {
-    ForwardIterator mid2 = uninitialized_copy(first1, last1, first2);
+    ForwardIterator mid2 = forgedstl::uninitialized_copy(first1, last1, first2);
     try {
-        uninitialized_fill(mid2, last2, x);
+        forgedstl::uninitialized_fill(mid2, last2, x);
     } catch (...) {
-        destroy(first2, mid2);
+        forgedstl::destroy(first2, mid2);
         throw;
     }
 }
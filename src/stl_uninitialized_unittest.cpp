@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <string>
+#include <type_traits>
 
 #include "stl_uninitialized.h"
 
@@ -85,4 +87,38 @@ REGISTER_TYPED_TEST_CASE_P(UninitializedFillTest, All);
 
 INSTANTIATE_TYPED_TEST_CASE_P(UninitlializedFill, UninitializedFillTest, types);
 
+struct Record {
+    int id;
+    double value;
+    char tag[8];
+};
+
+TEST(TypeTraitsTest, DerivedFromCompiler) {
+    EXPECT_TRUE((std::is_same<__true_type,
+                 __type_traits<Record>::is_POD_type>::value));
+    EXPECT_TRUE((std::is_same<__true_type,
+                 __type_traits<Record>::has_trivial_destructor>::value));
+    EXPECT_TRUE((std::is_same<__true_type,
+                 __type_traits<int*>::is_POD_type>::value));
+    // a user constructor does not stop copies from being bitwise
+    EXPECT_TRUE((std::is_same<__true_type,
+                 __type_traits<Temp>::is_POD_type>::value));
+    EXPECT_TRUE((std::is_same<__false_type,
+                 __type_traits<Temp>::has_trivial_default_constructor>::value));
+    EXPECT_TRUE((std::is_same<__false_type,
+                 __type_traits<std::string>::is_POD_type>::value));
+    EXPECT_TRUE((std::is_same<__false_type,
+                 __type_traits<std::string>::has_trivial_destructor>::value));
+
+    Record ra[3] = { { 1, 1.5, "a" }, { 2, 2.5, "b" }, { 3, 3.5, "c" } };
+    Record* p = (Record*)malloc(3 * sizeof(Record));
+    uninitialized_copy(ra, ra + 3, p);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(i + 1, p[i].id);
+        EXPECT_EQ(ra[i].value, p[i].value);
+        EXPECT_STREQ(ra[i].tag, p[i].tag);
+    }
+    free(p);
+}
+
 } // namespace forgedstl
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef FORGED_STL_INTERNAL_VECTOR_H_
 #define FORGED_STL_INTERNAL_VECTOR_H_
 
+#include <cstring>
+
 #include "stl_alloc.h"
 #include "stl_construct.h"
 #include "stl_iterator.h"
@@ -8,8 +10,45 @@
 
 namespace forgedstl {
 
-template <typename T, typename Alloc = alloc>
-class vector {
+// Growth policies for vector, picked by its third template parameter.
+// next_capacity(size, n, elem_size) is asked for the new capacity when a
+// full vector of size elements needs room for n more; the answer must be
+// at least size + n.
+
+// Doubles the capacity: the fewest reallocations, at up to twice the
+// memory actually used.
+struct __vector_growth_double {
+    static size_t next_capacity(size_t size, size_t n, size_t) {
+        return size + std::max(size, n);
+    }
+};
+
+// Grows by half. Less slack, and the blocks freed by earlier steps soon add
+// up to more than the next request, so the allocator can reuse them.
+struct __vector_growth_half {
+    static size_t next_capacity(size_t size, size_t n, size_t) {
+        return size + std::max(size / 2, n);
+    }
+};
+
+// Doubles until the buffer reaches ThresholdBytes, then grows by StepBytes
+// at a time, so a very large vector never asks for twice its size to fit
+// one more element.
+template <size_t ThresholdBytes = 64 * 1024 * 1024,
+          size_t StepBytes = 16 * 1024 * 1024>
+struct __vector_growth_capped {
+    static_assert(StepBytes > 0, "StepBytes must be positive");
+
+    static size_t next_capacity(size_t size, size_t n, size_t elem_size) {
+        const size_t step = size * elem_size < ThresholdBytes ?
+            size : StepBytes / elem_size;
+        return size + std::max(step, n);
+    }
+};
+
+template <typename T, typename Alloc = alloc,
+          typename GrowthPolicy = __vector_growth_double>
+class vector : protected __alloc_holder<Alloc> {
 public:
     typedef T value_type;
     typedef value_type* pointer;
@@ -20,6 +59,7 @@ public:
     typedef const value_type& const_reference;
     typedef size_t size_type;
     typedef ptrdiff_t difference_type;
+    typedef Alloc allocator_type;
 
     typedef reverse_iterator<const_iterator> const_reverse_iterator;
     typedef reverse_iterator<iterator> reverse_iterator;
@@ -68,50 +108,82 @@ public:
         return *(begin() + n);
     }
 
+    allocator_type get_allocator() const {
+        return this->get_alloc();
+    }
+
     // constructor
     vector() : start(nullptr), finish(nullptr), end_of_storage(nullptr) { }
-    vector(size_type n, const T& value) {
+    explicit vector(const allocator_type& a) : base(a),
+        start(nullptr), finish(nullptr), end_of_storage(nullptr) { }
+    vector(size_type n, const T& value,
+           const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    vector(int n, const T& value) {
+    vector(int n, const T& value,
+           const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    vector(long n, const T& value) {
+    vector(long n, const T& value,
+           const allocator_type& a = allocator_type()) : base(a) {
         fill_initialize(n, value);
     }
-    explicit vector(size_type n) {
+    explicit vector(size_type n, const allocator_type& a = allocator_type())
+        : base(a) {
         fill_initialize(n, T());
     }
 
-    vector(const vector<T, Alloc>& x) {
+    vector(const vector<T, Alloc, GrowthPolicy>& x) : base(x.get_alloc()) {
         start = allocate_and_copy(x.end() - x.begin(), x.begin(), x.end());
         finish = start + (x.end() - x.begin());
         end_of_storage = finish;
     }
 
+    vector(vector<T, Alloc, GrowthPolicy>&& x) noexcept : base(x.get_alloc()),
+        start(x.start), finish(x.finish), end_of_storage(x.end_of_storage) {
+        x.start = x.finish = x.end_of_storage = nullptr;
+    }
+
     template <typename InputIterator>
-    vector(InputIterator first, InputIterator last) :
+    vector(InputIterator first, InputIterator last,
+           const allocator_type& a = allocator_type()) : base(a),
         start(nullptr), finish(nullptr), end_of_storage(nullptr) {
         range_initialize(first, last, iterator_category(first));
     }
     ~vector() {
-        destroy(start, finish);
+        forgedstl::destroy(start, finish);
         deallocate();
     }
 
-    vector<T, Alloc>& operator=(const vector<T, Alloc>& x);
+    vector& operator=(const vector& x);
+    vector& operator=(vector&& x)
+        noexcept(__alloc_traits<Alloc>::propagate_on_move_assignment) {
+        if (this != &x) {
+            forgedstl::destroy(start, finish);
+            deallocate();
+            start = finish = end_of_storage = nullptr;
+            move_assign(x, typename __bool_type<
+                __alloc_traits<Alloc>::propagate_on_move_assignment>::type());
+        }
+        return *this;
+    }
 
     void reserve(size_type n) {
         if (capacity() < n) {
-            const size_type old_size = size();
-            iterator tmp = allocate_and_copy(n, start, finish);
-            destroy(start, finish);
-            deallocate();
-            start = tmp;
-            finish = start + old_size;
-            end_of_storage = start + n;
+            set_capacity(n);
+        }
+    }
+    // A hint from a caller that knows the final size: the capacity becomes
+    // exactly max(n, size()), giving back memory if it was larger.
+    void reserve_exact(size_type n) {
+        n = std::max(n, size());
+        if (capacity() != n) {
+            set_capacity(n);
         }
     }
+    void shrink_to_fit() {
+        reserve_exact(size());
+    }
 
     reference front() {
         return *begin();
@@ -128,32 +200,63 @@ public:
 
     void push_back(const T& x) {
         if (finish != end_of_storage) {
-            construct(finish, x);
+            forgedstl::construct(finish, x);
             ++finish;
         } else {
             insert_aux(end(), x);
         }
     }
+    void push_back(T&& x) {
+        emplace_back(std::move(x));
+    }
 
-    void swap(vector<T, Alloc>& x) { // todo
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        if (finish != end_of_storage) {
+            forgedstl::construct(finish, std::forward<Args>(args)...);
+            ++finish;
+        } else {
+            insert_aux(end(), std::forward<Args>(args)...);
+        }
+    }
+
+    void swap(vector<T, Alloc, GrowthPolicy>& x) {
         std::swap(start, x.start);
         std::swap(finish, x.finish);
         std::swap(end_of_storage, x.end_of_storage);
+        if (__alloc_traits<Alloc>::propagate_on_swap) {
+            std::swap(this->get_alloc(), x.get_alloc());
+        }
     }
 
     iterator insert(iterator position, const T& x) {
         size_type n = position - begin();
         if (finish != end_of_storage && position == end()) {
-            construct(finish, x);
+            forgedstl::construct(finish, x);
             ++finish;
         } else {
             insert_aux(position, x);
         }
         return begin() + n;
     }
+    iterator insert(iterator position, T&& x) {
+        return emplace(position, std::move(x));
+    }
     iterator insert(iterator position) {
         return insert(position, T());
     }
+
+    template <typename... Args>
+    iterator emplace(iterator position, Args&&... args) {
+        size_type n = position - begin();
+        if (finish != end_of_storage && position == end()) {
+            forgedstl::construct(finish, std::forward<Args>(args)...);
+            ++finish;
+        } else {
+            insert_aux(position, std::forward<Args>(args)...);
+        }
+        return begin() + n;
+    }
     template <typename InputIterator>
     void insert(iterator position, InputIterator first, InputIterator last) {
         range_insert(position, first, last, iterator_category(first));
@@ -168,20 +271,20 @@ public:
 
     void pop_back() {
         --finish;
-        destroy(finish);
+        forgedstl::destroy(finish);
     }
 
     iterator erase(iterator position) {
         if (position + 1 != end()) {
-            std::copy(position + 1, finish, position);
+            std::move(position + 1, finish, position);
         }
         --finish;
-        destroy(finish);
+        forgedstl::destroy(finish);
         return position;
     }
     iterator erase(iterator first, iterator last) {
-        iterator i = std::copy(last, finish, first);
-        destroy(i, finish);
+        iterator i = std::move(last, finish, first);
+        forgedstl::destroy(i, finish);
         finish = finish - (last - first);
         return first;
     }
@@ -202,19 +305,123 @@ public:
     }
 
 protected:
+    typedef __alloc_holder<Alloc> base;
     typedef simple_alloc<value_type, Alloc> data_allocator;
     iterator start;
     iterator finish;
     iterator end_of_storage;
 
-    void insert_aux(iterator position, const T& x);
+    template <typename... Args>
+    void insert_aux(iterator position, Args&&... args);
+
+    // Both move_assign overloads expect this vector to own no storage.
+    void move_assign(vector<T, Alloc, GrowthPolicy>& x, __true_type) {
+        this->get_alloc() = x.get_alloc();
+        std::swap(start, x.start);
+        std::swap(finish, x.finish);
+        std::swap(end_of_storage, x.end_of_storage);
+    }
+    void move_assign(vector<T, Alloc, GrowthPolicy>& x, __false_type) {
+        if (__alloc_equal(this->get_alloc(), x.get_alloc())) {
+            move_assign(x, __true_type());
+        } else {
+            // x's buffer cannot change hands, only its elements can
+            start = allocate_and_relocate(x.size(), x.start, x.finish);
+            finish = end_of_storage = start + x.size();
+            x.clear();
+        }
+    }
 
     void deallocate() {
         if (start != nullptr) {
-            data_allocator::deallocate(start, end_of_storage - start);
+            data_allocator::deallocate(this->get_alloc(), start,
+                                      end_of_storage - start);
         }
     }
 
+    size_type next_capacity(size_type n) const {
+        return GrowthPolicy::next_capacity(size(), n, sizeof(T));
+    }
+    // Moves the elements into a buffer of exactly n >= size() slots.
+    void set_capacity(size_type n) {
+        if (n == 0) {
+            deallocate();
+            start = finish = end_of_storage = nullptr;
+        } else if (trivially_relocatable) {
+            relocate_storage(n, finish, 0);
+        } else {
+            const size_type old_size = size();
+            iterator tmp = allocate_and_relocate(n, start, finish);
+            forgedstl::destroy(start, finish);
+            deallocate();
+            start = tmp;
+            finish = start + old_size;
+            end_of_storage = start + n;
+        }
+    }
+
+    enum {
+        trivially_relocatable = std::is_same<
+            typename __relocate_traits<T>::is_trivially_relocatable,
+            __true_type>::value
+    };
+
+    // Moves the elements into a buffer of len elements, leaving n raw
+    // slots at position, and returns the first slot; finish already
+    // counts them. Only for trivially relocatable T: the bytes are moved
+    // and the old buffer is released without running destructors.
+    iterator relocate_storage(size_type len, iterator position, size_type n) {
+        const size_type elems_before = position - start;
+        const size_type elems_after = finish - position;
+        if (start == nullptr) {
+            start = data_allocator::allocate(this->get_alloc(), len);
+        } else {
+            start = relocate_buffer(len, elems_before, elems_after, n,
+                                    typename __bool_type<
+                                        __alloc_has_reallocate<Alloc>::value
+                                    >::type());
+        }
+        finish = start + elems_before + n + elems_after;
+        end_of_storage = start + len;
+        return start + elems_before;
+    }
+    // reallocate can extend a large buffer in place, so only the tail
+    // after position may need to move.
+    iterator relocate_buffer(size_type len, size_type elems_before,
+                             size_type elems_after, size_type n,
+                             __true_type) {
+        iterator new_start = data_allocator::reallocate(
+            this->get_alloc(), start, end_of_storage - start, len);
+        memmove((void*)(new_start + elems_before + n),
+                (void*)(new_start + elems_before), elems_after * sizeof(T));
+        return new_start;
+    }
+    iterator relocate_buffer(size_type len, size_type elems_before,
+                             size_type elems_after, size_type n,
+                             __false_type) {
+        iterator new_start = data_allocator::allocate(this->get_alloc(), len);
+        memcpy((void*)new_start, (void*)start, elems_before * sizeof(T));
+        memcpy((void*)(new_start + elems_before + n),
+               (void*)(start + elems_before), elems_after * sizeof(T));
+        deallocate();
+        return new_start;
+    }
+    // Shifts [position, finish) up by n within the current capacity,
+    // leaving n raw slots at position.
+    iterator open_gap(iterator position, size_type n) {
+        memmove((void*)(position + n), (void*)position,
+                (finish - position) * sizeof(T));
+        finish += n;
+        return position;
+    }
+    // Takes back the slots opened by open_gap or relocate_storage when
+    // filling them failed.
+    void close_gap(iterator gap, size_type n) {
+        memmove((void*)gap, (void*)(gap + n),
+                (finish - (gap + n)) * sizeof(T));
+        finish -= n;
+    }
+
     void fill_initialize(size_type n, const T& value) {
         start = allocate_and_fill(n, value);
         finish = start + n;
@@ -222,12 +429,12 @@ protected:
     }
 
     iterator allocate_and_fill(size_type n, const T& value) {
-        iterator result = data_allocator::allocate(n);
+        iterator result = data_allocator::allocate(this->get_alloc(), n);
         try {
-            uninitialized_fill_n(result, n, value);
+            forgedstl::uninitialized_fill_n(result, n, value);
             return result;
         } catch(...) {
-            data_allocator::deallocate(result, n);
+            data_allocator::deallocate(this->get_alloc(), result, n);
             throw;
         }
     }
@@ -235,12 +442,25 @@ protected:
     template <typename InputIterator>
     iterator allocate_and_copy(size_type n,
                                InputIterator first, InputIterator last) {
-        iterator result = data_allocator::allocate(n);
+        iterator result = data_allocator::allocate(this->get_alloc(), n);
+        try {
+            forgedstl::uninitialized_copy(first, last, result);
+            return result;
+        } catch (...) {
+            data_allocator::deallocate(this->get_alloc(), result, n);
+            throw;
+        }
+    }
+
+    template <typename InputIterator>
+    iterator allocate_and_relocate(size_type n,
+                                   InputIterator first, InputIterator last) {
+        iterator result = data_allocator::allocate(this->get_alloc(), n);
         try {
-            uninitialized_copy(first, last, result);
+            forgedstl::uninitialized_move_if_noexcept(first, last, result);
             return result;
         } catch (...) {
-            data_allocator::deallocate(result, n);
+            data_allocator::deallocate(this->get_alloc(), result, n);
             throw;
         }
     }
@@ -275,67 +495,111 @@ protected:
 
 };
 
-template <typename T, typename Alloc>
-inline bool operator==(const vector<T, Alloc>& x, const vector<T, Alloc>& y) {
+template <typename T, typename Alloc, typename GrowthPolicy>
+inline bool operator==(const vector<T, Alloc, GrowthPolicy>& x,
+                       const vector<T, Alloc, GrowthPolicy>& y) {
     return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin());
 }
 
-template <typename T, typename Alloc>
-inline bool operator<(const vector<T, Alloc>& x, const vector<T, Alloc>& y) {
+template <typename T, typename Alloc, typename GrowthPolicy>
+inline bool operator<(const vector<T, Alloc, GrowthPolicy>& x,
+                      const vector<T, Alloc, GrowthPolicy>& y) {
     return std::lexicographical_compare(x.begin(), x.end(), y.begin(), y.end());
 }
 
-template <typename T, typename Alloc>
-inline void swap(vector<T, Alloc>& x, vector<T, Alloc>& y) {
+template <typename T, typename Alloc, typename GrowthPolicy>
+inline void swap(vector<T, Alloc, GrowthPolicy>& x,
+                 vector<T, Alloc, GrowthPolicy>& y) {
     x.swap(y);
 }
 
-template <typename T, typename Alloc>
-vector<T, Alloc>& vector<T, Alloc>::operator=(const vector<T, Alloc>& x) {
+template <typename T, typename Alloc, typename GrowthPolicy>
+vector<T, Alloc, GrowthPolicy>&
+vector<T, Alloc, GrowthPolicy>::operator=(const vector& x) {
     if (this != &x) {
+        if (__alloc_traits<Alloc>::propagate_on_copy_assignment) {
+            if (!__alloc_equal(this->get_alloc(), x.get_alloc())) {
+                // our storage belongs to the allocator being replaced
+                forgedstl::destroy(start, finish);
+                deallocate();
+                start = finish = end_of_storage = nullptr;
+            }
+            this->get_alloc() = x.get_alloc();
+        }
         if (x.size() > capacity()) {
             iterator tmp = allocate_and_copy(x.end() - x.begin(),
                                              x.begin(), x.end());
-            destroy(start, finish);
+            forgedstl::destroy(start, finish);
             deallocate();
             start = tmp;
             end_of_storage = start + (x.end() - x.begin());
         } else if (size() > x.size()) {
             iterator i = std::copy(x.begin(), x.end(), begin());
-            destroy(i, end());
+            forgedstl::destroy(i, end());
         } else {
             std::copy(x.begin(), x.begin() + size(), begin());
-            uninitialized_copy(x.begin() + size(), x.end(), end());
+            forgedstl::uninitialized_copy(x.begin() + size(), x.end(), end());
         }
         finish = start + x.size();
     }
     return *this;
 }
 
-template <typename T, typename Alloc>
-void vector<T, Alloc>::insert_aux(iterator position, const T& x) {
-    if (finish != end_of_storage) {
-        construct(finish, *(finish - 1));
+template <typename T, typename Alloc, typename GrowthPolicy>
+template <typename... Args>
+void vector<T, Alloc, GrowthPolicy>::insert_aux(iterator position,
+                                                Args&&... args) {
+    if (trivially_relocatable) {
+        // args may refer to an element that is about to move, so the new
+        // element is built aside and then relocated into its slot
+        alignas(T) unsigned char buf[sizeof(T)];
+        T* tmp = (T*)buf;
+        forgedstl::construct(tmp, std::forward<Args>(args)...);
+        iterator gap;
+        if (finish != end_of_storage) {
+            gap = open_gap(position, 1);
+        } else {
+            const size_type len = next_capacity(1);
+            try {
+                gap = relocate_storage(len, position, 1);
+            } catch (...) {
+                forgedstl::destroy(tmp);
+                throw;
+            }
+        }
+        memcpy((void*)gap, buf, sizeof(T));
+    } else if (finish != end_of_storage) {
+        // args may refer to an element that is about to be shifted
+        T x_copy(std::forward<Args>(args)...);
+        forgedstl::construct(finish, std::move(*(finish - 1)));
         ++finish;
-        T x_copy = x;
-        std::copy_backward(position, finish - 2, finish - 1);
-        *position = x_copy;
+        std::move_backward(position, finish - 2, finish - 1);
+        *position = std::move(x_copy);
     } else {
-        const size_type old_size = size();
-        const size_type len = old_size != 0 ? 2 * old_size : 1;
-        iterator new_start = data_allocator::allocate(len);
-        iterator new_finish = new_start;
+        const size_type len = next_capacity(1);
+        const size_type elems_before = position - start;
+        iterator new_start =
+            data_allocator::allocate(this->get_alloc(), len);
+        iterator new_finish = nullptr;
         try {
-            new_finish = uninitialized_copy(start, position, new_start);
-            construct(new_finish, x);
+            // the new element goes first, while args are still valid
+            forgedstl::construct(new_start + elems_before,
+                                 std::forward<Args>(args)...);
+            new_finish = forgedstl::uninitialized_move_if_noexcept(
+                start, position, new_start);
             ++new_finish;
-            new_finish = uninitialized_copy(position, finish, new_finish);
+            new_finish = forgedstl::uninitialized_move_if_noexcept(
+                position, finish, new_finish);
         } catch (...) {
-            destroy(new_start, new_finish);
-            data_allocator::deallocate(new_start, len);
+            if (new_finish == nullptr) {
+                forgedstl::destroy(new_start + elems_before);
+            } else {
+                forgedstl::destroy(new_start, new_finish);
+            }
+            data_allocator::deallocate(this->get_alloc(), new_start, len);
             throw;
         }
-        destroy(begin(), end());
+        forgedstl::destroy(begin(), end());
         deallocate();
         start = new_start;
         finish = new_finish;
@@ -343,40 +607,57 @@ void vector<T, Alloc>::insert_aux(iterator position, const T& x) {
     }
 }
 
-template <typename T, typename Alloc>
-void vector<T, Alloc>::insert(iterator position, size_type n, const T& x) {
+template <typename T, typename Alloc, typename GrowthPolicy>
+void vector<T, Alloc, GrowthPolicy>::insert(iterator position, size_type n,
+                                            const T& x) {
     if (n != 0) {
-        if (size_type(end_of_storage - finish) >= n) {
+        if (trivially_relocatable) {
+            T x_copy = x;
+            iterator gap = size_type(end_of_storage - finish) >= n ?
+                open_gap(position, n) :
+                relocate_storage(next_capacity(n), position, n);
+            try {
+                forgedstl::uninitialized_fill_n(gap, n, x_copy);
+            } catch (...) {
+                close_gap(gap, n);
+                throw;
+            }
+        } else if (size_type(end_of_storage - finish) >= n) {
             T x_copy = x;
             const size_type elems_after = finish - position;
             iterator old_finish = finish;
             if (elems_after > n) {
-                uninitialized_copy(finish - n, finish, finish);
+                forgedstl::uninitialized_move(finish - n, finish, finish);
                 finish += n;
-                std::copy_backward(position, old_finish - n, old_finish);
+                std::move_backward(position, old_finish - n, old_finish);
                 std::fill(position, position + n, x_copy);
             } else {
-                uninitialized_fill_n(finish, n - elems_after, x_copy);
+                forgedstl::uninitialized_fill_n(finish, n - elems_after, x_copy);
                 finish += n - elems_after;
-                uninitialized_copy(position, old_finish, finish);
+                forgedstl::uninitialized_move(position, old_finish, finish);
                 finish += elems_after;
                 std::fill(position, old_finish, x_copy);
             }
         } else {
-            const size_type old_size = size();
-            const size_type len = old_size + std::max(old_size, n);
-            iterator new_start = data_allocator::allocate(len);
+            const size_type len = next_capacity(n);
+            // x may be one of the elements about to be moved from
+            T x_copy = x;
+            iterator new_start =
+                data_allocator::allocate(this->get_alloc(), len);
             iterator new_finish = new_start;
             try {
-                new_finish = uninitialized_copy(start, position, new_start);
-                new_finish = uninitialized_fill_n(new_finish, n, x);
-                new_finish = uninitialized_copy(position, finish, new_finish);
+                new_finish = forgedstl::uninitialized_move_if_noexcept(
+                    start, position, new_start);
+                new_finish = forgedstl::uninitialized_fill_n(new_finish, n,
+                                                             x_copy);
+                new_finish = forgedstl::uninitialized_move_if_noexcept(
+                    position, finish, new_finish);
             } catch (...) {
-                destroy(new_start, new_finish);
-                data_allocator::deallocate(new_start, len);
+                forgedstl::destroy(new_start, new_finish);
+                data_allocator::deallocate(this->get_alloc(), new_start, len);
                 throw;
             }
-            destroy(start, finish);
+            forgedstl::destroy(start, finish);
             deallocate();
             start = new_start;
             finish = new_finish;
@@ -385,56 +666,68 @@ void vector<T, Alloc>::insert(iterator position, size_type n, const T& x) {
     }
 }
 
-template <typename T, typename Alloc>
+template <typename T, typename Alloc, typename GrowthPolicy>
 template <typename InputIterator>
-void vector<T, Alloc>::range_insert(iterator position,
-                                    InputIterator first, InputIterator last,
-                                    input_iterator_tag) {
+void vector<T, Alloc, GrowthPolicy>::range_insert(iterator position,
+                                                  InputIterator first, InputIterator last,
+                                                  input_iterator_tag) {
     for (; first != last; ++first) {
         position = insert(position, *first);
         ++position;
     }
 }
 
-template <typename T, typename Alloc>
+template <typename T, typename Alloc, typename GrowthPolicy>
 template <typename ForwardIterator>
-void vector<T, Alloc>::range_insert(iterator position,
-                                    ForwardIterator first, ForwardIterator last,
-                                    forward_iterator_tag) {
+void vector<T, Alloc, GrowthPolicy>::range_insert(iterator position,
+                                                  ForwardIterator first, ForwardIterator last,
+                                                  forward_iterator_tag) {
     if (first != last) {
         size_type n = distance(first, last);
-        if (size_type(end_of_storage - finish) >= n) {
+        if (trivially_relocatable) {
+            iterator gap = size_type(end_of_storage - finish) >= n ?
+                open_gap(position, n) :
+                relocate_storage(next_capacity(n), position, n);
+            try {
+                forgedstl::uninitialized_copy(first, last, gap);
+            } catch (...) {
+                close_gap(gap, n);
+                throw;
+            }
+        } else if (size_type(end_of_storage - finish) >= n) {
             const size_type elems_after = finish - position;
             iterator old_finish = finish;
             if (elems_after > n) {
-                uninitialized_copy(finish - n, finish, finish);
+                forgedstl::uninitialized_move(finish - n, finish, finish);
                 finish += n;
-                std::copy_backward(position, finish - n, old_finish);
+                std::move_backward(position, old_finish - n, old_finish);
                 std::copy(first, last, position);
             } else {
                 ForwardIterator mid = first;
                 advance(mid, elems_after);
-                uninitialized_copy(mid, last, finish);
+                forgedstl::uninitialized_copy(mid, last, finish);
                 finish += n - elems_after;
-                uninitialized_copy(position, old_finish, finish);
+                forgedstl::uninitialized_move(position, old_finish, finish);
                 finish += elems_after;
                 std::copy(first, mid, position);
             }
         } else {
-            const size_type old_size = size();
-            const size_type len = old_size + std::max(old_size, n);
-            iterator new_start = data_allocator::allocate(len);
+            const size_type len = next_capacity(n);
+            iterator new_start =
+                data_allocator::allocate(this->get_alloc(), len);
             iterator new_finish = new_start;
             try {
-                new_finish = uninitialized_copy(start, position, new_start);
-                new_finish = uninitialized_copy(first, last, new_finish);
-                new_finish = uninitialized_copy(position, finish, new_finish);
+                new_finish = forgedstl::uninitialized_move_if_noexcept(
+                    start, position, new_start);
+                new_finish = forgedstl::uninitialized_copy(first, last, new_finish);
+                new_finish = forgedstl::uninitialized_move_if_noexcept(
+                    position, finish, new_finish);
             } catch (...) {
-                destroy(new_start, new_finish);
-                data_allocator::deallocate(new_start, len);
+                forgedstl::destroy(new_start, new_finish);
+                data_allocator::deallocate(this->get_alloc(), new_start, len);
                 throw;
             }
-            destroy(start, finish);
+            forgedstl::destroy(start, finish);
             deallocate();
             start = new_start;
             finish = new_finish;
@@ -445,4 +738,13 @@ void vector<T, Alloc>::range_insert(iterator position,
 
 } // namepsace forgedstl
 
+// A vector holds no pointer into itself, so a vector of vectors grows by
+// memcpy. Allocators with state are left out; they may not be movable
+// bytewise.
+template <typename T, typename Alloc, typename GrowthPolicy>
+struct __relocate_traits<forgedstl::vector<T, Alloc, GrowthPolicy> > {
+    typedef typename __bool_type<std::is_empty<Alloc>::value>::type
+        is_trivially_relocatable;
+};
+
 #endif // FORGED_STL_INTERNAL_VECTOR_H_
@@ -1,6 +1,37 @@
 #include <gtest/gtest.h>
+#include <memory>
+#include <string>
 
 #include "stl_vector.h"
+#include "test_alloc.h"
+
+// Counts the special member calls that relocation is meant to skip.
+struct relocatable_handle {
+    static int moves;
+    static int destroys;
+    int* p;
+    relocatable_handle(int v) : p(new int(v)) { }
+    relocatable_handle(const relocatable_handle& x) : p(new int(*x.p)) { }
+    relocatable_handle(relocatable_handle&& x) : p(x.p) {
+        x.p = nullptr;
+        ++moves;
+    }
+    relocatable_handle& operator=(relocatable_handle x) {
+        std::swap(p, x.p);
+        return *this;
+    }
+    ~relocatable_handle() {
+        ++destroys;
+        delete p;
+    }
+};
+int relocatable_handle::moves = 0;
+int relocatable_handle::destroys = 0;
+
+template <>
+struct __relocate_traits<relocatable_handle> {
+    typedef __true_type is_trivially_relocatable;
+};
 
 namespace forgedstl {
 
@@ -77,6 +108,64 @@ TEST(VectorTest, SizeAndCapacity) {
     EXPECT_EQ(10, iv1.capacity());
 }
 
+TEST(VectorTest, GrowthPolicy) {
+    vector<int, alloc, __vector_growth_half> hv;
+    size_t caps[] = { 1, 2, 3, 4, 6, 6, 9, 9, 9, 13 };
+    for (int i = 0; i < 10; ++i) {
+        hv.push_back(i);
+        EXPECT_EQ(caps[i], hv.capacity());
+    }
+    hv.insert(hv.end(), 10, 0);
+    EXPECT_EQ(20, hv.capacity());
+
+    // doubles up to 64 bytes, then adds 32 bytes at a time
+    vector<std::string, alloc, __vector_growth_capped<64, 32> > sv;
+    const size_t step = 32 / sizeof(std::string) != 0 ?
+        32 / sizeof(std::string) : 1;
+    size_t cap = 0;
+    for (int i = 0; i < 40; ++i) {
+        sv.push_back(std::to_string(i));
+        if (sv.size() > cap) {
+            const size_t old = sv.size() - 1;
+            cap = old * sizeof(std::string) < 64 ?
+                old + std::max<size_t>(old, 1) : old + step;
+        }
+        EXPECT_EQ(cap, sv.capacity());
+    }
+    for (int i = 0; i < 40; ++i) {
+        EXPECT_EQ(std::to_string(i), sv[i]);
+    }
+}
+
+TEST(VectorTest, ShrinkToFitAndReserveExact) {
+    vector<int> iv;
+    for (int i = 0; i < 5; ++i) {
+        iv.push_back(i);
+    }
+    EXPECT_EQ(8, iv.capacity());
+    iv.shrink_to_fit();
+    EXPECT_EQ(5, iv.capacity());
+    iv.reserve_exact(7);
+    EXPECT_EQ(7, iv.capacity());
+    iv.reserve_exact(2);
+    EXPECT_EQ(5, iv.capacity());
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, iv[i]);
+    }
+    iv.clear();
+    iv.shrink_to_fit();
+    EXPECT_EQ(0, iv.capacity());
+    EXPECT_EQ(iv.begin(), iv.end());
+
+    vector<std::string> sv(3, "forged");
+    sv.reserve(20);
+    sv.shrink_to_fit();
+    EXPECT_EQ(3, sv.capacity());
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ("forged", sv[i]);
+    }
+}
+
 TEST(VectorTest, Construct) {
     vector<int> iv1(2, 3);
     ASSERT_EQ(2, iv1.size());
@@ -222,4 +311,186 @@ TEST(VectorTest, Reduce) {
     ASSERT_TRUE(iv.empty());
 }
 
+TEST(VectorTest, ArenaAlloc) {
+    typedef __arena_alloc_template<false, 2> Arena;
+    {
+        vector<int, Arena> iv;
+        for (int i = 0; i < 1000; ++i) {
+            iv.push_back(i);
+        }
+        vector<int, Arena> iv2(iv);
+        for (int i = 0; i < 1000; ++i) {
+            EXPECT_EQ(i, iv2[i]);
+        }
+        EXPECT_GT(Arena::heap_bytes(), 0);
+    }
+    Arena::release();
+    EXPECT_EQ(0, Arena::heap_bytes());
+}
+
+TEST(VectorTest, StatefulAlloc) {
+    EXPECT_EQ(3 * sizeof(int*), sizeof(vector<int>));
+
+    test_pool p1, p2;
+    {
+        vector<int, stateful_alloc> v1((stateful_alloc(&p1)));
+        for (int i = 0; i < 100; ++i) {
+            v1.push_back(i);
+        }
+        EXPECT_LT(0, p1.bytes_in_use);
+        EXPECT_EQ(0, p2.bytes_in_use);
+
+        vector<int, stateful_alloc> v2(v1);
+        EXPECT_EQ(&p1, v2.get_allocator().resource());
+
+        vector<int, stateful_alloc> v3(10, 7, stateful_alloc(&p2));
+        v3 = v1;
+        EXPECT_EQ(&p2, v3.get_allocator().resource());
+        EXPECT_TRUE(v1 == v3);
+
+        v2.swap(v3);
+        EXPECT_EQ(&p2, v2.get_allocator().resource());
+        EXPECT_EQ(&p1, v3.get_allocator().resource());
+        EXPECT_TRUE(v2 == v3);
+
+        const size_t in_use = p2.bytes_in_use;
+        vector<int, stateful_alloc> v4(50, stateful_alloc(&p2));
+        EXPECT_EQ(50, v4.size());
+        EXPECT_EQ(0, v4[49]);
+        EXPECT_EQ(&p2, v4.get_allocator().resource());
+        EXPECT_EQ(in_use + 50 * sizeof(int), p2.bytes_in_use);
+    }
+    EXPECT_EQ(0, p1.bytes_in_use);
+    EXPECT_EQ(0, p2.bytes_in_use);
+}
+
+struct throwing_move {
+    static int copies;
+    int v;
+    throwing_move(int x) : v(x) { }
+    throwing_move(const throwing_move& x) : v(x.v) { ++copies; }
+    throwing_move(throwing_move&& x) : v(x.v) { x.v = -1; }
+    throwing_move& operator=(const throwing_move&) = default;
+};
+int throwing_move::copies = 0;
+
+TEST(VectorTest, MoveAndEmplace) {
+    vector<std::unique_ptr<int> > pv;
+    for (int i = 0; i < 10; ++i) {
+        pv.push_back(std::unique_ptr<int>(new int(i)));
+    }
+    pv.emplace_back(new int(10));
+    pv.insert(pv.begin(), std::unique_ptr<int>(new int(-1)));
+    pv.emplace(pv.begin() + 5, new int(100));
+    ASSERT_EQ(13, pv.size());
+    EXPECT_EQ(-1, *pv[0]);
+    EXPECT_EQ(3, *pv[4]);
+    EXPECT_EQ(100, *pv[5]);
+    EXPECT_EQ(4, *pv[6]);
+    EXPECT_EQ(10, *pv.back());
+    pv.erase(pv.begin());
+    EXPECT_EQ(0, *pv.front());
+
+    vector<std::string> sv;
+    std::string s(100, 'x');
+    sv.push_back(std::move(s));
+    EXPECT_TRUE(s.empty());
+    sv.emplace_back(3, 'y');
+    EXPECT_EQ("yyy", sv.back());
+
+    // A move that may throw must not be used while relocating.
+    vector<throwing_move> tv;
+    tv.reserve(1);
+    tv.emplace_back(1);
+    throwing_move::copies = 0;
+    tv.emplace_back(2);
+    tv.reserve(100);
+    EXPECT_EQ(3, throwing_move::copies);
+    EXPECT_EQ(1, tv[0].v);
+    EXPECT_EQ(2, tv[1].v);
+}
+
+TEST(VectorTest, MoveConstructAndAssign) {
+    EXPECT_TRUE(std::is_nothrow_move_constructible<vector<int> >::value);
+    EXPECT_TRUE(std::is_nothrow_move_assignable<vector<int> >::value);
+
+    vector<int> v1(100, 7);
+    const int* data = &v1[0];
+    vector<int> v2(std::move(v1));
+    EXPECT_TRUE(v1.empty());
+    EXPECT_EQ(0, v1.capacity());
+    ASSERT_EQ(100, v2.size());
+    EXPECT_EQ(data, &v2[0]);
+
+    vector<int> v3(3, 1);
+    v3 = std::move(v2);
+    EXPECT_TRUE(v2.empty());
+    EXPECT_EQ(data, &v3[0]);
+    v2.push_back(1);
+    EXPECT_EQ(1, v2.size());
+
+    // growing the outer vector moves the inner buffers
+    vector<vector<double> > dvv;
+    dvv.push_back(vector<double>(10, 1.5));
+    const double* inner = &dvv[0][0];
+    for (int i = 0; i < 100; ++i) {
+        dvv.push_back(vector<double>(1, double(i)));
+    }
+    EXPECT_EQ(inner, &dvv[0][0]);
+}
+
+template <typename Alloc>
+void check_relocating_growth(vector<relocatable_handle, Alloc>& v) {
+    relocatable_handle::moves = 0;
+    relocatable_handle::destroys = 0;
+    for (int i = 0; i < 1000; ++i) {
+        v.emplace_back(i);
+    }
+    v.reserve(5000);
+    v.insert(v.begin() + 10, 3000, relocatable_handle(-1));
+    int ia[] = { -2, -3 };
+    v.insert(v.begin(), ia, ia + 2);
+    v.emplace(v.begin() + 1, -4);
+    // only the value passed to insert and insert's own copy are destroyed
+    EXPECT_EQ(0, relocatable_handle::moves);
+    EXPECT_EQ(2, relocatable_handle::destroys);
+
+    ASSERT_EQ(4003, v.size());
+    EXPECT_EQ(-2, *v[0].p);
+    EXPECT_EQ(-4, *v[1].p);
+    EXPECT_EQ(-3, *v[2].p);
+    EXPECT_EQ(9, *v[12].p);
+    EXPECT_EQ(-1, *v[13].p);
+    EXPECT_EQ(10, *v[3013].p);
+    EXPECT_EQ(999, *v.back().p);
+
+    // an element of the vector itself may be appended across a regrowth
+    while (v.size() != v.capacity()) {
+        v.emplace_back(0);
+    }
+    v.push_back(v[0]);
+    EXPECT_EQ(-2, *v.back().p);
+}
+
+TEST(VectorTest, TriviallyRelocatable) {
+    EXPECT_TRUE(__alloc_has_reallocate<alloc>::value);
+    EXPECT_TRUE(__alloc_has_reallocate<malloc_alloc>::value);
+    EXPECT_FALSE(__alloc_has_reallocate<stateful_alloc>::value);
+
+    {
+        vector<relocatable_handle> v;
+        check_relocating_growth(v);
+    }
+    {
+        vector<relocatable_handle, malloc_alloc> v;
+        check_relocating_growth(v);
+    }
+    test_pool p;
+    {
+        vector<relocatable_handle, stateful_alloc> v((stateful_alloc(&p)));
+        check_relocating_growth(v);
+    }
+    EXPECT_EQ(0, p.bytes_in_use);
+}
+
 } // namespace forgedstl
\ No newline at end of file
@@ -3,6 +3,10 @@
 
 #include <cstddef>
 #include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
 
 namespace forgedstl {
 
@@ -86,9 +90,54 @@ public:
     }
 };
 
+// Stateful allocator with the static-allocator interface used by the
+// containers. Every instance draws from a pool; instances are equal when
+// they share it.
+struct test_pool {
+    size_t bytes_in_use;
+    size_t allocations;
+
+    test_pool() : bytes_in_use(0), allocations(0) { }
+};
+
+class stateful_alloc {
+public:
+    stateful_alloc() : pool(&default_pool()) { }
+    explicit stateful_alloc(test_pool* p) : pool(p) { }
+
+    void* allocate(size_t n) {
+        pool->bytes_in_use += n;
+        pool->allocations += 1;
+        return ::operator new(n);
+    }
+    void deallocate(void* p, size_t n) {
+        pool->bytes_in_use -= n;
+        ::operator delete(p);
+    }
+
+    test_pool* resource() const {
+        return pool;
+    }
+
+    bool operator==(const stateful_alloc& x) const {
+        return pool == x.pool;
+    }
+    bool operator!=(const stateful_alloc& x) const {
+        return pool != x.pool;
+    }
+
+    static test_pool& default_pool() {
+        static test_pool p;
+        return p;
+    }
+
+private:
+    test_pool* pool;
+};
+
 } // end of namespace forgedstl
 
-void alloc_test() {
+inline void alloc_test() {
     int ia[5] = { 0, 1, 2, 3, 4 };
     std::vector<int, forgedstl::allocator<int> > iv(ia, ia + 5);
     //std::vector<int, std::allocator<int> > iv(ia, ia + 5);
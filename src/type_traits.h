@@ -1,135 +1,60 @@
 #ifndef FORGED_STL_TYPE_TRAITS_H_
 #define FORGED_STL_TYPE_TRAITS_H_
 
+#include <type_traits>
+
 struct __true_type {};
 struct __false_type {};
 
-template <typename type>
-struct __type_traits {
-    typedef __true_type this_dummy_member_must_be_first;
-
-    typedef __false_type has_trivial_default_constructor;
-    typedef __false_type has_trivial_copy_constructor;
-    typedef __false_type has_trivial_assignment_operator;
-    typedef __false_type has_trivial_destructor;
-    typedef __false_type is_POD_type;
-};
-
-template<>
-struct __type_traits<char> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<signed char> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<unsigned char> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<short> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<unsigned short> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
+// Maps a compile-time condition onto the tag types above.
+template <bool>
+struct __bool_type {
+    typedef __false_type type;
 };
 
-template<>
-struct __type_traits<int> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
+template <>
+struct __bool_type<true> {
+    typedef __true_type type;
 };
 
-template<>
-struct __type_traits<unsigned int> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<long> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<unsigned long> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<float> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<double> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
-
-template<>
-struct __type_traits<long double> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
-};
+// The answers come from the compiler, so built-in types, pointers and
+// plain aggregates all take the memmove/fill paths without being listed
+// here. Specializing this template still overrides them for a type.
+// is_POD_type is what the uninitialized_* algorithms test: it holds when
+// construction by copy and assignment are interchangeable with memcpy.
+template <typename type>
+struct __type_traits {
+    typedef __true_type this_dummy_member_must_be_first;
 
-template<typename T>
-struct __type_traits<T*> {
-    typedef __true_type has_trivial_default_constructor;
-    typedef __true_type has_trivial_copy_constructor;
-    typedef __true_type has_trivial_assignment_operator;
-    typedef __true_type has_trivial_destructor;
-    typedef __true_type is_POD_type;
+    typedef typename __bool_type<
+        std::is_trivially_default_constructible<type>::value>::type
+        has_trivial_default_constructor;
+    typedef typename __bool_type<
+        std::is_trivially_copy_constructible<type>::value>::type
+        has_trivial_copy_constructor;
+    typedef typename __bool_type<
+        std::is_trivially_copy_assignable<type>::value>::type
+        has_trivial_assignment_operator;
+    typedef typename __bool_type<
+        std::is_trivially_destructible<type>::value>::type
+        has_trivial_destructor;
+    typedef typename __bool_type<
+        std::is_trivially_copyable<type>::value &&
+        std::is_trivially_copy_constructible<type>::value &&
+        std::is_trivially_copy_assignable<type>::value>::type
+        is_POD_type;
+};
+
+// A trivially relocatable type may be moved to new storage by copying its
+// bytes, after which the old copy is dropped without running its
+// destructor. Containers use this to grow with memcpy or realloc instead
+// of moving and destroying element by element. POD types qualify; other
+// types opt in by specializing this template, which is safe for anything
+// that holds no pointer into itself (unique_ptr-like handles, most
+// strings without an inline buffer, vector, deque).
+template <typename type>
+struct __relocate_traits {
+    typedef typename __type_traits<type>::is_POD_type is_trivially_relocatable;
 };
 
 #endif // FORGED_STL_TYPE_TRAITS_H__